@@ -0,0 +1,289 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/time_utility.h"
+#include "example/pebble_binary_direct/direct.h"
+#include "framework/dr/protocol/binary_protocol.h"
+#include "framework/dr/serialize.h"
+#include "framework/dr/transport/buffer_transport.h"
+
+// 生成代码的binary直接编解码与通用协议路径的一致性测试和速度对比
+// 用法: ./direct_test
+
+#define CHECK(cond) \
+    if (!(cond)) { \
+        fprintf(stderr, "(%s:%d)(%s) check failed: %s\n", __FILE__, __LINE__, __FUNCTION__, #cond); \
+        exit(1); \
+    }
+
+using namespace pebble;
+
+typedef dr::protocol::TBinaryProtocol BinaryProtocol;
+typedef dr::transport::TMemoryBuffer MemoryBuffer;
+
+// 直接编解码只对TBinaryProtocol本身生效，派生类型走通用的虚函数路径，用来在同一传输层上对比
+class GenericBinaryProtocol : public BinaryProtocol {
+public:
+    explicit GenericBinaryProtocol(cxx::shared_ptr<dr::transport::TTransport> trans)
+        : BinaryProtocol(trans) {}
+};
+
+static bool Equal(const direct::Inner& a, const direct::Inner& b) {
+    return a.a == b.a && a.s == b.s && a.b == b.b;
+}
+
+static bool Equal(const direct::Big& a, const direct::Big& b) {
+    if (a.inners.size() != b.inners.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.inners.size(); i++) {
+        if (!Equal(a.inners[i], b.inners[i])) {
+            return false;
+        }
+    }
+    return a.id == b.id && a.name == b.name && a.vals == b.vals && Equal(a.inner, b.inner)
+        && a.attrs == b.attrs && a.flag == b.flag && a.flag2 == b.flag2 && a.score == b.score
+        && a.small == b.small && a.bits == b.bits && a.tags == b.tags && a.far == b.far
+        && a.tiny == b.tiny && a.empty_map == b.empty_map;
+}
+
+// 随机填充，覆盖负数、大整数、空容器和bool列表等边界
+static void RandomFill(unsigned seed, direct::Big* big) {
+    srand(seed);
+    big->id = (rand() % 3 == 0) ? -rand() : rand() % 1000;
+    big->name = std::string(rand() % 40, 'n');
+
+    big->vals.clear();
+    int num = rand() % 30;
+    for (int i = 0; i < num; i++) {
+        int64_t sign = (rand() % 2) ? -1 : 1;
+        big->vals.push_back(sign * (static_cast<int64_t>(rand()) << (rand() % 32)));
+    }
+
+    big->inner.a = rand() % 100;
+    big->inner.s = "in";
+    big->inner.b = rand() % 2;
+
+    big->attrs.clear();
+    num = rand() % 5;
+    for (int i = 0; i < num; i++) {
+        char key[8];
+        snprintf(key, sizeof(key), "k%d", i);
+        big->attrs[key] = rand() % 50 - 25;
+    }
+
+    big->flag  = rand() % 2;
+    big->flag2 = !big->flag;
+    big->score = (rand() % 1000) / 7.0 - 50;
+    big->small = static_cast<int16_t>(rand() % 65536 - 32768);
+
+    big->bits.clear();
+    num = rand() % 20;
+    for (int i = 0; i < num; i++) {
+        big->bits.push_back(rand() % 2);
+    }
+
+    big->tags.clear();
+    num = rand() % 20;
+    for (int i = 0; i < num; i++) {
+        big->tags.insert(rand() % 1000);
+    }
+
+    big->far  = (rand() % 2) ? INT64_MIN : INT64_MAX;
+    big->tiny = static_cast<int8_t>(rand() % 256 - 128);
+
+    big->inners.clear();
+    num = rand() % 3;
+    for (int i = 0; i < num; i++) {
+        direct::Inner inner;
+        inner.a = i;
+        inner.s = "x";
+        inner.b = i % 2;
+        big->inners.push_back(inner);
+    }
+}
+
+// 直接编码的结果必须与通用路径逐字节一致，直接解码的结果必须与原对象一致
+void TestEquivalence() {
+    cxx::shared_ptr<MemoryBuffer> write_buffer(new MemoryBuffer());
+    cxx::shared_ptr<MemoryBuffer> read_buffer(new MemoryBuffer());
+    BinaryProtocol direct_writer(write_buffer);
+    GenericBinaryProtocol generic_writer(write_buffer);
+    BinaryProtocol direct_reader(read_buffer);
+    GenericBinaryProtocol generic_reader(read_buffer);
+    CHECK(dr::protocol::TBinaryDirect::GetBuffer(&direct_writer) == write_buffer.get());
+    CHECK(dr::protocol::TBinaryDirect::GetBuffer(&generic_writer) == NULL);
+
+    uint8_t* data = NULL;
+    uint32_t data_len = 0;
+    for (unsigned seed = 1; seed <= 2000; seed++) {
+        direct::Big origin;
+        RandomFill(seed, &origin);
+
+        write_buffer->resetBuffer();
+        uint32_t generic_len = origin.write(&generic_writer);
+        write_buffer->getBuffer(&data, &data_len);
+        CHECK(generic_len == data_len);
+        std::string generic_data(reinterpret_cast<char*>(data), data_len);
+
+        write_buffer->resetBuffer();
+        uint32_t direct_len = origin.write(&direct_writer);
+        write_buffer->getBuffer(&data, &data_len);
+        CHECK(direct_len == generic_len && data_len == generic_len);
+        CHECK(0 == memcmp(data, generic_data.data(), data_len));
+
+        uint8_t* encoded = reinterpret_cast<uint8_t*>(const_cast<char*>(generic_data.data()));
+        direct::Big from_direct;
+        read_buffer->resetBuffer(encoded, generic_len, MemoryBuffer::OBSERVE);
+        CHECK(from_direct.read(&direct_reader) == generic_len);
+        CHECK(read_buffer->readEnd() == generic_len);
+        CHECK(Equal(origin, from_direct));
+
+        direct::Big from_generic;
+        read_buffer->resetBuffer(encoded, generic_len, MemoryBuffer::OBSERVE);
+        CHECK(from_generic.read(&generic_reader) == generic_len);
+        CHECK(Equal(origin, from_generic));
+
+        // 同一个缓冲区先写后读(RPC请求解码后直接编码响应的情况)
+        write_buffer->resetBuffer();
+        origin.write(&direct_writer);
+        direct::Big from_pipe;
+        CHECK(from_pipe.read(&direct_writer) == generic_len);
+        CHECK(Equal(origin, from_pipe));
+
+        // 未知字段要跳过
+        direct::Inner inner;
+        read_buffer->resetBuffer(encoded, generic_len, MemoryBuffer::OBSERVE);
+        CHECK(inner.read(&direct_reader) == generic_len);
+    }
+}
+
+// 截断的数据两条路径都必须解码失败，并且直接解码失败时不消费缓冲区
+void TestTruncated() {
+    cxx::shared_ptr<MemoryBuffer> read_buffer(new MemoryBuffer());
+    BinaryProtocol direct_reader(read_buffer);
+    GenericBinaryProtocol generic_reader(read_buffer);
+    uint8_t buff[8192];
+
+    for (unsigned seed = 1; seed <= 200; seed++) {
+        direct::Big origin;
+        RandomFill(seed, &origin);
+        int len = dr::Pack<direct::Big, BinaryProtocol>(&origin, buff, sizeof(buff));
+        CHECK(len > 0);
+
+        for (int cut = 0; cut < len; cut++) {
+            bool direct_failed = false;
+            direct::Big truncated;
+            read_buffer->resetBuffer(buff, cut, MemoryBuffer::OBSERVE);
+            try {
+                truncated.read(&direct_reader);
+            } catch (TException& e) {
+                direct_failed = true;
+            }
+            CHECK(direct_failed);
+            CHECK(read_buffer->readEnd() == 0);
+
+            bool generic_failed = false;
+            read_buffer->resetBuffer(buff, cut, MemoryBuffer::OBSERVE);
+            try {
+                truncated.read(&generic_reader);
+            } catch (TException& e) {
+                generic_failed = true;
+            }
+            CHECK(generic_failed);
+        }
+    }
+
+    // 外部缓冲区放不下时直接编码与通用路径一样抛异常
+    direct::Big big;
+    RandomFill(3, &big);
+    uint8_t small[8];
+    read_buffer->resetBuffer(small, sizeof(small), MemoryBuffer::OBSERVE);
+    bool failed = false;
+    try {
+        big.write(&direct_reader);
+    } catch (TException& e) {
+        failed = true;
+    }
+    CHECK(failed);
+}
+
+// 典型的业务数据: 小整数、短字符串和少量id
+void BenchTypical() {
+    direct::Big typical;
+    typical.id   = 42;
+    typical.name = "player_1234";
+    for (int i = 0; i < 8; i++) {
+        typical.vals.push_back(1000 + i);
+    }
+    typical.inner.a = 1;
+    typical.inner.s = "cn";
+    typical.attrs["level"] = 30;
+    typical.attrs["vip"]   = 2;
+    typical.score = 1.5;
+    typical.small = 3;
+    typical.far   = 1700000000000LL;
+
+    cxx::shared_ptr<MemoryBuffer> write_buffer(new MemoryBuffer());
+    cxx::shared_ptr<MemoryBuffer> read_buffer(new MemoryBuffer());
+    BinaryProtocol direct_writer(write_buffer);
+    GenericBinaryProtocol generic_writer(write_buffer);
+    BinaryProtocol direct_reader(read_buffer);
+    GenericBinaryProtocol generic_reader(read_buffer);
+
+    write_buffer->resetBuffer();
+    uint32_t len = typical.write(&generic_writer);
+    uint8_t* data = NULL;
+    uint32_t data_len = 0;
+    write_buffer->getBuffer(&data, &data_len);
+    std::string encoded(reinterpret_cast<char*>(data), data_len);
+    uint8_t* encoded_data = reinterpret_cast<uint8_t*>(const_cast<char*>(encoded.data()));
+
+    const int num = 500000;
+    direct::Big result;
+    dr::protocol::TProtocol* writers[] = { &generic_writer, &direct_writer };
+    dr::protocol::TProtocol* readers[] = { &generic_reader, &direct_reader };
+    double write_ns[2];
+    double read_ns[2];
+    for (int k = 0; k < 2; k++) {
+        int64_t t0 = TimeUtility::GetCurrentUS();
+        for (int i = 0; i < num; i++) {
+            write_buffer->resetBuffer();
+            typical.write(writers[k]);
+        }
+        int64_t t1 = TimeUtility::GetCurrentUS();
+        for (int i = 0; i < num; i++) {
+            read_buffer->resetBuffer(encoded_data, len, MemoryBuffer::OBSERVE);
+            result.read(readers[k]);
+        }
+        int64_t t2 = TimeUtility::GetCurrentUS();
+        write_ns[k] = (t1 - t0) * 1000.0 / num;
+        read_ns[k]  = (t2 - t1) * 1000.0 / num;
+    }
+
+    printf("typical %u bytes: write generic %.0f ns direct %.0f ns; read generic %.0f ns direct %.0f ns\n",
+        len, write_ns[0], write_ns[1], read_ns[0], read_ns[1]);
+}
+
+int main(int argc, char** argv) {
+    TestEquivalence();
+    TestTruncated();
+    BenchTypical();
+    printf("direct_test OK\n");
+    return 0;
+}
@@ -0,0 +1,307 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/time_utility.h"
+#include "example/pebble_compact_protocol/compact.h"
+#include "framework/dr/protocol/binary_protocol.h"
+#include "framework/dr/protocol/compact_protocol.h"
+#include "framework/dr/protocol/serialized_size.h"
+#include "framework/dr/serialize.h"
+#include "framework/dr/transport/buffer_transport.h"
+
+// TCompactProtocol的正确性测试和与TBinaryProtocol的编码大小、速度对比，以及预先计算的编码长度校验
+// 用法: ./compact_test
+
+#define CHECK(cond) \
+    if (!(cond)) { \
+        fprintf(stderr, "(%s:%d)(%s) check failed: %s\n", __FILE__, __LINE__, __FUNCTION__, #cond); \
+        exit(1); \
+    }
+
+using namespace pebble;
+
+typedef dr::protocol::TBinaryProtocol BinaryProtocol;
+typedef dr::protocol::TCompactProtocol CompactProtocol;
+
+static bool Equal(const compact::Inner& a, const compact::Inner& b) {
+    return a.a == b.a && a.s == b.s && a.b == b.b;
+}
+
+static bool Equal(const compact::Big& a, const compact::Big& b) {
+    if (a.inners.size() != b.inners.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.inners.size(); i++) {
+        if (!Equal(a.inners[i], b.inners[i])) {
+            return false;
+        }
+    }
+    return a.id == b.id && a.name == b.name && a.vals == b.vals && Equal(a.inner, b.inner)
+        && a.attrs == b.attrs && a.flag == b.flag && a.flag2 == b.flag2 && a.score == b.score
+        && a.small == b.small && a.bits == b.bits && a.tags == b.tags && a.far == b.far
+        && a.tiny == b.tiny && a.empty_map == b.empty_map;
+}
+
+// 随机填充，覆盖负数、大整数、空容器和bool列表等边界
+static void RandomFill(unsigned seed, compact::Big* big) {
+    srand(seed);
+    big->id = (rand() % 3 == 0) ? -rand() : rand() % 1000;
+    big->name = std::string(rand() % 40, 'n');
+
+    big->vals.clear();
+    int num = rand() % 30;
+    for (int i = 0; i < num; i++) {
+        int64_t sign = (rand() % 2) ? -1 : 1;
+        big->vals.push_back(sign * (static_cast<int64_t>(rand()) << (rand() % 32)));
+    }
+
+    big->inner.a = rand() % 100;
+    big->inner.s = "in";
+    big->inner.b = rand() % 2;
+
+    big->attrs.clear();
+    num = rand() % 5;
+    for (int i = 0; i < num; i++) {
+        char key[8];
+        snprintf(key, sizeof(key), "k%d", i);
+        big->attrs[key] = rand() % 50 - 25;
+    }
+
+    big->flag  = rand() % 2;
+    big->flag2 = !big->flag;
+    big->score = (rand() % 1000) / 7.0 - 50;
+    big->small = static_cast<int16_t>(rand() % 65536 - 32768);
+
+    big->bits.clear();
+    num = rand() % 20;
+    for (int i = 0; i < num; i++) {
+        big->bits.push_back(rand() % 2);
+    }
+
+    big->tags.clear();
+    num = rand() % 20;
+    for (int i = 0; i < num; i++) {
+        big->tags.insert(rand() % 1000);
+    }
+
+    big->far  = (rand() % 2) ? INT64_MIN : INT64_MAX;
+    big->tiny = static_cast<int8_t>(rand() % 256 - 128);
+
+    big->inners.clear();
+    num = rand() % 3;
+    for (int i = 0; i < num; i++) {
+        compact::Inner inner;
+        inner.a = i;
+        inner.s = "x";
+        inner.b = i % 2;
+        big->inners.push_back(inner);
+    }
+}
+
+// binary -> 对象 -> compact -> 对象 -> binary，两次binary编码结果必须一致
+void TestRoundTrip() {
+    uint8_t binary_buff[8192];
+    uint8_t compact_buff[8192];
+    uint8_t check_buff[8192];
+    int64_t binary_total  = 0;
+    int64_t compact_total = 0;
+
+    for (unsigned seed = 1; seed <= 2000; seed++) {
+        compact::Big origin;
+        RandomFill(seed, &origin);
+
+        int binary_len = dr::Pack<compact::Big, BinaryProtocol>(&origin, binary_buff,
+            sizeof(binary_buff));
+        CHECK(binary_len > 0);
+
+        compact::Big from_binary;
+        int ret = dr::UnPack<compact::Big, BinaryProtocol>(&from_binary, binary_buff, binary_len);
+        CHECK(ret == binary_len);
+
+        int compact_len = dr::Pack<compact::Big, CompactProtocol>(&from_binary, compact_buff,
+            sizeof(compact_buff));
+        CHECK(compact_len > 0);
+
+        compact::Big from_compact;
+        ret = dr::UnPack<compact::Big, CompactProtocol>(&from_compact, compact_buff, compact_len);
+        CHECK(ret == compact_len);
+        CHECK(Equal(origin, from_compact));
+
+        int check_len = dr::Pack<compact::Big, BinaryProtocol>(&from_compact, check_buff,
+            sizeof(check_buff));
+        CHECK(check_len == binary_len && 0 == memcmp(binary_buff, check_buff, binary_len));
+
+        // 截断的数据必须解码失败
+        for (int cut = 0; cut < compact_len; cut += 7) {
+            compact::Big truncated;
+            ret = dr::UnPack<compact::Big, CompactProtocol>(&truncated, compact_buff, cut);
+            CHECK(ret < 0);
+        }
+
+        binary_total  += binary_len;
+        compact_total += compact_len;
+    }
+
+    printf("random structs: binary %ld bytes, compact %ld bytes (%.1f%% smaller)\n",
+        static_cast<long>(binary_total), static_cast<long>(compact_total),
+        100.0 * (binary_total - compact_total) / binary_total);
+}
+
+// 预先计算的编码长度必须与两种协议实际编码的长度一致，预分配编码的结果必须与通用路径逐字节一致
+void TestSerializedSize() {
+    typedef dr::protocol::TPresizedWriter<BinaryProtocol> PresizedWriter;
+    cxx::shared_ptr<dr::transport::TMemoryBuffer> buffer(new dr::transport::TMemoryBuffer());
+    BinaryProtocol binary_protocol(buffer);
+    CompactProtocol compact_protocol(buffer);
+    uint8_t binary_buff[65536];
+    uint8_t compact_buff[65536];
+    uint8_t presized_buff[65536];
+    dr::PackContext<BinaryProtocol> context;
+
+    for (unsigned seed = 1; seed <= 2000; seed++) {
+        compact::Big big;
+        RandomFill(seed, &big);
+        // 部分样本使用长字符串和长列表，覆盖多字节的长度编码
+        if (seed % 7 == 0) {
+            big.name = std::string(300, 'z');
+            big.vals.resize(200, 1);
+        }
+
+        int binary_len = dr::Pack<compact::Big, BinaryProtocol>(&big, binary_buff,
+            sizeof(binary_buff));
+        CHECK(binary_len > 0);
+        uint32_t size = dr::protocol::TSerializedSize::Get(big, typeid(BinaryProtocol));
+        CHECK(size == static_cast<uint32_t>(binary_len));
+        size = big.SerializedSize(&binary_protocol);
+        CHECK(size == static_cast<uint32_t>(binary_len));
+        size = PresizedWriter::Size(big);
+        CHECK(size == static_cast<uint32_t>(binary_len));
+        size = PresizedWriter::Write(big, presized_buff);
+        CHECK(size == static_cast<uint32_t>(binary_len));
+        CHECK(0 == memcmp(presized_buff, binary_buff, binary_len));
+
+        const uint8_t* data = NULL;
+        int ret = dr::Pack<compact::Big, BinaryProtocol>(&big, &data, &context);
+        CHECK(ret == binary_len && 0 == memcmp(data, binary_buff, binary_len));
+        std::string str;
+        ret = dr::Pack<compact::Big, BinaryProtocol>(&big, &str);
+        CHECK(ret == binary_len && 0 == memcmp(str.data(), binary_buff, binary_len));
+
+        int compact_len = dr::Pack<compact::Big, CompactProtocol>(&big, compact_buff,
+            sizeof(compact_buff));
+        CHECK(compact_len > 0);
+        size = dr::protocol::TSerializedSize::Get(big, typeid(CompactProtocol));
+        CHECK(size == static_cast<uint32_t>(compact_len));
+        size = big.SerializedSize(&compact_protocol);
+        CHECK(size == static_cast<uint32_t>(compact_len));
+        ret = dr::Pack<compact::Big, CompactProtocol>(&big, &str);
+        CHECK(ret == compact_len && 0 == memcmp(str.data(), compact_buff, compact_len));
+    }
+
+    // 不支持预先计算的协议返回0
+    compact::Big big;
+    CHECK(dr::protocol::TSerializedSize::Get(big, typeid(dr::protocol::TProtocol)) == 0);
+}
+
+// 消息头的seqid是64位的
+void TestMessageHead() {
+    cxx::shared_ptr<dr::transport::TMemoryBuffer> buffer(new dr::transport::TMemoryBuffer());
+    CompactProtocol protocol(buffer);
+    protocol.writeMessageBegin("Svc:method", dr::protocol::T_ONEWAY, 0x123456789abcLL);
+    protocol.writeMessageEnd();
+
+    std::string name;
+    dr::protocol::TMessageType type;
+    int64_t seqid = 0;
+    protocol.readMessageBegin(name, type, seqid);
+    CHECK(name == "Svc:method" && type == dr::protocol::T_ONEWAY && seqid == 0x123456789abcLL);
+}
+
+// 未知字段要跳过，用字段少的结构解码字段多的数据
+void TestSkipUnknownField() {
+    uint8_t buff[8192];
+    compact::Big big;
+    RandomFill(7, &big);
+    int len = dr::Pack<compact::Big, CompactProtocol>(&big, buff, sizeof(buff));
+    CHECK(len > 0);
+
+    compact::Inner inner;
+    int ret = dr::UnPack<compact::Inner, CompactProtocol>(&inner, buff, len);
+    CHECK(ret == len);
+}
+
+// 典型的业务数据: 小整数、短字符串和少量id
+void BenchTypical() {
+    compact::Big typical;
+    typical.id   = 42;
+    typical.name = "player_1234";
+    for (int i = 0; i < 8; i++) {
+        typical.vals.push_back(1000 + i);
+    }
+    typical.inner.a = 1;
+    typical.inner.s = "cn";
+    typical.attrs["level"] = 30;
+    typical.attrs["vip"]   = 2;
+    typical.score = 1.5;
+    typical.small = 3;
+    typical.far   = 1700000000000LL;
+
+    uint8_t binary_buff[8192];
+    uint8_t compact_buff[8192];
+    int binary_len = dr::Pack<compact::Big, BinaryProtocol>(&typical, binary_buff,
+        sizeof(binary_buff));
+    int compact_len = dr::Pack<compact::Big, CompactProtocol>(&typical, compact_buff,
+        sizeof(compact_buff));
+    CHECK(binary_len > 0 && compact_len > 0);
+    printf("typical: binary %d bytes, compact %d bytes (%.1f%% smaller)\n",
+        binary_len, compact_len, 100.0 * (binary_len - compact_len) / binary_len);
+
+    const int num = 500000;
+    compact::Big result;
+    int64_t t0 = TimeUtility::GetCurrentUS();
+    for (int i = 0; i < num; i++) {
+        dr::Pack<compact::Big, BinaryProtocol>(&typical, binary_buff, sizeof(binary_buff), NULL);
+    }
+    int64_t t1 = TimeUtility::GetCurrentUS();
+    for (int i = 0; i < num; i++) {
+        dr::Pack<compact::Big, CompactProtocol>(&typical, compact_buff, sizeof(compact_buff), NULL);
+    }
+    int64_t t2 = TimeUtility::GetCurrentUS();
+    for (int i = 0; i < num; i++) {
+        dr::UnPack<compact::Big, BinaryProtocol>(&result, binary_buff, binary_len, NULL);
+    }
+    int64_t t3 = TimeUtility::GetCurrentUS();
+    for (int i = 0; i < num; i++) {
+        dr::UnPack<compact::Big, CompactProtocol>(&result, compact_buff, compact_len, NULL);
+    }
+    int64_t t4 = TimeUtility::GetCurrentUS();
+
+    printf("pack binary %.0f ns compact %.0f ns; unpack binary %.0f ns compact %.0f ns\n",
+        (t1 - t0) * 1000.0 / num, (t2 - t1) * 1000.0 / num,
+        (t3 - t2) * 1000.0 / num, (t4 - t3) * 1000.0 / num);
+}
+
+int main(int argc, char** argv) {
+    TestRoundTrip();
+    TestSerializedSize();
+    TestMessageHead();
+    TestSkipUnknownField();
+    BenchTypical();
+    printf("compact_test OK\n");
+    return 0;
+}
@@ -0,0 +1,236 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "common/coroutine.h"
+#include "common/time_utility.h"
+
+using namespace pebble;
+
+// 独立栈和共享栈两种模式下，挂起协程的内存占用和切换耗时
+// coroutine_bench_ucontext定义了PEBBLE_CO_USE_UCONTEXT，用于对比汇编和ucontext两种上下文切换，
+// ucontext不支持共享栈，只运行独立栈模式
+// 用法: ./coroutine_bench [挂起协程数] [切换次数]
+
+#define CHECK(cond) \
+    if (!(cond)) { \
+        fprintf(stderr, "(%s:%d)(%s) check failed: %s\n", __FILE__, __LINE__, __FUNCTION__, #cond); \
+        exit(1); \
+    }
+
+static const uint32_t kStackSize    = 128 * 1024;
+static const uint32_t kParkDataSize = 1024;     // 每个挂起协程栈上保持的数据量
+
+static int64_t g_done_num = 0;
+
+// 栈上数据的地址写到全局变量，避免编译器认为数据不会被访问而优化掉
+char* g_stack_data = NULL;
+
+static int64_t GetRss() {
+    long pages = 0;
+    long resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    CHECK(fp != NULL);
+    CHECK(fscanf(fp, "%ld %ld", &pages, &resident) == 2);
+    fclose(fp);
+    return static_cast<int64_t>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+// 栈上放一块数据后挂起两次，每次恢复后检查数据未被其它协程破坏
+static void ParkedRoutine(struct schedule* S, void* ud) {
+    char value = static_cast<char>(reinterpret_cast<intptr_t>(ud));
+    char data[kParkDataSize];
+    memset(data, value, sizeof(data));
+    g_stack_data = data;
+    for (int i = 0; i < 2; i++) {
+        coroutine_yield(S);
+        for (uint32_t j = 0; j < sizeof(data); j++) {
+            CHECK(data[j] == value);
+        }
+    }
+    g_done_num++;
+}
+
+static void PingPongRoutine(struct schedule* S, void* ud) {
+    while (true) {
+        coroutine_yield(S);
+    }
+}
+
+// 大量挂起的协程：内存占用、创建并首次运行的耗时、依次恢复的耗时(共享栈模式下每次都要换入换出)
+static void BenchParked(struct schedule* S, int32_t num) {
+    std::vector<int64_t> ids;
+    ids.reserve(num);
+    g_done_num = 0;
+
+    int64_t rss0 = GetRss();
+    int64_t t0 = TimeUtility::GetCurrentUS();
+    for (int32_t i = 0; i < num; i++) {
+        int64_t id = coroutine_new(S, ParkedRoutine, reinterpret_cast<void*>(static_cast<intptr_t>(i)));
+        CHECK(id >= 0);
+        coroutine_resume(S, id);
+        ids.push_back(id);
+    }
+    int64_t t1 = TimeUtility::GetCurrentUS();
+    int64_t rss1 = GetRss();
+
+    for (int k = 0; k < 2; k++) {
+        for (int32_t i = 0; i < num; i++) {
+            coroutine_resume(S, ids[i]);
+        }
+    }
+    int64_t t2 = TimeUtility::GetCurrentUS();
+    CHECK(g_done_num == num);
+
+    printf("  %d parked: rss %.0f bytes/co, create %.0f ns, resume %.0f ns\n",
+        num, static_cast<double>(rss1 - rss0) / num,
+        (t1 - t0) * 1000.0 / num, (t2 - t1) * 1000.0 / (2.0 * num));
+}
+
+// 一次resume加一次yield的耗时：同一个协程来回切换，以及两个协程交替运行
+// (共享栈模式下两个协程分配在同一运行栈上，每次切换都要换入换出)
+static void BenchSwitch(struct schedule* S, int32_t num) {
+    int64_t a = coroutine_new(S, PingPongRoutine, NULL);
+    int64_t b = coroutine_new(S, PingPongRoutine, NULL);
+    CHECK(a >= 0 && b >= 0);
+
+    int64_t t0 = TimeUtility::GetCurrentUS();
+    for (int32_t i = 0; i < num; i++) {
+        coroutine_resume(S, a);
+    }
+    int64_t t1 = TimeUtility::GetCurrentUS();
+    for (int32_t i = 0; i < num / 2; i++) {
+        coroutine_resume(S, a);
+        coroutine_resume(S, b);
+    }
+    int64_t t2 = TimeUtility::GetCurrentUS();
+
+    printf("  switch: ping-pong %.1f ns, alternate two %.1f ns\n",
+        (t1 - t0) * 1000.0 / num, (t2 - t1) * 1000.0 / (num / 2 * 2));
+}
+
+// co_poll挂起期间其它协程使用了同一运行栈，主循环写入的poll状态和恢复后看到的结果都要正确
+static int g_pipes[3][2];
+static int32_t g_poll_ok = 0;
+
+static void PollRoutine(struct schedule* S, void* ud) {
+    intptr_t index = reinterpret_cast<intptr_t>(ud);
+    char data[512];
+    memset(data, static_cast<char>(index), sizeof(data));
+    g_stack_data = data;
+
+    struct pollfd fds[3];
+    memset(fds, 0, sizeof(fds));
+    fds[0].fd     = g_pipes[index][0];
+    fds[0].events = POLLIN;
+    fds[1].fd     = -1;
+    fds[2].fd     = -1;
+    // 最后一个等待超时
+    bool expect_timeout = (index == 2);
+    int ret = co_poll(co_get_epoll_ct(), fds, 3, expect_timeout ? 20 : 2000);
+
+    for (uint32_t j = 0; j < sizeof(data); j++) {
+        CHECK(data[j] == static_cast<char>(index));
+    }
+    CHECK(ret == (expect_timeout ? 0 : 1));
+    CHECK(fds[0].revents == (expect_timeout ? 0 : POLLIN));
+    g_poll_ok++;
+}
+
+static void ScribbleRoutine(struct schedule* S, void* ud) {
+    char data[4096];
+    memset(data, 0x5a, sizeof(data));
+    g_stack_data = data;
+    coroutine_yield(S);
+    CHECK(data[0] == 0x5a && data[sizeof(data) - 1] == 0x5a);
+}
+
+static void CheckPollAfterShare(struct schedule* S) {
+    g_poll_ok = 0;
+    for (intptr_t i = 0; i < 3; i++) {
+        CHECK(pipe(g_pipes[i]) == 0);
+        int64_t id = coroutine_new(S, PollRoutine, reinterpret_cast<void*>(i));
+        CHECK(id >= 0);
+        coroutine_resume(S, id);
+    }
+    int64_t scribble = coroutine_new(S, ScribbleRoutine, NULL);
+    CHECK(scribble >= 0);
+    coroutine_resume(S, scribble);
+
+    for (int i = 1; i >= 0; i--) {
+        CHECK(write(g_pipes[i][1], "x", 1) == 1);
+        co_update();
+    }
+    for (int i = 0; i < 200 && g_poll_ok < 3; i++) {
+        co_update();
+    }
+    CHECK(g_poll_ok == 3);
+    coroutine_resume(S, scribble);
+
+    for (int i = 0; i < 3; i++) {
+        close(g_pipes[i][0]);
+        close(g_pipes[i][1]);
+    }
+    printf("  co_poll while other coroutines run: OK\n");
+}
+
+static void RunMode(const char* name, uint32_t share_stack_num, int32_t park_num, int32_t switch_num) {
+    // 每种模式在子进程中运行，避免前一种模式释放的内存被复用而影响RSS统计
+    fflush(stdout);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid > 0) {
+        int status = 0;
+        CHECK(waitpid(pid, &status, 0) == pid);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        return;
+    }
+
+    struct schedule* S = coroutine_open(kStackSize, share_stack_num);
+    CHECK(S != NULL);
+    printf("%s (stack %u KB, share stacks %u):\n", name, kStackSize / 1024,
+        static_cast<uint32_t>(S->share_stacks.size()));
+    BenchParked(S, park_num);
+    BenchSwitch(S, switch_num);
+    CheckPollAfterShare(S);
+    coroutine_close(S);
+    fflush(stdout);
+    _exit(0);
+}
+
+int main(int argc, char** argv) {
+    int32_t park_num   = argc > 1 ? atoi(argv[1]) : 10000;
+    int32_t switch_num = argc > 2 ? atoi(argv[2]) : 1000000;
+    if (park_num <= 0 || switch_num <= 1) {
+        fprintf(stderr, "usage: %s [parked coroutine num] [switch num]\n", argv[0]);
+        return 1;
+    }
+
+#ifdef PEBBLE_CO_ASM_CONTEXT
+    printf("context switch: asm\n");
+    RunMode("dedicated", 0, park_num, switch_num);
+    RunMode("shared", 1, park_num, switch_num);
+#else
+    printf("context switch: ucontext\n");
+    RunMode("dedicated", 0, park_num, switch_num);
+#endif
+    printf("coroutine_bench OK\n");
+    return 0;
+}
@@ -0,0 +1,19 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+// @see coroutine_ucontext.cpp
+#ifndef PEBBLE_CO_USE_UCONTEXT
+#error "coroutine_system_hook_ucontext.cpp must be built with -DPEBBLE_CO_USE_UCONTEXT"
+#endif
+
+#include "src/common/coroutine_system_hook.cpp"
@@ -0,0 +1,287 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "common/time_utility.h"
+#include "framework/message.h"
+#include "framework/processor.h"
+#include "framework/raw_message_driver.h"
+#include "server/pebble_server.h"
+
+using namespace pebble;
+
+// 本机回环的echo吞吐，对比不同reactor数，每种reactor数在独立的子进程中运行
+// 客户端直接使用阻塞socket，每个连接保持固定数量的在途请求
+// 用法: ./echo_bench [连接数] [每连接在途请求数] [消息长度] [每轮秒数]
+
+#define CHECK(cond) \
+    if (!(cond)) { \
+        fprintf(stderr, "(%s:%d)(%s) check failed: %s\n", __FILE__, __LINE__, __FUNCTION__, #cond); \
+        exit(1); \
+    }
+
+static const uint16_t kBasePort = 19600;
+static const uint32_t kMaxReactorNum = 16;
+
+// 收到的消息原样发回
+class EchoProcessor : public IProcessor {
+public:
+    virtual int32_t SetSendFunction(const SendFunction& send, const SendVFunction& sendv) {
+        m_send = send;
+        return 0;
+    }
+
+    virtual int32_t SetBroadcastFunction(const BroadcastFunction& broadcast,
+        const BroadcastVFunction& broadcastv) {
+        return 0;
+    }
+
+    virtual int32_t SetEventHandler(IEventHandler* event_handler) {
+        return 0;
+    }
+
+    virtual int32_t OnMessage(int64_t handle, const uint8_t* buff, uint32_t buff_len,
+        uint32_t is_overload) {
+        return m_send(handle, buff, buff_len, 0);
+    }
+
+    virtual int32_t Update() {
+        return 0;
+    }
+
+    virtual uint32_t GetUnFinishedTaskNum() {
+        return 0;
+    }
+
+    virtual void GetResourceUsed(cxx::unordered_map<std::string, int64_t>* resource_info) {
+    }
+
+private:
+    SendFunction m_send;
+};
+
+// 每个reactor的OnInit各自监听同一地址(SO_REUSEPORT)并挂上自己的EchoProcessor
+class EchoEventHandler : public AppEventHandler {
+public:
+    explicit EchoEventHandler(const std::string& url) : m_url(url) {}
+
+    virtual int32_t OnInit(PebbleServer* pebble_server) {
+        uint32_t index = pebble_server->GetReactorIndex();
+        if (index >= kMaxReactorNum) {
+            return -1;
+        }
+        int64_t handle = pebble_server->Bind(m_url);
+        if (handle < 0) {
+            fprintf(stderr, "reactor %u bind %s failed(%ld)\n", index, m_url.c_str(), handle);
+            return -1;
+        }
+        m_processors[index].SetSendFunction(Message::Send, Message::SendV);
+        return pebble_server->Attach(handle, &m_processors[index]);
+    }
+
+private:
+    std::string m_url;
+    EchoProcessor m_processors[kMaxReactorNum];
+};
+
+struct BenchConfig {
+    uint16_t port;
+    uint32_t conn_num;
+    uint32_t depth;
+    uint32_t msg_len;
+    uint32_t seconds;
+};
+
+struct ClientContext {
+    const BenchConfig* config;
+    volatile bool* stop;
+    int64_t echo_num;
+};
+
+static bool SendAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t ret = send(fd, data, len, 0);
+        if (ret <= 0) {
+            return false;
+        }
+        data += ret;
+        len  -= ret;
+    }
+    return true;
+}
+
+static bool RecvAll(int fd, char* data, size_t len) {
+    while (len > 0) {
+        ssize_t ret = recv(fd, data, len, 0);
+        if (ret <= 0) {
+            return false;
+        }
+        data += ret;
+        len  -= ret;
+    }
+    return true;
+}
+
+static int ConnectServer(uint16_t port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // 服务端可能还在启动，重试一段时间
+    for (int i = 0; i < 200; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        CHECK(fd >= 0);
+        if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            return fd;
+        }
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+// 消息格式与tcp://相同(TcpMsgHead + 数据)，先发出depth个请求，之后每收到一个应答再发一个
+static void* ClientRoutine(void* arg) {
+    ClientContext* context = static_cast<ClientContext*>(arg);
+    const BenchConfig* config = context->config;
+    int fd = ConnectServer(config->port);
+    CHECK(fd >= 0);
+
+    TcpMsgHead head;
+    head._magic    = htonl(TCP_HEAD_MAGIC);
+    head._version  = htonl(1);
+    head._data_len = htonl(config->msg_len);
+    std::string request(reinterpret_cast<const char*>(&head), sizeof(head));
+    request.append(config->msg_len, 'e');
+    std::string response(request.size(), '\0');
+
+    for (uint32_t i = 0; i < config->depth; i++) {
+        CHECK(SendAll(fd, request.data(), request.size()));
+    }
+    while (!*context->stop) {
+        CHECK(RecvAll(fd, &response[0], response.size()));
+        CHECK(response == request);
+        context->echo_num++;
+        CHECK(SendAll(fd, request.data(), request.size()));
+    }
+    close(fd);
+    return NULL;
+}
+
+// 客户端跑满指定时间后通知服务端退出
+static void* ControlRoutine(void* arg) {
+    const BenchConfig* config = static_cast<const BenchConfig*>(arg);
+    volatile bool stop = false;
+    std::vector<ClientContext> contexts(config->conn_num);
+    std::vector<pthread_t> threads(config->conn_num);
+    for (uint32_t i = 0; i < config->conn_num; i++) {
+        contexts[i].config   = config;
+        contexts[i].stop     = &stop;
+        contexts[i].echo_num = 0;
+        CHECK(pthread_create(&threads[i], NULL, ClientRoutine, &contexts[i]) == 0);
+    }
+
+    // 预热1秒后开始计数
+    sleep(1);
+    int64_t begin_num = 0;
+    for (uint32_t i = 0; i < config->conn_num; i++) {
+        begin_num += contexts[i].echo_num;
+    }
+    int64_t t0 = TimeUtility::GetCurrentUS();
+    sleep(config->seconds);
+    int64_t end_num = 0;
+    for (uint32_t i = 0; i < config->conn_num; i++) {
+        end_num += contexts[i].echo_num;
+    }
+    int64_t t1 = TimeUtility::GetCurrentUS();
+
+    stop = true;
+    for (uint32_t i = 0; i < config->conn_num; i++) {
+        CHECK(pthread_join(threads[i], NULL) == 0);
+    }
+
+    double qps = (end_num - begin_num) * 1000000.0 / (t1 - t0);
+    printf("%.0f echo/s, %.1f MB/s\n", qps, qps * config->msg_len / (1024 * 1024));
+    fflush(stdout);
+    kill(getpid(), SIGUSR1);
+    return NULL;
+}
+
+static void RunReactors(uint32_t reactor_num, const BenchConfig& base_config) {
+    fflush(stdout);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid > 0) {
+        int status = 0;
+        CHECK(waitpid(pid, &status, 0) == pid);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        return;
+    }
+
+    BenchConfig config = base_config;
+    config.port = kBasePort + reactor_num;
+    char url[64];
+    snprintf(url, sizeof(url), "tcp://127.0.0.1:%u", config.port);
+
+    PebbleServer server;
+    server.GetOptions()->_app_reactor_num = reactor_num;
+    server.GetOptions()->_log_priority    = "ERROR";
+    EchoEventHandler handler(url);
+    CHECK(server.Init(&handler) == 0);
+
+    printf("reactors %u: ", reactor_num);
+    pthread_t control;
+    CHECK(pthread_create(&control, NULL, ControlRoutine, &config) == 0);
+    server.Serve();
+    CHECK(pthread_join(control, NULL) == 0);
+    _exit(0);
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    config.port     = kBasePort;
+    config.conn_num = argc > 1 ? atoi(argv[1]) : 16;
+    config.depth    = argc > 2 ? atoi(argv[2]) : 4;
+    config.msg_len  = argc > 3 ? atoi(argv[3]) : 64;
+    config.seconds  = argc > 4 ? atoi(argv[4]) : 3;
+    if (config.conn_num == 0 || config.depth == 0 || config.msg_len == 0 || config.seconds == 0) {
+        fprintf(stderr, "usage: %s [conn num] [depth] [msg len] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%u connections, %u in flight each, %u bytes, %u cpus\n", config.conn_num,
+        config.depth, config.msg_len, static_cast<uint32_t>(sysconf(_SC_NPROCESSORS_ONLN)));
+    const uint32_t reactor_nums[] = { 1, 2, 4 };
+    for (uint32_t i = 0; i < sizeof(reactor_nums) / sizeof(reactor_nums[0]); i++) {
+        RunReactors(reactor_nums[i], config);
+    }
+    printf("echo_bench OK\n");
+    return 0;
+}
@@ -0,0 +1,176 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <algorithm>
+#include <deque>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "framework/monitor.h"
+#include "framework/processor.h"
+
+// 过载保护的离散事件模拟，对比固定任务数阈值(TaskMonitor)和自适应并发限制(ConcurrencyLimitMonitor)
+// 服务模型: 每个请求先等待下游5ms，再占用所有处理中请求共享的CPU 0.05ms(容量20个请求/ms)，请求按泊松分布到达
+// 用法: ./overload_sim <fixed|adaptive> <负载倍数> <任务数阈值>
+//   例如 ./overload_sim fixed 1.5 1000 与 ./overload_sim adaptive 1.5 1000
+
+namespace pebble {
+
+// 模拟使用虚拟时钟，monitor.h只依赖TimeUtility::GetMonotonicMS，不链接pebble库
+static int64_t g_now_us = 0;
+
+int64_t TimeUtility::GetMonotonicMS() {
+    return g_now_us / 1000;
+}
+
+} // namespace pebble
+
+using namespace pebble;
+
+// 只用作限制器的key
+class SimProcessor : public IProcessor {
+public:
+    virtual int32_t SetSendFunction(const SendFunction& send, const SendVFunction& sendv) {
+        return 0;
+    }
+    virtual int32_t SetBroadcastFunction(const BroadcastFunction& broadcast,
+        const BroadcastVFunction& broadcastv) {
+        return 0;
+    }
+    virtual int32_t SetEventHandler(IEventHandler* event_handler) {
+        return 0;
+    }
+    virtual int32_t OnMessage(int64_t handle, const uint8_t* buff, uint32_t buff_len,
+        uint32_t is_overload) {
+        return 0;
+    }
+    virtual int32_t Update() {
+        return 0;
+    }
+    virtual uint32_t GetUnFinishedTaskNum() {
+        return 0;
+    }
+    virtual void GetResourceUsed(cxx::unordered_map<std::string, int64_t>* resource_info) {}
+};
+
+struct SimRequest {
+    int64_t admit_us;
+    double  cpu_start;
+};
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        printf("usage: %s <fixed|adaptive> <load> <task_threshold>\n", argv[0]);
+        return 1;
+    }
+    bool     adaptive  = (0 == strcmp(argv[1], "adaptive"));
+    double   load      = atof(argv[2]);
+    uint32_t threshold = atoi(argv[3]);
+
+    const double  capacity_per_ms = 20.0;
+    const double  arrival_per_ms  = capacity_per_ms * load;
+    const int64_t downstream_us   = 5000;
+    const int64_t step_us         = 50;
+    const int64_t run_us          = 60LL * 1000000;
+    const int64_t warm_up_us      = 10LL * 1000000;
+    const int64_t slo_ms          = 100;
+
+    SimProcessor processor;
+    TaskMonitor task_monitor;
+    task_monitor.SetTaskThreshold(threshold);
+    ConcurrencyLimitMonitor limit_monitor;
+    limit_monitor.SetLimitRange(ConcurrencyLimiter::DEFAULT_MIN_LIMIT, threshold);
+    limit_monitor.SetEnable(adaptive);
+    ConcurrencyLimiter* limiter = limit_monitor.GetLimiter(&processor);
+    MonitorCenter monitor_center;
+    monitor_center.AddMonitor(&task_monitor);
+    monitor_center.AddMonitor(&limit_monitor);
+
+    std::deque<SimRequest> waiting_downstream;
+    std::deque<SimRequest> running;
+    double cpu_done = 0;
+    double next_arrival_ms = 0;
+    int64_t offered  = 0;
+    int64_t rejected = 0;
+    int64_t good     = 0;
+    int64_t late     = 0;
+    uint64_t limit_sum = 0;
+    uint64_t limit_num = 0;
+    std::vector<int64_t> latencies;
+
+    srand48(1);
+    for (g_now_us = 0; g_now_us < run_us; g_now_us += step_us) {
+        bool measure = g_now_us >= warm_up_us;
+
+        while (next_arrival_ms * 1000 <= g_now_us) {
+            next_arrival_ms += -log(1 - drand48()) / arrival_per_ms;
+            uint32_t inflight = waiting_downstream.size() + running.size();
+            task_monitor.SetTaskNum(inflight);
+            limit_monitor.SetInflight(&processor, inflight);
+            if (measure) {
+                offered++;
+            }
+            if (monitor_center.IsOverLoad()) {
+                if (measure) {
+                    rejected++;
+                }
+                continue;
+            }
+            SimRequest request;
+            request.admit_us  = g_now_us;
+            request.cpu_start = 0;
+            waiting_downstream.push_back(request);
+        }
+
+        while (!waiting_downstream.empty()
+            && g_now_us - waiting_downstream.front().admit_us >= downstream_us) {
+            SimRequest request = waiting_downstream.front();
+            waiting_downstream.pop_front();
+            request.cpu_start = cpu_done;
+            running.push_back(request);
+        }
+
+        if (!running.empty()) {
+            cpu_done += (step_us / 1000.0) * capacity_per_ms / running.size();
+        }
+        while (!running.empty() && cpu_done - running.front().cpu_start >= 1.0) {
+            int64_t latency_ms = g_now_us / 1000 - running.front().admit_us / 1000;
+            running.pop_front();
+            limiter->OnSample(latency_ms);
+            if (measure) {
+                latencies.push_back(latency_ms);
+                latency_ms <= slo_ms ? good++ : late++;
+            }
+        }
+
+        if (measure && g_now_us % 1000 == 0) {
+            limit_sum += limiter->GetLimit();
+            limit_num++;
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double seconds = (run_us - warm_up_us) / 1e6;
+    long p50 = latencies.empty() ? 0 : static_cast<long>(latencies[latencies.size() / 2]);
+    long p99 = latencies.empty() ? 0 : static_cast<long>(latencies[latencies.size() * 99 / 100]);
+    unsigned long avg_limit = adaptive ? static_cast<unsigned long>(limit_sum / limit_num) : threshold;
+    printf("%-8s threshold %5u load %.1f: goodput %6.0f/s (late %6.0f/s) reject %5.1f%% "
+        "p50 %4ld ms p99 %4ld ms avg limit %lu\n",
+        argv[1], threshold, load, good / seconds, late / seconds,
+        offered > 0 ? 100.0 * rejected / offered : 0.0, p50, p99, avg_limit);
+
+    return 0;
+}
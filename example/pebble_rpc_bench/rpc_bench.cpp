@@ -0,0 +1,227 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/time_utility.h"
+#include "framework/rpc.h"
+
+using namespace pebble;
+
+// RpcSession池化的基准：统计每个请求的堆分配次数和耗时
+// 用法: ./rpc_bench [请求数]
+
+static int64_t g_allocs = 0;
+
+void* operator new(size_t size) {
+    g_allocs++;
+    void* p = malloc(size ? size : 1);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) throw() {
+    free(p);
+}
+
+void* operator new[](size_t size) {
+    g_allocs++;
+    void* p = malloc(size ? size : 1);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete[](void* p) throw() {
+    free(p);
+}
+
+// 最简单的定长头部编解码，避免协议本身的开销干扰测试结果
+class BenchRpc : public Rpc {
+protected:
+    virtual int32_t HeadEncode(const RpcHead& head, uint8_t* buff, uint32_t buff_len) {
+        uint32_t name_len = head.m_function_name.size();
+        if (buff_len < 20 + name_len) {
+            return -1;
+        }
+        memcpy(buff, &head.m_message_type, 4);
+        memcpy(buff + 4, &head.m_session_id, 8);
+        memcpy(buff + 12, &head.m_function_id, 4);
+        memcpy(buff + 16, &name_len, 4);
+        memcpy(buff + 20, head.m_function_name.data(), name_len);
+        return 20 + name_len;
+    }
+
+    virtual int32_t HeadDecode(const uint8_t* buff, uint32_t buff_len, RpcHead* head) {
+        uint32_t name_len = 0;
+        if (buff_len < 20) {
+            return -1;
+        }
+        memcpy(&head->m_message_type, buff, 4);
+        memcpy(&head->m_session_id, buff + 4, 8);
+        memcpy(&head->m_function_id, buff + 12, 4);
+        memcpy(&name_len, buff + 16, 4);
+        if (buff_len < 20 + name_len) {
+            return -1;
+        }
+        head->m_function_name.assign(reinterpret_cast<const char*>(buff) + 20, name_len);
+        return 20 + name_len;
+    }
+
+    virtual int32_t ExceptionEncode(const RpcException& rpc_exception, uint8_t* buff,
+        uint32_t buff_len) {
+        memcpy(buff, &rpc_exception.m_error_code, 4);
+        return 4;
+    }
+
+    virtual int32_t ExceptionDecode(const uint8_t* buff, uint32_t buff_len,
+        RpcException* rpc_exception) {
+        memcpy(&rpc_exception->m_error_code, buff, 4);
+        return 4;
+    }
+};
+
+// 进程内的消息队列，代替网络收发
+struct MsgQueue {
+    uint8_t  buff[64][256];
+    uint32_t len[64];
+    int32_t  num;
+};
+
+static MsgQueue g_to_server;
+static MsgQueue g_to_client;
+
+static int32_t SendV(MsgQueue* queue, int64_t handle, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag) {
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        memcpy(queue->buff[queue->num] + offset, msg_frag[i], msg_frag_len[i]);
+        offset += msg_frag_len[i];
+    }
+    queue->len[queue->num++] = offset;
+    return 0;
+}
+
+static int32_t Send(MsgQueue* queue, int64_t handle, const uint8_t* msg, uint32_t msg_len,
+    int32_t flag) {
+    const uint8_t* msg_frag[] = { msg };
+    return SendV(queue, handle, 1, msg_frag, &msg_len, flag);
+}
+
+static int32_t OnEcho(const uint8_t* buff, uint32_t buff_len,
+    cxx::function<int32_t(int32_t, const uint8_t*, uint32_t)>& rsp) {
+    return rsp(0, buff, buff_len);
+}
+
+static int64_t g_done = 0;
+
+static int32_t OnResponse(int32_t ret, const uint8_t* buff, uint32_t buff_len) {
+    if (ret == 0) {
+        g_done++;
+    }
+    return 0;
+}
+
+static int32_t OnTimeout(int32_t* timeout_num, int32_t ret, const uint8_t* buff,
+    uint32_t buff_len) {
+    if (ret == kRPC_REQUEST_TIMEOUT) {
+        (*timeout_num)++;
+    }
+    return 0;
+}
+
+void BindSendFunction(BenchRpc* rpc, MsgQueue* queue) {
+    rpc->SetSendFunction(
+        cxx::bind(Send, queue, cxx::placeholders::_1, cxx::placeholders::_2,
+            cxx::placeholders::_3, cxx::placeholders::_4),
+        cxx::bind(SendV, queue, cxx::placeholders::_1, cxx::placeholders::_2,
+            cxx::placeholders::_3, cxx::placeholders::_4, cxx::placeholders::_5));
+}
+
+int main(int argc, char** argv) {
+    const int32_t request_num = argc > 1 ? atoi(argv[1]) : 100000;
+    const int32_t batch = 32;
+
+    BenchRpc client;
+    BenchRpc server;
+    BindSendFunction(&client, &g_to_server);
+    BindSendFunction(&server, &g_to_client);
+    server.AddOnRequestFunction("Bench:echo", OnEcho);
+
+    RpcHead head;
+    head.m_function_name = "Bench:echo";
+    head.m_function_id   = Rpc::GetFunctionId(head.m_function_name);
+    head.m_message_type  = kRPC_CALL;
+    OnRpcResponse on_rsp = OnResponse;
+
+    // 第一轮预热，让会话池和各级缓存达到稳定状态，只统计第二轮
+    for (int32_t round = 0; round < 2; round++) {
+        g_done = 0;
+        int64_t allocs = g_allocs;
+        int64_t start  = TimeUtility::GetCurrentUS();
+        for (int32_t i = 0; i < request_num; i += batch) {
+            for (int32_t j = 0; j < batch; j++) {
+                head.m_session_id = client.GenSessionId();
+                client.SendRequest(1, head, reinterpret_cast<const uint8_t*>("hello"), 5,
+                    on_rsp, 1000);
+            }
+            for (int32_t j = 0; j < g_to_server.num; j++) {
+                server.OnMessage(2, g_to_server.buff[j], g_to_server.len[j], 0);
+            }
+            g_to_server.num = 0;
+            for (int32_t j = 0; j < g_to_client.num; j++) {
+                client.OnMessage(1, g_to_client.buff[j], g_to_client.len[j], 0);
+            }
+            g_to_client.num = 0;
+        }
+        int64_t cost = TimeUtility::GetCurrentUS() - start;
+        if (round == 1) {
+            printf("requests %d done %ld allocs/request %.2f ns/request %.0f\n",
+                request_num, static_cast<long>(g_done),
+                static_cast<double>(g_allocs - allocs) / request_num,
+                cost * 1000.0 / request_num);
+        }
+    }
+
+    // 没有应答的请求要按时超时
+    int32_t timeout_num = 0;
+    head.m_session_id = client.GenSessionId();
+    client.SendRequest(1, head, reinterpret_cast<const uint8_t*>("x"), 1,
+        cxx::bind(OnTimeout, &timeout_num, cxx::placeholders::_1, cxx::placeholders::_2,
+            cxx::placeholders::_3), 20);
+    g_to_server.num = 0;
+    int64_t start = TimeUtility::GetCurrentMS();
+    while (timeout_num == 0 && TimeUtility::GetCurrentMS() - start < 1000) {
+        TimeUtility::UpdateMonotonicTime();
+        client.Update();
+        usleep(1000);
+    }
+    printf("timeout fired %d after %ld ms\n", timeout_num,
+        static_cast<long>(TimeUtility::GetCurrentMS() - start));
+
+    cxx::unordered_map<std::string, int64_t> resource;
+    client.GetResourceUsed(&resource);
+    for (cxx::unordered_map<std::string, int64_t>::iterator it = resource.begin();
+        it != resource.end(); ++it) {
+        printf("%s = %ld\n", it->first.c_str(), static_cast<long>(it->second));
+    }
+
+    return timeout_num == 1 ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "common/time_utility.h"
+#include "framework/rpc.h"
+
+using namespace pebble;
+
+// 会话超时的正确性测试：大量不同超时的请求，一半收到应答，一半超时
+// 每个请求的回调必须恰好执行一次，且超时回调不能早于其超时时间
+
+class StressRpc : public Rpc {
+protected:
+    virtual int32_t HeadEncode(const RpcHead& head, uint8_t* buff, uint32_t buff_len) {
+        memcpy(buff, &head.m_message_type, 4);
+        memcpy(buff + 4, &head.m_session_id, 8);
+        return 12;
+    }
+
+    virtual int32_t HeadDecode(const uint8_t* buff, uint32_t buff_len, RpcHead* head) {
+        memcpy(&head->m_message_type, buff, 4);
+        memcpy(&head->m_session_id, buff + 4, 8);
+        return 12;
+    }
+
+    virtual int32_t ExceptionEncode(const RpcException& rpc_exception, uint8_t* buff,
+        uint32_t buff_len) {
+        return 0;
+    }
+
+    virtual int32_t ExceptionDecode(const uint8_t* buff, uint32_t buff_len,
+        RpcException* rpc_exception) {
+        return 0;
+    }
+};
+
+static int32_t Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag) {
+    return 0;
+}
+
+static int32_t SendV(int64_t handle, uint32_t msg_frag_num, const uint8_t* msg_frag[],
+    uint32_t msg_frag_len[], int32_t flag) {
+    return 0;
+}
+
+enum RequestState {
+    kPENDING = 0,
+    kREPLIED,
+    kTIMEOUT,
+};
+
+static std::vector<int32_t> g_state;
+static std::vector<int64_t> g_deadline_ms;
+static int32_t g_bad = 0;
+
+static int32_t OnResponse(int32_t index, int32_t ret, const uint8_t* buff, uint32_t buff_len) {
+    if (g_state[index] != kPENDING) {
+        g_bad++;
+    }
+    g_state[index] = (ret == 0 ? kREPLIED : kTIMEOUT);
+    if (ret != 0 && TimeUtility::GetMonotonicMS() < g_deadline_ms[index]) {
+        g_bad++;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const int32_t request_num = 20000;
+    srand(7);
+
+    StressRpc client;
+    client.SetSendFunction(Send, SendV);
+    g_state.assign(request_num, kPENDING);
+    g_deadline_ms.assign(request_num, 0);
+
+    std::vector<uint64_t> session_ids;
+    for (int32_t i = 0; i < request_num; i++) {
+        RpcHead head;
+        head.m_message_type = kRPC_CALL;
+        // 连续的session id和低位相同的session id混合
+        head.m_session_id = (i % 3 == 0) ?
+            (static_cast<uint64_t>(i) << 20) : client.GenSessionId() + 1000000;
+        int32_t timeout_ms = 5 + rand() % 200;
+        g_deadline_ms[i] = TimeUtility::GetMonotonicMS() + timeout_ms;
+        int32_t ret = client.SendRequest(1, head, NULL, 0,
+            cxx::bind(OnResponse, i, cxx::placeholders::_1, cxx::placeholders::_2,
+                cxx::placeholders::_3), timeout_ms);
+        if (ret != 0) {
+            printf("send request %d failed(%d)\n", i, ret);
+            return 1;
+        }
+        session_ids.push_back(head.m_session_id);
+    }
+
+    // 随机应答一半的请求
+    std::vector<int32_t> order;
+    for (int32_t i = 0; i < request_num; i++) {
+        order.push_back(i);
+    }
+    std::random_shuffle(order.begin(), order.end());
+    for (int32_t k = 0; k < request_num / 2; k++) {
+        int32_t index = order[k];
+        uint8_t buff[12];
+        int32_t type = kRPC_REPLY;
+        memcpy(buff, &type, 4);
+        memcpy(buff + 4, &session_ids[index], 8);
+        int32_t ret = client.OnMessage(1, buff, sizeof(buff), 0);
+        if (ret != 0) {
+            printf("response %d failed(%d)\n", index, ret);
+            return 1;
+        }
+    }
+
+    int64_t start = TimeUtility::GetCurrentMS();
+    while (client.GetNextTimeout() >= 0 && TimeUtility::GetCurrentMS() - start < 2000) {
+        usleep(500);
+        TimeUtility::UpdateMonotonicTime();
+        client.Update();
+    }
+
+    int32_t replied = 0;
+    int32_t timeout = 0;
+    int32_t pending = 0;
+    for (int32_t i = 0; i < request_num; i++) {
+        switch (g_state[i]) {
+            case kREPLIED: replied++; break;
+            case kTIMEOUT: timeout++; break;
+            default:       pending++; break;
+        }
+    }
+    printf("replied %d timeout %d pending %d bad %d\n", replied, timeout, pending, g_bad);
+
+    bool ok = (replied == request_num / 2 && timeout == request_num - request_num / 2
+        && g_bad == 0);
+    return ok ? 0 : 1;
+}
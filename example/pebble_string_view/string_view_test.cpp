@@ -0,0 +1,320 @@
+﻿/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "common/coroutine.h"
+#include "common/time_utility.h"
+#include "example/pebble_string_view/view.h"
+#include "example/pebble_string_view/view_Proxy.h"
+#include "framework/dr/common/string_view.h"
+#include "framework/dr/protocol/binary_protocol.h"
+#include "framework/dr/protocol/compact_protocol.h"
+#include "framework/dr/serialize.h"
+#include "framework/dr/transport/buffer_transport.h"
+#include "framework/pebble_rpc.h"
+
+// cpp.view字段的编解码测试，以及协程中处理请求让出后请求数据的保持测试
+// 用法: ./string_view_test
+
+#define CHECK(cond) \
+    if (!(cond)) { \
+        fprintf(stderr, "(%s:%d)(%s) check failed: %s\n", __FILE__, __LINE__, __FUNCTION__, #cond); \
+        exit(1); \
+    }
+
+using namespace pebble;
+
+typedef dr::protocol::TBinaryProtocol BinaryProtocol;
+typedef dr::protocol::TCompactProtocol CompactProtocol;
+typedef dr::transport::TMemoryBuffer MemoryBuffer;
+
+static void Fill(view::Msg* msg) {
+    msg->name    = "alice";
+    msg->payload = std::string(1000, '\x01');
+    msg->plain   = "plain";
+    msg->tags.push_back("t1");
+    msg->tags.push_back("");
+    msg->tags.push_back("t3");
+
+    view::Item item;
+    item.key = "key";
+    item.n   = 3;
+    msg->items["a"] = item;
+    msg->items["b"] = item;
+
+    msg->uniq.insert("x");
+    msg->uniq.insert("y");
+}
+
+static bool Equal(const view::Msg& a, const view::Msg& b) {
+    if (a.items.size() != b.items.size()) {
+        return false;
+    }
+    std::map<dr::StringView, view::Item>::const_iterator ia = a.items.begin();
+    std::map<dr::StringView, view::Item>::const_iterator ib = b.items.begin();
+    for (; ia != a.items.end(); ++ia, ++ib) {
+        if (ia->first != ib->first || ia->second.key != ib->second.key
+            || ia->second.n != ib->second.n) {
+            return false;
+        }
+    }
+    return a.name == b.name && a.payload == b.payload && a.tags == b.tags
+        && a.plain == b.plain && a.uniq == b.uniq;
+}
+
+// 视图引用的数据完全在buff内
+static bool Inside(const dr::StringView& v, const std::string& buff) {
+    return v.IsReference() && v.data() >= buff.data()
+        && v.data() + v.size() <= buff.data() + buff.size();
+}
+
+// 作用域内解码引用缓冲区，作用域外解码持有副本，两种结果重新编码都与原始数据一致
+template <typename TPROTOCOL>
+void TestRoundTrip() {
+    view::Msg origin;
+    Fill(&origin);
+    std::string encoded;
+    int ret = dr::Pack<view::Msg, TPROTOCOL>(&origin, &encoded);
+    CHECK(ret > 0);
+    uint8_t* encoded_data = reinterpret_cast<uint8_t*>(&encoded[0]);
+
+    cxx::shared_ptr<MemoryBuffer> buffer(new MemoryBuffer());
+    TPROTOCOL protocol(buffer);
+
+    view::Msg copied;
+    buffer->resetBuffer(encoded_data, encoded.size(), MemoryBuffer::OBSERVE);
+    copied.read(&protocol);
+    CHECK(Equal(origin, copied));
+    CHECK(!copied.name.IsReference() && !copied.payload.IsReference());
+    CHECK(!copied.tags[0].IsReference());
+
+    view::Msg referenced;
+    {
+        dr::StringViewRefScope scope;
+        buffer->resetBuffer(encoded_data, encoded.size(), MemoryBuffer::OBSERVE);
+        referenced.read(&protocol);
+    }
+    CHECK(!dr::StringView::RefEnabled());
+    CHECK(Equal(origin, referenced));
+    CHECK(Inside(referenced.name, encoded) && Inside(referenced.payload, encoded));
+    CHECK(Inside(referenced.tags[2], encoded) && referenced.tags[1].empty());
+    CHECK(Inside(referenced.items.begin()->first, encoded));
+    CHECK(Inside(referenced.items.begin()->second.key, encoded));
+    CHECK(Inside(*referenced.uniq.begin(), encoded));
+
+    // 转发引用了请求数据的消息，编码结果不变
+    std::string forwarded;
+    ret = dr::Pack<view::Msg, TPROTOCOL>(&referenced, &forwarded);
+    CHECK(ret > 0 && forwarded == encoded);
+    cxx::shared_ptr<MemoryBuffer> out_buffer(new MemoryBuffer());
+    TPROTOCOL out_protocol(out_buffer);
+    uint32_t len = referenced.write(&out_protocol);
+    CHECK(referenced.SerializedSize(&out_protocol) == len);
+    uint8_t* data = NULL;
+    out_buffer->getBuffer(&data, &len);
+    CHECK(std::string(reinterpret_cast<char*>(data), len) == encoded);
+
+    // 复制对象只复制引用，str()复制数据
+    view::Msg assigned = referenced;
+    CHECK(assigned.name.data() == referenced.name.data());
+    std::string payload = referenced.payload.str();
+    CHECK(payload == origin.payload.str() && payload.data() != referenced.payload.data());
+
+    // 相同的编码可以解码到std::string字段
+    view::MsgCopy plain;
+    ret = dr::UnPack<view::MsgCopy, TPROTOCOL>(&plain, encoded);
+    CHECK(ret == static_cast<int>(encoded.size()));
+    CHECK(plain.name == "alice" && plain.payload.size() == 1000 && plain.tags.size() == 3);
+
+    // 截断的数据解码失败，异常退出作用域后引用开关恢复
+    bool failed = false;
+    buffer->resetBuffer(encoded_data, encoded.size() / 2, MemoryBuffer::OBSERVE);
+    try {
+        dr::StringViewRefScope scope;
+        view::Msg truncated;
+        truncated.read(&protocol);
+    } catch (TException& e) {
+        failed = true;
+    }
+    CHECK(failed && !dr::StringView::RefEnabled());
+
+    // 默认值
+    view::Msg dflt;
+    CHECK(dflt.name == "dflt");
+}
+
+// 两个PebbleRpc之间直接交换消息，服务端在协程中处理
+static std::string g_to_server;
+static std::string g_to_client;
+
+static int32_t Send(std::string* to, int64_t handle, const uint8_t* buff, uint32_t buff_len,
+    int32_t flag) {
+    to->assign(reinterpret_cast<const char*>(buff), buff_len);
+    return 0;
+}
+
+static int32_t SendV(std::string* to, int64_t handle, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag) {
+    to->clear();
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        to->append(reinterpret_cast<const char*>(msg_frag[i]), msg_frag_len[i]);
+    }
+    return 0;
+}
+
+static void SetSendTo(Rpc* rpc, std::string* to) {
+    rpc->SetSendFunction(
+        cxx::bind(Send, to, cxx::placeholders::_1, cxx::placeholders::_2,
+            cxx::placeholders::_3, cxx::placeholders::_4),
+        cxx::bind(SendV, to, cxx::placeholders::_1, cxx::placeholders::_2,
+            cxx::placeholders::_3, cxx::placeholders::_4, cxx::placeholders::_5));
+}
+
+// Forward先让出，恢复后再检查参数，期间测试用例会改写请求数据所在的缓冲区
+class ProxyService : public view::ProxyCobSvIf {
+public:
+    explicit ProxyService(CoroutineSchedule* schedule)
+        : m_schedule(schedule), m_co_id(INVALID_CO_ID), m_intact(false) {}
+
+    virtual void Forward(const view::Msg& msg, const int32_t hop,
+        cxx::function<void(int32_t ret_code, const view::Msg& response)>& rsp) {
+        m_co_id = m_schedule->CurrentTaskId();
+        m_schedule->Yield();
+
+        view::Msg origin;
+        Fill(&origin);
+        m_intact = Equal(origin, msg) && hop == 1;
+        m_co_id  = INVALID_CO_ID;
+        rsp(0, msg);
+    }
+
+    virtual void Plain(const std::string& s,
+        cxx::function<void(int32_t ret_code, int32_t response)>& rsp) {
+        rsp(0, s.size());
+    }
+
+    CoroutineSchedule* m_schedule;
+    int64_t m_co_id;
+    bool m_intact;
+};
+
+static void OnForward(bool* done, view::MsgCopy* result, int32_t ret_code,
+    const view::Msg& response) {
+    *done = (ret_code == 0);
+    result->name    = response.name.str();
+    result->payload = response.payload.str();
+}
+
+// 返回处理函数恢复后看到的参数是否完好
+static bool ForwardAcrossYield(PebbleRpc* client, PebbleRpc* server, CoroutineSchedule* schedule,
+    ProxyService* service) {
+    view::ProxyClient proxy(client);
+    proxy.SetHandle(1);
+    view::Msg msg;
+    Fill(&msg);
+    bool done = false;
+    view::MsgCopy result;
+    proxy.Forward(msg, 1, cxx::bind(OnForward, &done, &result,
+        cxx::placeholders::_1, cxx::placeholders::_2));
+    CHECK(!g_to_server.empty());
+
+    // 模拟网络层的接收缓冲区，OnMessage返回后即被复用
+    std::vector<uint8_t> recv_buff(g_to_server.begin(), g_to_server.end());
+    int32_t ret = server->OnMessage(2, &recv_buff[0], recv_buff.size(), 0);
+    CHECK(ret == 0 && service->m_co_id != INVALID_CO_ID);
+    memset(&recv_buff[0], 0, recv_buff.size());
+
+    g_to_client.clear();
+    schedule->Resume(service->m_co_id);
+    CHECK(service->m_co_id == INVALID_CO_ID && !g_to_client.empty());
+    ret = client->OnMessage(1, reinterpret_cast<const uint8_t*>(g_to_client.data()),
+        g_to_client.size(), 0);
+    CHECK(ret == 0 && done);
+    if (service->m_intact) {
+        CHECK(result.name == "alice" && result.payload == std::string(1000, '\x01'));
+    }
+    return service->m_intact;
+}
+
+void TestPinAcrossYield() {
+    CoroutineSchedule schedule;
+    CHECK(schedule.Init() == 0);
+    PebbleRpc client(kCODE_BINARY, NULL);
+    PebbleRpc server(kCODE_BINARY, &schedule);
+    SetSendTo(&client, &g_to_server);
+    SetSendTo(&server, &g_to_client);
+
+    ProxyService service(&schedule);
+    CHECK(server.AddService(&service) == 0);
+    CHECK(server.SetFunctionPinRequest("Proxy:Unknown", true) == kRPC_FUNCTION_NAME_UNEXISTED);
+
+    // 生成代码为Forward设置了保持请求数据，让出期间缓冲区被改写也不影响参数
+    CHECK(ForwardAcrossYield(&client, &server, &schedule, &service));
+
+    // 不保持时参数引用的是已被改写的缓冲区，说明上面的用例确实覆盖了缓冲区复用
+    CHECK(server.SetFunctionPinRequest("Proxy:Forward", false) == 0);
+    CHECK(!ForwardAcrossYield(&client, &server, &schedule, &service));
+
+    CHECK(server.SetFunctionPinRequest("Proxy:Forward", true) == 0);
+    CHECK(ForwardAcrossYield(&client, &server, &schedule, &service));
+}
+
+// 64KB的二进制数据加20个短字符串，对比std::string字段和视图字段的解码耗时
+void BenchDecode() {
+    view::Msg msg;
+    msg.name    = "proxy";
+    msg.payload = std::string(65536, 'b');
+    for (int i = 0; i < 20; i++) {
+        msg.tags.push_back(std::string(40, 'a' + i));
+    }
+    std::string encoded;
+    int ret = dr::Pack<view::Msg, BinaryProtocol>(&msg, &encoded);
+    CHECK(ret > 0);
+    uint8_t* encoded_data = reinterpret_cast<uint8_t*>(&encoded[0]);
+
+    cxx::shared_ptr<MemoryBuffer> buffer(new MemoryBuffer());
+    BinaryProtocol protocol(buffer);
+    const int num = 20000;
+    int64_t t0 = TimeUtility::GetCurrentUS();
+    for (int i = 0; i < num; i++) {
+        view::MsgCopy copied;
+        buffer->resetBuffer(encoded_data, encoded.size(), MemoryBuffer::OBSERVE);
+        copied.read(&protocol);
+    }
+    int64_t t1 = TimeUtility::GetCurrentUS();
+    for (int i = 0; i < num; i++) {
+        view::Msg referenced;
+        dr::StringViewRefScope scope;
+        buffer->resetBuffer(encoded_data, encoded.size(), MemoryBuffer::OBSERVE);
+        referenced.read(&protocol);
+    }
+    int64_t t2 = TimeUtility::GetCurrentUS();
+
+    printf("decode %u bytes: std::string %.0f ns, view %.0f ns\n",
+        static_cast<uint32_t>(encoded.size()),
+        (t1 - t0) * 1000.0 / num, (t2 - t1) * 1000.0 / num);
+}
+
+int main(int argc, char** argv) {
+    TestRoundTrip<BinaryProtocol>();
+    TestRoundTrip<CompactProtocol>();
+    TestPinAcrossYield();
+    BenchDecode();
+    printf("string_view_test OK\n");
+    return 0;
+}
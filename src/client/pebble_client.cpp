@@ -25,6 +25,7 @@
 #include "framework/event_handler.inh"
 #include "framework/message.h"
 #include "framework/pebble_rpc.h"
+#include "framework/raw_message_driver.h"
 #include "framework/session.h"
 #include "framework/stat.h"
 #include "framework/stat_manager.h"
@@ -90,7 +91,20 @@ int32_t PebbleClient::Init() {
 
     PLOG_INFO("%s", m_options.ToString().c_str());
 
-    int32_t ret = InitTimer();
+    TimeUtility::SetPreciseMonotonic(m_options._app_precise_clock);
+
+    RawMessageDriver::Instance()->SetUdpBatchNum(m_options._net_udp_batch_num);
+
+    int32_t ret = 0;
+    if (m_options._net_enable_uring) {
+        ret = Message::EnableUringDriver();
+        if (ret != 0) {
+            PLOG_ERROR("enable uring driver failed(%d:%s)", ret, Message::GetLastError());
+            return -1;
+        }
+    }
+
+    ret = InitTimer();
     CHECK_RETURN(ret);
 
     ret = InitCoSchedule();
@@ -111,6 +125,13 @@ int64_t PebbleClient::Connect(const std::string &url) {
 }
 
 int32_t PebbleClient::Close(int64_t handle) {
+    // ֪ͨProcessorͷźʹ˾ص״̬
+    for (int32_t i = 0; i < kPROCESSOR_TYPE_BUTT; ++i) {
+        if (m_processor_array[i] != NULL) {
+            m_processor_array[i]->OnClose(handle);
+        }
+    }
+
     int32_t ret = Message::Close(handle);
     PLOG_IF_ERROR(ret != 0, "close %ld failed(%s)", handle, Message::GetLastError());
     return ret;
@@ -139,7 +160,7 @@ int32_t PebbleClient::Attach(Router* router, IProcessor* processor) {
 
 
 IProcessor* PebbleClient::GetProcessor(ProcessorType processor_type) {
-    if (processor_type < kPEBBLE_RPC_BINARY || processor_type > kPEBBLE_RPC_PROTOBUF) {
+    if (processor_type < kPEBBLE_RPC_BINARY || processor_type >= kPROCESSOR_TYPE_BUTT) {
         return GetPebbleRpc(processor_type);
     }
     // ĿǰֻRPCصProcessorչҪﴦ
@@ -147,7 +168,7 @@ IProcessor* PebbleClient::GetProcessor(ProcessorType processor_type) {
 }
 
 PebbleRpc* PebbleClient::GetPebbleRpc(ProcessorType processor_type) {
-    if (processor_type < kPEBBLE_RPC_BINARY || processor_type > kPEBBLE_RPC_PROTOBUF) {
+    if (processor_type < kPEBBLE_RPC_BINARY || processor_type >= kPROCESSOR_TYPE_BUTT) {
         PLOG_ERROR("param processor_type invalid(%d)", processor_type);
         return NULL;
     }
@@ -175,6 +196,10 @@ PebbleRpc* PebbleClient::GetPebbleRpc(ProcessorType processor_type) {
             rpc_code_type = kCODE_PB;
             break;
 
+        case kPEBBLE_RPC_COMPACT:
+            rpc_code_type = kCODE_COMPACT;
+            break;
+
         default:
             PLOG_FATAL("unsupport processor type %d", processor_type);
             return NULL;
@@ -236,7 +261,8 @@ Router* PebbleClient::GetRouter(const std::string& name, RouterType router_type)
 int32_t PebbleClient::Update() {
     int32_t num = 0;
 
-    int64_t old = TimeUtility::GetCurrentMS();
+    // ÿֻһʱӣڵĶʱʱʱ㶼ʹô˻ʱ
+    int64_t old = TimeUtility::UpdateMonotonicTime();
 
     for (uint32_t i = 0; i < m_options._max_msg_num_per_loop; ++i) {
         if (ProcessMessage() <= 0) {
@@ -266,7 +292,7 @@ int32_t PebbleClient::Update() {
 
     if (m_stat_manager) {
         num += m_stat_manager->Update();
-        m_stat_manager->GetStat()->AddResourceItem("_loop", TimeUtility::GetCurrentMS() - old);
+        m_stat_manager->GetStat()->AddResourceItem("_loop", TimeUtility::UpdateMonotonicTime() - old);
     }
 
     return num;
@@ -309,6 +335,7 @@ int32_t PebbleClient::ProcessMessage() {
             break;
         }
 
+        it->second->SetMessageArrivedTime(msg_info._msg_arrived_ms);
         it->second->OnMessage(msg_info._remote_handle, msg, msg_len, 0);
         Message::Pop(handle);
     } while (0);
@@ -60,6 +60,7 @@ typedef enum {
     kPEBBLE_RPC_BINARY = 0, // thrift binarypebble rpcʵ
     kPEBBLE_RPC_JSON,       // thrift jsonpebble rpcʵ
     kPEBBLE_RPC_PROTOBUF,   // protobufpebble rpcʵ
+    kPEBBLE_RPC_COMPACT,    // thrift compactpebble rpcʵֶͷ䳤룬ʺϴ޵ĳ
     kPROCESSOR_TYPE_BUTT
 } ProcessorType;
 
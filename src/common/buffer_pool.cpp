@@ -0,0 +1,149 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "common/buffer_pool.h"
+
+
+namespace pebble {
+
+static uint32_t RoundUpPowerOf2(uint32_t size) {
+    uint32_t ret = 1;
+    while (ret < size && ret < 0x80000000U) {
+        ret <<= 1;
+    }
+    return ret;
+}
+
+BufferPool::BufferPool() {
+    m_min_block_size = 0;
+    m_max_block_size = 0;
+}
+
+BufferPool::~BufferPool() {
+    Clear();
+}
+
+int32_t BufferPool::Init(uint32_t min_block_size, uint32_t max_block_size,
+    uint32_t max_cache_size) {
+    if (min_block_size < sizeof(FreeBlock) || min_block_size > max_block_size) {
+        return -1;
+    }
+
+    Clear();
+
+    m_min_block_size = RoundUpPowerOf2(min_block_size);
+    m_max_block_size = RoundUpPowerOf2(max_block_size);
+
+    for (uint32_t size = m_min_block_size; size <= m_max_block_size; size <<= 1) {
+        Tier tier;
+        tier._free_list    = NULL;
+        tier._free_num     = 0;
+        tier._max_free_num = max_cache_size / size;
+        tier._block_size   = size;
+        m_tiers.push_back(tier);
+        if (size == 0x80000000U) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+uint8_t* BufferPool::Alloc(uint32_t size, uint32_t* block_size) {
+    uint32_t real_size = GetBlockSize(size);
+    int32_t index = GetTierIndex(real_size);
+    if (index >= 0) {
+        Tier& tier = m_tiers[index];
+        if (tier._free_list != NULL) {
+            FreeBlock* block = tier._free_list;
+            tier._free_list = block->_next;
+            tier._free_num--;
+            *block_size = real_size;
+            return reinterpret_cast<uint8_t*>(block);
+        }
+    }
+
+    uint8_t* block = static_cast<uint8_t*>(malloc(real_size));
+    if (block != NULL) {
+        *block_size = real_size;
+    }
+    return block;
+}
+
+void BufferPool::Free(uint8_t* block, uint32_t block_size) {
+    if (block == NULL) {
+        return;
+    }
+
+    int32_t index = GetTierIndex(block_size);
+    if (index >= 0 && m_tiers[index]._free_num < m_tiers[index]._max_free_num) {
+        Tier& tier = m_tiers[index];
+        FreeBlock* free_block = reinterpret_cast<FreeBlock*>(block);
+        free_block->_next = tier._free_list;
+        tier._free_list = free_block;
+        tier._free_num++;
+        return;
+    }
+
+    free(block);
+}
+
+uint32_t BufferPool::GetBlockSize(uint32_t size) const {
+    if (size <= m_min_block_size) {
+        return m_min_block_size;
+    }
+    // 超过最大分级的按实际大小分配
+    if (size > m_max_block_size) {
+        return size;
+    }
+    return RoundUpPowerOf2(size);
+}
+
+uint64_t BufferPool::GetCachedSize() const {
+    uint64_t cached_size = 0;
+    for (std::vector<Tier>::const_iterator it = m_tiers.begin(); it != m_tiers.end(); ++it) {
+        cached_size += static_cast<uint64_t>(it->_free_num) * it->_block_size;
+    }
+    return cached_size;
+}
+
+void BufferPool::Clear() {
+    for (std::vector<Tier>::iterator it = m_tiers.begin(); it != m_tiers.end(); ++it) {
+        FreeBlock* block = it->_free_list;
+        while (block != NULL) {
+            FreeBlock* next = block->_next;
+            free(block);
+            block = next;
+        }
+    }
+    m_tiers.clear();
+}
+
+int32_t BufferPool::GetTierIndex(uint32_t block_size) const {
+    if (m_tiers.empty() || block_size < m_min_block_size || block_size > m_max_block_size) {
+        return -1;
+    }
+    // 只有2的幂大小的块属于分级
+    if ((block_size & (block_size - 1)) != 0) {
+        return -1;
+    }
+    int32_t index = 0;
+    for (uint32_t size = m_min_block_size; size < block_size; size <<= 1) {
+        index++;
+    }
+    return index;
+}
+
+} // namespace pebble
@@ -0,0 +1,86 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#ifndef _PEBBLE_COMMON_BUFFER_POOL_H_
+#define _PEBBLE_COMMON_BUFFER_POOL_H_
+
+#include <vector>
+#include "common/platform.h"
+
+
+namespace pebble {
+
+/// @brief 按2的幂分级的内存块池，每一级维护一个空闲块链表，用于替代频繁的malloc/free
+/// @note 非线程安全
+class BufferPool {
+public:
+    BufferPool();
+    ~BufferPool();
+
+    /// @brief 初始化
+    /// @param min_block_size 最小块大小，向上取整为2的幂
+    /// @param max_block_size 最大块大小，向上取整为2的幂，超过此大小的申请直接malloc
+    /// @param max_cache_size 每一级最多缓存的空闲内存字节数，超出部分直接free
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t Init(uint32_t min_block_size, uint32_t max_block_size, uint32_t max_cache_size);
+
+    /// @brief 申请不小于size的内存块
+    /// @param size 需要的大小
+    /// @param block_size 输出参数，返回实际的块大小，释放时需要传回
+    /// @return 非NULL 成功
+    /// @return NULL 失败
+    uint8_t* Alloc(uint32_t size, uint32_t* block_size);
+
+    /// @brief 归还内存块
+    /// @param block Alloc返回的内存块
+    /// @param block_size Alloc返回的块大小
+    void Free(uint8_t* block, uint32_t block_size);
+
+    /// @brief 返回能容纳size的块大小
+    uint32_t GetBlockSize(uint32_t size) const;
+
+    /// @brief 返回最小块大小
+    uint32_t GetMinBlockSize() const {
+        return m_min_block_size;
+    }
+
+    /// @brief 返回当前缓存的空闲内存字节数
+    uint64_t GetCachedSize() const;
+
+private:
+    void Clear();
+
+    int32_t GetTierIndex(uint32_t block_size) const;
+
+private:
+    struct FreeBlock {
+        FreeBlock* _next;
+    };
+
+    struct Tier {
+        FreeBlock* _free_list;
+        uint32_t   _free_num;
+        uint32_t   _max_free_num;
+        uint32_t   _block_size;
+    };
+
+    uint32_t m_min_block_size;
+    uint32_t m_max_block_size;
+    std::vector<Tier> m_tiers;
+};
+
+} // namespace pebble
+
+#endif // _PEBBLE_COMMON_BUFFER_POOL_H_
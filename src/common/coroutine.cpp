@@ -22,6 +22,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
 
@@ -182,27 +183,290 @@ static pid_t GetPid()
     return tid;
 }
 
-struct coroutine *
-_co_new(struct schedule *S, std::tr1::function<void()>& std_func) {
-    if (NULL == S) {
-        assert(0);
-        return NULL;
+#ifdef PEBBLE_CO_ASM_CONTEXT
+
+// 保存当前callee-saved寄存器到当前栈上，栈顶写入*from_sp，再切换到to_sp并恢复寄存器
+// 新协程的栈由coctx_make构造，恢复后ret到pebble_coctx_entry，以保存的参数调用入口函数
+extern "C" void pebble_coctx_swap(void** from_sp, void* to_sp);
+extern "C" void pebble_coctx_entry();
+
+#if defined(__x86_64__)
+// 栈布局(低地址到高地址): mxcsr/x87控制字, r15, r14, r13, r12, rbx, rbp, 返回地址
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    ".globl pebble_coctx_swap\n"
+    ".hidden pebble_coctx_swap\n"
+    ".type pebble_coctx_swap, @function\n"
+    "pebble_coctx_swap:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size pebble_coctx_swap, .-pebble_coctx_swap\n"
+    ".p2align 4\n"
+    ".globl pebble_coctx_entry\n"
+    ".hidden pebble_coctx_entry\n"
+    ".type pebble_coctx_entry, @function\n"
+    "pebble_coctx_entry:\n"
+    "    movq %r12, %rdi\n"
+    "    callq *%r13\n"
+    "    ud2\n"
+    ".size pebble_coctx_entry, .-pebble_coctx_entry\n"
+);
+
+static const int COCTX_FRAME_SLOTS = 8;
+static const int COCTX_SLOT_FUNC   = 3;     // r13
+static const int COCTX_SLOT_ARG    = 4;     // r12
+static const int COCTX_SLOT_RET    = 7;
+#elif defined(__aarch64__)
+// 还未在aarch64上验证，只有定义了PEBBLE_CO_AARCH64_ASM才会编译 @see PEBBLE_CO_ASM_CONTEXT
+// 栈布局(低地址到高地址): x19-x28, x29(fp), x30(lr), d8-d15, fpcr, 对齐填充
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    ".globl pebble_coctx_swap\n"
+    ".hidden pebble_coctx_swap\n"
+    ".type pebble_coctx_swap, %function\n"
+    "pebble_coctx_swap:\n"
+    "    sub sp, sp, #176\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mrs x9, fpcr\n"
+    "    str x9, [sp, #160]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    ldr x9, [sp, #160]\n"
+    "    msr fpcr, x9\n"
+    "    add sp, sp, #176\n"
+    "    ret\n"
+    ".size pebble_coctx_swap, .-pebble_coctx_swap\n"
+    ".p2align 4\n"
+    ".globl pebble_coctx_entry\n"
+    ".hidden pebble_coctx_entry\n"
+    ".type pebble_coctx_entry, %function\n"
+    "pebble_coctx_entry:\n"
+    "    mov x0, x19\n"
+    "    blr x20\n"
+    "    brk #0\n"
+    ".size pebble_coctx_entry, .-pebble_coctx_entry\n"
+);
+
+static const int COCTX_FRAME_SLOTS = 22;
+static const int COCTX_SLOT_FUNC   = 1;     // x20
+static const int COCTX_SLOT_ARG    = 0;     // x19
+static const int COCTX_SLOT_RET    = 11;    // x30
+#endif
+
+/// @brief 在stack上构造初始上下文，首次切换进来时执行func(arg)，func不能返回
+static void coctx_make(coctx_t* ctx, char* stack, size_t stack_size,
+    void (*func)(void*), void* arg) {
+    uintptr_t top = reinterpret_cast<uintptr_t>(stack + stack_size) & ~static_cast<uintptr_t>(15);
+    // 多留16字节，保证恢复寄存器并ret之后栈仍是16字节对齐
+    uintptr_t* frame = reinterpret_cast<uintptr_t*>(top - 16 - COCTX_FRAME_SLOTS * sizeof(uintptr_t));
+    memset(frame, 0, COCTX_FRAME_SLOTS * sizeof(uintptr_t));
+#if defined(__x86_64__)
+    uint32_t mxcsr = 0;
+    uint16_t fpucw = 0;
+    __asm__ __volatile__("stmxcsr %0" : "=m"(mxcsr));
+    __asm__ __volatile__("fnstcw %0" : "=m"(fpucw));
+    frame[0] = mxcsr | (static_cast<uintptr_t>(fpucw) << 32);
+#elif defined(__aarch64__)
+    uint64_t fpcr = 0;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    frame[20] = fpcr;
+#endif
+    frame[COCTX_SLOT_FUNC] = reinterpret_cast<uintptr_t>(func);
+    frame[COCTX_SLOT_ARG]  = reinterpret_cast<uintptr_t>(arg);
+    frame[COCTX_SLOT_RET]  = reinterpret_cast<uintptr_t>(pebble_coctx_entry);
+    ctx->sp = frame;
+}
+
+static inline void coctx_swap(coctx_t* from, coctx_t* to) {
+    pebble_coctx_swap(&from->sp, to->sp);
+}
+
+#else
+
+static void coctx_make(coctx_t* ctx, char* stack, size_t stack_size,
+    void (*func)(uint32_t, uint32_t), struct schedule* S) {
+    getcontext(&ctx->uc);
+    ctx->uc.uc_stack.ss_sp = stack;
+    ctx->uc.uc_stack.ss_size = stack_size;
+    ctx->uc.uc_stack.ss_flags = 0;
+    ctx->uc.uc_link = &S->main.uc;
+    uintptr_t ptr = (uintptr_t) S;
+    makecontext(&ctx->uc, (void (*)(void)) func, 2,
+    (uint32_t)ptr,  // NOLINT
+    (uint32_t)(ptr>>32));  // NOLINT
+}
+
+static inline void coctx_swap(coctx_t* from, coctx_t* to) {
+    swapcontext(&from->uc, &to->uc);
+}
+
+#endif // PEBBLE_CO_ASM_CONTEXT
+
+static size_t GetPageSize() {
+    static size_t page_size = sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+/// @brief 进程内带保护页的协程栈数量上限，每个保护页使映射区数量加1，留出大部分余量给其它内存映射
+static int64_t GetMaxGuardedStackNum() {
+    int64_t max_map_count = 65530;
+    FILE* fp = fopen("/proc/sys/vm/max_map_count", "r");
+    if (fp) {
+        long long value = 0;
+        if (fscanf(fp, "%lld", &value) == 1 && value > 0) {
+            max_map_count = value;
+        }
+        fclose(fp);
+    }
+    return max_map_count / 4;
+}
+
+static volatile int64_t g_guarded_stack_num = 0;
+
+/// @brief 分配协程栈，优先复用栈池中的栈，新栈的最低一页为保护页
+static int32_t co_stack_alloc(struct schedule *S, co_stack_t* stack) {
+    if (!S->stack_pool.empty()) {
+        *stack = S->stack_pool.back();
+        S->stack_pool.pop_back();
+        return 0;
+    }
+
+    size_t page_size = GetPageSize();
+    void* p = mmap(NULL, S->stack_size + page_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == p) {
+        PLOG_ERROR("mmap coroutine stack failed(%d)", errno);
+        return -1;
+    }
+    stack->ptr = static_cast<char*>(p) + page_size;
+    stack->guarded = false;
+
+    // 超出上限后不再设置保护页，无保护页的相邻映射可以合并，协程数不受vm.max_map_count限制
+    static int64_t max_guarded_stack_num = GetMaxGuardedStackNum();
+    if (__sync_add_and_fetch(&g_guarded_stack_num, 1) > max_guarded_stack_num
+        || mprotect(p, page_size, PROT_NONE) != 0) {
+        __sync_sub_and_fetch(&g_guarded_stack_num, 1);
+        return 0;
+    }
+    stack->guarded = true;
+
+    return 0;
+}
+
+static void co_stack_free(struct schedule *S, co_stack_t* stack) {
+    if (stack->ptr) {
+        size_t page_size = GetPageSize();
+        munmap(stack->ptr - page_size, S->stack_size + page_size);
+        if (stack->guarded) {
+            __sync_sub_and_fetch(&g_guarded_stack_num, 1);
+        }
+        stack->ptr = NULL;
     }
+}
 
-    struct coroutine * co = NULL;
-    if (S->co_free_list.empty()) {
-        co = new coroutine;
-        co->stack = new char[S->stack_size];
+/// @brief 归还协程栈，调用时可能还运行在此栈上，栈池满时延迟到下一个栈归还时释放
+static void co_stack_release(struct schedule *S, co_stack_t* stack) {
+    if (S->stack_pool.size() < MAX_FREE_STACK_NUM) {
+        S->stack_pool.push_back(*stack);
     } else {
-        co = S->co_free_list.front();
-        S->co_free_list.pop_front();
+        co_stack_free(S, &S->dead_stack);
+        S->dead_stack = *stack;
+    }
+    stack->ptr = NULL;
+}
+
+static const uint32_t CO_GEN_MASK = 0x7FFFFFFF;
 
+/// @brief 按ID查找协程，ID已失效时返回NULL
+static inline struct coroutine * co_find(struct schedule *S, int64_t id) {
+    uint32_t index = static_cast<uint32_t>(id);
+    if (id < 0 || index >= S->co_slots.size()) {
+        return NULL;
+    }
+    co_slot_t& slot = S->co_slots[index];
+    if (slot.gen != static_cast<uint32_t>(id >> 32)) {
+        return NULL;
+    }
+    return slot.co;
+}
+
+/// @brief 分配协程对象，独立栈模式同时分配协程栈，共享栈模式轮流分配运行栈
+static struct coroutine * _co_alloc(struct schedule *S, int64_t* id) {
+    co_stack_t stack;
+    stack.ptr = NULL;
+    stack.guarded = false;
+    if (S->share_stacks.empty() && co_stack_alloc(S, &stack) != 0) {
+        return NULL;
+    }
+
+    // 优先使用最近释放的槽位，其上的协程对象直接复用
+    uint32_t index = 0;
+    if (S->co_free_slot >= 0) {
+        index = S->co_free_slot;
+        S->co_free_slot = S->co_slots[index].next_free;
+    } else {
+        index = S->co_slots.size();
+        co_slot_t new_slot = { NULL, 0, -1 };
+        S->co_slots.push_back(new_slot);
+    }
+    co_slot_t& slot = S->co_slots[index];
+    if (slot.co) {
         S->co_free_num--;
+    } else {
+        slot.co = new coroutine;
     }
+    slot.gen = (slot.gen + 1) & CO_GEN_MASK;
+    slot.next_free = -1;
+    *id = (static_cast<int64_t>(slot.gen) << 32) | index;
 
-    co->std_func = std_func;
-    co->func = NULL;
-    co->ud = NULL;
+    struct coroutine * co = slot.co;
+    co->stack = stack;
+    if (!S->share_stacks.empty()) {
+        co->share_index = S->share_next;
+        S->share_next = (S->share_next + 1) % S->share_stacks.size();
+    }
+    co->save_len = 0;
     co->sch = S;
     co->status = COROUTINE_READY;
 
@@ -210,41 +474,93 @@ _co_new(struct schedule *S, std::tr1::function<void()>& std_func) {
 }
 
 struct coroutine *
-_co_new(struct schedule *S, coroutine_func func, void *ud) {
+_co_new(struct schedule *S, std::tr1::function<void()>& std_func, int64_t* id) {
     if (NULL == S) {
         assert(0);
         return NULL;
     }
 
-    struct coroutine * co = NULL;
+    struct coroutine * co = _co_alloc(S, id);
+    if (NULL == co) {
+        return NULL;
+    }
+    co->std_func = std_func;
+    co->func = NULL;
+    co->ud = NULL;
 
-    if (S->co_free_list.empty()) {
-        co = new coroutine;
-        co->stack = new char[S->stack_size];
-    } else {
-        co = S->co_free_list.front();
-        S->co_free_list.pop_front();
+    return co;
+}
 
-        S->co_free_num--;
+struct coroutine *
+_co_new(struct schedule *S, coroutine_func func, void *ud, int64_t* id) {
+    if (NULL == S) {
+        assert(0);
+        return NULL;
+    }
+
+    struct coroutine * co = _co_alloc(S, id);
+    if (NULL == co) {
+        return NULL;
     }
     co->func = func;
     co->ud = ud;
-    co->sch = S;
-    co->status = COROUTINE_READY;
 
     return co;
 }
 
 void _co_delete(struct coroutine *co) {
-    delete [] co->stack;
+    co_stack_free(co->sch, &co->stack);
+    free(co->save_buff);
     delete co;
 }
 
+/// @brief 返回协程运行时使用的栈
+static inline char* co_stack_ptr(struct schedule *S, struct coroutine *co) {
+    return co->share_index < 0 ? co->stack.ptr : S->share_stacks[co->share_index].ptr;
+}
+
+#ifdef PEBBLE_CO_ASM_CONTEXT
+/// @brief 把挂起协程在共享栈上实际使用的部分(切出时的栈顶到栈底)保存到堆内存
+static void co_share_stack_save(struct schedule *S, struct coroutine *co) {
+    char* top = S->share_stacks[co->share_index].ptr + S->stack_size;
+    uint32_t len = top - static_cast<char*>(co->ctx.sp);
+    // 按实际使用大小分配，缓冲区过大时也重新分配，避免大量挂起协程占用过多内存
+    if (len > co->save_cap || len < co->save_cap / 4) {
+        free(co->save_buff);
+        co->save_cap = (len + 63) & ~63u;
+        co->save_buff = static_cast<char*>(malloc(co->save_cap));
+    }
+    memcpy(co->save_buff, co->ctx.sp, len);
+    co->save_len = len;
+}
+
+/// @brief 切换到协程前，把运行栈上的其它协程换出，并恢复此协程保存的栈内容
+static void co_share_stack_acquire(struct schedule *S, struct coroutine *co) {
+    coroutine*& owner = S->share_owners[co->share_index];
+    if (owner == co) {
+        return;
+    }
+    if (owner != NULL) {
+        co_share_stack_save(S, owner);
+    }
+    if (co->save_len > 0) {
+        char* top = S->share_stacks[co->share_index].ptr + S->stack_size;
+        memcpy(top - co->save_len, co->save_buff, co->save_len);
+        co->save_len = 0;
+    }
+    owner = co;
+}
+#else
+static void co_share_stack_acquire(struct schedule *S, struct coroutine *co) {
+}
+#endif
+
 struct schedule *
-coroutine_open(uint32_t stack_size) {
+coroutine_open(uint32_t stack_size, uint32_t share_stack_num) {
     if (0 == stack_size) {
         stack_size = 256 * 1024;
     }
+    stack_size = (stack_size + GetPageSize() - 1) & ~(GetPageSize() - 1);
     pid_t pid = GetPid();
     stCoRoutineEnv_t *env = g_arrCoEnvPerThread[pid];
     if (env) {
@@ -258,10 +574,32 @@ coroutine_open(uint32_t stack_size) {
     PLOG_INFO("init pid %ld env %p\n", (long)pid, env);
 
     struct schedule *S = new schedule;
-    S->nco = 0;
     S->running = -1;
+    S->co_free_slot = -1;
     S->co_free_num = 0;
     S->stack_size = stack_size;
+    S->dead_stack.ptr = NULL;
+    S->dead_stack.guarded = false;
+    S->share_next = 0;
+
+#ifndef PEBBLE_CO_ASM_CONTEXT
+    if (share_stack_num > 0) {
+        PLOG_ERROR("share stack mode need asm context switch, use independent stack mode");
+        share_stack_num = 0;
+    }
+#endif
+    for (uint32_t i = 0; i < share_stack_num; ++i) {
+        co_stack_t stack;
+        if (co_stack_alloc(S, &stack) != 0) {
+            break;
+        }
+        S->share_stacks.push_back(stack);
+        S->share_owners.push_back(NULL);
+    }
+    if (S->share_stacks.size() < share_stack_num) {
+        PLOG_ERROR("alloc share stack failed, use %u share stacks",
+            static_cast<uint32_t>(S->share_stacks.size()));
+    }
 
     env->co_schedule = S;
 
@@ -287,16 +625,20 @@ void coroutine_close(struct schedule *S) {
     FreeEpoll(env->pEpoll);
 
     // 遍历所有的协程，逐个释放
-    cxx::unordered_map<int64_t, coroutine*>::iterator pos = S->co_hash_map.begin();
-    for (; pos != S->co_hash_map.end(); pos++) {
-        if (pos->second) {
-            _co_delete(pos->second);
+    std::vector<co_slot_t>::iterator pos = S->co_slots.begin();
+    for (; pos != S->co_slots.end(); pos++) {
+        if (pos->co) {
+            _co_delete(pos->co);
         }
     }
 
-    std::list<coroutine*>::iterator p = S->co_free_list.begin();
-    for (; p != S->co_free_list.end(); p++) {
-        _co_delete(*p);
+    for (std::vector<co_stack_t>::iterator it = S->stack_pool.begin(); it != S->stack_pool.end(); ++it) {
+        co_stack_free(S, &(*it));
+    }
+    co_stack_free(S, &S->dead_stack);
+
+    for (std::vector<co_stack_t>::iterator it = S->share_stacks.begin(); it != S->share_stacks.end(); ++it) {
+        co_stack_free(S, &(*it));
     }
 
     // 释放掉整个调度器
@@ -312,10 +654,11 @@ int64_t coroutine_new(struct schedule *S, std::tr1::function<void()>& std_func)
     if (NULL == S) {
         return -1;
     }
-    struct coroutine *co = _co_new(S, std_func);
-    int64_t id = S->nco;
-    S->co_hash_map[id] = co;
-    S->nco++;
+    int64_t id = -1;
+    struct coroutine *co = _co_new(S, std_func, &id);
+    if (NULL == co) {
+        return -1;
+    }
 
     PLOG_TRACE("coroutine %ld is created.", id);
     return id;
@@ -325,41 +668,64 @@ int64_t coroutine_new(struct schedule *S, coroutine_func func, void *ud) {
     if (NULL == S || NULL == func) {
         return -1;
     }
-    struct coroutine *co = _co_new(S, func, ud);
-    int64_t id = S->nco;
-    S->co_hash_map[id] = co;
-    S->nco++;
+    int64_t id = -1;
+    struct coroutine *co = _co_new(S, func, ud, &id);
+    if (NULL == co) {
+        return -1;
+    }
 
     PLOG_TRACE("coroutine %ld is created.", id);
     return id;
 }
 
-static void mainfunc(uint32_t low32, uint32_t hi32) {
-    uintptr_t ptr = (uintptr_t) low32 | ((uintptr_t) hi32 << 32);
-    struct schedule *S = (struct schedule *) ptr;
+static void co_run(struct schedule *S) {
     int64_t id = S->running;
-    struct coroutine *C = S->co_hash_map[id];
+    struct coroutine *C = co_find(S, id);
     if (C->func != NULL) {
         C->func(S, C->ud);
     } else {
         C->std_func();
     }
-    S->co_free_list.push_back(C);
-    S->co_free_num++;
-
-    if (S->co_free_num > MAX_FREE_CO_NUM) {
-        coroutine* co = S->co_free_list.front();
-        _co_delete(co);
-
-        S->co_free_list.pop_front();
-        S->co_free_num--;
+    if (C->share_index < 0) {
+        co_stack_release(S, &C->stack);
+    } else {
+        S->share_owners[C->share_index] = NULL;
+        C->share_index = -1;
+    }
+
+    // 释放槽位，代数加1使旧ID失效；缓存的协程对象过多时释放此对象，此后不能再访问C
+    uint32_t index = static_cast<uint32_t>(id);
+    co_slot_t& slot = S->co_slots[index];
+    slot.gen = (slot.gen + 1) & CO_GEN_MASK;
+    slot.next_free = S->co_free_slot;
+    S->co_free_slot = index;
+    if (S->co_free_num < MAX_FREE_CO_NUM) {
+        S->co_free_num++;
+    } else {
+        _co_delete(C);
+        slot.co = NULL;
     }
 
-    S->co_hash_map.erase(id);
     S->running = -1;
     PLOG_TRACE("coroutine %ld is deleted.", id);
 }
 
+#ifdef PEBBLE_CO_ASM_CONTEXT
+static void mainfunc(void* arg) {
+    struct schedule *S = static_cast<struct schedule*>(arg);
+    coctx_t dead_ctx;
+    co_run(S);
+    // 协程已结束，切回主流程后不会再切换回来
+    coctx_swap(&dead_ctx, &S->main);
+}
+#else
+static void mainfunc(uint32_t low32, uint32_t hi32) {
+    uintptr_t ptr = (uintptr_t) low32 | ((uintptr_t) hi32 << 32);
+    co_run((struct schedule *) ptr);
+    // 返回后由uc_link切回主流程
+}
+#endif
+
 int32_t coroutine_resume(struct schedule * S, int64_t id, int32_t result) {
     if (NULL == S) {
         return kCO_INVALID_PARAM;
@@ -367,17 +733,10 @@ int32_t coroutine_resume(struct schedule * S, int64_t id, int32_t result) {
     if (S->running != -1) {
         return kCO_CANNOT_RESUME_IN_COROUTINE;
     }
-    cxx::unordered_map<int64_t, coroutine*>::iterator pos = S->co_hash_map.find(id);
-
-    // 如果在协程哈希表中没有找到，或者找到的协程内容为空
-    if (pos == S->co_hash_map.end()) {
-        PLOG_ERROR("coroutine %ld can't find in co_map", id);
-        return kCO_COROUTINE_UNEXIST;
-    }
-
-    struct coroutine *C = pos->second;
+    // 槽位下标越界或代数不符时协程已不存在
+    struct coroutine *C = co_find(S, id);
     if (NULL == C) {
-        PLOG_ERROR("coroutine %ld instance is NULL", id);
+        PLOG_ERROR("coroutine %ld can't find in co_slots", id);
         return kCO_COROUTINE_UNEXIST;
     }
 
@@ -387,19 +746,14 @@ int32_t coroutine_resume(struct schedule * S, int64_t id, int32_t result) {
         case COROUTINE_READY: {
             PLOG_TRACE("coroutine %ld status is COROUTINE_READY, begin to execute...", id);
 
-            getcontext(&C->ctx);
-            C->ctx.uc_stack.ss_sp = C->stack;
-            C->ctx.uc_stack.ss_size = S->stack_size;
-            C->ctx.uc_stack.ss_flags = 0;
-            C->ctx.uc_link = &S->main;
+            if (C->share_index >= 0) {
+                co_share_stack_acquire(S, C);
+            }
+            coctx_make(&C->ctx, co_stack_ptr(S, C), S->stack_size, mainfunc, S);
             S->running = id;
             C->status = COROUTINE_RUNNING;
-            uintptr_t ptr = (uintptr_t) S;
-            makecontext(&C->ctx, (void (*)(void)) mainfunc, 2,
-            (uint32_t)ptr,  // NOLINT
-            (uint32_t)(ptr>>32));  // NOLINT
 
-            swapcontext(&S->main, &C->ctx);
+            coctx_swap(&S->main, &C->ctx);
 
             break;
         }
@@ -407,9 +761,12 @@ int32_t coroutine_resume(struct schedule * S, int64_t id, int32_t result) {
             PLOG_TRACE("coroutine %ld status is COROUTINE_SUSPEND,"
                     "begin to resume...", id);
 
+            if (C->share_index >= 0) {
+                co_share_stack_acquire(S, C);
+            }
             S->running = id;
             C->status = COROUTINE_RUNNING;
-            swapcontext(&S->main, &C->ctx);
+            coctx_swap(&S->main, &C->ctx);
 
             break;
         }
@@ -434,7 +791,7 @@ int32_t coroutine_yield(struct schedule * S) {
     }
 
     assert(id >= 0);
-    struct coroutine * C = S->co_hash_map[id];
+    struct coroutine * C = co_find(S, id);
 
     if (C->status != COROUTINE_RUNNING) {
         PLOG_ERROR("coroutine %ld status is SUSPEND, can't yield again.", id);
@@ -445,31 +802,23 @@ int32_t coroutine_yield(struct schedule * S) {
     S->running = -1;
 
     PLOG_TRACE("coroutine %ld will be yield, swith to main loop...", id);
-    swapcontext(&C->ctx, &S->main);
+    coctx_swap(&C->ctx, &S->main);
 
     return C->result;
 }
 
 int coroutine_status(struct schedule * S, int64_t id) {
-    // assert(id >= 0 && id <= S->nco);
     if (NULL == S) {
         return COROUTINE_DEAD;
     }
 
-    if (id < 0 || id > S->nco) {
-        PLOG_DEBUG("coroutine %ld not exist", id);
-        return COROUTINE_DEAD;
-    }
-
-    cxx::unordered_map<int64_t, coroutine*>::iterator pos = S->co_hash_map.find(id);
-
-    // 如果在协程哈希表中没有找到，或者找到的协程内容为空
-    if (pos == S->co_hash_map.end()) {
+    struct coroutine *C = co_find(S, id);
+    if (NULL == C) {
         PLOG_DEBUG("cann't find coroutine %ld", id);
         return COROUTINE_DEAD;
     }
 
-    return (pos->second)->status;
+    return C->status;
 }
 
 int64_t coroutine_running(struct schedule * S) {
@@ -485,15 +834,13 @@ coroutine* get_curr_coroutine(struct schedule * S) {
         return NULL;
     }
 
-    cxx::unordered_map<int64_t, coroutine*>::iterator pos = S->co_hash_map.find(S->running);
-
-    // 如果在协程哈希表中没有找到，或者找到的协程内容为空
-    if (pos == S->co_hash_map.end()) {
-        PLOG_FATAL("coroutine %ld can't find in co_map", S->running);
+    struct coroutine *C = co_find(S, S->running);
+    if (NULL == C) {
+        PLOG_FATAL("coroutine %ld can't find in co_slots", S->running);
         return NULL;
     }
 
-    return pos->second;
+    return C;
 }
 
 
@@ -558,9 +905,9 @@ CoroutineSchedule::~CoroutineSchedule() {
         Close();
 }
 
-int CoroutineSchedule::Init(Timer* timer, uint32_t stack_size) {
+int CoroutineSchedule::Init(Timer* timer, uint32_t stack_size, uint32_t share_stack_num) {
     timer_ = timer;
-    schedule_ = coroutine_open(stack_size);
+    schedule_ = coroutine_open(stack_size, share_stack_num);
     if (schedule_ == NULL)
         return -1;
     return 0;
@@ -944,17 +1291,17 @@ void OnPollPreparePfn(stTimeoutItem_t * ap,
     }
 }
 
-void co_update()
+int co_update(int timeout_ms)
 {
     stCoEpoll_t* ctx = co_get_epoll_ct();
     if (!ctx) {
-        return;
+        return 0;
     }
     if (!ctx->result) {
         ctx->result = co_epoll_res_alloc(stCoEpoll_t::_EPOLL_SIZE);
     }
     co_epoll_res *result = ctx->result;
-    int ret = epoll_wait(ctx->iEpollFd, result->events, stCoEpoll_t::_EPOLL_SIZE, 1);
+    int ret = epoll_wait(ctx->iEpollFd, result->events, stCoEpoll_t::_EPOLL_SIZE, timeout_ms);
 
     stTimeoutItemLink_t *active = (ctx->pstActiveList);
     stTimeoutItemLink_t *timeout = (ctx->pstTimeoutList);
@@ -983,16 +1330,67 @@ void co_update()
 
     Join<stTimeoutItem_t, stTimeoutItemLink_t>(active, timeout);
 
+    int num = 0;
     lp = active->head;
     while (lp) {
 
         PopHead<stTimeoutItem_t, stTimeoutItemLink_t>(active);
         if (lp->pfnProcess) {
             lp->pfnProcess(lp);
+            num++;
         }
 
         lp = active->head;
     }
+    return num;
+}
+
+int co_get_epoll_fd(stCoEpoll_t *ctx)
+{
+    return ctx ? ctx->iEpollFd : -1;
+}
+
+int co_get_next_timeout(stCoEpoll_t *ctx, int max_ms)
+{
+    if (!ctx) {
+        return -1;
+    }
+
+    stTimeout_t *apTimeout = ctx->pTimeout;
+    unsigned long long now = GetTickMS();
+    if (now < apTimeout->ullStart) {
+        now = apTimeout->ullStart;
+    }
+
+    // 与TakeAllTimeout一样把起点推进到当前时间，只是遇到非空的槽就停下，已检查过的空槽不再重复检查
+    if (now - apTimeout->ullStart >= static_cast<unsigned long long>(apTimeout->iItemSize)) {
+        int i = 0;
+        for (; i < apTimeout->iItemSize; i++) {
+            if (apTimeout->pItems[(apTimeout->llStartIdx + i) % apTimeout->iItemSize].head) {
+                break;
+            }
+        }
+        if (i == apTimeout->iItemSize) {
+            apTimeout->ullStart = now;
+        }
+    }
+    while (apTimeout->ullStart < now
+        && !apTimeout->pItems[apTimeout->llStartIdx % apTimeout->iItemSize].head) {
+        apTimeout->ullStart++;
+        apTimeout->llStartIdx++;
+    }
+
+    long long cnt = static_cast<long long>(now - apTimeout->ullStart) + max_ms + 1;
+    if (cnt > apTimeout->iItemSize) {
+        cnt = apTimeout->iItemSize;
+    }
+    for (long long i = 0; i < cnt; i++) {
+        if (apTimeout->pItems[(apTimeout->llStartIdx + i) % apTimeout->iItemSize].head) {
+            unsigned long long expire = apTimeout->ullStart + i;
+            return expire > now ? static_cast<int>(expire - now) : 0;
+        }
+    }
+    return -1;
 }
 void OnCoroutineEvent(stTimeoutItem_t * ap) {
     coroutine_resume(co_get_curr_thread_env()->co_schedule, ap->co_id);
@@ -1013,16 +1411,25 @@ int co_poll(stCoEpoll_t *ctx, struct pollfd fds[], nfds_t nfds, int timeout)
     }
     int epfd = ctx->iEpollFd;
 
+    // 共享栈模式下协程挂起后栈内容会被换出，挂在epoll和超时链表上、由主循环访问的
+    // poll状态及fds都要放在堆上，恢复后再把结果拷回调用者的fds
+    bool on_heap = !co_get_curr_thread_env()->co_schedule->share_stacks.empty();
+
     // 1.struct change
-    stPoll_t arg;
+    stPoll_t stack_arg;
+    stPoll_t& arg = on_heap ? *reinterpret_cast<stPoll_t*>(malloc(sizeof(stPoll_t))) : stack_arg;
     memset(&arg, 0, sizeof(arg));
 
     arg.iEpollFd = epfd;
     arg.fds = fds;
     arg.nfds = nfds;
+    if (on_heap) {
+        arg.fds = reinterpret_cast<struct pollfd*>(malloc(nfds * sizeof(struct pollfd)));
+        memcpy(arg.fds, fds, nfds * sizeof(struct pollfd));
+    }
 
     stPollItem_t arr[2];
-    if (nfds < sizeof(arr) / sizeof(arr[0])) {
+    if (!on_heap && nfds < sizeof(arr) / sizeof(arr[0])) {
         arg.pPollItems = arr;
     } else {
         arg.pPollItems = reinterpret_cast<stPollItem_t*>(malloc(nfds * sizeof(stPollItem_t)));
@@ -1039,12 +1446,19 @@ int co_poll(stCoEpoll_t *ctx, struct pollfd fds[], nfds_t nfds, int timeout)
     if (ret != 0) {
         co_log_err("CO_ERR: AddTimeout ret %d now %lld timeout %d arg.ullExpireTime %lld",
                     ret, now, timeout, arg.ullExpireTime);
+        if (arg.pPollItems != arr) {
+            free(arg.pPollItems);
+        }
+        if (on_heap) {
+            free(arg.fds);
+            free(&arg);
+        }
         errno = EINVAL;
         return -__LINE__;
     }
 
     for (nfds_t i = 0; i < nfds; i++) {
-        arg.pPollItems[i].pSelf = fds + i;
+        arg.pPollItems[i].pSelf = arg.fds + i;
         arg.pPollItems[i].pPoll = &arg;
 
         arg.pPollItems[i].pfnPrepare = OnPollPreparePfn;
@@ -1072,7 +1486,16 @@ int co_poll(stCoEpoll_t *ctx, struct pollfd fds[], nfds_t nfds, int timeout)
         free(arg.pPollItems);
         arg.pPollItems = NULL;
     }
-    return arg.iRaiseCnt;
+
+    int raise_cnt = arg.iRaiseCnt;
+    if (on_heap) {
+        for (nfds_t i = 0; i < nfds; i++) {
+            fds[i].revents = arg.fds[i].revents;
+        }
+        free(arg.fds);
+        free(&arg);
+    }
+    return raise_cnt;
 }
 
 
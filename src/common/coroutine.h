@@ -17,6 +17,7 @@
 
 #include <list>
 #include <set>
+#include <vector>
 #include <string.h>
 #include <sys/poll.h>
 #include <ucontext.h>
@@ -46,20 +47,48 @@ typedef enum {
 #define COROUTINE_SUSPEND 3
 
 #define MAX_FREE_CO_NUM     1024
+#define MAX_FREE_STACK_NUM  1024
 #define INVALID_CO_ID       -1
 
 typedef void (*coroutine_func)(struct schedule *, void *ud);
 
+// x86-64使用汇编实现的上下文切换，只保存callee-saved寄存器，不像swapcontext那样
+// 每次切换都要调用rt_sigprocmask，其它平台仍使用ucontext；定义PEBBLE_CO_USE_UCONTEXT时强制使用ucontext
+// aarch64的汇编实现还未在aarch64上编译运行验证，需定义PEBBLE_CO_AARCH64_ASM才启用
+#if !defined(PEBBLE_CO_USE_UCONTEXT) \
+    && (defined(__x86_64__) || (defined(__aarch64__) && defined(PEBBLE_CO_AARCH64_ASM)))
+#define PEBBLE_CO_ASM_CONTEXT 1
+#endif
+
+/// @brief 协程上下文
+struct coctx_t {
+#ifdef PEBBLE_CO_ASM_CONTEXT
+    void* sp;                   // 切出时的栈顶，寄存器都保存在栈上
+#else
+    ucontext_t uc;
+#endif
+};
+
+/// @brief 协程栈
+struct co_stack_t {
+    char* ptr;                  // 栈的低地址
+    bool guarded;               // 是否有保护页
+};
+
 struct coroutine {
     coroutine_func func;
     std::tr1::function<void()> std_func;
     void *ud;
-    ucontext_t ctx;
+    coctx_t ctx;
     struct schedule * sch;
     int status;
     bool enable_hook;
-    char* stack;                // 协程栈的内容
+    co_stack_t stack;           // 协程栈，运行结束后归还给调度器的栈池
     int32_t result;             // 携带resume结果
+    int32_t share_index;        // 共享栈模式下使用的运行栈下标，独立栈模式为-1
+    char* save_buff;            // 共享栈模式下切出后保存的栈内容
+    uint32_t save_len;          // 保存的栈内容长度
+    uint32_t save_cap;          // save_buff的大小
 
     coroutine() {
         func = NULL;
@@ -67,29 +96,56 @@ struct coroutine {
         sch = NULL;
         status = COROUTINE_DEAD;
         enable_hook = false;
-        stack = NULL;
+        stack.ptr = NULL;
+        stack.guarded = false;
         result = 0;
-        memset(&ctx, 0, sizeof(ucontext_t));
+        share_index = -1;
+        save_buff = NULL;
+        save_len = 0;
+        save_cap = 0;
+        memset(&ctx, 0, sizeof(ctx));
     }
 };
 
+/// @brief 协程槽位，协程ID的高32位为槽位的代数，低32位为槽位下标，
+///     查找协程只需检查下标范围和代数，槽位释放后代数改变，旧ID自然失效
+struct co_slot_t {
+    coroutine* co;              // 槽位上的协程对象，空闲槽位上可能保留对象以便复用
+    uint32_t gen;               // 代数，奇数表示使用中，分配和释放时各加1
+    int32_t next_free;          // 空闲槽位链表中的下一个下标，-1表示结束
+};
+
 /// @brief struct schedule 协程调度器的数据结构
 struct schedule {
-    ucontext_t main;
-    int64_t nco;                // 下一个要创建的协程ID
+    coctx_t main;
     int64_t running;            // 当前正在运行的协程ID
-    cxx::unordered_map<int64_t, coroutine*> co_hash_map;
-    std::list<coroutine*> co_free_list;
-    int32_t co_free_num;
-    uint32_t stack_size;
+    std::vector<co_slot_t> co_slots;    // 协程槽位表
+    int32_t co_free_slot;       // 空闲槽位链表头，-1表示没有空闲槽位
+    int32_t co_free_num;        // 空闲槽位上保留的协程对象数，最多MAX_FREE_CO_NUM个
+    uint32_t stack_size;        // 协程栈大小，按页对齐
+    std::vector<co_stack_t> stack_pool; // 回收的协程栈，最多缓存MAX_FREE_STACK_NUM个
+    co_stack_t dead_stack;      // 已结束协程仍在使用的栈，栈池满时延迟释放
+    std::vector<co_stack_t> share_stacks;   // 共享栈模式下的运行栈，为空时为独立栈模式
+    std::vector<coroutine*> share_owners;   // 各运行栈上当前的协程
+    uint32_t share_next;        // 新协程使用的运行栈下标(轮流分配)
 };
 
 
 /// @brief 协程库初始化函数
 /// @param stack_size 协程的栈大小，默认是256k
+/// @param share_stack_num 共享栈个数，默认为0使用独立栈模式，每个协程一个栈；
+///     >0时为共享栈模式，所有协程轮流分配到这些运行栈上执行，切换到同一运行栈上的其它协程时，
+///     把被换出协程实际使用的栈内容拷贝到按需分配的堆内存中，恢复执行时再拷贝回来，
+///     适合大量挂起且栈使用很少的协程，代价是切换时的拷贝；
+///     共享栈模式下协程挂起期间其栈上的变量可能已被换出，不能在其它协程或主循环的回调中访问，
+///     异步回调的结果需先存放在堆上，由协程恢复后自己取走(co_poll及zookeeper同步接口已按此处理)；
+///     需要汇编上下文切换支持(x86-64，aarch64需定义PEBBLE_CO_AARCH64_ASM)
 /// @return 返回struct schedule* 类型的指针
 /// @note 只能够在主线程调用
-struct schedule * coroutine_open(uint32_t stack_size = 256 * 1024);
+/// @note 协程栈使用mmap分配(MAP_NORESERVE，只有实际使用的页才占用物理内存)，栈底有一个不可访问的保护页，
+///     栈溢出时直接触发SIGSEGV而不是破坏堆；每个带保护页的栈占用2个内存映射区，进程内带保护页的栈数
+///     限制在vm.max_map_count的1/4以内，超出后新分配的栈不再带保护页
+struct schedule * coroutine_open(uint32_t stack_size = 256 * 1024, uint32_t share_stack_num = 0);
 
 /// @brief 协程库关闭
 /// @param 协程调度器结构体指针
@@ -141,8 +197,23 @@ struct stCoEpoll_t;
 
 coroutine* co_self();
 int co_poll(stCoEpoll_t *ctx, struct pollfd fds[], nfds_t nfds, int timeout_ms);
-void co_update();
+
+/// @brief 处理系统调用hook的fd事件和co_poll超时，唤醒等待的协程
+/// @param timeout_ms 没有事件时在hook的epoll上最长等待的时间，默认1ms，由外部事件循环等待时传0
+/// @return 本次唤醒的协程数
+int co_update(int timeout_ms = 1);
+
 stCoEpoll_t* co_get_epoll_ct();
+
+/// @brief 返回系统调用hook使用的epoll fd，可读时需要co_update，可加入外部的事件循环合并等待
+int co_get_epoll_fd(stCoEpoll_t *ctx);
+
+/// @brief 获取距离最近一个co_poll超时的毫秒数，用于外部事件循环决定阻塞等待多久
+/// @param max_ms 只检查max_ms以内的超时
+/// @return >=0 距离最近一个超时的毫秒数，0表示已有超时需要co_update
+/// @return <0 max_ms以内没有超时
+int co_get_next_timeout(stCoEpoll_t *ctx, int max_ms);
+
 void co_enable_hook_sys();
 void co_disable_hook_sys();
 bool co_is_enable_sys_hook();
@@ -228,9 +299,10 @@ public:
     /// @brief 初始化工作, new了一个新的schedule
     /// @param timer 定时器实例，使协程支持yield超时
     /// @param stack_size 协程的栈大小，默认是256k
+    /// @param share_stack_num 共享栈个数，默认为0(独立栈模式) @see coroutine_open
     /// @return = 0 成功
     /// @return = -1 失败
-    int Init(Timer* timer = NULL, uint32_t stack_size = 256 * 1024);
+    int Init(Timer* timer = NULL, uint32_t stack_size = 256 * 1024, uint32_t share_stack_num = 0);
 
     /// @brief 关闭协程系统, 释放所有资源
     /// @return 还未结束的协程数
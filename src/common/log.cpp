@@ -29,6 +29,7 @@
 
 #include "common/file_util.h"
 #include "common/log.h"
+#include "common/mutex.h"
 #include "common/string_utility.h"
 #include "common/time_utility.h"
 
@@ -45,6 +46,8 @@ static const char*  g_priority_str[] = { "TRACE", "DEBUG", "INFO", "ERROR", "FAT
 static RollUtil* g_log_file = NULL;
 static RollUtil* g_error_file = NULL;
 static LogWriteFunc g_log_write_func;
+// 多reactor线程并发写log时保护文件输出及滚动
+static Mutex g_log_mutex;
 
 // PLOG对外提供static接口，内部需要使用RollUtil对象，为避免全局对象析构顺序问题，做一层包装
 class RollUtilHolder {
@@ -172,7 +175,7 @@ void Log::Write(LOG_PRIORITY pri, const char* file, uint32_t line,
         return;
     }
 
-    static char buff[4096] = {0};
+    static __thread char buff[4096] = {0};
 
     // log前缀，接入其他log时不用组装
     int pre_len = 0;
@@ -219,6 +222,8 @@ void Log::Write(LOG_PRIORITY pri, const char* file, uint32_t line,
         return;
     }
 
+    AutoLocker locker(&g_log_mutex);
+
     // 输出到ERROR文件
     if (pri >= LOG_PRIORITY_ERROR && g_error_file != NULL) {
         FILE* error = g_error_file->GetFile();
@@ -238,6 +243,7 @@ void Log::Write(LOG_PRIORITY pri, const char* file, uint32_t line,
 
 void Log::Close()
 {
+    AutoLocker locker(&g_log_mutex);
     if (g_log_file != NULL) {
         g_log_file->Close();
     }
@@ -258,6 +264,7 @@ void Log::EnableCrashRecord()
 
 void Log::Flush()
 {
+    AutoLocker locker(&g_log_mutex);
     if (g_log_file != NULL) {
         g_log_file->Flush();
     }
@@ -244,6 +244,7 @@ int32_t Epoll::GetEvent(uint32_t *events, uint64_t *data)
 
 bool NetIO::NON_BLOCK = true;
 bool NetIO::ADDR_REUSE = true;
+bool NetIO::PORT_REUSE = false;
 bool NetIO::KEEP_ALIVE = true;
 bool NetIO::USE_NAGLE = false;
 bool NetIO::USE_LINGER = false;
@@ -345,8 +346,10 @@ NetAddr NetIO::Accept(NetAddr listen_addr)
 
     struct sockaddr_in cli_addr;
     socklen_t addr_len = sizeof(cli_addr);
-    int32_t new_socket = accept(socket_info->_socket_fd,
-        reinterpret_cast<struct sockaddr*>(&cli_addr), &addr_len);
+    // accept4ֱ÷close-on-execʡȥfcntlϵͳ
+    int32_t accept_flags = SOCK_CLOEXEC | (NetIO::NON_BLOCK ? SOCK_NONBLOCK : 0);
+    int32_t new_socket = accept4(socket_info->_socket_fd,
+        reinterpret_cast<struct sockaddr*>(&cli_addr), &addr_len, accept_flags);
     if (new_socket < 0)
     {
         if (errno == EBADF || errno == ENOTSOCK)
@@ -358,19 +361,6 @@ NetAddr NetIO::Accept(NetAddr listen_addr)
         INFO("accept none from addr[%lu]", listen_addr);
         return INVAILD_NETADDR;
     }
-    // O_NONBLOCKacceptʱ̳У
-    if (true == NetIO::NON_BLOCK)
-    {
-        int32_t flags_val = fcntl(new_socket, F_GETFL);
-        if (-1 != flags_val)
-        {
-            if (fcntl(new_socket, F_SETFL, flags_val | O_NONBLOCK) == -1) {
-                ERR("fcntl socket failed in %d", errno);
-                close(new_socket);
-                return INVAILD_NETADDR;
-            }
-        }
-    }
 
     NetAddr net_addr = AllocNetAddr();
     if (INVAILD_NETADDR == net_addr)
@@ -721,6 +711,106 @@ int32_t NetIO::RecvFrom(NetAddr local_addr, NetAddr* remote_addr, char* buff, ui
     return recv_ret;
 }
 
+int32_t NetIO::SendMMsg(NetAddr local_addr, struct mmsghdr* msgs, uint32_t msg_num)
+{
+    SocketInfo *socket_info = RawGetSocketInfo(local_addr);
+    if (NULL == socket_info || 0 == (UDP_PROTOCOL & socket_info->_state))
+    {
+        ERR("sendmmsg an invalid addr[%lu]", local_addr);
+        return -1;
+    }
+    // fdرˣ´
+    if (socket_info->_socket_fd < 0)
+    {
+        if (socket_info->_state & LISTEN_ADDR)
+        {
+            RawListen(local_addr, socket_info);
+        }
+        else if (socket_info->_state & CONNECT_ADDR)
+        {
+            RawConnect(local_addr, socket_info);
+        }
+        if (socket_info->_socket_fd < 0)
+        {
+            ERR("cannot open addr[%lu] for sendmmsg", local_addr);
+            return -1;
+        }
+    }
+
+    int32_t send_ret = 0;
+    do
+    {
+        send_ret = sendmmsg(socket_info->_socket_fd, msgs, msg_num, 0);
+    } while (send_ret < 0 && errno == EINTR);
+
+    if (send_ret >= 0)
+    {
+        return send_ret;
+    }
+    // socketҪEPOLLOUT¼ϲǷ񻺴
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+    {
+        if (m_epoll != NULL)
+        {
+            socket_info->_state |= IN_BLOCKED;
+            m_epoll->ModFd(socket_info->_socket_fd,
+                EPOLLIN | EPOLLOUT | EPOLLERR, local_addr);
+        }
+        return 0;
+    }
+    ERR("sendmmsg failed in %d, socket[%d]", errno, socket_info->_socket_fd);
+    return -1;
+}
+
+int32_t NetIO::RecvMMsg(NetAddr local_addr, struct mmsghdr* msgs, uint32_t msg_num)
+{
+    SocketInfo *socket_info = RawGetSocketInfo(local_addr);
+    if (NULL == socket_info || 0 == (UDP_PROTOCOL & socket_info->_state))
+    {
+        ERR("recvmmsg an invalid addr[%lu]", local_addr);
+        return -1;
+    }
+    // fdѾرˣ0
+    if (socket_info->_socket_fd < 0)
+    {
+        return 0;
+    }
+
+    int32_t recv_ret = 0;
+    do
+    {
+        recv_ret = recvmmsg(socket_info->_socket_fd, msgs, msg_num, MSG_DONTWAIT, NULL);
+    } while (recv_ret < 0 && errno == EINTR);
+
+    if (recv_ret >= 0)
+    {
+        return recv_ret;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+    {
+        return 0;
+    }
+    // ȡʱرգ´ʹʱ´򿪣ͬRecvFrom
+    ERR("recvmmsg failed in %d, close the socket[%d]", errno, socket_info->_socket_fd);
+    RawClose(socket_info);
+    return -1;
+}
+
+void NetIO::ToSockAddr(NetAddr remote_addr, struct sockaddr_in* sock_addr)
+{
+    memset(sock_addr, 0, sizeof(*sock_addr));
+    sock_addr->sin_family = AF_INET;
+    sock_addr->sin_addr.s_addr = static_cast<uint32_t>(remote_addr >> 32);
+    sock_addr->sin_port = static_cast<uint16_t>(remote_addr & 0xFFFF);
+}
+
+NetAddr NetIO::FromSockAddr(const struct sockaddr_in& sock_addr)
+{
+    NetAddr remote_addr = (static_cast<uint64_t>(sock_addr.sin_addr.s_addr) << 32);
+    remote_addr |= sock_addr.sin_port;
+    return remote_addr;
+}
+
 int32_t NetIO::Close(NetAddr dst_addr)
 {
     SocketInfo* socket_info = RawGetSocketInfo(dst_addr);
@@ -910,6 +1000,9 @@ int32_t NetIO::RawListen(NetAddr net_addr, SocketInfo* socket_info)
     // õַãϵͳĬΪfalse
     ret = ((ret < 0 || false == NetIO::ADDR_REUSE)
         ? ret : setsockopt(s_fd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(flags)));
+    // ö˿ڸã߳/̸Լͬһ˿ڣں˷ַӣϵͳĬΪfalse
+    ret = ((ret < 0 || false == NetIO::PORT_REUSE)
+        ? ret : setsockopt(s_fd, SOL_SOCKET, SO_REUSEPORT, &flags, sizeof(flags)));
     // ӶʱϵͳĬΪtrue
     ret = ((ret < 0 || false == NetIO::KEEP_ALIVE || 0 == (TCP_PROTOCOL & socket_info->_state))
         ? ret : setsockopt(s_fd, SOL_SOCKET, SO_KEEPALIVE, &flags, sizeof(flags)));
@@ -19,6 +19,9 @@
 #include <string>
 #include <sys/epoll.h>
 
+struct mmsghdr;
+struct sockaddr_in;
+
 namespace pebble {
 
 int GetIpByIf(const char* if_name, std::string* ip);
@@ -98,6 +101,11 @@ public:
         return m_last_error;
     }
 
+    /// @brief epoll fdٹҵ¼ѭ(io_uring)ϵȴ
+    int32_t GetFd() const {
+        return m_epoll_fd;
+    }
+
 private:
     char    m_last_error[256];
     int32_t m_epoll_fd;
@@ -154,6 +162,20 @@ public:
     /// @note only for udp listen
     int32_t RecvFrom(NetAddr local_addr, NetAddr* remote_addr, char* buff, uint32_t buff_len);
 
+    /// @brief udp(sendmmsg)listenַɵдÿĵmsg_name
+    /// @return >=0 ͳɹısocketʱmsg_num
+    /// @return -1 ʧܣerrno
+    int32_t SendMMsg(NetAddr local_addr, struct mmsghdr* msgs, uint32_t msg_num);
+
+    /// @brief udp(recvmmsg)listenַԶ˵ַдÿĵmsg_name
+    /// @return >=0 յıʱΪ0
+    /// @return -1 ʧܣerrno
+    int32_t RecvMMsg(NetAddr local_addr, struct mmsghdr* msgs, uint32_t msg_num);
+
+    /// @brief ԶNetAddr(ip << 32 | port)sockaddr_inתͬRecvFrom/SendToĵַʽ
+    static void ToSockAddr(NetAddr remote_addr, struct sockaddr_in* sock_addr);
+    static NetAddr FromSockAddr(const struct sockaddr_in& sock_addr);
+
     /// @brief ر
     /// @return -1 رպ󷵻ش󣬴ԭerrno
     /// @return 0  ӹر
@@ -184,6 +206,7 @@ public:
     // 
     static bool NON_BLOCK;              ///< NON_BLOCK ǷΪдĬΪtrue
     static bool ADDR_REUSE;             ///< ADDR_REUSE Ƿ򿪵ַãĬΪtrue
+    static bool PORT_REUSE;             ///< PORT_REUSE Ƿ򿪶˿ڸ(SO_REUSEPORT)ĬΪfalse
     static bool KEEP_ALIVE;             ///< KEEP_ALIVE ǷӶʱԼ⣬ĬΪtrue
     static bool USE_NAGLE;              ///< USE_NAGLE Ƿʹnagle㷨ϲСĬΪfalse
     static bool USE_LINGER;             ///< USE_LINGER ǷʹlingerʱرӣĬΪfalse
@@ -22,6 +22,26 @@
 
 namespace pebble {
 
+#ifndef CLOCK_MONOTONIC_COARSE
+#define CLOCK_MONOTONIC_COARSE 6
+#endif
+
+static bool s_precise_monotonic = false;
+static clockid_t s_coarse_clock_id = CLOCK_MONOTONIC_COARSE;
+
+// 每个事件循环线程独立缓存，0表示当前线程未启用缓存
+static __thread int64_t s_cached_monotonic_us = 0;
+
+static int64_t ReadMonotonicUS(clockid_t clock_id) {
+    struct timespec ts;
+    if (clock_gettime(clock_id, &ts) != 0) {
+        // 2.6.32以下内核不支持COARSE时钟，退化为CLOCK_MONOTONIC
+        s_coarse_clock_id = CLOCK_MONOTONIC;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+    }
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 int64_t TimeUtility::GetCurrentMS() {
     int64_t timestamp = GetCurrentUS();
     return timestamp / 1000;
@@ -35,6 +55,26 @@ int64_t TimeUtility::GetCurrentUS() {
     return timestamp;
 }
 
+int64_t TimeUtility::GetMonotonicMS() {
+    return GetMonotonicUS() / 1000;
+}
+
+int64_t TimeUtility::GetMonotonicUS() {
+    if (s_precise_monotonic || 0 == s_cached_monotonic_us) {
+        return ReadMonotonicUS(CLOCK_MONOTONIC);
+    }
+    return s_cached_monotonic_us;
+}
+
+int64_t TimeUtility::UpdateMonotonicTime() {
+    s_cached_monotonic_us = ReadMonotonicUS(s_precise_monotonic ? CLOCK_MONOTONIC : s_coarse_clock_id);
+    return s_cached_monotonic_us / 1000;
+}
+
+void TimeUtility::SetPreciseMonotonic(bool precise) {
+    s_precise_monotonic = precise;
+}
+
 std::string TimeUtility::GetStringTime()
 {
     time_t now = time(NULL);
@@ -57,11 +97,12 @@ std::string TimeUtility::GetStringTime()
 }
 
 const char* TimeUtility::GetStringTimeDetail() {
-    static char buff[64] = {0};
-    static struct timeval tv_now;
-    static time_t now;
-    static struct tm tm_now;
-    static struct tm* p_tm_now;
+    // 多reactor线程会并发打log，返回的buff按线程独立
+    static __thread char buff[64] = {0};
+    struct timeval tv_now;
+    time_t now;
+    struct tm tm_now;
+    struct tm* p_tm_now;
 
     gettimeofday(&tv_now, NULL);
     now = (time_t)tv_now.tv_sec;
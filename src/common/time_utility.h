@@ -29,6 +29,20 @@ public:
     // 得到当前的微妙
     static int64_t GetCurrentUS();
 
+    // 得到单调时钟的毫秒，不受系统时间调整影响，用于定时器、超时和耗时计算
+    // 非精确模式下，调用过UpdateMonotonicTime的线程返回本轮事件循环缓存的时间
+    static int64_t GetMonotonicMS();
+
+    // 得到单调时钟的微妙，同GetMonotonicMS
+    static int64_t GetMonotonicUS();
+
+    // 刷新当前线程缓存的单调时钟，由事件循环每轮调用一次，返回刷新后的毫秒
+    // 非精确模式下读取CLOCK_MONOTONIC_COARSE，开销远小于gettimeofday，精度为内核tick(1~4ms)
+    static int64_t UpdateMonotonicTime();
+
+    // 设置精确模式，精确模式下每次GetMonotonicMS/US都读取CLOCK_MONOTONIC，默认关闭
+    static void SetPreciseMonotonic(bool precise);
+
     // 得到字符串形式的时间 格式：2015-04-10 10:11:12
     static std::string GetStringTime();
 
@@ -211,7 +211,7 @@ int64_t SequenceTimer::StartTimer(uint32_t timeout_ms, const TimeoutCallback& cb
     cxx::shared_ptr<TimerItem> item(new TimerItem);
     item->stoped   = false;
     item->id       = m_timer_seqid;
-    item->timeout  = TimeUtility::GetCurrentMS() + timeout_ms;
+    item->timeout  = TimeUtility::GetMonotonicMS() + timeout_ms;
     item->cb       = cb;
 
     m_timers[timeout_ms].push_back(item);
@@ -236,7 +236,7 @@ int32_t SequenceTimer::StopTimer(int64_t timer_id) {
 
 int32_t SequenceTimer::Update() {
     int32_t num = 0;
-    int64_t now = TimeUtility::GetCurrentMS();
+    int64_t now = TimeUtility::GetMonotonicMS();
     int32_t ret = 0;
     uint32_t old_timeout = 0;
     uint32_t timer_map_size = m_timers.size();
@@ -292,5 +292,255 @@ int32_t SequenceTimer::Update() {
     return num;
 }
 
-}  // namespace pebble
+int64_t SequenceTimer::GetNextTimeout() {
+    int64_t next = -1;
+
+    cxx::unordered_map<uint32_t, std::list<cxx::shared_ptr<TimerItem> > >::iterator mit =
+        m_timers.begin();
+    for (; mit != m_timers.end(); ++mit) {
+        // 每个队列按超时时间有序，只需看第一个未停止的
+        std::list<cxx::shared_ptr<TimerItem> >& timer_list = mit->second;
+        while (!timer_list.empty() && timer_list.front()->stoped) {
+            timer_list.pop_front();
+        }
+        if (!timer_list.empty() && (next < 0 || timer_list.front()->timeout < next)) {
+            next = timer_list.front()->timeout;
+        }
+    }
+
+    if (next < 0) {
+        return -1;
+    }
+
+    int64_t now = TimeUtility::GetMonotonicMS();
+    return next > now ? next - now : 0;
+}
+
+TimingWheelTimer::TimingWheelTimer() {
+    m_next_tick      = TimeUtility::GetMonotonicMS();
+    m_timer_num      = 0;
+    m_free_node      = NULL;
+    m_running        = NULL;
+    m_running_stoped = false;
+    m_last_error[0]  = 0;
+
+    for (uint32_t i = 0; i < TVR_SIZE; i++) {
+        ListInit(&m_tvr[i]);
+    }
+    for (uint32_t level = 0; level < TVN_NUM; level++) {
+        for (uint32_t i = 0; i < TVN_SIZE; i++) {
+            ListInit(&m_tvn[level][i]);
+        }
+    }
+}
+
+TimingWheelTimer::~TimingWheelTimer() {
+    for (std::vector<TimerNode*>::iterator it = m_node_blocks.begin();
+        it != m_node_blocks.end(); ++it) {
+        delete [] *it;
+    }
+    m_node_blocks.clear();
+}
+
+TimingWheelTimer::TimerNode* TimingWheelTimer::AllocNode() {
+    if (!m_free_node) {
+        uint32_t base = m_node_blocks.size() << NODE_BLOCK_BITS;
+        TimerNode* block = new TimerNode[NODE_BLOCK_SIZE];
+        m_node_blocks.push_back(block);
+
+        for (uint32_t i = NODE_BLOCK_SIZE; i > 0; i--) {
+            TimerNode* node = &block[i - 1];
+            node->index  = base + i - 1;
+            node->gen    = 0;
+            node->in_use = false;
+            node->prev   = NULL;
+            node->next   = m_free_node;
+            m_free_node  = node;
+        }
+    }
+
+    TimerNode* node = m_free_node;
+    m_free_node  = static_cast<TimerNode*>(node->next);
+    node->next   = NULL;
+    node->in_use = true;
+    ++m_timer_num;
+    return node;
+}
+
+void TimingWheelTimer::FreeNode(TimerNode* node) {
+    // 立即释放回调中绑定的资源，节点本身留在池中复用
+    node->cb     = TimeoutCallback();
+    node->in_use = false;
+    node->gen    = (node->gen + 1) & 0x7FFFFFFF;
+    node->prev   = NULL;
+    node->next   = m_free_node;
+    m_free_node  = node;
+    --m_timer_num;
+}
+
+TimingWheelTimer::TimerNode* TimingWheelTimer::FindNode(int64_t timer_id) {
+    if (timer_id < 0) {
+        return NULL;
+    }
+
+    uint32_t index = static_cast<uint32_t>(timer_id & 0xFFFFFFFF);
+    uint32_t gen   = static_cast<uint32_t>(timer_id >> 32);
+    uint32_t block = index >> NODE_BLOCK_BITS;
+    if (block >= m_node_blocks.size()) {
+        return NULL;
+    }
+
+    TimerNode* node = &m_node_blocks[block][index & (NODE_BLOCK_SIZE - 1)];
+    if (!node->in_use || node->gen != gen) {
+        return NULL;
+    }
+    return node;
+}
+
+void TimingWheelTimer::AddNode(TimerNode* node) {
+    int64_t expire = node->expire;
+    int64_t delta  = expire - m_next_tick;
+    TimerLink* head = NULL;
+
+    if (delta < 0) {
+        // 已经过期，放到下一个处理的槽
+        head = &m_tvr[m_next_tick & TVR_MASK];
+    } else if (delta < TVR_SIZE) {
+        head = &m_tvr[expire & TVR_MASK];
+    } else {
+        for (uint32_t level = 0; level < TVN_NUM; level++) {
+            uint32_t shift = TVR_BITS + (level + 1) * TVN_BITS;
+            if (delta >= (1LL << shift) && level + 1 < TVN_NUM) {
+                continue;
+            }
+            if (delta >= (1LL << shift)) {
+                // 超出最高层范围，先放在最远的槽，级联时再按真实到期时间重新分配
+                expire = m_next_tick + (1LL << shift) - 1;
+            }
+            head = &m_tvn[level][(expire >> (shift - TVN_BITS)) & TVN_MASK];
+            break;
+        }
+    }
+
+    ListAdd(head, node);
+}
+
+uint32_t TimingWheelTimer::Cascade(uint32_t level, uint32_t idx) {
+    TimerLink list;
+    ListMove(&m_tvn[level - 1][idx], &list);
+
+    while (list.next != &list) {
+        TimerNode* node = static_cast<TimerNode*>(list.next);
+        ListDel(node);
+        AddNode(node);
+    }
+
+    return idx;
+}
+
+int64_t TimingWheelTimer::StartTimer(uint32_t timeout_ms, const TimeoutCallback& cb) {
+    if (!cb || 0 == timeout_ms) {
+        _LOG_LAST_ERROR("param is invalid: timeout_ms = %u, cb = %d", timeout_ms, (cb ? true : false));
+        return kTIMER_INVALID_PARAM;
+    }
+
+    TimerNode* node = AllocNode();
+    node->timeout = timeout_ms;
+    node->expire  = TimeUtility::GetMonotonicMS() + timeout_ms;
+    node->cb      = cb;
+    AddNode(node);
+
+    return (static_cast<int64_t>(node->gen) << 32) | node->index;
+}
+
+int32_t TimingWheelTimer::StopTimer(int64_t timer_id) {
+    TimerNode* node = FindNode(timer_id);
+    if (!node || (node == m_running && m_running_stoped)) {
+        _LOG_LAST_ERROR("timer id %ld not exist", timer_id);
+        return kTIMER_UNEXISTED;
+    }
+
+    if (node == m_running) {
+        // 在自己的回调中停止，回调返回后再释放
+        m_running_stoped = true;
+        return 0;
+    }
+
+    ListDel(node);
+    FreeNode(node);
+
+    return 0;
+}
+
+int32_t TimingWheelTimer::Update() {
+    int64_t now = TimeUtility::GetMonotonicMS();
+    int32_t num = 0;
+    int32_t ret = 0;
+
+    while (m_next_tick <= now) {
+        if (0 == m_timer_num) {
+            // 没有定时器时直接跳过空转的时间
+            m_next_tick = now + 1;
+            break;
+        }
+
+        uint32_t idx = m_next_tick & TVR_MASK;
+        if (0 == idx) {
+            for (uint32_t level = 1; level <= TVN_NUM; level++) {
+                uint32_t shift = TVR_BITS + (level - 1) * TVN_BITS;
+                if (Cascade(level, (m_next_tick >> shift) & TVN_MASK) != 0) {
+                    break;
+                }
+            }
+        }
+
+        TimerLink expired;
+        ListMove(&m_tvr[idx], &expired);
+        ++m_next_tick;
+
+        while (expired.next != &expired) {
+            TimerNode* node = static_cast<TimerNode*>(expired.next);
+            ListDel(node);
+
+            m_running        = node;
+            m_running_stoped = false;
+            ret = node->cb();
+            m_running        = NULL;
+            ++num;
 
+            // 返回 <0 删除定时器，=0 继续，>0按新的超时时间重启定时器
+            if (ret < 0 || m_running_stoped) {
+                FreeNode(node);
+                continue;
+            }
+            if (ret > 0) {
+                node->timeout = ret;
+            }
+            node->expire = now + node->timeout;
+            AddNode(node);
+        }
+    }
+
+    return num;
+}
+
+int64_t TimingWheelTimer::GetNextTimeout() {
+    if (0 == m_timer_num) {
+        return -1;
+    }
+
+    // 低层槽中的定时器到期时间与槽一一对应，高层的定时器最早在下一次级联(低8位回0)时到期
+    int64_t tick = m_next_tick;
+    do {
+        TimerLink* head = &m_tvr[tick & TVR_MASK];
+        if (head->next != head) {
+            break;
+        }
+        ++tick;
+    } while (tick & TVR_MASK);
+
+    int64_t now = TimeUtility::GetMonotonicMS();
+    return tick > now ? tick - now : 0;
+}
+
+}  // namespace pebble
@@ -15,6 +15,7 @@
 #define _PEBBLE_COMMON_TIMER_H_
 
 #include <list>
+#include <vector>
 
 #include "common/error.h"
 #include "common/platform.h"
@@ -76,6 +77,11 @@ public:
 
     /// @brief 获取定时器数目
     virtual int64_t GetTimerNum() { return 0; }
+
+    /// @brief 获取距离最近一个定时器到期的时间，用于空闲时决定阻塞等待多久
+    /// @return >=0 距离最近一个定时器到期的毫秒数，0表示已有定时器到期
+    /// @return <0 没有定时器
+    virtual int64_t GetNextTimeout() { return GetTimerNum() > 0 ? 0 : -1; }
 };
 
 #if 0
@@ -161,6 +167,9 @@ public:
         return m_id_2_timer.size();
     }
 
+    /// @see Timer::GetNextTimeout
+    virtual int64_t GetNextTimeout();
+
 private:
     struct TimerItem {
         TimerItem() {
@@ -184,6 +193,117 @@ private:
     char m_last_error[256];
 };
 
+/// @brief 分层时间轮定时器，精度为1ms，共5层(256 + 64 * 4个槽)覆盖uint32_t范围内的任意超时时间\n
+///     定时器节点侵入式挂在槽的双向链表上，节点从按块分配的池中获取，停止时立即摘链并归还\n
+///     适合大量启动后很快被取消的定时器，如RPC的请求超时\n
+///     复杂度:start O(1)，stop O(1)，timeout 均摊O(1)
+class TimingWheelTimer : public Timer {
+public:
+    TimingWheelTimer();
+    virtual ~TimingWheelTimer();
+
+    /// @see Timer::StartTimer
+    virtual int64_t StartTimer(uint32_t timeout_ms, const TimeoutCallback& cb);
+
+    /// @see Timer::StopTimer
+    virtual int32_t StopTimer(int64_t timer_id);
+
+    /// @see Timer::Update
+    virtual int32_t Update();
+
+    /// @see Timer::LastErrorStr
+    virtual const char* GetLastError() const {
+        return m_last_error;
+    }
+
+    /// @see Timer::GetTimerNum
+    virtual int64_t GetTimerNum() {
+        return m_timer_num;
+    }
+
+    /// @see Timer::GetNextTimeout
+    /// @note 只扫描最低层，高层的定时器按下一次级联的时间估计，误差不超过256ms且只会偏早
+    virtual int64_t GetNextTimeout();
+
+private:
+    static const uint32_t TVR_BITS   = 8;
+    static const uint32_t TVN_BITS   = 6;
+    static const uint32_t TVR_SIZE   = 1 << TVR_BITS;
+    static const uint32_t TVN_SIZE   = 1 << TVN_BITS;
+    static const uint32_t TVR_MASK   = TVR_SIZE - 1;
+    static const uint32_t TVN_MASK   = TVN_SIZE - 1;
+    static const uint32_t TVN_NUM    = 4;
+    static const uint32_t NODE_BLOCK_BITS = 10;
+    static const uint32_t NODE_BLOCK_SIZE = 1 << NODE_BLOCK_BITS;
+
+    struct TimerLink {
+        TimerLink* prev;
+        TimerLink* next;
+    };
+
+    struct TimerNode : public TimerLink {
+        uint32_t index;     // 在节点池中的下标
+        uint32_t gen;       // 每次归还时递增，用于识别过期的定时器ID
+        bool     in_use;
+        uint32_t timeout;
+        int64_t  expire;
+        TimeoutCallback cb;
+    };
+
+    static void ListInit(TimerLink* head) {
+        head->prev = head;
+        head->next = head;
+    }
+
+    static void ListAdd(TimerLink* head, TimerLink* node) {
+        node->prev = head->prev;
+        node->next = head;
+        head->prev->next = node;
+        head->prev = node;
+    }
+
+    static void ListDel(TimerLink* node) {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = NULL;
+        node->next = NULL;
+    }
+
+    /// @brief 把from上的所有节点移到空链表to上
+    static void ListMove(TimerLink* from, TimerLink* to) {
+        if (from->next == from) {
+            ListInit(to);
+            return;
+        }
+        to->next = from->next;
+        to->prev = from->prev;
+        to->next->prev = to;
+        to->prev->next = to;
+        ListInit(from);
+    }
+
+    TimerNode* AllocNode();
+    void FreeNode(TimerNode* node);
+    TimerNode* FindNode(int64_t timer_id);
+
+    /// @brief 按到期时间把节点挂到对应层的槽上
+    void AddNode(TimerNode* node);
+
+    /// @brief 把第level层(>=1)的idx槽上的节点重新分配到低层，返回idx
+    uint32_t Cascade(uint32_t level, uint32_t idx);
+
+private:
+    int64_t    m_next_tick;     // 下一个待处理的毫秒
+    int64_t    m_timer_num;
+    TimerLink  m_tvr[TVR_SIZE];
+    TimerLink  m_tvn[TVN_NUM][TVN_SIZE];
+    std::vector<TimerNode*> m_node_blocks;
+    TimerNode* m_free_node;     // 空闲节点通过next串联
+    TimerNode* m_running;       // 正在执行回调的节点
+    bool       m_running_stoped;
+    char m_last_error[256];
+};
+
 }  // namespace pebble
 
 #endif  // _PEBBLE_COMMON_TIMER_H_
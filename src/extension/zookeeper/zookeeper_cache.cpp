@@ -187,6 +187,19 @@ void ZookeeperCache::Update()
     }
 }
 
+int64_t ZookeeperCache::GetNextTimeout()
+{
+    if (m_cache_keys.empty()) {
+        return -1;
+    }
+
+    timeval now;
+    gettimeofday(&now, NULL);
+
+    int64_t next = m_last_refresh + m_refresh_time_ms + 1 - (now.tv_sec * 1000 + now.tv_usec / 1000);
+    return next > 0 ? next : 0;
+}
+
 void ZookeeperCache::UpdateCache(GetAllNameResults& results, bool is_watch) // NOLINT
 {
     // 更新cache和回调通知
@@ -881,6 +881,40 @@ int ZookeeperClient::Update(bool is_block)
     return (interest == 0 ? -1 : 0);
 }
 
+int64_t ZookeeperClient::GetNextTimeout()
+{
+    if (m_zk_handle == NULL)
+    {
+        return -1;
+    }
+
+    // 未连接成功时，异步update按秒限频，等到下一秒
+    if (ZOO_CONNECTED_STATE != zoo_state(m_zk_handle))
+    {
+        timeval now;
+        gettimeofday(&now, NULL);
+        if (now.tv_sec > m_last_update_time)
+        {
+            return 0;
+        }
+        return (m_last_update_time + 1 - now.tv_sec) * 1000 - now.tv_usec / 1000;
+    }
+
+    int fd = -1;
+    int interest = 0;
+    timeval timeout = { 0, 0 };
+    zookeeper_interest(m_zk_handle, &fd, &interest, &timeout);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (interest & ZOOKEEPER_WRITE)
+    {
+        return 0;
+    }
+    return timeout.tv_sec * 1000 + timeout.tv_usec / 1000;
+}
+
 int ZookeeperClient::Close(bool is_clean)
 {
     if (m_zk_handle != NULL)
@@ -150,6 +150,11 @@ public:
     /// @return 0 有更新动作
     int Update(bool is_block = false);
 
+    // 距离下次需要异步Update的毫秒数，包括心跳、重连和待发送的请求
+    /// @return >=0 毫秒数，0表示需要立即Update
+    /// @return <0 没有时间上的要求
+    int64_t GetNextTimeout();
+
     // close the zookeeper handle and free up any resources
     int Close(bool is_clean = false);
 
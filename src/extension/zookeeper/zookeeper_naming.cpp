@@ -74,6 +74,8 @@ struct SyncWaitAdaptor
     virtual ~SyncWaitAdaptor() {}
 
     int32_t _rc;
+    // 结果暂存在堆上的adaptor内，等待方恢复后再取走，回调不直接写等待方(可能在共享栈上)的变量
+    std::vector<std::string> _urls;
 
     virtual void WaitRsp() { assert(false); }
 };
@@ -81,15 +83,11 @@ struct SyncWaitAdaptor
 struct BlockWaitAdaptor : public SyncWaitAdaptor
 {
     explicit BlockWaitAdaptor(ZookeeperClient* zk_client)
-        : SyncWaitAdaptor(), _zk_client(zk_client), _urls(NULL) {}
-
-    BlockWaitAdaptor(ZookeeperClient* zk_client, std::vector<std::string>* urls)
-        : SyncWaitAdaptor(), _zk_client(zk_client), _urls(urls) {}
+        : SyncWaitAdaptor(), _zk_client(zk_client) {}
 
     virtual ~BlockWaitAdaptor() {}
 
     ZookeeperClient* _zk_client;
-    std::vector<std::string>* _urls;
 
     virtual void WaitRsp()
     {
@@ -107,23 +105,19 @@ struct BlockWaitAdaptor : public SyncWaitAdaptor
     void OnRsp(int32_t rc, const std::vector<std::string>& urls)
     {
         _rc = rc;
-        *_urls = urls;
+        _urls = urls;
     }
 };
 
 struct CoroutineWaitAdaptor : public SyncWaitAdaptor
 {
     explicit CoroutineWaitAdaptor(CoroutineSchedule* cor_sche)
-        : SyncWaitAdaptor(), _cor_sche(cor_sche), _cor_id(-1), _urls(NULL) {}
-
-    CoroutineWaitAdaptor(CoroutineSchedule* cor_sche, std::vector<std::string>* urls)
-        : SyncWaitAdaptor(), _cor_sche(cor_sche), _cor_id(-1), _urls(urls) {}
+        : SyncWaitAdaptor(), _cor_sche(cor_sche), _cor_id(-1) {}
 
     virtual ~CoroutineWaitAdaptor() {}
 
     CoroutineSchedule* _cor_sche;
     int64_t            _cor_id;
-    std::vector<std::string>* _urls;
 
     virtual void WaitRsp()
     {
@@ -140,7 +134,7 @@ struct CoroutineWaitAdaptor : public SyncWaitAdaptor
     void OnRsp(int32_t rc, const std::vector<std::string>& urls)
     {
         _rc = rc;
-        *_urls = urls;
+        _urls = urls;
         _cor_sche->Resume(_cor_id);
     }
 };
@@ -368,11 +362,11 @@ int32_t ZookeeperNaming::GetUrlsByName(const std::string& name, std::vector<std:
     SyncWaitAdaptor *sync_adaptor = NULL;
     CbReturnValue ret_cob = NULL;
     if (NULL != m_cor_schedule && m_cor_schedule->CurrentTaskId() >= 0) {
-        CoroutineWaitAdaptor *coroutine_adaptor = new CoroutineWaitAdaptor(m_cor_schedule, urls);
+        CoroutineWaitAdaptor *coroutine_adaptor = new CoroutineWaitAdaptor(m_cor_schedule);
         ret_cob = cxx::bind(&CoroutineWaitAdaptor::OnRsp, coroutine_adaptor, _1, _2);
         sync_adaptor = coroutine_adaptor;
     } else {
-        BlockWaitAdaptor *block_adaptor = new BlockWaitAdaptor(m_zk_client, urls);
+        BlockWaitAdaptor *block_adaptor = new BlockWaitAdaptor(m_zk_client);
         ret_cob = cxx::bind(&BlockWaitAdaptor::OnRsp, block_adaptor, _1, _2);
         sync_adaptor = block_adaptor;
     }
@@ -380,6 +374,7 @@ int32_t ZookeeperNaming::GetUrlsByName(const std::string& name, std::vector<std:
     if (0 == ret) {
         sync_adaptor->WaitRsp();
         ret = sync_adaptor->_rc;
+        urls->swap(sync_adaptor->_urls);
     }
 
     delete sync_adaptor;
@@ -492,6 +487,19 @@ int32_t ZookeeperNaming::Update()
     return num;
 }
 
+int64_t ZookeeperNaming::GetNextTimeout()
+{
+    if (NULL == m_zk_client) {
+        return -1;
+    }
+    int64_t next = m_zk_client->GetNextTimeout();
+    int64_t timeout = m_zk_cache->GetNextTimeout();
+    if (timeout >= 0 && (next < 0 || timeout < next)) {
+        next = timeout;
+    }
+    return next;
+}
+
 /* 
     1. ZOO_CHILD_EVENT: 下面路径孩子节点发生变化(变多、变少)
     /path               service_name增减
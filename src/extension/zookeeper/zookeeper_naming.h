@@ -157,6 +157,9 @@ public:
     /// @brief 驱动异步更新
     virtual int32_t Update();
 
+    /// @brief 距离下次需要Update的毫秒数，包括zk心跳、重连和cache刷新
+    virtual int64_t GetNextTimeout();
+
 private:
     void WatcherFunc(int32_t type, const char* path);
 
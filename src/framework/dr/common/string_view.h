@@ -0,0 +1,156 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+
+#ifndef PEBBLE_DR_COMMON_STRING_VIEW_H
+#define PEBBLE_DR_COMMON_STRING_VIEW_H
+
+#include <stdint.h>
+#include <string.h>
+#include <ostream>
+#include <string>
+
+
+namespace pebble {
+namespace dr {
+
+/// @brief IDL中标注了cpp.view的string/binary字段的类型，如 1: string (cpp.view) payload\n
+///   解码时在StringViewRefScope作用域内直接引用解码缓冲区(指针+长度)，不分配内存也不复制；
+///   其它情况以及用户赋值时和std::string一样保存一份数据
+/// @note 引用解码缓冲区时只在缓冲区有效期间可用，RPC服务处理函数的参数在处理函数返回前有效，
+///   需要保存到处理函数返回之后时用str()复制；复制StringView对象只复制引用
+class StringView {
+public:
+    StringView() : m_ref(NULL), m_ref_size(0) {}
+
+    StringView(const char* str) : m_ref(NULL), m_ref_size(0), m_str(str) {} // NOLINT
+
+    StringView(const char* data, size_t size) : m_ref(NULL), m_ref_size(0), m_str(data, size) {}
+
+    StringView(const std::string& str) : m_ref(NULL), m_ref_size(0), m_str(str) {} // NOLINT
+
+    /// @brief 引用外部数据，不复制，调用方保证数据在本对象使用期间有效
+    void Reference(const char* data, size_t size) {
+        m_ref      = data;
+        m_ref_size = size;
+        m_str.clear();
+    }
+
+    /// @brief 是否引用外部数据
+    bool IsReference() const {
+        return m_ref != NULL;
+    }
+
+    /// @brief 改为自己保存数据并返回保存数据的std::string，原来引用的外部数据被丢弃
+    std::string* MutableString() {
+        m_ref      = NULL;
+        m_ref_size = 0;
+        return &m_str;
+    }
+
+    const char* data() const {
+        return m_ref != NULL ? m_ref : m_str.data();
+    }
+
+    size_t size() const {
+        return m_ref != NULL ? m_ref_size : m_str.size();
+    }
+
+    size_t length() const {
+        return size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// @brief 复制一份数据
+    std::string str() const {
+        return std::string(data(), size());
+    }
+
+    // 以下接口和std::string一致
+    void clear() {
+        MutableString()->clear();
+    }
+
+    void assign(const char* data, size_t size) {
+        MutableString()->assign(data, size);
+    }
+
+    const char& operator[](size_t pos) const {
+        return data()[pos];
+    }
+
+    int compare(const StringView& other) const {
+        size_t len = size() < other.size() ? size() : other.size();
+        int ret = len > 0 ? memcmp(data(), other.data(), len) : 0;
+        if (ret != 0) {
+            return ret;
+        }
+        return size() < other.size() ? -1 : (size() > other.size() ? 1 : 0);
+    }
+
+    /// @brief 作用域内解码到StringView的字段是否直接引用解码缓冲区
+    static bool RefEnabled() {
+        return *RefFlag();
+    }
+
+private:
+    friend class StringViewRefScope;
+
+    static bool* RefFlag() {
+        static __thread bool s_ref_enabled = false;
+        return &s_ref_enabled;
+    }
+
+    const char* m_ref;
+    size_t      m_ref_size;
+    std::string m_str;
+};
+
+/// @brief 作用域内当前线程解码的StringView字段直接引用解码缓冲区，由调用方保证缓冲区在字段使用期间有效
+class StringViewRefScope {
+public:
+    StringViewRefScope() : m_prev(*StringView::RefFlag()) {
+        *StringView::RefFlag() = true;
+    }
+
+    ~StringViewRefScope() {
+        *StringView::RefFlag() = m_prev;
+    }
+
+private:
+    bool m_prev;
+};
+
+inline bool operator==(const StringView& lhs, const StringView& rhs) {
+    return lhs.size() == rhs.size() && lhs.compare(rhs) == 0;
+}
+
+inline bool operator!=(const StringView& lhs, const StringView& rhs) {
+    return !(lhs == rhs);
+}
+
+inline bool operator<(const StringView& lhs, const StringView& rhs) {
+    return lhs.compare(rhs) < 0;
+}
+
+inline std::ostream& operator<<(std::ostream& out, const StringView& str) {
+    return out.write(str.data(), str.size());
+}
+
+} // namespace dr
+} // namespace pebble
+
+#endif // PEBBLE_DR_COMMON_STRING_VIEW_H
@@ -0,0 +1,448 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#ifndef PEBBLE_DR_PROTOCOL_BINARY_DIRECT_H
+#define PEBBLE_DR_PROTOCOL_BINARY_DIRECT_H
+
+#include <string.h>
+#include <typeinfo>
+#include "framework/dr/protocol/binary_protocol.h"
+#include "framework/dr/transport/buffer_transport.h"
+
+
+namespace pebble { namespace dr { namespace protocol {
+
+/// @brief binary协议的长度计算器，接口与TProtocol的写接口一致，只累加长度不输出数据\n
+///   生成代码的write(TBinarySizer*)与write(TProtocol*)共用同一份字段序列化代码，返回值即为binary编码长度
+class TBinarySizer {
+public:
+    TBinarySizer() : m_recursion_depth(0) {}
+
+    void incrementRecursionDepth() {
+        if (DEFAULT_RECURSION_LIMIT < ++m_recursion_depth) {
+            throw TProtocolException(TProtocolException::DEPTH_LIMIT);
+        }
+    }
+    void decrementRecursionDepth() { --m_recursion_depth; }
+
+    uint32_t writeStructBegin(const char*) { return 0; }
+    uint32_t writeStructEnd() { return 0; }
+    uint32_t writeFieldBegin(const char*, const TType, const int16_t) { return 3; }
+    uint32_t writeFieldEnd() { return 0; }
+    uint32_t writeFieldStop() { return 1; }
+    uint32_t writeMapBegin(const TType, const TType, const uint32_t) { return 6; }
+    uint32_t writeMapEnd() { return 0; }
+    uint32_t writeListBegin(const TType, const uint32_t) { return 5; }
+    uint32_t writeListEnd() { return 0; }
+    uint32_t writeSetBegin(const TType, const uint32_t) { return 5; }
+    uint32_t writeSetEnd() { return 0; }
+    uint32_t writeBool(const bool) { return 1; }
+    uint32_t writeByte(const int8_t) { return 1; }
+    uint32_t writeI16(const int16_t) { return 2; }
+    uint32_t writeI32(const int32_t) { return 4; }
+    uint32_t writeI64(const int64_t) { return 8; }
+    uint32_t writeDouble(const double) { return 8; }
+
+    template <typename StrType>
+    uint32_t writeString(const StrType& str) {
+        return 4 + static_cast<uint32_t>(str.size());
+    }
+    template <typename StrType>
+    uint32_t writeBinary(const StrType& str) {
+        return writeString(str);
+    }
+
+private:
+    uint32_t m_recursion_depth;
+};
+
+/// @brief binary协议的直接编码器，接口与TProtocol的写接口一致，非虚函数，直接写入预留好的连续内存\n
+///   不做越界检查，调用者必须先用TBinarySizer算出准确长度并预留足够的空间
+class TBinaryWriter {
+public:
+    explicit TBinaryWriter(uint8_t* buff) : m_pos(buff), m_recursion_depth(0) {}
+
+    void incrementRecursionDepth() {
+        if (DEFAULT_RECURSION_LIMIT < ++m_recursion_depth) {
+            throw TProtocolException(TProtocolException::DEPTH_LIMIT);
+        }
+    }
+    void decrementRecursionDepth() { --m_recursion_depth; }
+
+    uint32_t writeStructBegin(const char*) { return 0; }
+    uint32_t writeStructEnd() { return 0; }
+
+    uint32_t writeFieldBegin(const char*, const TType field_type, const int16_t field_id) {
+        writeByte(static_cast<int8_t>(field_type));
+        writeI16(field_id);
+        return 3;
+    }
+    uint32_t writeFieldEnd() { return 0; }
+    uint32_t writeFieldStop() { return writeByte(static_cast<int8_t>(T_STOP)); }
+
+    uint32_t writeMapBegin(const TType key_type, const TType val_type, const uint32_t size) {
+        writeByte(static_cast<int8_t>(key_type));
+        writeByte(static_cast<int8_t>(val_type));
+        writeI32(static_cast<int32_t>(size));
+        return 6;
+    }
+    uint32_t writeMapEnd() { return 0; }
+
+    uint32_t writeListBegin(const TType elem_type, const uint32_t size) {
+        writeByte(static_cast<int8_t>(elem_type));
+        writeI32(static_cast<int32_t>(size));
+        return 5;
+    }
+    uint32_t writeListEnd() { return 0; }
+
+    uint32_t writeSetBegin(const TType elem_type, const uint32_t size) {
+        return writeListBegin(elem_type, size);
+    }
+    uint32_t writeSetEnd() { return 0; }
+
+    uint32_t writeBool(const bool value) {
+        *m_pos++ = value ? 1 : 0;
+        return 1;
+    }
+    uint32_t writeByte(const int8_t byte) {
+        *m_pos++ = static_cast<uint8_t>(byte);
+        return 1;
+    }
+    uint32_t writeI16(const int16_t i16) {
+        uint16_t net = htons(static_cast<uint16_t>(i16));
+        memcpy(m_pos, &net, 2);
+        m_pos += 2;
+        return 2;
+    }
+    uint32_t writeI32(const int32_t i32) {
+        uint32_t net = htonl(static_cast<uint32_t>(i32));
+        memcpy(m_pos, &net, 4);
+        m_pos += 4;
+        return 4;
+    }
+    uint32_t writeI64(const int64_t i64) {
+        uint64_t net = htonll(static_cast<uint64_t>(i64));
+        memcpy(m_pos, &net, 8);
+        m_pos += 8;
+        return 8;
+    }
+    uint32_t writeDouble(const double dub) {
+        uint64_t bits = htonll(bitwise_cast<uint64_t>(dub));
+        memcpy(m_pos, &bits, 8);
+        m_pos += 8;
+        return 8;
+    }
+
+    template <typename StrType>
+    uint32_t writeString(const StrType& str) {
+        uint32_t size = static_cast<uint32_t>(str.size());
+        writeI32(static_cast<int32_t>(size));
+        memcpy(m_pos, str.data(), size);
+        m_pos += size;
+        return 4 + size;
+    }
+    template <typename StrType>
+    uint32_t writeBinary(const StrType& str) {
+        return writeString(str);
+    }
+
+    uint8_t* pos() const { return m_pos; }
+
+private:
+    uint8_t* m_pos;
+    uint32_t m_recursion_depth;
+};
+
+/// @brief binary协议的直接解码器，接口与TProtocol的读接口一致，非虚函数，直接在接收缓冲区上移动游标\n
+///   每次读取都检查剩余长度，数据不足时与TMemoryBuffer一样抛END_OF_FILE异常
+class TBinaryReader {
+public:
+    TBinaryReader(const uint8_t* buff, uint32_t buff_len,
+        int32_t string_limit, int32_t container_limit)
+        :   m_begin(buff), m_pos(buff), m_end(buff + buff_len),
+            m_string_limit(string_limit), m_container_limit(container_limit),
+            m_recursion_depth(0) {}
+
+    uint32_t readStructBegin(std::string&) { return 0; }
+    uint32_t readStructEnd() { return 0; }
+
+    uint32_t readFieldBegin(std::string&, TType& field_type, int16_t& field_id) {
+        int8_t type;
+        readByte(type);
+        field_type = static_cast<TType>(type);
+        if (T_STOP == field_type) {
+            field_id = 0;
+            return 1;
+        }
+        readI16(field_id);
+        return 3;
+    }
+    uint32_t readFieldEnd() { return 0; }
+
+    uint32_t readMapBegin(TType& key_type, TType& val_type, uint32_t& size) {
+        int8_t k, v;
+        readByte(k);
+        readByte(v);
+        key_type = static_cast<TType>(k);
+        val_type = static_cast<TType>(v);
+        readSize(size, m_container_limit);
+        return 6;
+    }
+    uint32_t readMapEnd() { return 0; }
+
+    uint32_t readListBegin(TType& elem_type, uint32_t& size) {
+        int8_t e;
+        readByte(e);
+        elem_type = static_cast<TType>(e);
+        readSize(size, m_container_limit);
+        return 5;
+    }
+    uint32_t readListEnd() { return 0; }
+
+    uint32_t readSetBegin(TType& elem_type, uint32_t& size) {
+        return readListBegin(elem_type, size);
+    }
+    uint32_t readSetEnd() { return 0; }
+
+    uint32_t readBool(bool& value) {
+        need(1);
+        value = (*m_pos++ != 0);
+        return 1;
+    }
+    uint32_t readBool(std::vector<bool>::reference value) {
+        bool b = false;
+        readBool(b);
+        value = b;
+        return 1;
+    }
+    uint32_t readByte(int8_t& byte) {
+        need(1);
+        byte = static_cast<int8_t>(*m_pos++);
+        return 1;
+    }
+    uint32_t readI16(int16_t& i16) {
+        uint16_t net;
+        need(2);
+        memcpy(&net, m_pos, 2);
+        m_pos += 2;
+        i16 = static_cast<int16_t>(ntohs(net));
+        return 2;
+    }
+    uint32_t readI32(int32_t& i32) {
+        uint32_t net;
+        need(4);
+        memcpy(&net, m_pos, 4);
+        m_pos += 4;
+        i32 = static_cast<int32_t>(ntohl(net));
+        return 4;
+    }
+    uint32_t readI64(int64_t& i64) {
+        uint64_t net;
+        need(8);
+        memcpy(&net, m_pos, 8);
+        m_pos += 8;
+        i64 = static_cast<int64_t>(ntohll(net));
+        return 8;
+    }
+    uint32_t readDouble(double& dub) {
+        uint64_t bits;
+        need(8);
+        memcpy(&bits, m_pos, 8);
+        m_pos += 8;
+        dub = bitwise_cast<double>(static_cast<uint64_t>(ntohll(bits)));
+        return 8;
+    }
+
+    template <typename StrType>
+    uint32_t readString(StrType& str) {
+        uint32_t size = 0;
+        readSize(size, m_string_limit);
+        need(size);
+        str.assign(reinterpret_cast<const char*>(m_pos), size);
+        m_pos += size;
+        return 4 + size;
+    }
+    uint32_t readBinary(std::string& str) {
+        return readString(str);
+    }
+
+    /// @brief StringViewRefScope作用域内直接引用解码缓冲区
+    uint32_t readString(::pebble::dr::StringView& str) {
+        if (!::pebble::dr::StringView::RefEnabled()) {
+            return readString(*str.MutableString());
+        }
+        uint32_t size = 0;
+        readSize(size, m_string_limit);
+        need(size);
+        str.Reference(reinterpret_cast<const char*>(m_pos), size);
+        m_pos += size;
+        return 4 + size;
+    }
+    uint32_t readBinary(::pebble::dr::StringView& str) {
+        return readString(str);
+    }
+
+    /// @brief 跳过未知字段，不拷贝数据
+    uint32_t skip(TType type);
+
+    /// @brief 已解码的长度
+    uint32_t consumed() const {
+        return static_cast<uint32_t>(m_pos - m_begin);
+    }
+
+private:
+    void need(uint32_t len) {
+        if (static_cast<uint32_t>(m_end - m_pos) < len) {
+            throw transport::TTransportException(transport::TTransportException::END_OF_FILE,
+                "No more data to read.");
+        }
+    }
+
+    void readSize(uint32_t& size, int32_t limit) {
+        int32_t sizei;
+        readI32(sizei);
+        if (sizei < 0) {
+            throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+        } else if (limit > 0 && sizei > limit) {
+            throw TProtocolException(TProtocolException::SIZE_LIMIT);
+        }
+        size = static_cast<uint32_t>(sizei);
+    }
+
+private:
+    const uint8_t* m_begin;
+    const uint8_t* m_pos;
+    const uint8_t* m_end;
+    int32_t        m_string_limit;
+    int32_t        m_container_limit;
+    uint32_t       m_recursion_depth;
+};
+
+inline uint32_t TBinaryReader::skip(TType type) {
+    const uint8_t* start = m_pos;
+    switch (type) {
+        case T_BOOL:
+        case T_BYTE:
+            need(1);
+            m_pos += 1;
+            break;
+        case T_I16:
+            need(2);
+            m_pos += 2;
+            break;
+        case T_I32:
+            need(4);
+            m_pos += 4;
+            break;
+        case T_I64:
+        case T_DOUBLE:
+            need(8);
+            m_pos += 8;
+            break;
+        case T_STRING: {
+            uint32_t size = 0;
+            readSize(size, m_string_limit);
+            need(size);
+            m_pos += size;
+            break;
+        }
+        case T_STRUCT: {
+            if (DEFAULT_RECURSION_LIMIT < ++m_recursion_depth) {
+                throw TProtocolException(TProtocolException::DEPTH_LIMIT);
+            }
+            std::string name;
+            TType field_type;
+            int16_t field_id;
+            while (true) {
+                readFieldBegin(name, field_type, field_id);
+                if (T_STOP == field_type) {
+                    break;
+                }
+                skip(field_type);
+            }
+            --m_recursion_depth;
+            break;
+        }
+        case T_MAP: {
+            TType key_type;
+            TType val_type;
+            uint32_t size = 0;
+            readMapBegin(key_type, val_type, size);
+            for (uint32_t i = 0; i < size; ++i) {
+                skip(key_type);
+                skip(val_type);
+            }
+            break;
+        }
+        case T_SET:
+        case T_LIST: {
+            TType elem_type;
+            uint32_t size = 0;
+            readListBegin(elem_type, size);
+            for (uint32_t i = 0; i < size; ++i) {
+                skip(elem_type);
+            }
+            break;
+        }
+        default:
+            throw TProtocolException(TProtocolException::INVALID_DATA);
+    }
+    return static_cast<uint32_t>(m_pos - start);
+}
+
+/// @brief 生成代码的read(TProtocol*)/write(TProtocol*)入口使用，协议为TBinaryProtocol且传输层为
+///   TMemoryBuffer时(RPC编解码的情况)改走直接编解码，其它协议和传输层仍走通用的虚函数路径
+class TBinaryDirect {
+public:
+    /// @brief 可以直接编解码时返回协议底层的TMemoryBuffer，否则返回NULL
+    static transport::TMemoryBuffer* GetBuffer(TProtocol* prot) {
+        if (typeid(*prot) != typeid(TBinaryProtocol)) {
+            return NULL;
+        }
+        transport::TTransport* trans = static_cast<TBinaryProtocol*>(prot)->getRawTransport();
+        if (typeid(*trans) != typeid(transport::TMemoryBuffer)) {
+            return NULL;
+        }
+        return static_cast<transport::TMemoryBuffer*>(trans);
+    }
+
+    /// @brief 先算出编码长度，一次预留后直接写入
+    template <typename TDATA>
+    static uint32_t Write(const TDATA& obj, transport::TMemoryBuffer* buff) {
+        TBinarySizer sizer;
+        uint32_t size = obj.write(&sizer);
+        TBinaryWriter writer(buff->getWritePtr(size));
+        obj.write(&writer);
+        buff->wroteBytes(size);
+        return size;
+    }
+
+    /// @brief 直接在TMemoryBuffer的未读数据上解码，解码成功后消费掉已读的部分
+    template <typename TDATA>
+    static uint32_t Read(TDATA& obj, TProtocol* prot, transport::TMemoryBuffer* buff) {
+        TBinaryProtocol* binary = static_cast<TBinaryProtocol*>(prot);
+        uint32_t len = 0;
+        const uint8_t* data = buff->borrowAll(&len);
+        TBinaryReader reader(data, len,
+            binary->getStringSizeLimit(), binary->getContainerSizeLimit());
+        obj.read(&reader);
+        buff->consume(reader.consumed());
+        return reader.consumed();
+    }
+};
+
+} // namespace protocol
+} // namespace dr
+} // namespace pebble
+
+#endif // PEBBLE_DR_PROTOCOL_BINARY_DIRECT_H
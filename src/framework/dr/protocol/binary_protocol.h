@@ -85,6 +85,18 @@ class TBinaryProtocolT
     strict_write_ = strict_write;
   }
 
+  int32_t getStringSizeLimit() const {
+    return string_limit_;
+  }
+
+  int32_t getContainerSizeLimit() const {
+    return container_limit_;
+  }
+
+  Transport_* getRawTransport() const {
+    return trans_;
+  }
+
   /**
    * Writing functions.
    */
@@ -139,6 +151,18 @@ class TBinaryProtocolT
 
   inline uint32_t writeBinary(const std::string& str);
 
+  uint32_t writeBinary(const ::pebble::dr::StringView& str) {
+    return writeString(str);
+  }
+
+  virtual uint32_t writeStringView_virt(const ::pebble::dr::StringView& str) {
+    return writeString(str);
+  }
+
+  virtual uint32_t writeBinaryView_virt(const ::pebble::dr::StringView& str) {
+    return writeString(str);
+  }
+
   /**
    * Reading functions
    */
@@ -193,6 +217,24 @@ class TBinaryProtocolT
 
   inline uint32_t readBinary(std::string& str);
 
+  /**
+   * Inside a StringViewRefScope the view references the borrowed transport
+   * memory instead of copying it.
+   */
+  uint32_t readString(::pebble::dr::StringView& str);
+
+  uint32_t readBinary(::pebble::dr::StringView& str) {
+    return readString(str);
+  }
+
+  virtual uint32_t readStringView_virt(::pebble::dr::StringView& str) {
+    return readString(str);
+  }
+
+  virtual uint32_t readBinaryView_virt(::pebble::dr::StringView& str) {
+    return readString(str);
+  }
+
  protected:
   template<typename StrType>
   uint32_t readStringBody(StrType& str, int32_t sz);
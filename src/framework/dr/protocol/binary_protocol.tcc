@@ -421,6 +421,30 @@ uint32_t TBinaryProtocolT<Transport_>::readBinary(std::string& str) {
   return TBinaryProtocolT<Transport_>::readString(str);
 }
 
+template <class Transport_>
+uint32_t TBinaryProtocolT<Transport_>::readString(::pebble::dr::StringView& str) {
+  if (!::pebble::dr::StringView::RefEnabled()) {
+    return readString(*str.MutableString());
+  }
+
+  uint32_t result;
+  int32_t size;
+  result = readI32(size);
+  if (size > 0) {
+    if (this->string_limit_ > 0 && size > this->string_limit_) {
+      throw TProtocolException(TProtocolException::SIZE_LIMIT);
+    }
+    const uint8_t* borrow_buf;
+    uint32_t got = size;
+    if ((borrow_buf = this->trans_->borrow(NULL, &got))) {
+      str.Reference((const char*)borrow_buf, size);
+      this->trans_->consume(size);
+      return result + size;
+    }
+  }
+  return result + readStringBody(*str.MutableString(), size);
+}
+
 template <class Transport_>
 template<typename StrType>
 uint32_t TBinaryProtocolT<Transport_>::readStringBody(StrType& str,
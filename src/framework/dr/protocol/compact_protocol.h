@@ -0,0 +1,458 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef PEBBLE_DR_PROTOCOL_COMPACTPROTOCOL_H
+#define PEBBLE_DR_PROTOCOL_COMPACTPROTOCOL_H
+
+#include "framework/dr/protocol/protocol.h"
+#include "framework/dr/protocol/virtual_protocol.h"
+#include <stack>
+#include <stdlib.h>
+
+namespace pebble { namespace dr { namespace protocol {
+
+/**
+ * C++ Implementation of the Compact Protocol as described in THRIFT-110.
+ * Integers are zigzag varints, field headers carry the delta from the
+ * previous field id together with the type in one byte, and bool fields are
+ * folded into their field header.
+ *
+ * The message header differs from upstream thrift in that the seqid is a
+ * 64-bit varint, as pebble uses 64-bit session ids.
+ */
+template <class Transport_>
+class TCompactProtocolT
+  : public TVirtualProtocol< TCompactProtocolT<Transport_> > {
+
+ protected:
+  static const int8_t  PROTOCOL_ID       = (int8_t)0x82u;
+  static const int8_t  VERSION_N         = 1;
+  static const int8_t  VERSION_MASK      = 0x1f; // 0001 1111
+  static const int8_t  TYPE_MASK         = (int8_t)0xE0u; // 1110 0000
+  static const int8_t  TYPE_BITS         = 0x07; // 0000 0111
+  static const int32_t TYPE_SHIFT_AMOUNT = 5;
+  static const int MAX_STRING_SIZE       = (8 * 1024 * 1024); // 8M
+  static const int MAX_CONTAINER_SIZE    = (8 * 1024 * 1024); // 8M
+
+  /**
+   * (Writing) If we encounter a boolean field begin, save the TField here
+   * so it can have the value incorporated.
+   */
+  struct {
+    bool pending;
+    const char* name;
+    TType fieldType;
+    int16_t fieldId;
+  } booleanField_;
+
+  /**
+   * (Reading) If we read a field header, and it's a boolean field, save
+   * the boolean value here so that readBool can use it.
+   */
+  struct {
+    bool hasBoolValue;
+    bool boolValue;
+  } boolValue_;
+
+  /**
+   * Used to keep track of the last field for the current and previous structs,
+   * so we can do the delta stuff.
+   */
+  std::stack<int16_t> lastField_;
+  int16_t lastFieldId_;
+
+ public:
+  /**
+   * Types of compact fields, stored in the low nibble of the field header.
+   */
+  enum Types {
+    CT_STOP           = 0x00,
+    CT_BOOLEAN_TRUE   = 0x01,
+    CT_BOOLEAN_FALSE  = 0x02,
+    CT_BYTE           = 0x03,
+    CT_I16            = 0x04,
+    CT_I32            = 0x05,
+    CT_I64            = 0x06,
+    CT_DOUBLE         = 0x07,
+    CT_BINARY         = 0x08,
+    CT_LIST           = 0x09,
+    CT_SET            = 0x0A,
+    CT_MAP            = 0x0B,
+    CT_STRUCT         = 0x0C
+  };
+
+  TCompactProtocolT(cxx::shared_ptr<Transport_> trans) :
+    TVirtualProtocol< TCompactProtocolT<Transport_> >(trans),
+    lastFieldId_(0),
+    trans_(trans.get()),
+    string_limit_(MAX_STRING_SIZE),
+    container_limit_(MAX_CONTAINER_SIZE) {
+    booleanField_.pending = false;
+    booleanField_.name = NULL;
+    boolValue_.hasBoolValue = false;
+  }
+
+  TCompactProtocolT(cxx::shared_ptr<Transport_> trans,
+                    int32_t string_limit,
+                    int32_t container_limit) :
+    TVirtualProtocol< TCompactProtocolT<Transport_> >(trans),
+    lastFieldId_(0),
+    trans_(trans.get()),
+    string_limit_(string_limit),
+    container_limit_(container_limit) {
+    booleanField_.pending = false;
+    booleanField_.name = NULL;
+    boolValue_.hasBoolValue = false;
+  }
+
+  ~TCompactProtocolT() {}
+
+  void setStringSizeLimit(int32_t string_limit) {
+    string_limit_ = string_limit;
+  }
+
+  void setContainerSizeLimit(int32_t container_limit) {
+    container_limit_ = container_limit;
+  }
+
+  Transport_* getRawTransport() const {
+    return trans_;
+  }
+
+  /**
+   * Writing functions
+   */
+
+  uint32_t writeMessageBegin(const std::string& name,
+                             const TMessageType messageType,
+                             const int64_t seqid);
+
+  uint32_t writeStructBegin(const char* name);
+
+  uint32_t writeStructEnd();
+
+  uint32_t writeFieldBegin(const char* name,
+                           const TType fieldType,
+                           const int16_t fieldId);
+
+  uint32_t writeFieldStop();
+
+  uint32_t writeListBegin(const TType elemType,
+                          const uint32_t size);
+
+  uint32_t writeSetBegin(const TType elemType,
+                         const uint32_t size);
+
+  uint32_t writeMapBegin(const TType keyType,
+                         const TType valType,
+                         const uint32_t size);
+
+  uint32_t writeBool(const bool value);
+
+  uint32_t writeByte(const int8_t byte);
+
+  uint32_t writeI16(const int16_t i16);
+
+  uint32_t writeI32(const int32_t i32);
+
+  uint32_t writeI64(const int64_t i64);
+
+  uint32_t writeDouble(const double dub);
+
+  template <typename StrType>
+  uint32_t writeString(const StrType& str);
+
+  template <typename StrType>
+  uint32_t writeBinary(const StrType& str);
+
+  virtual uint32_t writeStringView_virt(const ::pebble::dr::StringView& str) {
+    return writeBinary(str);
+  }
+
+  virtual uint32_t writeBinaryView_virt(const ::pebble::dr::StringView& str) {
+    return writeBinary(str);
+  }
+
+  /**
+  * These methods are called by structs, but don't actually have any wired
+  * output or purpose
+  */
+  uint32_t writeMessageEnd() { return 0; }
+  uint32_t writeMapEnd() { return 0; }
+  uint32_t writeListEnd() { return 0; }
+  uint32_t writeSetEnd() { return 0; }
+  uint32_t writeFieldEnd() { return 0; }
+
+ protected:
+  int32_t writeFieldBeginInternal(const char* name,
+                                  const TType fieldType,
+                                  const int16_t fieldId,
+                                  int8_t typeOverride);
+  uint32_t writeCollectionBegin(const TType elemType, int32_t size);
+  uint32_t writeVarint32(uint32_t n);
+  uint32_t writeVarint64(uint64_t n);
+  uint64_t i64ToZigzag(const int64_t l);
+  uint32_t i32ToZigzag(const int32_t n);
+  inline int8_t getCompactType(const TType ttype);
+
+ public:
+  uint32_t readMessageBegin(std::string& name,
+                            TMessageType& messageType,
+                            int64_t& seqid);
+
+  uint32_t readStructBegin(std::string& name);
+
+  uint32_t readStructEnd();
+
+  uint32_t readFieldBegin(std::string& name,
+                          TType& fieldType,
+                          int16_t& fieldId);
+
+  uint32_t readMapBegin(TType& keyType,
+                        TType& valType,
+                        uint32_t& size);
+
+  uint32_t readListBegin(TType& elemType,
+                         uint32_t& size);
+
+  uint32_t readSetBegin(TType& elemType,
+                        uint32_t& size);
+
+  uint32_t readBool(bool& value);
+  // Provide the default readBool() implementation for std::vector<bool>
+  using TVirtualProtocol< TCompactProtocolT<Transport_> >::readBool;
+
+  uint32_t readByte(int8_t& byte);
+
+  uint32_t readI16(int16_t& i16);
+
+  uint32_t readI32(int32_t& i32);
+
+  uint32_t readI64(int64_t& i64);
+
+  uint32_t readDouble(double& dub);
+
+  template<typename StrType>
+  uint32_t readString(StrType& str);
+
+  uint32_t readBinary(std::string& str);
+
+  /**
+   * Inside a StringViewRefScope the view references the borrowed transport
+   * memory instead of copying it.
+   */
+  uint32_t readBinary(::pebble::dr::StringView& str);
+
+  virtual uint32_t readStringView_virt(::pebble::dr::StringView& str) {
+    return readBinary(str);
+  }
+
+  virtual uint32_t readBinaryView_virt(::pebble::dr::StringView& str) {
+    return readBinary(str);
+  }
+
+  /*
+   *These methods are here for the struct to call, but don't have any wire
+   * encoding.
+   */
+  uint32_t readMessageEnd() { return 0; }
+  uint32_t readFieldEnd() { return 0; }
+  uint32_t readMapEnd() { return 0; }
+  uint32_t readListEnd() { return 0; }
+  uint32_t readSetEnd() { return 0; }
+
+ protected:
+  uint32_t readVarint32(int32_t& i32);
+  uint32_t readVarint64(int64_t& i64);
+  int32_t zigzagToI32(uint32_t n);
+  int64_t zigzagToI64(uint64_t n);
+  TType getTType(int8_t type);
+
+  Transport_* trans_;
+
+  int32_t string_limit_;
+  int32_t container_limit_;
+};
+
+typedef TCompactProtocolT<TTransport> TCompactProtocol;
+
+/**
+ * Constructs compact protocol handlers
+ */
+template <class Transport_>
+class TCompactProtocolFactoryT : public TProtocolFactory {
+ public:
+  TCompactProtocolFactoryT() :
+    string_limit_(0),
+    container_limit_(0) {}
+
+  TCompactProtocolFactoryT(int32_t string_limit, int32_t container_limit) :
+    string_limit_(string_limit),
+    container_limit_(container_limit) {}
+
+  virtual ~TCompactProtocolFactoryT() {}
+
+  void setStringSizeLimit(int32_t string_limit) {
+    string_limit_ = string_limit;
+  }
+
+  void setContainerSizeLimit(int32_t container_limit) {
+    container_limit_ = container_limit;
+  }
+
+  cxx::shared_ptr<TProtocol> getProtocol(cxx::shared_ptr<TTransport> trans) {
+    cxx::shared_ptr<Transport_> specific_trans =
+      cxx::dynamic_pointer_cast<Transport_>(trans);
+    TProtocol* prot;
+    if (specific_trans) {
+      prot = new TCompactProtocolT<Transport_>(specific_trans, string_limit_,
+                                               container_limit_);
+    } else {
+      prot = new TCompactProtocol(trans, string_limit_, container_limit_);
+    }
+
+    return cxx::shared_ptr<TProtocol>(prot);
+  }
+
+ private:
+  int32_t string_limit_;
+  int32_t container_limit_;
+
+};
+
+typedef TCompactProtocolFactoryT<TTransport> TCompactProtocolFactory;
+
+/**
+ * Computes the exact compact encoding size of a struct. It has the write
+ * interface of TProtocol but only adds up lengths, following the same field
+ * id delta and bool folding rules as TCompactProtocolT. Generated structs
+ * provide write(TCompactSizer*) sharing the body of write(TProtocol*).
+ */
+class TCompactSizer {
+ public:
+  TCompactSizer() : lastFieldId_(0), depth_(0), recursionDepth_(0),
+                    boolFieldPending_(false), boolFieldId_(0) {}
+
+  void incrementRecursionDepth() {
+    if (DEFAULT_RECURSION_LIMIT < ++recursionDepth_) {
+      throw TProtocolException(TProtocolException::DEPTH_LIMIT);
+    }
+  }
+  void decrementRecursionDepth() { --recursionDepth_; }
+
+  uint32_t writeStructBegin(const char*) {
+    if (depth_ >= MAX_DEPTH) {
+      throw TProtocolException(TProtocolException::DEPTH_LIMIT);
+    }
+    lastField_[depth_++] = lastFieldId_;
+    lastFieldId_ = 0;
+    return 0;
+  }
+  uint32_t writeStructEnd() {
+    lastFieldId_ = lastField_[--depth_];
+    return 0;
+  }
+
+  uint32_t writeFieldBegin(const char*, const TType fieldType, const int16_t fieldId) {
+    if (fieldType == T_BOOL) {
+      boolFieldPending_ = true;
+      boolFieldId_ = fieldId;
+      return 0;
+    }
+    return fieldHeaderSize(fieldId);
+  }
+  uint32_t writeFieldEnd() { return 0; }
+  uint32_t writeFieldStop() { return 1; }
+
+  uint32_t writeMapBegin(const TType, const TType, const uint32_t size) {
+    return size == 0 ? 1 : varint64Size(size) + 1;
+  }
+  uint32_t writeMapEnd() { return 0; }
+  uint32_t writeListBegin(const TType, const uint32_t size) {
+    return static_cast<int32_t>(size) <= 14 ? 1 : 1 + varint64Size(size);
+  }
+  uint32_t writeListEnd() { return 0; }
+  uint32_t writeSetBegin(const TType elemType, const uint32_t size) {
+    return writeListBegin(elemType, size);
+  }
+  uint32_t writeSetEnd() { return 0; }
+
+  uint32_t writeBool(const bool) {
+    if (boolFieldPending_) {
+      boolFieldPending_ = false;
+      return fieldHeaderSize(boolFieldId_);
+    }
+    return 1;
+  }
+  uint32_t writeByte(const int8_t) { return 1; }
+  uint32_t writeI16(const int16_t i16) { return varint64Size(zigzag32(i16)); }
+  uint32_t writeI32(const int32_t i32) { return varint64Size(zigzag32(i32)); }
+  uint32_t writeI64(const int64_t i64) {
+    return varint64Size((static_cast<uint64_t>(i64) << 1) ^ static_cast<uint64_t>(i64 >> 63));
+  }
+  uint32_t writeDouble(const double) { return 8; }
+
+  template <typename StrType>
+  uint32_t writeString(const StrType& str) {
+    uint32_t size = static_cast<uint32_t>(str.size());
+    return varint64Size(size) + size;
+  }
+  template <typename StrType>
+  uint32_t writeBinary(const StrType& str) {
+    return writeString(str);
+  }
+
+ private:
+  static const uint32_t MAX_DEPTH = DEFAULT_RECURSION_LIMIT + 2;
+
+  uint32_t fieldHeaderSize(int16_t fieldId) {
+    uint32_t size = 1;
+    if (!(fieldId > lastFieldId_ && fieldId - lastFieldId_ <= 15)) {
+      size += writeI16(fieldId);
+    }
+    lastFieldId_ = fieldId;
+    return size;
+  }
+
+  static uint32_t zigzag32(int32_t n) {
+    return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31);
+  }
+
+  static uint32_t varint64Size(uint64_t n) {
+    uint32_t size = 1;
+    while (n & ~0x7FULL) {
+      n >>= 7;
+      ++size;
+    }
+    return size;
+  }
+
+  int16_t lastField_[MAX_DEPTH];
+  int16_t lastFieldId_;
+  uint32_t depth_;
+  uint32_t recursionDepth_;
+  bool boolFieldPending_;
+  int16_t boolFieldId_;
+};
+
+}}} // pebble::dr::protocol
+
+#include "framework/dr/protocol/compact_protocol.tcc"
+
+#endif // PEBBLE_DR_PROTOCOL_COMPACTPROTOCOL_H
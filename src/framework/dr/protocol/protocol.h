@@ -21,6 +21,7 @@
 #define PEBBLE_DR_PROTOCOL_PROTOCOL_H
 
 #include "framework/dr/common/dr_define.h"
+#include "framework/dr/common/string_view.h"
 #include "framework/dr/transport/transport.h"
 #include "framework/dr/protocol/protocol_exception.h"
 
@@ -360,6 +361,18 @@ class TProtocol {
 
   virtual uint32_t writeBinary_virt(const std::string& str) = 0;
 
+  /**
+   * Writes a StringView field. Protocols that can write straight from
+   * data()/size() override these; the defaults go through a std::string copy.
+   */
+  virtual uint32_t writeStringView_virt(const ::pebble::dr::StringView& str) {
+    return writeString_virt(str.str());
+  }
+
+  virtual uint32_t writeBinaryView_virt(const ::pebble::dr::StringView& str) {
+    return writeBinary_virt(str.str());
+  }
+
   uint32_t writeMessageBegin(const std::string& name,
                              const TMessageType messageType,
                              const int64_t seqid) {
@@ -472,6 +485,16 @@ class TProtocol {
     return writeBinary_virt(str);
   }
 
+  uint32_t writeString(const ::pebble::dr::StringView& str) {
+    T_VIRTUAL_CALL();
+    return writeStringView_virt(str);
+  }
+
+  uint32_t writeBinary(const ::pebble::dr::StringView& str) {
+    T_VIRTUAL_CALL();
+    return writeBinaryView_virt(str);
+  }
+
   /**
    * Reading functions
    */
@@ -526,6 +549,19 @@ class TProtocol {
 
   virtual uint32_t readBinary_virt(std::string& str) = 0;
 
+  /**
+   * Reads a StringView field. Protocols that can borrow from the transport
+   * override these to reference the data inside a StringViewRefScope; the
+   * defaults read into the view's own string.
+   */
+  virtual uint32_t readStringView_virt(::pebble::dr::StringView& str) {
+    return readString_virt(*str.MutableString());
+  }
+
+  virtual uint32_t readBinaryView_virt(::pebble::dr::StringView& str) {
+    return readBinary_virt(*str.MutableString());
+  }
+
   uint32_t readMessageBegin(std::string& name,
                             TMessageType& messageType,
                             int64_t& seqid) {
@@ -630,6 +666,16 @@ class TProtocol {
     return readBinary_virt(str);
   }
 
+  uint32_t readString(::pebble::dr::StringView& str) {
+    T_VIRTUAL_CALL();
+    return readStringView_virt(str);
+  }
+
+  uint32_t readBinary(::pebble::dr::StringView& str) {
+    T_VIRTUAL_CALL();
+    return readBinaryView_virt(str);
+  }
+
   /*
    * std::vector is specialized for bool, and its elements are individual bits
    * rather than bools.   We need to define a different version of readBool()
@@ -0,0 +1,86 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#ifndef PEBBLE_DR_PROTOCOL_SERIALIZED_SIZE_H
+#define PEBBLE_DR_PROTOCOL_SERIALIZED_SIZE_H
+
+#include <typeinfo>
+#include "framework/dr/protocol/binary_direct.h"
+#include "framework/dr/protocol/compact_protocol.h"
+
+
+namespace pebble { namespace dr { namespace protocol {
+
+/// @brief 按编译期确定的协议类型计算编码长度，并在一次分配好的缓冲区上直接编码\n
+///   只有编码不经过虚函数的协议才值得先算长度，否则多出的一遍计算比按需扩展缓冲区更慢
+template <typename TPROTOCOL>
+struct TPresizedWriter {
+    static const bool kEnable = false;
+
+    template <typename TDATA>
+    static uint32_t Size(const TDATA& obj) {
+        (void)obj;
+        return 0;
+    }
+
+    template <typename TDATA>
+    static uint32_t Write(const TDATA& obj, uint8_t* buff) {
+        (void)obj;
+        (void)buff;
+        return 0;
+    }
+};
+
+template <>
+struct TPresizedWriter<TBinaryProtocol> {
+    static const bool kEnable = true;
+
+    template <typename TDATA>
+    static uint32_t Size(const TDATA& obj) {
+        TBinarySizer sizer;
+        return obj.write(&sizer);
+    }
+
+    /// @note buff至少要有Size(obj)字节
+    template <typename TDATA>
+    static uint32_t Write(const TDATA& obj, uint8_t* buff) {
+        TBinaryWriter writer(buff);
+        return obj.write(&writer);
+    }
+};
+
+/// @brief 编码前计算生成结构的准确编码长度\n
+///   目前支持TBinaryProtocol和TCompactProtocol，其它协议(json等)返回0表示无法预先计算
+class TSerializedSize {
+public:
+    /// @brief 计算obj按protocol_type协议编码后的长度
+    /// @return 0 协议不支持预先计算
+    template <typename TDATA>
+    static uint32_t Get(const TDATA& obj, const std::type_info& protocol_type) {
+        if (protocol_type == typeid(TBinaryProtocol)) {
+            TBinarySizer sizer;
+            return obj.write(&sizer);
+        }
+        if (protocol_type == typeid(TCompactProtocol)) {
+            TCompactSizer sizer;
+            return obj.write(&sizer);
+        }
+        return 0;
+    }
+};
+
+} // namespace protocol
+} // namespace dr
+} // namespace pebble
+
+#endif // PEBBLE_DR_PROTOCOL_SERIALIZED_SIZE_H
@@ -15,6 +15,7 @@
 #include <cstring>
 #include <framework/dr/protocol/binary_protocol.h>
 #include <iostream>
+#include <new>
 
 
 namespace pebble { namespace dr { namespace detail {
@@ -24,22 +25,50 @@ uint32_t FixBuffer::read(uint8_t* buf, uint32_t len) {
 }
 
 uint32_t FixBuffer::readAll(uint8_t* buf, uint32_t len) {
-    uint8_t *new_buf_pos = m_buf_pos + len;
-    if (new_buf_pos > m_buf_bound) {
-        throw ArrayOutOfBoundsException();
+    if (len > static_cast<uint32_t>(m_buf_bound - m_buf_pos)) {
+        onOverflow();
+        // 数据不完整，记录越界后立即结束解包，不用填充的数据继续解析
+        throw pebble::dr::transport::TTransportException(
+            pebble::dr::transport::TTransportException::END_OF_FILE, "No more data to read.");
     }
     std::memcpy(buf, m_buf_pos, len);
-    m_buf_pos = new_buf_pos;
+    m_buf_pos += len;
     return len;
 }
 
 void FixBuffer::write(const uint8_t* buf, uint32_t len) {
-    uint8_t *new_buf_pos = m_buf_pos + len;
-    if (new_buf_pos > m_buf_bound) {
-        throw ArrayOutOfBoundsException();
+    if (len > static_cast<uint32_t>(m_buf_bound - m_buf_pos)) {
+        onOverflow();
+        return;
     }
     std::memcpy(m_buf_pos, buf, len);
-    m_buf_pos = new_buf_pos;
+    m_buf_pos += len;
+}
+
+const uint8_t* FixBuffer::borrow(uint8_t* buf, uint32_t* len) {
+    uint32_t remain = static_cast<uint32_t>(m_buf_bound - m_buf_pos);
+    if (*len > remain) {
+        return NULL;
+    }
+    *len = remain;
+    return m_buf_pos;
+}
+
+void FixBuffer::consume(uint32_t len) {
+    if (len > static_cast<uint32_t>(m_buf_bound - m_buf_pos)) {
+        onOverflow();
+        return;
+    }
+    m_buf_pos += len;
+}
+
+void FixBuffer::onOverflow() {
+    if (!m_no_throw) {
+        throw ArrayOutOfBoundsException();
+    }
+    // 之后的读写都越界
+    m_overflow = true;
+    m_buf_pos  = m_buf_bound;
 }
 
 int32_t FixBuffer::used() {
@@ -51,7 +80,7 @@ void AutoBuffer::write(const uint8_t* buf, uint32_t len) {
     if (new_buf_pos > m_buf_bound) {
         uint32_t org_used = used();
         uint32_t new_size = (org_used + len) * 2;
-        m_buf = reinterpret_cast<uint8_t *>(realloc(m_buf, new_size));
+        grow(new_size);
         m_buf_pos = m_buf + org_used;
         m_buf_bound = m_buf + new_size;
         new_buf_pos = m_buf_pos + len;
@@ -60,6 +89,26 @@ void AutoBuffer::write(const uint8_t* buf, uint32_t len) {
     m_buf_pos = new_buf_pos;
 }
 
+uint8_t* AutoBuffer::getWritePtr(uint32_t len) {
+    if (len > static_cast<uint32_t>(m_buf_bound - m_buf_pos)) {
+        uint32_t org_used = used();
+        uint32_t new_size = org_used + len;
+        grow(new_size);
+        m_buf_pos = m_buf + org_used;
+        m_buf_bound = m_buf + new_size;
+    }
+    return m_buf_pos;
+}
+
+void AutoBuffer::grow(uint32_t new_size) {
+    // 失败时保留原缓冲区，由Pack捕获异常返回错误
+    uint8_t *new_buf = reinterpret_cast<uint8_t *>(realloc(m_buf, new_size));
+    if (NULL == new_buf) {
+        throw std::bad_alloc();
+    }
+    m_buf = new_buf;
+}
+
 int32_t AutoBuffer::used() {
     return m_buf_pos - m_buf;
 }
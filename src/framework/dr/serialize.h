@@ -14,6 +14,7 @@
 #ifndef PEBBLE_DR_SERIALIZE_H
 #define PEBBLE_DR_SERIALIZE_H
 
+#include "framework/dr/protocol/serialized_size.h"
 #include "framework/dr/transport/virtual_transport.h"
 #include <string>
 #include <stdlib.h>
@@ -28,7 +29,20 @@ class FixBuffer : public pebble::dr::transport::TVirtualTransport<FixBuffer> {
         FixBuffer(uint8_t *buf, uint32_t buf_len)
             : m_buf(buf),
               m_buf_bound(buf + buf_len),
-              m_buf_pos(buf) {
+              m_buf_pos(buf),
+              m_no_throw(false),
+              m_overflow(false) {
+        }
+
+        /// @brief 重新指定缓冲区，复用对象
+        /// @param no_throw 为true时写越界不抛异常，只记录越界，之后的写被丢弃；
+        ///   读越界记录越界后抛TTransportException结束解包
+        void reset(uint8_t *buf, uint32_t buf_len, bool no_throw) {
+            m_buf       = buf;
+            m_buf_bound = buf + buf_len;
+            m_buf_pos   = buf;
+            m_no_throw  = no_throw;
+            m_overflow  = false;
         }
 
         uint32_t read(uint8_t* buf, uint32_t len);
@@ -37,14 +51,29 @@ class FixBuffer : public pebble::dr::transport::TVirtualTransport<FixBuffer> {
 
         void write(const uint8_t* buf, uint32_t len);
 
+        const uint8_t* borrow(uint8_t* buf, uint32_t* len);
+
+        void consume(uint32_t len);
+
         int32_t used();
 
+        bool overflow() const {
+            return m_overflow;
+        }
+
+    private:
+        void onOverflow();
+
     private:
         uint8_t *m_buf;
 
         uint8_t *m_buf_bound;
 
         uint8_t *m_buf_pos;
+
+        bool m_no_throw;
+
+        bool m_overflow;
 };
 
 class AutoBuffer : public pebble::dr::transport::TVirtualTransport<AutoBuffer> {
@@ -56,14 +85,30 @@ class AutoBuffer : public pebble::dr::transport::TVirtualTransport<AutoBuffer> {
 
         void write(const uint8_t* buf, uint32_t len);
 
+        /// @brief 返回至少能写入len字节的位置，空间不足时一次扩展到刚好够用，写完后调用wroteBytes
+        uint8_t* getWritePtr(uint32_t len);
+
+        void wroteBytes(uint32_t len) {
+            m_buf_pos += len;
+        }
+
         int32_t used();
 
         char * str();
 
+        /// @brief 清空数据，保留已分配的内存
+        void reset() {
+            m_buf_pos = m_buf;
+        }
+
         ~AutoBuffer() {
             free(m_buf);
         }
 
+    private:
+        /// @brief 扩展到new_size字节，内存不足时抛std::bad_alloc，原缓冲区不变
+        void grow(uint32_t new_size);
+
     private:
         uint8_t *m_buf;
 
@@ -131,7 +176,14 @@ template<typename TDATA, typename TPROTOCOL>
 int Pack(const TDATA *obj, std::string *str) { //NOLINT
     if (obj == NULL || str == NULL) return pebble::dr::kINVALIDPARAMETER;
 
+    typedef pebble::dr::protocol::TPresizedWriter<TPROTOCOL> PresizedWriter;
     try {
+        // 协议支持时先算出长度，一次分配好后直接编码到str中
+        if (PresizedWriter::kEnable) {
+            str->resize(PresizedWriter::Size(*obj));
+            return PresizedWriter::Write(*obj, reinterpret_cast<uint8_t*>(&(*str)[0]));
+        }
+
         cxx::shared_ptr<detail::AutoBuffer> a_buff(new detail::AutoBuffer(256));
         TPROTOCOL protocol(a_buff);
 
@@ -154,6 +206,123 @@ int UnPack(TDATA *obj, const std::string &str) {
         reinterpret_cast<const uint8_t*>(str.c_str()), str.size());
 }
 
+/// @brief 可复用的打包上下文，重复打包/解包时不再分配缓冲区和协议对象，缓冲区越界只通过返回码报告
+/// @note 协议对象跨调用复用，只适用于TBinaryProtocol等不保存解析状态的协议；不能多线程共用
+template<typename TPROTOCOL>
+class PackContext {
+public:
+    PackContext()
+        : m_fix_buff(new detail::FixBuffer(NULL, 0)),
+          m_fix_protocol(new TPROTOCOL(m_fix_buff)),
+          m_auto_buff(new detail::AutoBuffer(256)),
+          m_auto_protocol(new TPROTOCOL(m_auto_buff)) {
+    }
+
+    /// @brief 当前线程的上下文，线程退出时不释放
+    static PackContext* ThreadInstance() {
+        static __thread PackContext* s_context = NULL;
+        if (NULL == s_context) {
+            s_context = new PackContext();
+        }
+        return s_context;
+    }
+
+    cxx::shared_ptr<detail::FixBuffer>  m_fix_buff;
+    cxx::shared_ptr<TPROTOCOL>          m_fix_protocol;
+    cxx::shared_ptr<detail::AutoBuffer> m_auto_buff;     // 打包到上下文内部的缓冲区
+    cxx::shared_ptr<TPROTOCOL>          m_auto_protocol;
+};
+
+/// @brief 打包到用户提供的缓冲区，复用上下文中的协议对象，热路径上不分配内存也不抛异常
+/// @param context 为NULL时使用当前线程的上下文
+/// @return >0 成功，返回打包后的长度
+/// @return <0 失败 @see PackError
+template<typename TDATA, typename TPROTOCOL>
+int Pack(const TDATA *obj, uint8_t *buff, uint32_t buff_len, PackContext<TPROTOCOL> *context) {
+    if (obj == NULL || buff == NULL) return pebble::dr::kINVALIDPARAMETER;
+    if (context == NULL) context = PackContext<TPROTOCOL>::ThreadInstance();
+
+    typedef pebble::dr::protocol::TPresizedWriter<TPROTOCOL> PresizedWriter;
+    if (PresizedWriter::kEnable) {
+        try {
+            if (PresizedWriter::Size(*obj) > buff_len) {
+                return pebble::dr::kINSUFFICIENTBUFFER;
+            }
+            return PresizedWriter::Write(*obj, buff);
+        } catch (...) {
+            return pebble::dr::kUNKNOW;
+        }
+    }
+
+    detail::FixBuffer* f_buff = context->m_fix_buff.get();
+    f_buff->reset(buff, buff_len, true);
+    try {
+        obj->write(context->m_fix_protocol.get());
+    } catch (...) {
+        context->m_fix_protocol->reset();
+        return pebble::dr::kUNKNOW;
+    }
+
+    if (f_buff->overflow()) {
+        return pebble::dr::kINSUFFICIENTBUFFER;
+    }
+    return f_buff->used();
+}
+
+/// @brief 打包到上下文内部的缓冲区，缓冲区按需增长并复用，binary协议先算出长度一次扩展到位
+/// @param data 返回打包后的数据，下次使用同一上下文打包前有效
+/// @param context 为NULL时使用当前线程的上下文
+/// @return >0 成功，返回打包后的长度
+/// @return <0 失败 @see PackError
+template<typename TDATA, typename TPROTOCOL>
+int Pack(const TDATA *obj, const uint8_t **data, PackContext<TPROTOCOL> *context) {
+    if (obj == NULL || data == NULL) return pebble::dr::kINVALIDPARAMETER;
+    if (context == NULL) context = PackContext<TPROTOCOL>::ThreadInstance();
+
+    detail::AutoBuffer* a_buff = context->m_auto_buff.get();
+    a_buff->reset();
+    typedef pebble::dr::protocol::TPresizedWriter<TPROTOCOL> PresizedWriter;
+    try {
+        if (PresizedWriter::kEnable) {
+            uint32_t size = PresizedWriter::Size(*obj);
+            a_buff->wroteBytes(PresizedWriter::Write(*obj, a_buff->getWritePtr(size)));
+            *data = reinterpret_cast<const uint8_t*>(a_buff->str());
+            return a_buff->used();
+        }
+        obj->write(context->m_auto_protocol.get());
+    } catch (...) {
+        context->m_auto_protocol->reset();
+        return pebble::dr::kUNKNOW;
+    }
+
+    *data = reinterpret_cast<const uint8_t*>(a_buff->str());
+    return a_buff->used();
+}
+
+/// @brief 从用户提供的缓冲区解包，复用上下文中的协议对象，数据不完整时返回kINVALIDBUFFER而不抛异常
+/// @param context 为NULL时使用当前线程的上下文
+/// @return >0 成功，返回解包的长度
+/// @return <0 失败 @see PackError
+template<typename TDATA, typename TPROTOCOL>
+int UnPack(TDATA *obj, const uint8_t *buff, uint32_t buff_len, PackContext<TPROTOCOL> *context) {
+    if (obj == NULL || buff == NULL) return pebble::dr::kINVALIDPARAMETER;
+    if (context == NULL) context = PackContext<TPROTOCOL>::ThreadInstance();
+
+    detail::FixBuffer* f_buff = context->m_fix_buff.get();
+    f_buff->reset(const_cast<uint8_t*>(buff), buff_len, true);
+    try {
+        obj->read(context->m_fix_protocol.get());
+    } catch (...) {
+        context->m_fix_protocol->reset();
+        return f_buff->overflow() ? pebble::dr::kINVALIDBUFFER : pebble::dr::kUNKNOW;
+    }
+
+    if (f_buff->overflow()) {
+        return pebble::dr::kINVALIDBUFFER;
+    }
+    return f_buff->used();
+}
+
 /// @brief 不依赖生成代码，直接对序列化后(Binary打包)的buffer进行字段更新操作
 /// @param path 用id序列表示的要更新字段的路径
 /// @param old_data 原始数据
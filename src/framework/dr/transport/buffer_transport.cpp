@@ -32,10 +32,13 @@ namespace pebble { namespace dr { namespace transport {
 void TMemoryBuffer::computeRead(uint32_t len, uint8_t** out_start, uint32_t* out_give)
 {
     // Correct rBound_ so we can use the fast path in the future.
-    rBound_ = wBase_;
+    // When observing a buffer for decoding rBound_ is ahead of wBase_, never move it back.
+    if (wBase_ > rBound_) {
+        rBound_ = wBase_;
+    }
 
     // Decide how much to give.
-    uint32_t give = (std::min)(len, available_read());
+    uint32_t give = (std::min)(len, static_cast<uint32_t>(rBound_ - rBase_));
 
     if (0 == give) {
         throw TTransportException(TTransportException::END_OF_FILE, "No more data to read.");
@@ -146,9 +149,12 @@ void TMemoryBuffer::wroteBytes(uint32_t len)
 const uint8_t* TMemoryBuffer::borrowSlow(uint8_t* buf, uint32_t* len)
 {
     (void) buf;
-    rBound_ = wBase_;
-    if (available_read() >= *len) {
-        *len = available_read();
+    if (wBase_ > rBound_) {
+        rBound_ = wBase_;
+    }
+    uint32_t avail = static_cast<uint32_t>(rBound_ - rBase_);
+    if (avail >= *len) {
+        *len = avail;
         return rBase_;
     }
     return NULL;
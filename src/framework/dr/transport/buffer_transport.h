@@ -433,6 +433,16 @@ public:
     // that had been provided by getWritePtr().
     void wroteBytes(uint32_t len);
 
+    // Returns all unread bytes without consuming them, for decoders that parse
+    // straight out of the buffer.  Follow with consume() of what was parsed.
+    const uint8_t* borrowAll(uint32_t* len) {
+        if (wBase_ > rBound_) {
+            rBound_ = wBase_;
+        }
+        *len = static_cast<uint32_t>(rBound_ - rBase_);
+        return rBase_;
+    }
+
     /*
      * TVirtualTransport provides a default implementation of readAll().
      * We want to use the TBufferBase version instead.
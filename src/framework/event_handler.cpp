@@ -12,6 +12,8 @@
  */
 
 #include "framework/event_handler.inh"
+#include "framework/monitor.h"
+#include "framework/rpc.h"
 #include "framework/stat.h"
 #include "framework/stat_manager.h"
 
@@ -28,6 +30,18 @@ void RpcEventHandler::OnRequestProcComplete(const std::string& name,
     }
 }
 
+void RpcEventHandler::OnRequestLatencySample(int32_t result, int32_t time_cost_ms) {
+    if (!m_concurrency_limiter) {
+        return;
+    }
+    // 过载拒绝(各种过载原因的组合)和找不到服务的请求没有经过处理，不作为时延样本
+    if ((result <= kRPC_SYSTEM_OVERLOAD_BASE && result > kRPC_SYSTEM_OVERLOAD_BASE - 4)
+        || result == kRPC_UNSUPPORT_FUNCTION_NAME) {
+        return;
+    }
+    m_concurrency_limiter->OnSample(time_cost_ms);
+}
+
 void RpcEventHandler::OnResponseProcComplete(const std::string& name,
     int32_t result, int32_t time_cost_ms) {
     if (m_stat_manager) {
@@ -0,0 +1,1083 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common/string_utility.h"
+#include "common/time_utility.h"
+#include "framework/loopback_message_driver.h"
+#include "framework/net_message.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+
+namespace pebble {
+
+static const char* INPROC_SCHEME = "inproc://";
+static const char* SHM_SCHEME    = "shm://";
+
+/// @brief shm://的unix socket使用抽象命名空间，不在文件系统中留下文件
+static const char* SHM_SOCKET_PREFIX = "pebble.shm.";
+
+/// @brief 共享内存及握手消息的校验字
+static const uint32_t SHM_MAGIC = 0x50424C53;
+
+/// @brief 环形队列尾部剩余空间放不下消息时写入此长度，消费者跳到队列头部
+static const uint32_t SHM_WRAP_MARK = 0xFFFFFFFF;
+
+/// @brief 环形队列中每个消息的头部，[uint32_t len][uint32_t reserved]，消息按8字节对齐
+static const uint32_t SHM_RECORD_HEAD_LEN = 8;
+
+/// @brief 连接状态
+enum {
+    kLOOPBACK_LISTEN    = 0,
+    kLOOPBACK_ACCEPTED  = 1,
+    kLOOPBACK_CONNECTED = 2,
+};
+
+/// @brief inproc消息块，块头和数据在同一块内存中，Peek直接返回块内数据
+struct InprocMsg {
+    InprocMsg* _next;
+    uint32_t   _block_size;
+    uint32_t   _len;
+    int64_t    _arrived_ms;
+
+    uint8_t* Data() {
+        return reinterpret_cast<uint8_t*>(this + 1);
+    }
+};
+
+/// @brief 单生产者单消费者环形队列，head只由消费者写，tail只由生产者写，分属不同cache line
+struct ShmRing {
+    volatile uint32_t _head;
+    char              _pad0[60];
+    volatile uint32_t _tail;
+    char              _pad1[60];
+};
+
+/// @brief 共享内存布局，头部之后依次是两个方向的队列数据
+struct ShmChannel {
+    uint32_t _magic;
+    uint32_t _ring_len;
+    char     _pad[56];
+    ShmRing  _rings[2];     // 0: connect -> bind, 1: bind -> connect
+};
+
+/// @brief 握手消息，connect端附带共享内存fd和eventfd，bind端回复附带eventfd
+struct ShmHandshake {
+    uint32_t _magic;
+    uint32_t _ring_len;
+};
+
+struct LoopbackEndpoint {
+    LoopbackEndpoint() {
+        _handle         = -1;
+        _listen_handle  = -1;
+        _type           = kLOOPBACK_CONNECTED;
+        _shm            = false;
+        _peer_closed    = false;
+        _arrived_ms     = 0;
+
+        _peer           = NULL;
+        _msg_head       = NULL;
+        _msg_tail       = NULL;
+        _msg_num        = 0;
+
+        _sock_fd        = -1;
+        _event_fd       = -1;
+        _peer_event_fd  = -1;
+        _handshaked     = false;
+        _channel        = NULL;
+        _channel_len    = 0;
+        _ring_len       = 0;
+        _send_ring      = NULL;
+        _send_data      = NULL;
+        _recv_ring      = NULL;
+        _recv_data      = NULL;
+
+        _in_ready_list  = false;
+        _ready_prev     = NULL;
+        _ready_next     = NULL;
+    }
+
+    bool HasNewMsg() const {
+        if (!_shm) {
+            return _msg_head != NULL;
+        }
+        return _recv_ring != NULL
+            && _recv_ring->_head != __atomic_load_n(&_recv_ring->_tail, __ATOMIC_ACQUIRE);
+    }
+
+    int64_t      _handle;
+    int64_t      _listen_handle;    // 服务端连接对应的Bind句柄
+    int32_t      _type;
+    bool         _shm;
+    bool         _peer_closed;
+    std::string  _name;             // Bind的名字
+    int64_t      _arrived_ms;
+
+    // inproc，对端Send时直接把消息块挂到本端的接收队列
+    LoopbackEndpoint* _peer;
+    InprocMsg*   _msg_head;
+    InprocMsg*   _msg_tail;
+    uint32_t     _msg_num;
+
+    // shm
+    int32_t      _sock_fd;          // unix socket，listen或握手及断线检测
+    int32_t      _event_fd;         // 本端的eventfd，对端写此fd唤醒本端，可读时只需检查本连接
+    int32_t      _peer_event_fd;    // 对端的eventfd
+    bool         _handshaked;
+    uint8_t*     _channel;
+    uint32_t     _channel_len;
+    uint32_t     _ring_len;
+    ShmRing*     _send_ring;
+    uint8_t*     _send_data;
+    ShmRing*     _recv_ring;
+    uint8_t*     _recv_data;
+
+    // 就绪链表节点
+    bool              _in_ready_list;
+    LoopbackEndpoint* _ready_prev;
+    LoopbackEndpoint* _ready_next;
+};
+
+static uint32_t AlignRecordLen(uint32_t msg_len) {
+    return (SHM_RECORD_HEAD_LEN + msg_len + 7) & ~7U;
+}
+
+static uint32_t RoundUpPowerOf2(uint32_t len) {
+    uint32_t ret = 4096;
+    while (ret < len) {
+        ret <<= 1;
+    }
+    return ret;
+}
+
+static void SetShmSocketAddr(const std::string& name, struct sockaddr_un* addr, socklen_t* addr_len) {
+    std::string path(SHM_SOCKET_PREFIX);
+    path.append(name);
+    if (path.size() > sizeof(addr->sun_path) - 1) {
+        path.resize(sizeof(addr->sun_path) - 1);
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path + 1, path.data(), path.size());
+    *addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + path.size();
+}
+
+static int32_t SendFds(int32_t sock_fd, const ShmHandshake& handshake,
+    const int32_t* fds, uint32_t fd_num) {
+    char control[CMSG_SPACE(sizeof(int32_t) * 2)];
+    struct iovec iov;
+    iov.iov_base = const_cast<ShmHandshake*>(&handshake);
+    iov.iov_len  = sizeof(handshake);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int32_t) * fd_num);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(int32_t) * fd_num);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int32_t) * fd_num);
+
+    return (sendmsg(sock_fd, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(handshake))) ? 0 : -1;
+}
+
+LoopbackMessageDriver::LoopbackMessageDriver() {
+    m_fallback     = NULL;
+    m_raw          = NULL;
+    m_msg_buff_len = RawMessageDriver::DEFAULT_MSG_BUFF_LEN;
+    m_shm_ring_len = DEFAULT_SHM_RING_LEN;
+    m_handle_seq   = 1;
+    m_continuous_ready_num = 0;
+    m_ready_head   = NULL;
+    m_ready_tail   = NULL;
+    m_last_error[0] = 0;
+}
+
+LoopbackMessageDriver::~LoopbackMessageDriver() {
+    // 进程退出时只释放资源，fd关闭后自动从epoll中移除
+    cxx::unordered_map<int64_t, LoopbackEndpoint*>::iterator it = m_endpoints.begin();
+    for (; it != m_endpoints.end(); ++it) {
+        LoopbackEndpoint* endpoint = it->second;
+        while (endpoint->_msg_head != NULL) {
+            InprocMsg* msg = endpoint->_msg_head;
+            endpoint->_msg_head = msg->_next;
+            m_buff_pool.Free(reinterpret_cast<uint8_t*>(msg), msg->_block_size);
+        }
+        if (endpoint->_sock_fd >= 0) {
+            close(endpoint->_sock_fd);
+        }
+        if (endpoint->_event_fd >= 0) {
+            close(endpoint->_event_fd);
+        }
+        if (endpoint->_peer_event_fd >= 0) {
+            close(endpoint->_peer_event_fd);
+        }
+        if (endpoint->_channel != NULL) {
+            munmap(endpoint->_channel, endpoint->_channel_len);
+        }
+        delete endpoint;
+    }
+    m_endpoints.clear();
+}
+
+int32_t LoopbackMessageDriver::Init(MessageDriver* fallback, RawMessageDriver* raw,
+    uint32_t msg_buff_len, uint32_t shm_ring_len) {
+    if (fallback == NULL || raw == NULL) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+    m_fallback     = fallback;
+    m_raw          = raw;
+    m_msg_buff_len = msg_buff_len;
+
+    // 队列至少能容纳两个最大消息，保证队列为空时任意位置都能写入一个最大消息
+    uint32_t min_ring_len = 2 * AlignRecordLen(msg_buff_len);
+    m_shm_ring_len = RoundUpPowerOf2(shm_ring_len > min_ring_len ? shm_ring_len : min_ring_len);
+
+    int32_t ret = m_buff_pool.Init(256, msg_buff_len + sizeof(InprocMsg),
+        NetMessage::MAX_CACHED_BUFF_LEN);
+    if (ret != 0) {
+        _LOG_LAST_ERROR("buff pool init failed(%d)", ret);
+        return kMESSAGE_INVAILD_PARAM;
+    }
+    return 0;
+}
+
+int64_t LoopbackMessageDriver::Bind(const std::string& url) {
+    if (m_fallback == NULL) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    if (StringUtility::StartsWith(url, INPROC_SCHEME)) {
+        return BindInproc(url.substr(strlen(INPROC_SCHEME)));
+    }
+    if (StringUtility::StartsWith(url, SHM_SCHEME)) {
+        return BindShm(url.substr(strlen(SHM_SCHEME)));
+    }
+    return m_fallback->Bind(url);
+}
+
+int64_t LoopbackMessageDriver::Connect(const std::string& url) {
+    if (m_fallback == NULL) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    if (StringUtility::StartsWith(url, INPROC_SCHEME)) {
+        return ConnectInproc(url.substr(strlen(INPROC_SCHEME)));
+    }
+    if (StringUtility::StartsWith(url, SHM_SCHEME)) {
+        return ConnectShm(url.substr(strlen(SHM_SCHEME)));
+    }
+    return m_fallback->Connect(url);
+}
+
+int32_t LoopbackMessageDriver::Send(int64_t handle, const uint8_t* msg, uint32_t msg_len,
+    int32_t flag) {
+    if (!IsLoopbackHandle(handle)) {
+        return m_fallback ? m_fallback->Send(handle, msg, msg_len, flag) : kMESSAGE_UNINSTALL_DRIVER;
+    }
+    const uint8_t* frags[1] = { msg     };
+    uint32_t fragslen[1]    = { msg_len };
+    return SendV(handle, 1, frags, fragslen, flag);
+}
+
+int32_t LoopbackMessageDriver::SendV(int64_t handle, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag) {
+    if (!IsLoopbackHandle(handle)) {
+        return m_fallback ? m_fallback->SendV(handle, msg_frag_num, msg_frag, msg_frag_len, flag)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    LoopbackEndpoint* endpoint = GetEndpoint(handle);
+    if (endpoint == NULL) {
+        _LOG_LAST_ERROR("get endpoint %ld failed", handle);
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    if (endpoint->_type == kLOOPBACK_LISTEN) {
+        _LOG_LAST_ERROR("can't send to listen handle %ld", handle);
+        return kMESSAGE_INVAILD_PARAM;
+    }
+    if (endpoint->_peer_closed) {
+        _LOG_LAST_ERROR("peer of %ld closed", handle);
+        return kMESSAGE_ON_DISCONNECTED;
+    }
+
+    uint32_t msg_len = 0;
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        msg_len += msg_frag_len[i];
+    }
+    if (msg_len > m_msg_buff_len) {
+        _LOG_LAST_ERROR("bufflen(%u) < msglen(%u)", m_msg_buff_len, msg_len);
+        return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+    }
+
+    if (endpoint->_shm) {
+        return SendShm(endpoint, msg_frag_num, msg_frag, msg_frag_len, msg_len);
+    }
+    return SendInproc(endpoint, msg_frag_num, msg_frag, msg_frag_len, msg_len);
+}
+
+int32_t LoopbackMessageDriver::Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
+    MsgExternInfo* msg_info) {
+    if (!IsLoopbackHandle(handle)) {
+        return m_fallback ? m_fallback->Recv(handle, msg_buff, buff_len, msg_info)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    const uint8_t* msg = NULL;
+    uint32_t msg_len = 0;
+    int32_t ret = Peek(handle, &msg, &msg_len, msg_info);
+    if (ret != 0) {
+        return ret;
+    }
+    if (*buff_len < msg_len) {
+        return kMESSAGE_RECV_BUFF_NOT_ENOUGH;
+    }
+    memcpy(msg_buff, msg, msg_len);
+    *buff_len = msg_len;
+
+    return Pop(handle);
+}
+
+int32_t LoopbackMessageDriver::Peek(int64_t handle, const uint8_t** msg, uint32_t* msg_len,
+    MsgExternInfo* msg_info) {
+    if (!IsLoopbackHandle(handle)) {
+        return m_fallback ? m_fallback->Peek(handle, msg, msg_len, msg_info)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    LoopbackEndpoint* endpoint = GetEndpoint(handle);
+    if (endpoint == NULL) {
+        _LOG_LAST_ERROR("get endpoint %ld failed", handle);
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    if (!endpoint->HasNewMsg()) {
+        _LOG_LAST_ERROR("no msg");
+        return kMESSAGE_RECV_EMPTY;
+    }
+
+    if (!endpoint->_shm) {
+        *msg     = endpoint->_msg_head->Data();
+        *msg_len = endpoint->_msg_head->_len;
+        endpoint->_arrived_ms = endpoint->_msg_head->_arrived_ms;
+        return FillMsgInfo(endpoint, msg_info);
+    }
+
+    // 消息直接在共享内存中返回，Pop之前生产者不会覆盖
+    ShmRing* ring = endpoint->_recv_ring;
+    uint32_t ring_len = endpoint->_ring_len;
+    uint32_t head  = ring->_head;
+    uint32_t avail = __atomic_load_n(&ring->_tail, __ATOMIC_ACQUIRE) - head;
+    uint32_t pos   = head & (ring_len - 1);
+    uint32_t len   = *reinterpret_cast<uint32_t*>(endpoint->_recv_data + pos);
+    if (len == SHM_WRAP_MARK && avail > ring_len - pos) {
+        // 跳过尾部填充，标记和其后的消息是同时发布的
+        avail -= ring_len - pos;
+        head  += ring_len - pos;
+        __atomic_store_n(&ring->_head, head, __ATOMIC_RELEASE);
+        pos = 0;
+        len = *reinterpret_cast<uint32_t*>(endpoint->_recv_data);
+    }
+    // 长度和队列位置由对端进程写入，对端异常或恶意写入时关闭连接，避免越界读
+    if (avail > ring_len || len > ring_len - SHM_RECORD_HEAD_LEN
+        || AlignRecordLen(len) > avail || pos + AlignRecordLen(len) > ring_len) {
+        _LOG_LAST_ERROR("invalid shm record, handle = %ld, len = %u, avail = %u", handle, len, avail);
+        CloseEndpoint(endpoint);
+        return kMESSAGE_RECV_INVALID_DATA;
+    }
+    *msg     = endpoint->_recv_data + pos + SHM_RECORD_HEAD_LEN;
+    *msg_len = len;
+    return FillMsgInfo(endpoint, msg_info);
+}
+
+int32_t LoopbackMessageDriver::Pop(int64_t handle) {
+    if (!IsLoopbackHandle(handle)) {
+        return m_fallback ? m_fallback->Pop(handle) : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    LoopbackEndpoint* endpoint = GetEndpoint(handle);
+    if (endpoint == NULL) {
+        _LOG_LAST_ERROR("get endpoint %ld failed", handle);
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    if (!endpoint->HasNewMsg()) {
+        _LOG_LAST_ERROR("no msg");
+        return kMESSAGE_RECV_EMPTY;
+    }
+
+    if (!endpoint->_shm) {
+        InprocMsg* msg = endpoint->_msg_head;
+        endpoint->_msg_head = msg->_next;
+        if (endpoint->_msg_head == NULL) {
+            endpoint->_msg_tail = NULL;
+        }
+        endpoint->_msg_num--;
+        m_buff_pool.Free(reinterpret_cast<uint8_t*>(msg), msg->_block_size);
+    } else {
+        const uint8_t* msg = NULL;
+        uint32_t msg_len = 0;
+        int32_t ret = Peek(handle, &msg, &msg_len, NULL);
+        if (ret != 0) {
+            // 消息非法，连接已关闭
+            return ret;
+        }
+        ShmRing* ring = endpoint->_recv_ring;
+        __atomic_store_n(&ring->_head, ring->_head + AlignRecordLen(msg_len), __ATOMIC_RELEASE);
+        // 与生产者的fence配对：要么生产者看到队列已空而唤醒本端，要么本端看到新的tail
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    // 还有消息的连接重新排到就绪链表尾部，避免单个连接独占
+    UnlinkReadyEndpoint(endpoint);
+    if (endpoint->HasNewMsg()) {
+        LinkReadyEndpoint(endpoint);
+    } else if (endpoint->_peer_closed && endpoint->_type == kLOOPBACK_ACCEPTED) {
+        CloseEndpoint(endpoint);
+    }
+    return 0;
+}
+
+int32_t LoopbackMessageDriver::Close(int64_t handle) {
+    if (!IsLoopbackHandle(handle)) {
+        return m_fallback ? m_fallback->Close(handle) : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    LoopbackEndpoint* endpoint = GetEndpoint(handle);
+    if (endpoint != NULL) {
+        CloseEndpoint(endpoint);
+    }
+    return 0;
+}
+
+int32_t LoopbackMessageDriver::Poll(int64_t* handle, int32_t* event, int32_t timeout_ms) {
+    if (m_fallback == NULL) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    if (m_ready_head != NULL) {
+        if (++m_continuous_ready_num < MAX_CONTINUOUS_READY_NUM) {
+            *handle = m_ready_head->_handle;
+            return 0;
+        }
+        m_continuous_ready_num = 0;
+        if (m_fallback->Poll(handle, event, 0) == 0) {
+            return 0;
+        }
+        *handle = m_ready_head->_handle;
+        return 0;
+    }
+    m_continuous_ready_num = 0;
+
+    // eventfd和unix socket挂在RAW驱动的epoll上，事件在fallback的Poll中回调
+    int32_t ret = m_fallback->Poll(handle, event, timeout_ms);
+    if (ret == 0) {
+        return 0;
+    }
+    if (m_ready_head != NULL) {
+        *handle = m_ready_head->_handle;
+        return 0;
+    }
+    return ret;
+}
+
+int32_t LoopbackMessageDriver::ReportHandleResult(int64_t handle, int32_t result, int64_t time_cost) {
+    if (!IsLoopbackHandle(handle)) {
+        return m_fallback ? m_fallback->ReportHandleResult(handle, result, time_cost)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+    return kMESSAGE_UNSUPPORT;
+}
+
+int32_t LoopbackMessageDriver::GetUsedSize(int64_t handle, uint32_t* remain_size,
+    uint32_t* max_size) {
+    if (!IsLoopbackHandle(handle)) {
+        return m_fallback ? m_fallback->GetUsedSize(handle, remain_size, max_size)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    LoopbackEndpoint* endpoint = GetEndpoint(handle);
+    if (endpoint == NULL) {
+        _LOG_LAST_ERROR("get endpoint %ld failed", handle);
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    if (!endpoint->_shm || endpoint->_send_ring == NULL) {
+        return kMESSAGE_UNSUPPORT;
+    }
+    ShmRing* ring = endpoint->_send_ring;
+    uint32_t used = ring->_tail - __atomic_load_n(&ring->_head, __ATOMIC_ACQUIRE);
+    *remain_size = endpoint->_ring_len - used;
+    *max_size    = endpoint->_ring_len;
+    return 0;
+}
+
+const char* LoopbackMessageDriver::GetLastError() {
+    if (m_last_error[0] == 0 && m_fallback != NULL) {
+        return m_fallback->GetLastError();
+    }
+    return m_last_error;
+}
+
+LoopbackEndpoint* LoopbackMessageDriver::GetEndpoint(int64_t handle) {
+    cxx::unordered_map<int64_t, LoopbackEndpoint*>::iterator it = m_endpoints.find(handle);
+    if (it == m_endpoints.end()) {
+        return NULL;
+    }
+    return it->second;
+}
+
+LoopbackEndpoint* LoopbackMessageDriver::CreateEndpoint(int32_t type, bool shm) {
+    LoopbackEndpoint* endpoint = new LoopbackEndpoint();
+    endpoint->_type   = type;
+    endpoint->_shm    = shm;
+    endpoint->_handle = ((m_handle_seq++ & 0x7FFFFFFFLL) << 32) | LOOPBACK_HANDLE_FLAG;
+    m_endpoints[endpoint->_handle] = endpoint;
+    return endpoint;
+}
+
+void LoopbackMessageDriver::CloseEndpoint(LoopbackEndpoint* endpoint) {
+    UnlinkReadyEndpoint(endpoint);
+
+    if (endpoint->_type == kLOOPBACK_LISTEN && !endpoint->_shm) {
+        m_inproc_names.erase(endpoint->_name);
+    }
+
+    if (endpoint->_peer != NULL) {
+        LoopbackEndpoint* peer = endpoint->_peer;
+        endpoint->_peer = NULL;
+        peer->_peer     = NULL;
+        OnPeerClosed(peer);
+    }
+    while (endpoint->_msg_head != NULL) {
+        InprocMsg* msg = endpoint->_msg_head;
+        endpoint->_msg_head = msg->_next;
+        m_buff_pool.Free(reinterpret_cast<uint8_t*>(msg), msg->_block_size);
+    }
+
+    // 关闭unix socket后对端收到EOF
+    if (endpoint->_sock_fd >= 0) {
+        m_raw->RemoveEventFd(endpoint->_sock_fd);
+        close(endpoint->_sock_fd);
+    }
+    if (endpoint->_event_fd >= 0) {
+        m_raw->RemoveEventFd(endpoint->_event_fd);
+        close(endpoint->_event_fd);
+    }
+    if (endpoint->_peer_event_fd >= 0) {
+        close(endpoint->_peer_event_fd);
+    }
+    if (endpoint->_channel != NULL) {
+        munmap(endpoint->_channel, endpoint->_channel_len);
+    }
+
+    m_endpoints.erase(endpoint->_handle);
+    delete endpoint;
+}
+
+void LoopbackMessageDriver::OnPeerClosed(LoopbackEndpoint* endpoint) {
+    endpoint->_peer_closed = true;
+    if (endpoint->_sock_fd >= 0) {
+        // EOF会一直可读，不再监听
+        m_raw->RemoveEventFd(endpoint->_sock_fd);
+        close(endpoint->_sock_fd);
+        endpoint->_sock_fd = -1;
+    }
+    // 服务端连接在未读消息读完后释放，客户端句柄由用户Close
+    if (endpoint->_type == kLOOPBACK_ACCEPTED && !endpoint->HasNewMsg()) {
+        CloseEndpoint(endpoint);
+    }
+}
+
+int64_t LoopbackMessageDriver::BindInproc(const std::string& name) {
+    if (name.empty()) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+    if (m_inproc_names.find(name) != m_inproc_names.end()) {
+        _LOG_LAST_ERROR("inproc://%s already bound", name.c_str());
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+
+    LoopbackEndpoint* listener = CreateEndpoint(kLOOPBACK_LISTEN, false);
+    listener->_name = name;
+    m_inproc_names[name] = listener->_handle;
+    return listener->_handle;
+}
+
+int64_t LoopbackMessageDriver::ConnectInproc(const std::string& name) {
+    cxx::unordered_map<std::string, int64_t>::iterator it = m_inproc_names.find(name);
+    if (it == m_inproc_names.end()) {
+        _LOG_LAST_ERROR("inproc://%s not bound", name.c_str());
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+
+    // 连接立即建立，服务端连接在收到第一个消息时由Poll返回
+    LoopbackEndpoint* client = CreateEndpoint(kLOOPBACK_CONNECTED, false);
+    LoopbackEndpoint* server = CreateEndpoint(kLOOPBACK_ACCEPTED, false);
+    server->_listen_handle = it->second;
+    client->_peer = server;
+    server->_peer = client;
+    return client->_handle;
+}
+
+int64_t LoopbackMessageDriver::BindShm(const std::string& name) {
+    if (name.empty()) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    int32_t fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        _LOG_LAST_ERROR("socket failed(%s)", strerror(errno));
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+    struct sockaddr_un addr;
+    socklen_t addr_len = 0;
+    SetShmSocketAddr(name, &addr, &addr_len);
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) != 0
+        || listen(fd, 1024) != 0) {
+        _LOG_LAST_ERROR("listen shm://%s failed(%s)", name.c_str(), strerror(errno));
+        close(fd);
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+
+    LoopbackEndpoint* listener = CreateEndpoint(kLOOPBACK_LISTEN, true);
+    listener->_name    = name;
+    listener->_sock_fd = fd;
+    if (m_raw->AddEventFd(fd, cxx::bind(&LoopbackMessageDriver::OnSocketEvent,
+        this, listener->_handle)) != 0) {
+        listener->_sock_fd = -1;
+        close(fd);
+        CloseEndpoint(listener);
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+    return listener->_handle;
+}
+
+int64_t LoopbackMessageDriver::ConnectShm(const std::string& name) {
+#ifdef __NR_memfd_create
+    if (name.empty()) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    int32_t fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        _LOG_LAST_ERROR("socket failed(%s)", strerror(errno));
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+    struct sockaddr_un addr;
+    socklen_t addr_len = 0;
+    SetShmSocketAddr(name, &addr, &addr_len);
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) != 0) {
+        _LOG_LAST_ERROR("connect shm://%s failed(%s)", name.c_str(), strerror(errno));
+        close(fd);
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+
+    LoopbackEndpoint* client = CreateEndpoint(kLOOPBACK_CONNECTED, true);
+    client->_sock_fd = fd;
+    if (InitEventFd(client) != 0) {
+        CloseEndpoint(client);
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+
+    // 共享内存由connect端创建，握手后两端各自映射，fd不再需要
+    int32_t mem_fd = syscall(__NR_memfd_create, "pebble_shm", MFD_CLOEXEC);
+    if (mem_fd < 0) {
+        _LOG_LAST_ERROR("memfd_create failed(%s)", strerror(errno));
+        CloseEndpoint(client);
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+    if (MapChannel(client, mem_fd, true) != 0) {
+        close(mem_fd);
+        CloseEndpoint(client);
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+
+    ShmHandshake handshake;
+    handshake._magic    = SHM_MAGIC;
+    handshake._ring_len = client->_ring_len;
+    int32_t fds[2] = { mem_fd, client->_event_fd };
+    int32_t ret = SendFds(fd, handshake, fds, 2);
+    close(mem_fd);
+    if (ret != 0) {
+        _LOG_LAST_ERROR("send handshake to shm://%s failed(%s)", name.c_str(), strerror(errno));
+        CloseEndpoint(client);
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+
+    // 握手回复异步处理，之前Send的消息已经在共享内存中，握手完成后对端即可读取
+    if (m_raw->AddEventFd(fd, cxx::bind(&LoopbackMessageDriver::OnSocketEvent,
+        this, client->_handle)) != 0) {
+        client->_sock_fd = -1;
+        close(fd);
+        CloseEndpoint(client);
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+    return client->_handle;
+#else
+    _LOG_LAST_ERROR("memfd_create unsupported");
+    return kMESSAGE_UNSUPPORT;
+#endif
+}
+
+int32_t LoopbackMessageDriver::SendInproc(LoopbackEndpoint* endpoint, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], const uint32_t msg_frag_len[], uint32_t msg_len) {
+    LoopbackEndpoint* peer = endpoint->_peer;
+    if (peer->_msg_num >= MAX_INPROC_QUEUE_NUM) {
+        _LOG_LAST_ERROR("inproc queue full, handle = %ld", peer->_handle);
+        return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+    }
+
+    uint32_t block_size = 0;
+    uint8_t* block = m_buff_pool.Alloc(sizeof(InprocMsg) + msg_len, &block_size);
+    if (block == NULL) {
+        _LOG_LAST_ERROR("alloc msg block failed, len = %u", msg_len);
+        return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+    }
+
+    InprocMsg* msg   = reinterpret_cast<InprocMsg*>(block);
+    msg->_next       = NULL;
+    msg->_block_size = block_size;
+    msg->_len        = msg_len;
+    msg->_arrived_ms = TimeUtility::GetMonotonicMS();
+    uint8_t* data = msg->Data();
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        memcpy(data, msg_frag[i], msg_frag_len[i]);
+        data += msg_frag_len[i];
+    }
+
+    if (peer->_msg_tail != NULL) {
+        peer->_msg_tail->_next = msg;
+    } else {
+        peer->_msg_head = msg;
+    }
+    peer->_msg_tail = msg;
+    peer->_msg_num++;
+    LinkReadyEndpoint(peer);
+    return 0;
+}
+
+int32_t LoopbackMessageDriver::SendShm(LoopbackEndpoint* endpoint, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], const uint32_t msg_frag_len[], uint32_t msg_len) {
+    ShmRing* ring = endpoint->_send_ring;
+    if (ring == NULL) {
+        _LOG_LAST_ERROR("shm endpoint %ld not ready", endpoint->_handle);
+        return kMESSAGE_SEND_FAILED;
+    }
+
+    uint32_t ring_len   = endpoint->_ring_len;
+    uint32_t record_len = AlignRecordLen(msg_len);
+    uint32_t head = __atomic_load_n(&ring->_head, __ATOMIC_ACQUIRE);
+    uint32_t old_tail = ring->_tail;
+    uint32_t tail = old_tail;
+    uint32_t pos  = tail & (ring_len - 1);
+    uint32_t need_len = record_len;
+    if (ring_len - pos < record_len) {
+        // 尾部放不下，填充后从队列头部写
+        need_len += ring_len - pos;
+    }
+    if (tail - head + need_len > ring_len) {
+        _LOG_LAST_ERROR("shm ring full, handle = %ld", endpoint->_handle);
+        return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+    }
+    if (need_len > record_len) {
+        *reinterpret_cast<uint32_t*>(endpoint->_send_data + pos) = SHM_WRAP_MARK;
+        tail += ring_len - pos;
+        pos = 0;
+    }
+
+    uint8_t* data = endpoint->_send_data + pos;
+    *reinterpret_cast<uint32_t*>(data) = msg_len;
+    data += SHM_RECORD_HEAD_LEN;
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        memcpy(data, msg_frag[i], msg_frag_len[i]);
+        data += msg_frag_len[i];
+    }
+    __atomic_store_n(&ring->_tail, tail + record_len, __ATOMIC_RELEASE);
+
+    // 发送前对端已读完所有消息时，对端可能在等待，需要唤醒
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->_head, __ATOMIC_ACQUIRE) == old_tail && endpoint->_peer_event_fd >= 0) {
+        uint64_t value = 1;
+        if (write(endpoint->_peer_event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+            _LOG_LAST_ERROR("wakeup peer of %ld failed(%s)", endpoint->_handle, strerror(errno));
+        }
+    }
+    return 0;
+}
+
+int32_t LoopbackMessageDriver::InitEventFd(LoopbackEndpoint* endpoint) {
+    int32_t fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        _LOG_LAST_ERROR("eventfd failed(%s)", strerror(errno));
+        return -1;
+    }
+    if (m_raw->AddEventFd(fd, cxx::bind(&LoopbackMessageDriver::OnWakeup,
+        this, endpoint->_handle)) != 0) {
+        _LOG_LAST_ERROR("add eventfd failed(%s)", m_raw->GetLastError());
+        close(fd);
+        return -1;
+    }
+    endpoint->_event_fd = fd;
+    return 0;
+}
+
+void LoopbackMessageDriver::OnWakeup(int64_t handle) {
+    LoopbackEndpoint* endpoint = GetEndpoint(handle);
+    if (endpoint == NULL || endpoint->_event_fd < 0) {
+        return;
+    }
+    uint64_t value = 0;
+    while (read(endpoint->_event_fd, &value, sizeof(value)) > 0) {
+    }
+
+    if (!endpoint->_in_ready_list && endpoint->HasNewMsg()) {
+        endpoint->_arrived_ms = TimeUtility::GetMonotonicMS();
+        LinkReadyEndpoint(endpoint);
+    }
+}
+
+void LoopbackMessageDriver::OnSocketEvent(int64_t handle) {
+    LoopbackEndpoint* endpoint = GetEndpoint(handle);
+    if (endpoint == NULL || endpoint->_sock_fd < 0) {
+        return;
+    }
+    if (endpoint->_type == kLOOPBACK_LISTEN) {
+        OnShmAccept(endpoint);
+        return;
+    }
+
+    ShmHandshake handshake;
+    char control[CMSG_SPACE(sizeof(int32_t) * 2)];
+    struct iovec iov;
+    iov.iov_base = &handshake;
+    iov.iov_len  = sizeof(handshake);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t ret = recvmsg(endpoint->_sock_fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (ret <= 0) {
+        // 对端进程退出或关闭了连接
+        OnPeerClosed(endpoint);
+        return;
+    }
+
+    int32_t fds[2] = { -1, -1 };
+    uint32_t fd_num = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        uint32_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int32_t);
+        for (uint32_t i = 0; i < num && fd_num < 2; i++) {
+            memcpy(&fds[fd_num++], CMSG_DATA(cmsg) + i * sizeof(int32_t), sizeof(int32_t));
+        }
+    }
+    OnShmHandshake(endpoint, reinterpret_cast<const uint8_t*>(&handshake),
+        static_cast<int32_t>(ret), fds, fd_num);
+}
+
+void LoopbackMessageDriver::OnShmAccept(LoopbackEndpoint* listener) {
+    while (true) {
+        int32_t fd = accept4(listener->_sock_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                _LOG_LAST_ERROR("accept shm://%s failed(%s)", listener->_name.c_str(), strerror(errno));
+            }
+            return;
+        }
+
+        LoopbackEndpoint* server = CreateEndpoint(kLOOPBACK_ACCEPTED, true);
+        server->_listen_handle = listener->_handle;
+        server->_sock_fd       = fd;
+        if (m_raw->AddEventFd(fd, cxx::bind(&LoopbackMessageDriver::OnSocketEvent,
+            this, server->_handle)) != 0) {
+            server->_sock_fd = -1;
+            close(fd);
+            CloseEndpoint(server);
+        }
+    }
+}
+
+void LoopbackMessageDriver::OnShmHandshake(LoopbackEndpoint* endpoint, const uint8_t* data,
+    int32_t data_len, const int32_t* fds, uint32_t fd_num) {
+    ShmHandshake handshake;
+    memset(&handshake, 0, sizeof(handshake));
+    if (data_len == static_cast<int32_t>(sizeof(handshake))) {
+        memcpy(&handshake, data, sizeof(handshake));
+    }
+
+    uint32_t expect_fd_num = (endpoint->_type == kLOOPBACK_ACCEPTED) ? 2 : 1;
+    if (endpoint->_handshaked || handshake._magic != SHM_MAGIC || fd_num != expect_fd_num) {
+        _LOG_LAST_ERROR("invalid shm handshake, handle = %ld, fd num = %u", endpoint->_handle, fd_num);
+        for (uint32_t i = 0; i < fd_num; i++) {
+            close(fds[i]);
+        }
+        if (!endpoint->_handshaked) {
+            CloseEndpoint(endpoint);
+        }
+        return;
+    }
+
+    if (endpoint->_type == kLOOPBACK_CONNECTED) {
+        endpoint->_peer_event_fd = fds[0];
+        endpoint->_handshaked    = true;
+        // 握手前已发送的消息对端可能还没看到
+        if (endpoint->_send_ring->_tail != __atomic_load_n(&endpoint->_send_ring->_head,
+            __ATOMIC_ACQUIRE)) {
+            uint64_t value = 1;
+            if (write(endpoint->_peer_event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                _LOG_LAST_ERROR("wakeup peer of %ld failed(%s)", endpoint->_handle, strerror(errno));
+            }
+        }
+        return;
+    }
+
+    int32_t ret = MapChannel(endpoint, fds[0], false);
+    close(fds[0]);
+    endpoint->_peer_event_fd = fds[1];
+    if (ret != 0 || InitEventFd(endpoint) != 0) {
+        CloseEndpoint(endpoint);
+        return;
+    }
+
+    ShmHandshake reply;
+    reply._magic    = SHM_MAGIC;
+    reply._ring_len = endpoint->_ring_len;
+    if (SendFds(endpoint->_sock_fd, reply, &endpoint->_event_fd, 1) != 0) {
+        _LOG_LAST_ERROR("reply shm handshake failed(%s)", strerror(errno));
+        CloseEndpoint(endpoint);
+        return;
+    }
+    endpoint->_handshaked = true;
+
+    if (endpoint->HasNewMsg()) {
+        endpoint->_arrived_ms = TimeUtility::GetMonotonicMS();
+        LinkReadyEndpoint(endpoint);
+    }
+}
+
+int32_t LoopbackMessageDriver::MapChannel(LoopbackEndpoint* endpoint, int32_t fd, bool init) {
+    uint64_t channel_len = sizeof(ShmChannel) + 2ULL * m_shm_ring_len;
+    if (init) {
+        if (ftruncate(fd, channel_len) != 0) {
+            _LOG_LAST_ERROR("ftruncate shm failed(%s)", strerror(errno));
+            return -1;
+        }
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(ShmChannel))) {
+            _LOG_LAST_ERROR("invalid shm fd");
+            return -1;
+        }
+        channel_len = st.st_size;
+    }
+
+    void* addr = mmap(NULL, channel_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        _LOG_LAST_ERROR("mmap shm failed(%s)", strerror(errno));
+        return -1;
+    }
+    endpoint->_channel     = static_cast<uint8_t*>(addr);
+    endpoint->_channel_len = channel_len;
+
+    // 新建的共享内存内容为0，队列为空
+    ShmChannel* channel = reinterpret_cast<ShmChannel*>(addr);
+    if (init) {
+        channel->_magic    = SHM_MAGIC;
+        channel->_ring_len = m_shm_ring_len;
+    }
+    uint32_t ring_len = channel->_ring_len;
+    if (channel->_magic != SHM_MAGIC || ring_len == 0 || (ring_len & (ring_len - 1)) != 0
+        || channel_len != sizeof(ShmChannel) + 2ULL * ring_len) {
+        _LOG_LAST_ERROR("invalid shm channel, ring len = %u", ring_len);
+        return -1;
+    }
+    endpoint->_ring_len = ring_len;
+
+    uint8_t* ring_data = endpoint->_channel + sizeof(ShmChannel);
+    uint32_t send_idx  = (endpoint->_type == kLOOPBACK_CONNECTED) ? 0 : 1;
+    endpoint->_send_ring = &channel->_rings[send_idx];
+    endpoint->_send_data = ring_data + send_idx * ring_len;
+    endpoint->_recv_ring = &channel->_rings[1 - send_idx];
+    endpoint->_recv_data = ring_data + (1 - send_idx) * ring_len;
+    return 0;
+}
+
+void LoopbackMessageDriver::LinkReadyEndpoint(LoopbackEndpoint* endpoint) {
+    if (endpoint->_in_ready_list) {
+        return;
+    }
+    endpoint->_in_ready_list = true;
+    endpoint->_ready_prev = m_ready_tail;
+    endpoint->_ready_next = NULL;
+    if (m_ready_tail != NULL) {
+        m_ready_tail->_ready_next = endpoint;
+    } else {
+        m_ready_head = endpoint;
+    }
+    m_ready_tail = endpoint;
+}
+
+void LoopbackMessageDriver::UnlinkReadyEndpoint(LoopbackEndpoint* endpoint) {
+    if (!endpoint->_in_ready_list) {
+        return;
+    }
+    if (endpoint->_ready_prev != NULL) {
+        endpoint->_ready_prev->_ready_next = endpoint->_ready_next;
+    } else {
+        m_ready_head = endpoint->_ready_next;
+    }
+    if (endpoint->_ready_next != NULL) {
+        endpoint->_ready_next->_ready_prev = endpoint->_ready_prev;
+    } else {
+        m_ready_tail = endpoint->_ready_prev;
+    }
+    endpoint->_in_ready_list = false;
+    endpoint->_ready_prev = NULL;
+    endpoint->_ready_next = NULL;
+}
+
+int32_t LoopbackMessageDriver::FillMsgInfo(LoopbackEndpoint* endpoint, MsgExternInfo* msg_info) {
+    if (msg_info == NULL) {
+        return 0;
+    }
+    msg_info->_msg_arrived_ms = endpoint->_arrived_ms;
+    msg_info->_remote_handle  = endpoint->_handle;
+    msg_info->_self_handle    = (endpoint->_type == kLOOPBACK_ACCEPTED)
+        ? endpoint->_listen_handle : endpoint->_handle;
+    return 0;
+}
+
+} // namespace pebble
@@ -0,0 +1,168 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#ifndef _PEBBLE_COMMON_LOOPBACK_MESSAGE_DRIVER_H_
+#define _PEBBLE_COMMON_LOOPBACK_MESSAGE_DRIVER_H_
+
+#include "common/buffer_pool.h"
+#include "framework/raw_message_driver.h"
+
+
+namespace pebble {
+
+struct LoopbackEndpoint;
+
+/// @brief 同机部署的服务之间的本地通信驱动，不经过TCP协议栈\n
+///   - "inproc://name"：同一进程内通信，Send把消息放入对端的接收队列，对端Peek直接返回该消息块，
+///     不需要系统调用，只有一次拷贝(Send返回后用户的缓冲区即可复用)\n
+///   - "shm://name"：跨进程通信，每个连接使用一块共享内存，内含两个方向的单生产者单消费者无锁环形队列，
+///     Peek直接返回环形队列中的消息，对端从空闲状态被唤醒时才写eventfd，
+///     连接建立时通过unix socket传递共享内存和eventfd，unix socket同时用于检测对端退出\n
+///   Connect时对应的name必须已经Bind，否则返回失败。
+///   其它url及非本驱动创建的句柄都转给fallback处理，eventfd和unix socket挂在RawMessageDriver的epoll上，
+///   fallback阻塞等待时也能被唤醒
+class LoopbackMessageDriver : public MessageDriver {
+protected:
+    LoopbackMessageDriver();
+    LoopbackMessageDriver(const LoopbackMessageDriver& rhs) {}
+public:
+    virtual ~LoopbackMessageDriver();
+
+    static LoopbackMessageDriver* Instance() {
+        static LoopbackMessageDriver s_loopback_message;
+        return &s_loopback_message;
+    }
+
+    /// @brief shm://每个方向环形队列的默认大小
+    static const uint32_t DEFAULT_SHM_RING_LEN = 4 * 1024 * 1024;
+
+    /// @brief inproc://每个连接最多缓存的未读消息数
+    static const uint32_t MAX_INPROC_QUEUE_NUM = 10000;
+
+    /// @brief 初始化
+    /// @param fallback 非本驱动url使用的驱动，需已初始化
+    /// @param raw 用于挂载eventfd和unix socket的RAW驱动，需已初始化
+    /// @param msg_buff_len 单个消息的最大长度
+    /// @param shm_ring_len shm://每个方向环形队列的大小，向上取整为2的幂
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t Init(MessageDriver* fallback, RawMessageDriver* raw,
+        uint32_t msg_buff_len = RawMessageDriver::DEFAULT_MSG_BUFF_LEN,
+        uint32_t shm_ring_len = DEFAULT_SHM_RING_LEN);
+
+    /// @brief 替换非本驱动url使用的驱动，需在Bind/Connect之前调用
+    void SetFallback(MessageDriver* fallback) {
+        m_fallback = fallback;
+    }
+
+    MessageDriver* GetFallback() const {
+        return m_fallback;
+    }
+
+    virtual int64_t Bind(const std::string& url);
+
+    virtual int64_t Connect(const std::string& url);
+
+    virtual int32_t Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag);
+
+    virtual int32_t SendV(int64_t handle, uint32_t msg_frag_num,
+                          const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag);
+
+    virtual int32_t Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
+                         MsgExternInfo* msg_info);
+
+    virtual int32_t Peek(int64_t handle, const uint8_t** msg, uint32_t* msg_len,
+                         MsgExternInfo* msg_info);
+
+    virtual int32_t Pop(int64_t handle);
+
+    virtual int32_t Close(int64_t handle);
+
+    virtual int32_t Poll(int64_t* handle, int32_t* event, int32_t timeout_ms);
+
+    virtual int32_t ReportHandleResult(int64_t handle, int32_t result, int64_t time_cost);
+
+    /// @brief shm://连接返回发送队列的剩余空间和总大小
+    virtual int32_t GetUsedSize(int64_t handle, uint32_t* remain_size, uint32_t* max_size);
+
+    virtual const char* GetLastError();
+
+private:
+    /// @brief 本驱动句柄的低32位为此值，RAW驱动的低32位为socket下标或udp端口，uring驱动为0x80000000
+    static const int64_t LOOPBACK_HANDLE_FLAG = 0x40000000LL;
+
+    /// @brief 连续返回本驱动的事件达到此数量后先Poll一次fallback，避免网络事件饿死
+    static const uint32_t MAX_CONTINUOUS_READY_NUM = 32;
+
+    bool IsLoopbackHandle(int64_t handle) const {
+        return (handle & 0xFFFFFFFFLL) == LOOPBACK_HANDLE_FLAG;
+    }
+
+    LoopbackEndpoint* GetEndpoint(int64_t handle);
+
+    LoopbackEndpoint* CreateEndpoint(int32_t type, bool shm);
+
+    /// @brief 释放连接，通知对端
+    void CloseEndpoint(LoopbackEndpoint* endpoint);
+
+    /// @brief 对端已关闭，未读消息读完后服务端连接自动释放
+    void OnPeerClosed(LoopbackEndpoint* endpoint);
+
+    int64_t BindInproc(const std::string& name);
+    int64_t ConnectInproc(const std::string& name);
+    int64_t BindShm(const std::string& name);
+    int64_t ConnectShm(const std::string& name);
+
+    int32_t SendInproc(LoopbackEndpoint* endpoint, uint32_t msg_frag_num,
+        const uint8_t* msg_frag[], const uint32_t msg_frag_len[], uint32_t msg_len);
+    int32_t SendShm(LoopbackEndpoint* endpoint, uint32_t msg_frag_num,
+        const uint8_t* msg_frag[], const uint32_t msg_frag_len[], uint32_t msg_len);
+
+    /// @brief 创建shm连接本端的eventfd，对端写此fd唤醒本端
+    int32_t InitEventFd(LoopbackEndpoint* endpoint);
+
+    /// @brief shm连接的eventfd可读，只检查该连接的接收队列
+    void OnWakeup(int64_t handle);
+
+    /// @brief unix socket可读，处理accept、握手及对端退出
+    void OnSocketEvent(int64_t handle);
+    void OnShmAccept(LoopbackEndpoint* listener);
+    void OnShmHandshake(LoopbackEndpoint* endpoint, const uint8_t* data, int32_t data_len,
+        const int32_t* fds, uint32_t fd_num);
+
+    /// @brief 映射共享内存并初始化环形队列指针
+    int32_t MapChannel(LoopbackEndpoint* endpoint, int32_t fd, bool init);
+
+    void LinkReadyEndpoint(LoopbackEndpoint* endpoint);
+    void UnlinkReadyEndpoint(LoopbackEndpoint* endpoint);
+
+    int32_t FillMsgInfo(LoopbackEndpoint* endpoint, MsgExternInfo* msg_info);
+
+private:
+    MessageDriver*     m_fallback;
+    RawMessageDriver*  m_raw;
+    uint32_t           m_msg_buff_len;
+    uint32_t           m_shm_ring_len;
+    int64_t            m_handle_seq;
+    uint32_t           m_continuous_ready_num;
+    BufferPool         m_buff_pool;         // inproc消息块
+    cxx::unordered_map<int64_t, LoopbackEndpoint*> m_endpoints;
+    cxx::unordered_map<std::string, int64_t> m_inproc_names;
+    LoopbackEndpoint*  m_ready_head;
+    LoopbackEndpoint*  m_ready_tail;
+    char               m_last_error[256];
+};
+
+} // namespace pebble
+
+#endif // _PEBBLE_COMMON_LOOPBACK_MESSAGE_DRIVER_H_
@@ -12,8 +12,10 @@
  */
 
 
+#include "framework/loopback_message_driver.h"
 #include "framework/message.h"
 #include "framework/raw_message_driver.h"
+#include "framework/uring_message_driver.h"
 
 namespace pebble {
 
@@ -48,7 +50,15 @@ class DefaultMessageDriver {
 public:
     DefaultMessageDriver() {
         RawMessageDriver* driver = RawMessageDriver::Instance();
-        if (driver->Init() == 0) {
+        if (driver->Init() != 0) {
+            return;
+        }
+        // inproc://、shm://由本地通信驱动处理，其它url仍转给RAW驱动
+        // io_uring驱动默认不启用，由Message::EnableUringDriver插入到两者之间
+        LoopbackMessageDriver* loopback_driver = LoopbackMessageDriver::Instance();
+        if (loopback_driver->Init(driver, driver) == 0) {
+            Message::SetMessageDriver(loopback_driver);
+        } else {
             Message::SetMessageDriver(driver);
         }
     }
@@ -58,6 +68,7 @@ static DefaultMessageDriver s_default_message_driver;
 
 
 MessageDriver* Message::m_driver = NULL;
+__thread MessageDriver* Message::m_thread_driver = NULL;
 
 int32_t Message::Init()
 {
@@ -66,24 +77,27 @@ int32_t Message::Init()
 
 int64_t Message::Bind(const std::string &url)
 {
-    if (m_driver) {
-        return m_driver->Bind(url);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->Bind(url);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
 
 int64_t Message::Connect(const std::string &url)
 {
-    if (m_driver) {
-        return m_driver->Connect(url);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->Connect(url);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
 
 int32_t Message::Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag)
 {
-    if (m_driver) {
-        return m_driver->Send(handle, msg, msg_len, flag);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->Send(handle, msg, msg_len, flag);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
@@ -91,8 +105,9 @@ int32_t Message::Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int3
 int32_t Message::SendV(int64_t handle, uint32_t msg_frag_num,
                        const uint8_t* msg_frag[], uint32_t msg_frag_len[], int flag)
 {
-    if (m_driver) {
-        return m_driver->SendV(handle, msg_frag_num, msg_frag, msg_frag_len, flag);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->SendV(handle, msg_frag_num, msg_frag, msg_frag_len, flag);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
@@ -100,8 +115,9 @@ int32_t Message::SendV(int64_t handle, uint32_t msg_frag_num,
 int32_t Message::Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
                       MsgExternInfo* msg_info)
 {
-    if (m_driver) {
-        return m_driver->Recv(handle, msg_buff, buff_len, msg_info);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->Recv(handle, msg_buff, buff_len, msg_info);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
@@ -109,56 +125,63 @@ int32_t Message::Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
 int32_t Message::Peek(int64_t handle, const uint8_t* *msg, uint32_t* msg_len,
                       MsgExternInfo* msg_info)
 {
-    if (m_driver) {
-        return m_driver->Peek(handle, msg, msg_len, msg_info);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->Peek(handle, msg, msg_len, msg_info);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
 
 int32_t Message::Pop(int64_t handle)
 {
-    if (m_driver) {
-        return m_driver->Pop(handle);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->Pop(handle);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
 
 int32_t Message::Close(int64_t handle)
 {
-    if (m_driver) {
-        return m_driver->Close(handle);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->Close(handle);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
 
 int32_t Message::Poll(int64_t* handle, int32_t* event, int32_t timeout)
 {
-    if (m_driver) {
-        return m_driver->Poll(handle, event, timeout);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->Poll(handle, event, timeout);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
 
 int32_t Message::ReportHandleResult(int64_t handle, int32_t result, int64_t time_cost)
 {
-    if (m_driver) {
-        return m_driver->ReportHandleResult(handle, result, time_cost);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->ReportHandleResult(handle, result, time_cost);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
 
 int32_t Message::GetUsedSize(int64_t handle, uint32_t* remain_size, uint32_t* max_size)
 {
-    if (m_driver) {
-        return m_driver->GetUsedSize(handle, remain_size, max_size);
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->GetUsedSize(handle, remain_size, max_size);
     }
     return kMESSAGE_UNINSTALL_DRIVER;
 }
 
 const char* Message::GetLastError()
 {
-    if (m_driver) {
-        return m_driver->GetLastError();
+    MessageDriver* driver = GetDriver();
+    if (driver) {
+        return driver->GetLastError();
     }
     return "no driver installed.";
 }
@@ -168,5 +191,35 @@ void Message::SetMessageDriver(MessageDriver* driver)
     m_driver = driver;
 }
 
+void Message::SetThreadMessageDriver(MessageDriver* driver)
+{
+    m_thread_driver = driver;
+}
+
+int32_t Message::EnableUringDriver()
+{
+    RawMessageDriver* raw_driver = RawMessageDriver::Instance();
+    UringMessageDriver* uring_driver = UringMessageDriver::Instance();
+    LoopbackMessageDriver* loopback_driver = LoopbackMessageDriver::Instance();
+    if (m_driver == uring_driver || loopback_driver->GetFallback() == uring_driver) {
+        return 0;
+    }
+    // 用户自己安装的驱动不做替换
+    if (m_driver != raw_driver && m_driver != loopback_driver) {
+        return kMESSAGE_UNSUPPORT;
+    }
+
+    int32_t ret = uring_driver->Init(raw_driver);
+    if (ret != 0) {
+        return ret;
+    }
+    if (m_driver == loopback_driver) {
+        loopback_driver->SetFallback(uring_driver);
+    } else {
+        m_driver = uring_driver;
+    }
+    return 0;
+}
+
 
 } // namespace pebble
@@ -47,7 +47,7 @@ typedef enum {
 struct MsgExternInfo {
     int64_t     _self_handle;       // bind或connect获得的handle
     int64_t     _remote_handle;     // 远端handle
-    int64_t     _msg_arrived_ms;    // 消息到达时间
+    int64_t     _msg_arrived_ms;    // 消息到达时间，单调时钟毫秒 @see TimeUtility::GetMonotonicMS
 };
 
 /// @brief 网络驱动接口
@@ -199,8 +199,24 @@ public:
     /// @return -1 表示失败
     static void SetMessageDriver(MessageDriver* driver);
 
+    /// @brief 设置当前线程使用的通信驱动，多reactor模式下每个线程使用自己的驱动，
+    ///     设置后本线程的Message接口都使用此驱动，其它线程不受影响
+    /// @param driver 本线程使用的驱动，为NULL时恢复使用SetMessageDriver设置的全局驱动
+    static void SetThreadMessageDriver(MessageDriver* driver);
+
+    /// @brief 启用io_uring驱动处理"uring://"地址，默认不启用，未启用时uring://地址不可用
+    /// @return 0 表示成功
+    /// @return <0 表示失败，已通过SetMessageDriver安装了其它驱动时返回kMESSAGE_UNSUPPORT
+    /// @note 需在Bind/Connect uring://地址前调用，只作用于全局驱动，多reactor时只在主reactor可用
+    static int32_t EnableUringDriver();
+
 private:
+    static MessageDriver* GetDriver() {
+        return m_thread_driver ? m_thread_driver : m_driver;
+    }
+
     static MessageDriver* m_driver;
+    static __thread MessageDriver* m_thread_driver;
 };
 
 } // namespace pebble
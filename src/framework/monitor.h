@@ -14,6 +14,7 @@
 #ifndef _PEBBLE_APP_MONITOR_H_
 #define _PEBBLE_APP_MONITOR_H_
 
+#include <math.h>
 #include <vector>
 
 #include "common/platform.h"
@@ -22,6 +23,8 @@
 
 namespace pebble {
 
+class IProcessor;
+
 enum OverLoadType {
     kNO_OVERLOAD     = 0,   // 未过载
     kMESSAGE_EXPIRED = 0x1, // 消息过期
@@ -78,7 +81,7 @@ public:
     }
 
     virtual uint32_t IsOverLoad() {
-        return (m_arrived_ms + m_expire_threshold_ms) < TimeUtility::GetCurrentMS()
+        return (m_arrived_ms + m_expire_threshold_ms) < TimeUtility::GetMonotonicMS()
             ? kMESSAGE_EXPIRED : kNO_OVERLOAD;
     }
 
@@ -87,6 +90,174 @@ private:
     uint32_t m_expire_threshold_ms;
 };
 
+/// @brief 按请求处理时延自适应调整的并发限制(Vegas算法)\n
+///   以观察到的最小处理时延作为无排队时延，每个采样窗口按 limit * (1 - 最小时延 / 平均时延)
+///   估算排队的请求数，排队少于alpha时增大限制，多于beta时减小限制，alpha、beta随限制按对数增长；
+///   处理中的请求数达到限制后新请求按kTASK_OVERLOAD拒绝\n
+///   时延来自请求处理完成事件，精度为ms，亚毫秒的服务只在处理时延明显上升时才收紧限制
+class ConcurrencyLimiter {
+public:
+    ConcurrencyLimiter()
+        :   m_min_limit(DEFAULT_MIN_LIMIT), m_max_limit(UINT32_MAX),
+            m_limit(DEFAULT_INITIAL_LIMIT), m_inflight(0), m_min_latency_ms(0),
+            m_window_start_ms(0), m_window_latency_ms(0), m_window_sample_num(0),
+            m_window_max_inflight(0), m_window_num(0) {}
+    ~ConcurrencyLimiter() {}
+
+    static const uint32_t DEFAULT_MIN_LIMIT      = 10;
+    static const uint32_t DEFAULT_INITIAL_LIMIT  = 20;
+    static const uint32_t SAMPLE_WINDOW_MS       = 100;  // 采样窗口最短时间
+    static const uint32_t SAMPLE_WINDOW_MIN_NUM  = 10;   // 采样窗口最少样本数
+    static const uint32_t MIN_LATENCY_RESET_WINDOWS = 600; // 每隔多少个窗口重新测量最小时延，适应服务本身时延的变化
+
+    /// @brief 设置限制的调整范围
+    void SetLimitRange(uint32_t min_limit, uint32_t max_limit) {
+        m_min_limit = min_limit > 0 ? min_limit : 1;
+        m_max_limit = max_limit > m_min_limit ? max_limit : m_min_limit;
+        m_limit = Clamp(m_limit);
+    }
+
+    /// @brief 设置当前处理中的请求数，在过载判断之前调用
+    void SetInflight(uint32_t inflight) {
+        m_inflight = inflight;
+        if (inflight > m_window_max_inflight) {
+            m_window_max_inflight = inflight;
+        }
+    }
+
+    /// @brief 请求处理完成时调用
+    /// @param latency_ms 请求处理时延
+    void OnSample(int64_t latency_ms) {
+        int64_t now = TimeUtility::GetMonotonicMS();
+        if (0 == m_window_sample_num) {
+            m_window_start_ms = now;
+        }
+        // 精度为ms，按至少1ms计算避免最小时延为0
+        m_window_latency_ms += latency_ms > 0 ? latency_ms : 1;
+        m_window_sample_num++;
+        if (m_window_sample_num < SAMPLE_WINDOW_MIN_NUM || now - m_window_start_ms < SAMPLE_WINDOW_MS) {
+            return;
+        }
+
+        UpdateLimit(static_cast<double>(m_window_latency_ms) / m_window_sample_num);
+
+        m_window_latency_ms   = 0;
+        m_window_sample_num   = 0;
+        m_window_max_inflight = m_inflight;
+    }
+
+    uint32_t GetLimit() const {
+        return static_cast<uint32_t>(m_limit);
+    }
+
+    bool IsOverLimit() const {
+        return m_inflight >= GetLimit();
+    }
+
+private:
+    double Clamp(double limit) const {
+        if (limit < m_min_limit) {
+            return m_min_limit;
+        }
+        if (limit > m_max_limit) {
+            return m_max_limit;
+        }
+        return limit;
+    }
+
+    void UpdateLimit(double latency_ms) {
+        if (m_min_latency_ms <= 0 || latency_ms < m_min_latency_ms
+            || ++m_window_num >= MIN_LATENCY_RESET_WINDOWS) {
+            m_min_latency_ms = latency_ms;
+            m_window_num = 0;
+        }
+
+        double queue_size = m_limit * (1 - m_min_latency_ms / latency_ms);
+        double step  = log10(m_limit) > 1 ? log10(m_limit) : 1;
+        double alpha = 3 * step;
+        double beta  = 6 * step;
+
+        if (queue_size > beta) {
+            m_limit = Clamp(m_limit - step);
+        } else if (queue_size < alpha && m_window_max_inflight * 2 >= GetLimit()) {
+            // 并发数远低于限制时时延不能说明限制是否合适，不增大
+            m_limit = Clamp(m_limit + (queue_size < 1 ? beta : step));
+        }
+    }
+
+private:
+    uint32_t m_min_limit;
+    uint32_t m_max_limit;
+    double   m_limit;
+    uint32_t m_inflight;
+    double   m_min_latency_ms;
+    int64_t  m_window_start_ms;
+    int64_t  m_window_latency_ms;
+    uint32_t m_window_sample_num;
+    uint32_t m_window_max_inflight;
+    uint32_t m_window_num;
+};
+
+/// @brief 自适应并发限制监控，每个Processor的服务时延不同，各自使用独立的ConcurrencyLimiter\n
+///   过载判断前用SetInflight选定当前消息所属的Processor，没有限制器的Processor不受限制
+class ConcurrencyLimitMonitor : public IMonitor {
+public:
+    ConcurrencyLimitMonitor()
+        :   m_enable(true), m_min_limit(ConcurrencyLimiter::DEFAULT_MIN_LIMIT),
+            m_max_limit(UINT32_MAX), m_current(NULL) {}
+    virtual ~ConcurrencyLimitMonitor() {
+        for (LimiterMap::iterator it = m_limiters.begin(); it != m_limiters.end(); ++it) {
+            delete it->second;
+        }
+    }
+
+    /// @brief 关闭后不再拒绝请求，仍然采样和调整限制
+    void SetEnable(bool enable) {
+        m_enable = enable;
+    }
+
+    /// @brief 设置所有限制器的调整范围
+    void SetLimitRange(uint32_t min_limit, uint32_t max_limit) {
+        m_min_limit = min_limit;
+        m_max_limit = max_limit;
+        for (LimiterMap::iterator it = m_limiters.begin(); it != m_limiters.end(); ++it) {
+            it->second->SetLimitRange(m_min_limit, m_max_limit);
+        }
+    }
+
+    /// @brief 获取Processor的限制器，不存在时创建，请求处理时延作为此限制器的样本
+    ConcurrencyLimiter* GetLimiter(const IProcessor* processor) {
+        ConcurrencyLimiter*& limiter = m_limiters[processor];
+        if (NULL == limiter) {
+            limiter = new ConcurrencyLimiter();
+            limiter->SetLimitRange(m_min_limit, m_max_limit);
+        }
+        return limiter;
+    }
+
+    /// @brief 设置当前消息所属Processor处理中的请求数，在过载判断之前调用
+    void SetInflight(const IProcessor* processor, uint32_t inflight) {
+        LimiterMap::iterator it = m_limiters.find(processor);
+        m_current = (m_limiters.end() == it ? NULL : it->second);
+        if (m_current) {
+            m_current->SetInflight(inflight);
+        }
+    }
+
+    virtual uint32_t IsOverLoad() {
+        return (m_enable && m_current && m_current->IsOverLimit()) ? kTASK_OVERLOAD : kNO_OVERLOAD;
+    }
+
+private:
+    typedef cxx::unordered_map<const IProcessor*, ConcurrencyLimiter*> LimiterMap;
+
+    bool     m_enable;
+    uint32_t m_min_limit;
+    uint32_t m_max_limit;
+    LimiterMap m_limiters;
+    ConcurrencyLimiter* m_current;
+};
+
 /// @brief 监控中心，根据系统负载情况和流控策略配置提供流控决策支持
 class MonitorCenter {
 public:
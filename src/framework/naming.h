@@ -87,6 +87,12 @@ public:
     virtual int32_t Update()
     { return kNAMING_NOT_SUPPORTTED; }
 
+    /// @brief 距离下次需要Update的毫秒数，用于空闲时决定阻塞等待多久
+    /// @return >=0 毫秒数，0表示需要立即Update
+    /// @return <0 没有时间上的要求，空闲时最长等待idle_us后Update
+    virtual int64_t GetNextTimeout()
+    { return -1; }
+
     /// @brief 获取上次的错误信息
     virtual const char* GetLastError() { return NULL; }
 
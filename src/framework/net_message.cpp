@@ -12,8 +12,12 @@
  */
 
 #include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "common/net_util.h"
 #include "common/string_utility.h"
@@ -21,6 +25,13 @@
 #include "framework/net_message.h"
 
 
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
 namespace pebble {
 
 /// @brief 封装一个连接，维护收发缓存及消息处理操作
@@ -28,20 +39,30 @@ class NetConnection {
 public:
     NetConnection();
     ~NetConnection();
-    /// @brief 初始化连接，主要是创建接收缓冲区
+    /// @brief 初始化连接，收发缓冲区在有数据时才从buff_pool申请
+    /// @param stream 是否流式传输(TCP)，非流式传输的每个消息独占一个发送块，保持报文边界
     /// @return 0 成功
     /// @return <0 失败
-    int32_t Init(uint32_t buff_len, uint32_t msg_head_len);
+    int32_t Init(BufferPool* buff_pool, uint32_t msg_head_len, bool stream);
 
-    /// @brief cache新的发送数据，添加到发送队列尾部
+    /// @brief cache新的发送数据，添加到发送块链表尾部
+    /// @param offset 跳过分片数据中前offset字节(已发送的部分)
     /// @return 0 成功
     /// @return <0 失败
-    int32_t CacheSendData(const uint8_t* data, uint32_t data_len);
+    int32_t CacheSendData(uint32_t frag_num, const uint8_t* frag[], const uint32_t frag_len[],
+        uint32_t offset);
 
-    /// @brief 在最后cache数据上append新的数据
-    /// @return 0 成功
-    /// @return <0 失败，失败时会清理掉当前数据
-    int32_t AppendSendData(const uint8_t* data, uint32_t data_len);
+    /// @brief 是否有待发送的缓存数据
+    bool HasSendData() {
+        return _send_block_head != NULL;
+    }
+
+    /// @brief 取出待发送的缓存数据，流式传输最多取frag_num块，非流式传输只取1块(1个报文)
+    /// @return 取出的数据块数
+    uint32_t GetSendData(const uint8_t* frag[], uint32_t frag_len[], uint32_t frag_num);
+
+    /// @brief 已发送send_len字节，推进发送位置，发送完的块归还内存池
+    void ConsumeSendData(uint32_t send_len);
 
     /// @brief 取出接收缓冲区的消息
     /// @return 0 成功
@@ -61,116 +82,248 @@ public:
     /// @brief 是否有新的消息
     bool HasNewMsg();
 
-    // 每个连接维护一个接收缓冲区，每次只收取一个完整包并持有，直至上层用户消费掉，然后再开始接收新的数据
+    /// @brief 保证从队头消息开始有need_len的连续空间，必要时整理缓冲区或升级为更大的缓冲区
+    /// @return 0 成功
+    /// @return <0 失败，内存不足
+    /// @note 队头消息完整时不能调用，否则之前PeekMsg返回的消息地址会失效
+    int32_t ReserveRecvBuff(uint32_t need_len);
+
+    /// @brief 缓冲区无数据时归还给内存池，空闲连接不占用接收缓冲区
+    void ReleaseRecvBuff();
+
+    /// @brief 丢弃所有已接收的数据
+    void ResetRecvBuff();
+
+    /// @brief 从recvmmsg批量收到的报文中取出第idx个之后(含)的第一个非空报文作为队头消息
+    /// @return true 有报文
+    bool LoadDatagram(uint32_t idx);
+
+    // 每个连接维护一个接收缓冲区，可以预读并缓存多个完整消息，用户按顺序Peek/Pop消费，
+    // 缓冲区从内存池申请，先使用小块，收到大消息时再升级为大块，无数据时归还
+    BufferPool* _buff_pool;
     uint8_t* _buff;         // 接收缓冲区
     uint32_t _buff_len;     // 接收缓冲区大小
     uint32_t _msg_head_len; // 消息头长度，用于TCP分包
 
-    uint32_t _recv_len;     // 已经接收的数据长度
-    uint32_t _cur_msg_len;  // 待接收消息的总长度，这个长度由上层用户解析消息头后给出，连接根据这个去收取一个完整包
-    int64_t  _arrived_ms;   // 接收消息的时间戳
+    uint32_t _read_pos;     // 队头消息在缓冲区中的起始位置
+    uint32_t _recv_len;     // 缓冲区中已接收数据的结束位置
+    uint32_t _cur_msg_len;  // 队头消息的总长度，这个长度由上层用户解析消息头后给出，为0时表示消息头还未收完
+    int64_t  _recv_ms;      // 最近一次收到数据的时间戳
+    int64_t  _arrived_ms;   // 队头消息的到达时间，解析消息头时记录，后续分段到达不更新
     uint64_t _peer_addr;    // 记录udp listen收到消息的远端地址
 
-    // 每个连接维护发送消息列表，若一个消息未完全发送成功，需要缓存剩余数据，直至发送完毕
-    struct Msg {
-        Msg() : _msg_len(0), _msg(NULL) {}
-        uint32_t _msg_len;
-        uint8_t* _msg;  // 内存由外部维护
+    // udp批量接收时，接收缓冲区按slot划分，每个slot存放一个报文，按顺序作为队头消息
+    struct UdpBatch {
+        uint32_t _num;      // 本次收到的报文数
+        uint32_t _idx;      // 当前队头报文的下标
+        uint32_t _slot_len; // 每个报文占用的缓冲区长度
+        uint32_t _lens[NetMessage::MAX_UDP_BATCH_NUM];
+        uint64_t _peers[NetMessage::MAX_UDP_BATCH_NUM];
     };
-    uint32_t _max_send_list_size;
-    std::list<Msg> _send_msg_list; // 待发送的消息缓存，固定限制大小为1w
+    UdpBatch* _udp_batch;   // 使用recvmmsg时才创建
+
+    // 每个连接维护发送块链表，若一个消息未完全发送成功，需要缓存剩余数据，直至发送完毕
+    // 发送块从内存池申请，块头部和数据在同一块内存中，缓存时优先追加到尾块的剩余空间，
+    // 发送时多个块一次sendmsg发出，部分发送只推进偏移，不重新拷贝
+    struct SendBlock {
+        SendBlock* _next;
+        uint32_t   _block_size; // 整块内存大小(含块头)，归还内存池时使用
+        uint32_t   _begin;      // 待发送数据的起始位置
+        uint32_t   _end;        // 待发送数据的结束位置
+
+        uint8_t* Data() {
+            return reinterpret_cast<uint8_t*>(this + 1);
+        }
+        uint32_t Capacity() {
+            return _block_size - sizeof(SendBlock);
+        }
+    };
+    bool       _stream;             // 是否流式传输
+    uint32_t   _max_send_list_size; // 发送块数限制，默认为1w
+    uint32_t   _send_block_num;
+    SendBlock* _send_block_head;
+    SendBlock* _send_block_tail;
+
+    // 就绪链表节点，由NetMessage维护
+    uint64_t       _handle;         // 连接句柄
+    bool           _in_ready_list;  // 是否在就绪链表中
+    NetConnection* _ready_prev;
+    NetConnection* _ready_next;
 };
 
 NetConnection::NetConnection() {
+    _buff_pool      = NULL;
     _buff           = NULL;
     _buff_len       = 0;
     _msg_head_len   = 0;
+    _read_pos       = 0;
     _recv_len       = 0;
     _cur_msg_len    = 0;
+    _recv_ms        = 0;
     _arrived_ms     = 0;
     _peer_addr      = INVAILD_HANDLE;
+    _udp_batch      = NULL;
+    _stream         = true;
     _max_send_list_size = 10000;
+    _send_block_num  = 0;
+    _send_block_head = NULL;
+    _send_block_tail = NULL;
+    _handle         = INVAILD_HANDLE;
+    _in_ready_list  = false;
+    _ready_prev     = NULL;
+    _ready_next     = NULL;
 }
 
 NetConnection::~NetConnection() {
-    free(_buff);
-    for (std::list<Msg>::iterator it = _send_msg_list.begin();
-        it != _send_msg_list.end(); ++it) {
-        free((*it)._msg);
+    if (_buff_pool) {
+        _buff_pool->Free(_buff, _buff_len);
+    }
+    while (_send_block_head != NULL) {
+        SendBlock* block = _send_block_head;
+        _send_block_head = block->_next;
+        _buff_pool->Free(reinterpret_cast<uint8_t*>(block), block->_block_size);
     }
+    delete _udp_batch;
 }
 
-int32_t NetConnection::Init(uint32_t buff_len, uint32_t msg_head_len) {
-    if (_buff) {
+int32_t NetConnection::Init(BufferPool* buff_pool, uint32_t msg_head_len, bool stream) {
+    if (_buff_pool) {
         return -1;
     }
-    if (buff_len == 0) {
+    if (buff_pool == NULL) {
         return -2;
     }
-    _buff_len       = buff_len;
+    _buff_pool      = buff_pool;
     _msg_head_len   = msg_head_len;
-    _buff = (uint8_t*)malloc(_buff_len);
-    if (_buff == NULL) {
-        return -3;
-    }
+    _stream         = stream;
     return 0;
 }
 
 // 数据发送失败时，把未发送完成的数据cache起来，择机发送
-int32_t NetConnection::CacheSendData(const uint8_t* data, uint32_t data_len) {
-    if (data_len == 0 || data == NULL) {
+int32_t NetConnection::CacheSendData(uint32_t frag_num, const uint8_t* frag[],
+    const uint32_t frag_len[], uint32_t offset) {
+    uint32_t data_len = 0;
+    for (uint32_t i = 0; i < frag_num; i++) {
+        data_len += frag_len[i];
+    }
+    if (data_len <= offset || frag == NULL) {
         return -1;
     }
-    if (_send_msg_list.size() > _max_send_list_size) {
-        return -2;
+    data_len -= offset;
+
+    // 流式传输先填满尾块的剩余空间，非流式传输每个报文独占一个块
+    uint32_t tail_free_len = 0;
+    if (_stream && _send_block_tail != NULL) {
+        tail_free_len = _send_block_tail->Capacity() - _send_block_tail->_end;
+    }
+
+    // 剩余数据只申请一个能容纳下的新块，所以每次cache最多增加一个块
+    SendBlock* new_block = NULL;
+    if (data_len > tail_free_len) {
+        if (_send_block_num >= _max_send_list_size) {
+            return -2;
+        }
+        uint32_t block_size = 0;
+        uint8_t* buff = _buff_pool->Alloc(
+            data_len - tail_free_len + sizeof(SendBlock), &block_size);
+        if (buff == NULL) {
+            return -3;
+        }
+        new_block = reinterpret_cast<SendBlock*>(buff);
+        new_block->_next       = NULL;
+        new_block->_block_size = block_size;
+        new_block->_begin      = 0;
+        new_block->_end        = 0;
+    }
+
+    SendBlock* block = (tail_free_len > 0) ? _send_block_tail : new_block;
+    for (uint32_t i = 0; i < frag_num; i++) {
+        const uint8_t* data = frag[i];
+        uint32_t len = frag_len[i];
+        if (offset >= len) {
+            offset -= len;
+            continue;
+        }
+        data += offset;
+        len  -= offset;
+        offset = 0;
+
+        while (len > 0) {
+            uint32_t copy_len = block->Capacity() - block->_end;
+            if (copy_len == 0) {
+                block = new_block;
+                continue;
+            }
+            copy_len = (copy_len < len) ? copy_len : len;
+            memcpy(block->Data() + block->_end, data, copy_len);
+            block->_end += copy_len;
+            data += copy_len;
+            len  -= copy_len;
+        }
     }
 
-    Msg msg;
-    msg._msg_len = data_len;
-    msg._msg     = (uint8_t*)malloc(data_len);
-    if (msg._msg == NULL) {
-        return -3;
+    if (new_block != NULL) {
+        if (_send_block_tail != NULL) {
+            _send_block_tail->_next = new_block;
+        } else {
+            _send_block_head = new_block;
+        }
+        _send_block_tail = new_block;
+        _send_block_num++;
     }
 
-    memcpy(msg._msg, data, data_len);
-    _send_msg_list.push_back(msg);
     return 0;
 }
 
-int32_t NetConnection::AppendSendData(const uint8_t* data, uint32_t data_len) {
-    if (_send_msg_list.empty()) {
-        return -1;
+uint32_t NetConnection::GetSendData(const uint8_t* frag[], uint32_t frag_len[], uint32_t frag_num) {
+    uint32_t num = 0;
+    SendBlock* block = _send_block_head;
+    while (block != NULL && num < frag_num) {
+        frag[num]     = block->Data() + block->_begin;
+        frag_len[num] = block->_end - block->_begin;
+        num++;
+        if (!_stream) {
+            break;
+        }
+        block = block->_next;
     }
-    Msg& msg = _send_msg_list.back();
+    return num;
+}
 
-    uint32_t new_len = msg._msg_len + data_len;
-    uint8_t* new_msg = static_cast<uint8_t*>(realloc(msg._msg, new_len));
-    if (NULL == new_msg) {
-        // append数据失败，那么这个cache实际已经无效了，需要删除
-        free(msg._msg);
-        _send_msg_list.pop_back();
-        return -2;
-    }
-    memcpy(new_msg + msg._msg_len, data, data_len);
-    msg._msg     = new_msg;
-    msg._msg_len = new_len;
+void NetConnection::ConsumeSendData(uint32_t send_len) {
+    while (_send_block_head != NULL) {
+        SendBlock* block = _send_block_head;
+        uint32_t block_data_len = block->_end - block->_begin;
+        if (send_len < block_data_len) {
+            block->_begin += send_len;
+            return;
+        }
 
-    return 0;
+        send_len -= block_data_len;
+        _send_block_head = block->_next;
+        if (_send_block_head == NULL) {
+            _send_block_tail = NULL;
+        }
+        _send_block_num--;
+        _buff_pool->Free(reinterpret_cast<uint8_t*>(block), block->_block_size);
+
+        if (send_len == 0) {
+            return;
+        }
+    }
 }
 
 int32_t NetConnection::RecvMsg(uint8_t* buff, uint32_t* buff_len) {
     // 有数据，且消息完整
-    if (_recv_len > 0 && _recv_len == _cur_msg_len) {
+    if (HasNewMsg()) {
         if (*buff_len < _cur_msg_len) {
             return -1;
         }
-        memcpy(buff, _buff, _cur_msg_len);
+        memcpy(buff, _buff + _read_pos, _cur_msg_len);
         *buff_len = _cur_msg_len;
 
         // 清理接收数据
-        _recv_len    = 0;
-        _cur_msg_len = 0;
-        return 0;
+        return PopMsg();
     }
 
     // 无数据或无完整消息
@@ -179,8 +332,8 @@ int32_t NetConnection::RecvMsg(uint8_t* buff, uint32_t* buff_len) {
 
 int32_t NetConnection::PeekMsg(const uint8_t** msg, uint32_t* msg_len) {
     // 有数据，且消息完整
-    if (_recv_len > 0 && _recv_len == _cur_msg_len) {
-        *msg = _buff;
+    if (HasNewMsg()) {
+        *msg = _buff + _read_pos;
         *msg_len = _cur_msg_len;
         return 0;
     }
@@ -191,16 +344,89 @@ int32_t NetConnection::PeekMsg(const uint8_t** msg, uint32_t* msg_len) {
 
 int32_t NetConnection::PopMsg() {
     // 有数据，且消息完整才清理
-    if (_recv_len > 0 && _recv_len == _cur_msg_len) {
-        _recv_len    = 0;
-        _cur_msg_len = 0;
+    if (HasNewMsg()) {
+        _read_pos    += _cur_msg_len;
+        _cur_msg_len  = 0;
+        if (_udp_batch != NULL) {
+            LoadDatagram(_udp_batch->_idx + 1);
+        }
+        ReleaseRecvBuff();
         return 0;
     }
     return -1;
 }
 
 bool NetConnection::HasNewMsg() {
-    return (_recv_len > 0 && _recv_len == _cur_msg_len);
+    return (_cur_msg_len > 0 && _recv_len - _read_pos >= _cur_msg_len);
+}
+
+int32_t NetConnection::ReserveRecvBuff(uint32_t need_len) {
+    uint32_t data_len = _recv_len - _read_pos;
+    if (_buff != NULL && _buff_len >= need_len) {
+        // 把未收完的消息移到缓冲区头部，腾出尾部空间用于预读
+        if (_read_pos > 0) {
+            memmove(_buff, _buff + _read_pos, data_len);
+            _read_pos = 0;
+            _recv_len = data_len;
+        }
+        return 0;
+    }
+
+    uint32_t new_buff_len = 0;
+    uint8_t* new_buff = _buff_pool->Alloc(need_len, &new_buff_len);
+    if (new_buff == NULL) {
+        return -1;
+    }
+    if (data_len > 0) {
+        memcpy(new_buff, _buff + _read_pos, data_len);
+    }
+    _buff_pool->Free(_buff, _buff_len);
+
+    _buff     = new_buff;
+    _buff_len = new_buff_len;
+    _read_pos = 0;
+    _recv_len = data_len;
+    return 0;
+}
+
+void NetConnection::ReleaseRecvBuff() {
+    if (_buff == NULL || _read_pos != _recv_len) {
+        return;
+    }
+    _buff_pool->Free(_buff, _buff_len);
+    _buff     = NULL;
+    _buff_len = 0;
+    _read_pos = 0;
+    _recv_len = 0;
+}
+
+void NetConnection::ResetRecvBuff() {
+    if (_udp_batch != NULL) {
+        _udp_batch->_num = 0;
+        _udp_batch->_idx = 0;
+    }
+    _read_pos    = _recv_len;
+    _cur_msg_len = 0;
+    ReleaseRecvBuff();
+}
+
+bool NetConnection::LoadDatagram(uint32_t idx) {
+    for (; idx < _udp_batch->_num; idx++) {
+        if (_udp_batch->_lens[idx] == 0) {
+            continue;
+        }
+        _udp_batch->_idx = idx;
+        _read_pos    = idx * _udp_batch->_slot_len;
+        _recv_len    = _read_pos + _udp_batch->_lens[idx];
+        _cur_msg_len = _udp_batch->_lens[idx];
+        _peer_addr   = _udp_batch->_peers[idx];
+        return true;
+    }
+    // 批量报文已全部消费
+    _udp_batch->_num = 0;
+    _udp_batch->_idx = 0;
+    _read_pos = _recv_len;
+    return false;
 }
 
 
@@ -211,17 +437,26 @@ NetMessage::NetMessage() {
     m_epoll = NULL;
     m_netio = NULL;
 
-    m_send_buff    = NULL;
     m_msg_head_len = 0;
     m_msg_buff_len = DEFAULT_MSG_BUFF_LEN;
     m_max_send_list_size = 10000;
+    m_ready_head   = NULL;
+    m_ready_tail   = NULL;
+    m_udp_batch_num  = 1;
+    m_udp_gso        = false;
+    m_udp_send_buff  = NULL;
+    m_udp_send_len   = 0;
+    m_udp_pending_num = 0;
 }
 
 NetMessage::~NetMessage() {
-    CloseAllConnections();
+    if (m_netio != NULL) {
+        FlushUdpSend();
+        CloseAllConnections();
+    }
     delete m_netio;
     delete m_epoll;
-    free(m_send_buff);
+    free(m_udp_send_buff);
 }
 
 int32_t NetMessage::Init(uint32_t msg_head_len, const GetMsgDataLen& get_msg_data_len_func,
@@ -238,10 +473,15 @@ int32_t NetMessage::Init(uint32_t msg_head_len, const GetMsgDataLen& get_msg_dat
         m_msg_buff_len = msg_buff_len;
     }
 
-    if (m_send_buff) {
-        free(m_send_buff);
+    m_udp_gso = IsUdpGsoSupported();
+
+    // 所有连接共享收发缓冲区内存池，空闲连接不占用收发缓冲区
+    uint32_t min_buff_len = (m_msg_buff_len < MIN_BUFF_BLOCK_LEN) ? m_msg_buff_len : MIN_BUFF_BLOCK_LEN;
+    int32_t pool_ret = m_buff_pool.Init(min_buff_len, m_msg_buff_len, MAX_CACHED_BUFF_LEN);
+    if (pool_ret != 0) {
+        _LOG_LAST_ERROR("buff pool init failed(%d)", pool_ret);
+        return kMESSAGE_INVAILD_PARAM;
     }
-    m_send_buff = (uint8_t*)malloc(m_msg_buff_len);
 
     int32_t ret = 0;
     if (!m_epoll) {
@@ -300,6 +540,20 @@ uint64_t NetMessage::Connect(const std::string& ip, uint16_t port) {
 }
 
 int32_t NetMessage::Send(uint64_t handle, const uint8_t* msg, uint32_t msg_len) {
+    const uint8_t* frags[1] = { msg     };
+    uint32_t fragslen[1]    = { msg_len };
+
+    const SocketInfo* socket_info = m_netio->GetSocketInfo(GetSendHandle(handle));
+    if (socket_info->_state & UDP_PROTOCOL) {
+        return SendUdpV(handle, 1, frags, fragslen);
+    }
+
+    // 还有缓存数据未发完时直接追加到缓存，保证消息顺序
+    NetConnection* connection = GetConnection(handle);
+    if (connection != NULL && connection->HasSendData()) {
+        return CacheSendData(handle, connection, 1, frags, fragslen, 0);
+    }
+
     int32_t send_len = SendData(handle, msg, msg_len);
 
     if (send_len < 0) {
@@ -311,41 +565,36 @@ int32_t NetMessage::Send(uint64_t handle, const uint8_t* msg, uint32_t msg_len)
     }
 
     // 有数据未发完，需要缓存
-    NetConnection* connection = GetConnection(handle);
+    return CacheSendData(handle, connection, 1, frags, fragslen, send_len);
+}
+
+int32_t NetMessage::CacheSendData(uint64_t handle, NetConnection* connection,
+    uint32_t msg_frag_num, const uint8_t* msg_frag[], uint32_t msg_frag_len[], uint32_t offset) {
     if (connection == NULL) {
         _LOG_LAST_ERROR("get connection %lu failed", handle);
         return kMESSAGE_CACHE_FAILED;
     }
-    int32_t ret = connection->CacheSendData(msg + send_len, msg_len - send_len);
+    int32_t ret = connection->CacheSendData(msg_frag_num, msg_frag, msg_frag_len, offset);
     if (ret != 0) {
-        _LOG_LAST_ERROR("cache msg failed(%d), len = %d", ret, msg_len - send_len);
+        _LOG_LAST_ERROR("cache msg failed(%d), offset = %u", ret, offset);
         return kMESSAGE_CACHE_FAILED;
     }
-
     return 0;
 }
 
 int32_t NetMessage::SendV(uint64_t handle, uint32_t msg_frag_num,
                           const uint8_t* msg_frag[], uint32_t msg_frag_len[]) {
-    uint64_t send_handle = GetSendHandle(handle);
-    uint32_t msg_len = 0;
-    const SocketInfo* socket_info = m_netio->GetSocketInfo(send_handle);
+    const SocketInfo* socket_info = m_netio->GetSocketInfo(GetSendHandle(handle));
     if (socket_info->_state & UDP_PROTOCOL) {
-        // 分片的消息cp到一起
-        for (uint32_t i = 0; i < msg_frag_num; i++) {
-            if (msg_len + msg_frag_len[i] > m_msg_buff_len) {
-                _LOG_LAST_ERROR("bufflen(%u) < msglen(%u) i=%d",
-                    m_msg_buff_len, msg_len + msg_frag_len[i], i);
-                return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
-            }
-            memcpy(m_send_buff + msg_len, msg_frag[i], msg_frag_len[i]);
-            msg_len += msg_frag_len[i];
-        }
+        return SendUdpV(handle, msg_frag_num, msg_frag, msg_frag_len);
+    }
 
-        return Send(handle, m_send_buff, msg_len);
+    // tcp，还有缓存数据未发完时直接追加到缓存，保证消息顺序
+    NetConnection* connection = GetConnection(handle);
+    if (connection != NULL && connection->HasSendData()) {
+        return CacheSendData(handle, connection, msg_frag_num, msg_frag, msg_frag_len, 0);
     }
 
-    // tcp
     int32_t send_len = m_netio->SendV(handle, msg_frag_num, (const char**)msg_frag, msg_frag_len);
 
     // 网络错误，关闭连接
@@ -356,7 +605,7 @@ int32_t NetMessage::SendV(uint64_t handle, uint32_t msg_frag_num,
     }
 
     // 计算总消息长度
-    msg_len = 0;
+    uint32_t msg_len = 0;
     for (uint32_t i = 0; i < msg_frag_num; i++) {
         msg_len += msg_frag_len[i];
     }
@@ -367,35 +616,7 @@ int32_t NetMessage::SendV(uint64_t handle, uint32_t msg_frag_num,
     }
 
     // 有数据未发完，需要缓存
-    int32_t ret = 0;
-    bool cache = false;
-    NetConnection* connection = GetConnection(handle);
-    if (connection == NULL) {
-        _LOG_LAST_ERROR("get connection %lu failed", handle);
-        return kMESSAGE_CACHE_FAILED;
-    }
-
-    for (uint32_t i = 0; i < msg_frag_num; i++) {
-        if (send_len >= static_cast<int32_t>(msg_frag_len[i])) {
-            send_len -= msg_frag_len[i];
-            continue;
-        }
-
-        if (!cache) {
-            cache = true;
-            ret = connection->CacheSendData(msg_frag[i] + send_len, msg_frag_len[i] - send_len);
-        } else {
-            ret = connection->AppendSendData(msg_frag[i] + send_len, msg_frag_len[i] - send_len);
-        }
-
-        if (ret != 0) {
-            _LOG_LAST_ERROR("cache msg frags failed(%d) i=%d,len=%u.", ret, i, msg_frag_len[i]);
-            return kMESSAGE_CACHE_FAILED;
-        }
-        send_len = 0;
-    }
-
-    return 0;
+    return CacheSendData(handle, connection, msg_frag_num, msg_frag, msg_frag_len, send_len);
 }
 
 int32_t NetMessage::Recv(uint64_t handle, uint8_t* buff, uint32_t* buff_len,
@@ -425,6 +646,8 @@ int32_t NetMessage::Recv(uint64_t handle, uint8_t* buff, uint32_t* buff_len,
         msg_info->_remote_handle = connection->_peer_addr;
     }
 
+    OnMsgConsumed(handle, connection);
+
     return 0;
 }
 
@@ -471,12 +694,62 @@ int32_t NetMessage::Pop(uint64_t handle) {
         return kMESSAGE_RECV_EMPTY;
     }
 
+    OnMsgConsumed(handle, connection);
+
+    return 0;
+}
+
+void NetMessage::OnMsgConsumed(uint64_t handle, NetConnection* connection) {
+    UnlinkReadyConnection(connection);
+
+    // 缓冲区中可能已经预读了后续消息，解析下一个消息头
+    if (ParseMsgLen(connection) < 0) {
+        connection->ResetRecvBuff();
+        CloseConnection(handle);
+        return;
+    }
+
+    // 还有完整消息的连接重新排到就绪链表尾部，避免单个连接独占
+    if (connection->HasNewMsg()) {
+        LinkReadyConnection(connection);
+    }
+}
+
+int32_t NetMessage::ParseMsgLen(NetConnection* connection) {
+    // udp按报文收取，不需要解析消息头
+    if (connection->_msg_head_len == 0) {
+        return 0;
+    }
+    if (connection->_cur_msg_len > 0
+        || connection->_recv_len - connection->_read_pos < m_msg_head_len) {
+        return 0;
+    }
+
+    int32_t msg_data_len = m_get_msg_data_len_func(
+        connection->_buff + connection->_read_pos, m_msg_head_len);
+    if (msg_data_len < 0) {
+        _LOG_LAST_ERROR("para msg head failed(%d)", msg_data_len);
+        return -1;
+    }
+    if (static_cast<uint64_t>(msg_data_len) + m_msg_head_len > m_msg_buff_len) {
+        _LOG_LAST_ERROR("msg len(%d) exceed buff len(%u)", msg_data_len, m_msg_buff_len);
+        return -1;
+    }
+    connection->_cur_msg_len = m_msg_head_len + msg_data_len;
+    // 消息头不晚于最近一次收取到达，预读的消息在此之后才解析，不能取解析时的时间
+    connection->_arrived_ms  = connection->_recv_ms;
     return 0;
 }
 
 int32_t NetMessage::Close(uint64_t handle) {
+    // 合并的报文可能使用此socket发送，关闭前先发出，发不出的丢弃
+    if (HasUdpPending(handle)) {
+        FlushUdpSend();
+        RemoveUdpPending(handle);
+    }
     cxx::unordered_map<uint64_t, NetConnection*>::iterator it = m_connections.find(handle);
     if (it != m_connections.end()) {
+        UnlinkReadyConnection(it->second);
         delete it->second;
         m_connections.erase(it);
     }
@@ -485,18 +758,52 @@ int32_t NetMessage::Close(uint64_t handle) {
 }
 
 int32_t NetMessage::PollConnectionBuffer(uint64_t* handle) {
-    cxx::unordered_map<uint64_t, NetConnection*>::iterator it = m_connections.begin();
-    for (; it != m_connections.end(); ++it) {
-        if (it->second->HasNewMsg()) {
-            *handle = it->first;
-            return 1;
-        }
+    if (m_ready_head == NULL) {
+        return 0;
     }
-    return 0;
+    *handle = m_ready_head->_handle;
+    return 1;
+}
+
+void NetMessage::LinkReadyConnection(NetConnection* connection) {
+    if (connection->_in_ready_list) {
+        return;
+    }
+    connection->_in_ready_list = true;
+    connection->_ready_prev = m_ready_tail;
+    connection->_ready_next = NULL;
+    if (m_ready_tail != NULL) {
+        m_ready_tail->_ready_next = connection;
+    } else {
+        m_ready_head = connection;
+    }
+    m_ready_tail = connection;
+}
+
+void NetMessage::UnlinkReadyConnection(NetConnection* connection) {
+    if (!connection->_in_ready_list) {
+        return;
+    }
+    if (connection->_ready_prev != NULL) {
+        connection->_ready_prev->_ready_next = connection->_ready_next;
+    } else {
+        m_ready_head = connection->_ready_next;
+    }
+    if (connection->_ready_next != NULL) {
+        connection->_ready_next->_ready_prev = connection->_ready_prev;
+    } else {
+        m_ready_tail = connection->_ready_prev;
+    }
+    connection->_in_ready_list = false;
+    connection->_ready_prev = NULL;
+    connection->_ready_next = NULL;
 }
 
 // handle一定是数据连接句柄，通过数据关系找到本地监听句柄
 int32_t NetMessage::Poll(uint64_t* handle, int32_t* event, int32_t timeout_ms) {
+    // 上一轮处理中合并的udp报文一次发出
+    FlushUdpSend();
+
     // 优先消费缓存消息
     int32_t num = PollConnectionBuffer(handle);
     if (num > 0) {
@@ -508,60 +815,86 @@ int32_t NetMessage::Poll(uint64_t* handle, int32_t* event, int32_t timeout_ms) {
         return -1;
     }
 
+    // 一次处理完epoll_wait返回的所有事件，避免每个事件都要一次系统调用
     uint32_t events  = 0;
     uint64_t netaddr = 0;
-    ret = m_epoll->GetEvent(&events, &netaddr);
-    if (ret != 0) {
-        return -1;
+    while (m_epoll->GetEvent(&events, &netaddr) == 0) {
+        ProcessEvent(events, netaddr);
+    }
+
+    if (PollConnectionBuffer(handle) > 0) {
+        return 0;
+    }
+
+    return -1;
+}
+
+void NetMessage::ProcessEvent(uint32_t events, uint64_t netaddr) {
+    if (netaddr & EVENT_FD_FLAG) {
+        cxx::unordered_map<int32_t, cxx::function<void()> >::iterator it =
+            m_event_fds.find(static_cast<int32_t>(netaddr & 0xFFFFFFFF));
+        if (it != m_event_fds.end()) {
+            // 回调中可能移除fd，先拷贝
+            cxx::function<void()> on_event = it->second;
+            on_event();
+        }
+        return;
     }
 
     if (events & EPOLLERR) {
         _LOG_LAST_ERROR("EPOLLERR get, %lu", netaddr);
         CloseConnection(netaddr);
-        return kMESSAGE_GET_ERR_EVENT;
+        return;
     }
 
-    ret = -1;
     if (events & EPOLLOUT) {
-        // 发送缓存数据
-        if (SendCacheData(netaddr) > 0) {
-            // ret = 0;
+        // 发送缓存数据，socket满时留下的合并udp报文也在此时发出
+        SendCacheData(netaddr);
+        if (m_udp_pending_num > 0) {
+            FlushUdpSend();
         }
     }
 
+    if (!(events & EPOLLIN)) {
+        return;
+    }
+
+    int32_t ret = 0;
     const SocketInfo* socket_info = m_netio->GetSocketInfo(netaddr);
-    if (events & EPOLLIN) {
-        // 收包处理，区分TCP和UDP的收包逻辑
-        if (socket_info->_state & TCP_PROTOCOL) {
-            if (socket_info->_state & LISTEN_ADDR) {
-                uint64_t peer_handle = m_netio->Accept(netaddr);
-                if (peer_handle != INVAILD_NETADDR) {
-                    CreateConnection(peer_handle);
-                }
-                return ret;
+    // 收包处理，区分TCP和UDP的收包逻辑
+    if (socket_info->_state & TCP_PROTOCOL) {
+        if (socket_info->_state & LISTEN_ADDR) {
+            uint64_t peer_handle = m_netio->Accept(netaddr);
+            if (peer_handle != INVAILD_NETADDR) {
+                CreateConnection(peer_handle);
             }
-            do {
-                ret = RecvTcpData(netaddr);
-            } while (ret == RECV_CONTINUE);
-        } else {
-            ret = RecvUdpData(netaddr);
-        }
-
-        if (ret < 0) {
-            CloseConnection(netaddr);
-            return kMESSAGE_RECV_FAILED;
+            return;
         }
+        do {
+            ret = RecvTcpData(netaddr);
+        } while (ret == RECV_CONTINUE);
+    } else {
+        ret = RecvUdpData(netaddr);
+    }
 
-        ret = 0;
-        *handle = netaddr;
+    if (ret < 0) {
+        CloseConnection(netaddr);
+        return;
     }
 
-    return ret;
+    NetConnection* connection = GetConnection(netaddr);
+    if (connection != NULL && connection->HasNewMsg()) {
+        LinkReadyConnection(connection);
+    }
 }
 
 NetConnection* NetMessage::CreateConnection(uint64_t netaddr) {
     NetConnection* connection = new NetConnection();
-    int32_t ret = connection->Init(m_msg_buff_len, m_msg_head_len);
+    // udp按报文收取，不需要消息头
+    const SocketInfo* socket_info = m_netio->GetSocketInfo(netaddr);
+    uint32_t msg_head_len = (socket_info->_state & UDP_PROTOCOL) ? 0 : m_msg_head_len;
+    int32_t ret = connection->Init(&m_buff_pool, msg_head_len,
+        (socket_info->_state & TCP_PROTOCOL) != 0);
     if (ret < 0) {
         delete connection;
         _LOG_LAST_ERROR("connection init failed %d", ret);
@@ -569,6 +902,7 @@ NetConnection* NetMessage::CreateConnection(uint64_t netaddr) {
     }
 
     connection->_max_send_list_size = m_max_send_list_size;
+    connection->_handle = netaddr;
 
     std::pair<cxx::unordered_map<uint64_t, NetConnection*>::iterator, bool> insert =
         m_connections.insert(std::pair<uint64_t, NetConnection*>(netaddr, connection));
@@ -602,6 +936,8 @@ void NetMessage::CloseAllConnections() {
         delete it->second;
     }
     m_connections.clear();
+    m_ready_head = NULL;
+    m_ready_tail = NULL;
     m_netio->CloseAll();
 }
 
@@ -648,77 +984,88 @@ int32_t NetMessage::SendCacheData(uint64_t netaddr) {
         return kMESSAGE_UNKNOWN_CONNECTION;
     }
 
-    if (connection->_send_msg_list.empty()) {
-        return 0;
-    }
+    // 每次可写事件尽量发送所有缓存数据，直至socket写满
+    const uint8_t* frags[NetIO::MAX_SENDV_DATA_NUM];
+    uint32_t fragslen[NetIO::MAX_SENDV_DATA_NUM];
+    int32_t total_send_len = 0;
+    while (connection->HasSendData()) {
+        uint32_t frag_num = connection->GetSendData(frags, fragslen, NetIO::MAX_SENDV_DATA_NUM);
+        uint32_t need_send_len = 0;
+        for (uint32_t i = 0; i < frag_num; i++) {
+            need_send_len += fragslen[i];
+        }
 
-    // 每次暂时发一包
-    NetConnection::Msg& msg = connection->_send_msg_list.front();
-    int32_t send_len = SendData(netaddr, msg._msg, msg._msg_len);
-    if (send_len < 0) {
-        // 返回<0连接已经关闭，缓存已经清理
-        return send_len;
-    }
+        int32_t send_len = 0;
+        if (frag_num == 1) {
+            send_len = SendData(netaddr, frags[0], fragslen[0]);
+        } else {
+            send_len = m_netio->SendV(netaddr, frag_num, (const char**)frags, fragslen);
+            if (send_len < 0) {
+                CloseConnection(netaddr);
+                _LOG_LAST_ERROR("send to %lu failed(%s)", netaddr, m_netio->GetLastError());
+                send_len = kMESSAGE_SEND_FAILED;
+            }
+        }
+        if (send_len < 0) {
+            // 返回<0连接已经关闭，缓存已经清理
+            return send_len;
+        }
 
-    if (send_len == (int32_t)msg._msg_len) {
-        // 发送完整数据，清掉缓存
-        connection->_send_msg_list.pop_front();
-    } else if (send_len > 0) {
-        // 发送部分数据，重新缓存
-        uint8_t* new_buff = (uint8_t*)malloc(msg._msg_len - send_len);
-        memcpy(new_buff, msg._msg + send_len, msg._msg_len - send_len);
-        free(msg._msg);
-        msg._msg = new_buff;
-        msg._msg_len -= send_len;
-    } // 发送0字节，缓存不变
+        connection->ConsumeSendData(send_len);
+        total_send_len += send_len;
+        if (send_len < static_cast<int32_t>(need_send_len)) {
+            // socket已写满，等待下次可写事件
+            break;
+        }
+    }
 
-    return send_len;
+    return total_send_len;
 }
 
 int32_t NetMessage::RecvTcpData(uint64_t netaddr) {
-    // 每次收取1包，等待用户消费完后再收取下一包
+    // 尽量一次读取缓冲区剩余空间大小的数据，缓冲区中可以预读多个消息
     NetConnection* connection = GetConnection(netaddr);
     if (connection == NULL) {
         _LOG_LAST_ERROR("get connection %lu failed", netaddr);
         return kMESSAGE_UNKNOWN_CONNECTION;
     }
 
-    if (connection->HasNewMsg()) {
-        return RECV_END;
+    // 队头消息完整时可能已被Peek，不能移动缓冲区数据，只使用尾部剩余空间
+    if (!connection->HasNewMsg()) {
+        uint32_t need_len = connection->_cur_msg_len > 0 ? connection->_cur_msg_len : m_msg_head_len;
+        if (connection->ReserveRecvBuff(need_len) != 0) {
+            _LOG_LAST_ERROR("alloc recv buff failed, len=%u, netaddr=%lu", need_len, netaddr);
+            return -1;
+        }
     }
 
-    uint32_t old_len = connection->_recv_len; // 已经收取的数据长度
-    uint32_t need_read = 0;     // 还需要读取的长度
-    bool get_msg_len = false;   // 是否需要解析头获取数据部分长度
-    if (old_len < m_msg_head_len) {
-        need_read = m_msg_head_len - old_len;
-        get_msg_len = true;
-    } else {
-        need_read = connection->_cur_msg_len - old_len;
+    uint32_t free_len = connection->_buff_len - connection->_recv_len;
+    if (free_len == 0) {
+        // 缓冲区已满，等待用户消费后再收取
+        return RECV_END;
     }
 
-    int32_t recv_len = m_netio->Recv(netaddr, (char*)connection->_buff + old_len, need_read);
+    int32_t recv_len = m_netio->Recv(netaddr,
+        (char*)connection->_buff + connection->_recv_len, free_len);
     if (recv_len < 0) {
         _LOG_LAST_ERROR("recv failed(%d:%s), netaddr=%lu", recv_len, m_netio->GetLastError(), netaddr);
         return -1;
     }
-    connection->_recv_len += recv_len;
-    if (recv_len < (int32_t)need_read) {
-        // 未收完期望的数据，等待下次再收
+    if (recv_len == 0) {
+        connection->ReleaseRecvBuff();
         return RECV_END;
     }
 
-    if (get_msg_len) {
-        int32_t msg_data_len = m_get_msg_data_len_func(connection->_buff, m_msg_head_len);
-        if (msg_data_len < 0) {
-            _LOG_LAST_ERROR("para msg head failed(%d)", msg_data_len);
-            return -1;
-        }
-        connection->_cur_msg_len = m_msg_head_len + msg_data_len;
-        connection->_arrived_ms  = TimeUtility::GetCurrentMS();
+    connection->_recv_len += recv_len;
+    connection->_recv_ms   = TimeUtility::GetMonotonicMS();
+
+    if (ParseMsgLen(connection) < 0) {
+        connection->ResetRecvBuff();
+        return -1;
     }
 
-    if (connection->HasNewMsg()) {
+    if (recv_len < static_cast<int32_t>(free_len)) {
+        // socket中的数据已读完，等待下次再收
         return RECV_END;
     }
 
@@ -732,6 +1079,26 @@ int32_t NetMessage::RecvUdpData(uint64_t netaddr) {
         return kMESSAGE_UNKNOWN_CONNECTION;
     }
 
+    // 上一个消息还未被消费，不能覆盖接收缓冲区
+    if (connection->HasNewMsg()) {
+        return 0;
+    }
+
+    uint32_t udp_buff_len = (m_msg_buff_len < MAX_UDP_MSG_LEN) ? m_msg_buff_len : MAX_UDP_MSG_LEN;
+    // 批量接收的报文数受单个缓冲区的最大大小限制
+    uint32_t batch_num = m_msg_buff_len / udp_buff_len;
+    if (batch_num > m_udp_batch_num) {
+        batch_num = m_udp_batch_num;
+    }
+    if (batch_num > 1) {
+        return RecvUdpBatch(netaddr, connection, batch_num, udp_buff_len);
+    }
+
+    if (connection->ReserveRecvBuff(udp_buff_len) != 0) {
+        _LOG_LAST_ERROR("alloc recv buff failed, netaddr=%lu", netaddr);
+        return -1;
+    }
+
     uint64_t peer_addr = INVAILD_NETADDR;
     int32_t recv_len = 0;
 
@@ -741,6 +1108,9 @@ int32_t NetMessage::RecvUdpData(uint64_t netaddr) {
     } else {
         recv_len = m_netio->Recv(netaddr, (char*)connection->_buff, connection->_buff_len);
     }
+    if (recv_len <= 0) {
+        connection->ReleaseRecvBuff();
+    }
     if (recv_len < 0) {
         _LOG_LAST_ERROR("recv failed(%d:%s), netaddr=%lu", recv_len, m_netio->GetLastError(), netaddr);
         return -1;
@@ -750,8 +1120,9 @@ int32_t NetMessage::RecvUdpData(uint64_t netaddr) {
     }
 
     connection->_cur_msg_len = recv_len;
+    connection->_read_pos    = 0;
     connection->_recv_len    = recv_len;
-    connection->_arrived_ms  = TimeUtility::GetCurrentMS();
+    connection->_arrived_ms  = TimeUtility::GetMonotonicMS();
     connection->_peer_addr   = peer_addr;
 
     if (peer_addr != INVAILD_NETADDR) {
@@ -761,11 +1132,388 @@ int32_t NetMessage::RecvUdpData(uint64_t netaddr) {
     return 1;
 }
 
+int32_t NetMessage::RecvUdpBatch(uint64_t netaddr, NetConnection* connection,
+    uint32_t batch_num, uint32_t slot_len) {
+    if (connection->ReserveRecvBuff(slot_len * batch_num) != 0) {
+        _LOG_LAST_ERROR("alloc recv buff failed, netaddr=%lu", netaddr);
+        return -1;
+    }
+    if (connection->_udp_batch == NULL) {
+        connection->_udp_batch = new NetConnection::UdpBatch();
+    }
+
+    // 每个报文接收到独立的slot中，一次recvmmsg收取socket中最多batch_num个报文
+    struct mmsghdr msgs[MAX_UDP_BATCH_NUM];
+    struct iovec iovs[MAX_UDP_BATCH_NUM];
+    struct sockaddr_in peer_addrs[MAX_UDP_BATCH_NUM];
+    const SocketInfo* socket_info = m_netio->GetSocketInfo(netaddr);
+    bool is_listen = (socket_info->_state & LISTEN_ADDR) != 0;
+    memset(msgs, 0, sizeof(msgs[0]) * batch_num);
+    for (uint32_t i = 0; i < batch_num; i++) {
+        iovs[i].iov_base = connection->_buff + i * slot_len;
+        iovs[i].iov_len  = slot_len;
+        msgs[i].msg_hdr.msg_iov    = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        if (is_listen) {
+            msgs[i].msg_hdr.msg_name    = &peer_addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(peer_addrs[i]);
+        }
+    }
+
+    int32_t recv_num = m_netio->RecvMMsg(netaddr, msgs, batch_num);
+    if (recv_num <= 0) {
+        connection->ReleaseRecvBuff();
+    }
+    if (recv_num < 0) {
+        _LOG_LAST_ERROR("recv failed(%d:%s), netaddr=%lu", recv_num, m_netio->GetLastError(), netaddr);
+        return -1;
+    }
+    if (recv_num == 0) {
+        return 0;
+    }
+
+    NetConnection::UdpBatch* batch = connection->_udp_batch;
+    batch->_num      = recv_num;
+    batch->_idx      = 0;
+    batch->_slot_len = slot_len;
+    for (int32_t i = 0; i < recv_num; i++) {
+        batch->_lens[i]  = msgs[i].msg_len;
+        batch->_peers[i] = INVAILD_NETADDR;
+        if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            // 超过slot长度的报文被截断，直接丢弃
+            _LOG_LAST_ERROR("udp msg truncated, len=%u, netaddr=%lu", msgs[i].msg_len, netaddr);
+            batch->_lens[i] = 0;
+        }
+        if (is_listen) {
+            batch->_peers[i] = NetIO::FromSockAddr(peer_addrs[i]);
+            m_peer_handle_to_local[batch->_peers[i]] = netaddr;
+        }
+    }
+    connection->_arrived_ms = TimeUtility::GetMonotonicMS();
+
+    if (!connection->LoadDatagram(0)) {
+        connection->ReleaseRecvBuff();
+        return 0;
+    }
+    return 1;
+}
+
+int32_t NetMessage::SendUdpV(uint64_t handle, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], uint32_t msg_frag_len[]) {
+    uint32_t msg_len = 0;
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        msg_len += msg_frag_len[i];
+    }
+    if (msg_len > m_msg_buff_len) {
+        _LOG_LAST_ERROR("bufflen(%u) < msglen(%u)", m_msg_buff_len, msg_len);
+        return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+    }
+
+    uint64_t send_handle = GetSendHandle(handle);
+    if (m_udp_batch_num > 1) {
+        if (msg_len > MAX_UDP_MSG_LEN) {
+            _LOG_LAST_ERROR("udp msglen(%u) > %u", msg_len, MAX_UDP_MSG_LEN);
+            return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+        }
+        if (m_udp_pending_num >= m_udp_batch_num
+            || m_udp_send_len + msg_len > UDP_SEND_BATCH_BUFF_LEN) {
+            FlushUdpSend();
+            // socket缓冲区满时未发出的报文仍在合并缓冲区中，放不下的报文返回失败
+            if (m_udp_pending_num >= m_udp_batch_num
+                || m_udp_send_len + msg_len > UDP_SEND_BATCH_BUFF_LEN) {
+                _LOG_LAST_ERROR("udp socket blocked, %u msgs pending", m_udp_pending_num);
+                return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+            }
+        }
+        if (m_udp_send_buff == NULL) {
+            m_udp_send_buff = (uint8_t*)malloc(UDP_SEND_BATCH_BUFF_LEN);
+            if (m_udp_send_buff == NULL) {
+                _LOG_LAST_ERROR("alloc udp send buff failed");
+                return kMESSAGE_CACHE_FAILED;
+            }
+        }
+
+        // 调用返回后用户的分片即可释放，合并发送只能拷贝
+        UdpPendingMsg& pending = m_udp_pending[m_udp_pending_num++];
+        pending._handle      = handle;
+        pending._send_handle = send_handle;
+        pending._offset      = m_udp_send_len;
+        pending._len         = msg_len;
+        for (uint32_t i = 0; i < msg_frag_num; i++) {
+            memcpy(m_udp_send_buff + m_udp_send_len, msg_frag[i], msg_frag_len[i]);
+            m_udp_send_len += msg_frag_len[i];
+        }
+        return 0;
+    }
+
+    // 还有缓存数据未发完时直接追加到缓存，保证报文顺序
+    NetConnection* connection = GetConnection(handle);
+    if (connection != NULL && connection->HasSendData()) {
+        return CacheSendData(handle, connection, msg_frag_num, msg_frag, msg_frag_len, 0);
+    }
+
+    // iovec直接指向用户的分片，分片过多时才拷贝到一起
+    struct iovec iovs[NetIO::MAX_SENDV_DATA_NUM];
+    uint32_t iov_num = 0;
+    uint8_t* tmp_buff = NULL;
+    uint32_t tmp_buff_len = 0;
+    if (msg_frag_num > NetIO::MAX_SENDV_DATA_NUM) {
+        tmp_buff = m_buff_pool.Alloc(msg_len, &tmp_buff_len);
+        if (tmp_buff == NULL) {
+            _LOG_LAST_ERROR("alloc send buff failed, len=%u", msg_len);
+            return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+        }
+        uint32_t copy_len = 0;
+        for (uint32_t i = 0; i < msg_frag_num; i++) {
+            memcpy(tmp_buff + copy_len, msg_frag[i], msg_frag_len[i]);
+            copy_len += msg_frag_len[i];
+        }
+        iovs[0].iov_base = tmp_buff;
+        iovs[0].iov_len  = msg_len;
+        iov_num = 1;
+    } else {
+        for (; iov_num < msg_frag_num; iov_num++) {
+            iovs[iov_num].iov_base = const_cast<uint8_t*>(msg_frag[iov_num]);
+            iovs[iov_num].iov_len  = msg_frag_len[iov_num];
+        }
+    }
+
+    struct mmsghdr msg;
+    struct sockaddr_in peer_addr;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_hdr.msg_iov    = iovs;
+    msg.msg_hdr.msg_iovlen = iov_num;
+    const SocketInfo* socket_info = m_netio->GetSocketInfo(send_handle);
+    if (!(socket_info->_state & CONNECT_ADDR)) { // udp protocol listen
+        NetIO::ToSockAddr(handle, &peer_addr);
+        msg.msg_hdr.msg_name    = &peer_addr;
+        msg.msg_hdr.msg_namelen = sizeof(peer_addr);
+    }
+
+    int32_t ret = m_netio->SendMMsg(send_handle, &msg, 1);
+    m_buff_pool.Free(tmp_buff, tmp_buff_len);
+
+    // 网络错误，关闭连接
+    if (ret < 0) {
+        CloseConnection(handle);
+        _LOG_LAST_ERROR("send to %lu failed(%s)", handle, m_netio->GetLastError());
+        return kMESSAGE_SEND_FAILED;
+    }
+
+    if (ret == 1) {
+        return 0;
+    }
+
+    // socket缓冲区满，需要缓存
+    return CacheSendData(handle, connection, msg_frag_num, msg_frag, msg_frag_len, 0);
+}
+
+void NetMessage::SetUdpBatchNum(uint32_t num) {
+    if (num < 1) {
+        num = 1;
+    } else if (num > MAX_UDP_BATCH_NUM) {
+        num = MAX_UDP_BATCH_NUM;
+    }
+    FlushUdpSend();
+    m_udp_batch_num = num;
+}
+
+void NetMessage::FlushUdpSend() {
+    // 相邻的使用同一个本地socket的报文一次sendmmsg发出，保持报文顺序，
+    // socket缓冲区满时未发出的报文留在合并缓冲区，socket可写或下次Poll时再发
+    uint64_t blocked[MAX_UDP_BATCH_NUM];
+    uint32_t blocked_num = 0;
+    uint32_t remain_num  = 0;
+    uint32_t remain_len  = 0;
+    uint32_t begin = 0;
+    while (begin < m_udp_pending_num) {
+        uint64_t send_handle = m_udp_pending[begin]._send_handle;
+        uint32_t end = begin + 1;
+        while (end < m_udp_pending_num && m_udp_pending[end]._send_handle == send_handle) {
+            end++;
+        }
+
+        // 同一socket前面的报文未发出时后面的也不发，避免乱序
+        bool is_blocked = false;
+        for (uint32_t i = 0; i < blocked_num && !is_blocked; i++) {
+            is_blocked = (blocked[i] == send_handle);
+        }
+        uint32_t idx = is_blocked ? begin : SendUdpBatch(send_handle, begin, end);
+        if (idx < end && !is_blocked) {
+            blocked[blocked_num++] = send_handle;
+        }
+
+        // 剩余报文按原顺序移到合并缓冲区头部
+        for (; idx < end; idx++) {
+            UdpPendingMsg pending = m_udp_pending[idx];
+            if (pending._offset != remain_len) {
+                memmove(m_udp_send_buff + remain_len, m_udp_send_buff + pending._offset, pending._len);
+                pending._offset = remain_len;
+            }
+            remain_len += pending._len;
+            m_udp_pending[remain_num++] = pending;
+        }
+        begin = end;
+    }
+    m_udp_pending_num = remain_num;
+    m_udp_send_len    = remain_len;
+}
+
+bool NetMessage::HasUdpPending(uint64_t handle) const {
+    for (uint32_t idx = 0; idx < m_udp_pending_num; idx++) {
+        if (m_udp_pending[idx]._handle == handle || m_udp_pending[idx]._send_handle == handle) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void NetMessage::RemoveUdpPending(uint64_t handle) {
+    uint32_t remain_num = 0;
+    uint32_t remain_len = 0;
+    for (uint32_t idx = 0; idx < m_udp_pending_num; idx++) {
+        UdpPendingMsg pending = m_udp_pending[idx];
+        if (pending._handle == handle || pending._send_handle == handle) {
+            continue;
+        }
+        if (pending._offset != remain_len) {
+            memmove(m_udp_send_buff + remain_len, m_udp_send_buff + pending._offset, pending._len);
+            pending._offset = remain_len;
+        }
+        remain_len += pending._len;
+        m_udp_pending[remain_num++] = pending;
+    }
+    if (remain_num < m_udp_pending_num) {
+        _LOG_LAST_ERROR("handle %lu closed, drop %u udp msgs", handle, m_udp_pending_num - remain_num);
+    }
+    m_udp_pending_num = remain_num;
+    m_udp_send_len    = remain_len;
+}
+
+uint32_t NetMessage::SendUdpBatch(uint64_t send_handle, uint32_t begin, uint32_t end) {
+    // GSO报文的总长度不能超过一个IP报文
+    static const uint32_t MAX_UDP_GSO_TOTAL_LEN = 65000;
+
+    struct mmsghdr msgs[MAX_UDP_BATCH_NUM];
+    struct iovec iovs[MAX_UDP_BATCH_NUM];
+    struct sockaddr_in peer_addrs[MAX_UDP_BATCH_NUM];
+    char controls[MAX_UDP_BATCH_NUM][CMSG_SPACE(sizeof(uint16_t))];
+    uint32_t first_idx[MAX_UDP_BATCH_NUM]; // 每个mmsghdr对应的第一个待发送报文
+
+    const SocketInfo* socket_info = m_netio->GetSocketInfo(send_handle);
+    bool is_connect = (socket_info->_state & CONNECT_ADDR) != 0;
+    uint32_t msg_num = 0;
+    uint32_t idx = begin;
+    while (idx < end) {
+        const UdpPendingMsg& first = m_udp_pending[idx];
+        uint32_t seg_num = 1;
+        uint32_t total_len = first._len;
+        if (m_udp_gso && first._len > 0 && first._len <= MAX_UDP_GSO_SEGMENT_LEN) {
+            // 发往同一对端的等长报文合并为一个GSO报文，只有最后一个分段可以更短，
+            // 报文在合并缓冲区中是连续存放的，可以直接作为一个iovec
+            while (idx + seg_num < end && seg_num < MAX_UDP_GSO_SEGMENT_NUM) {
+                const UdpPendingMsg& next = m_udp_pending[idx + seg_num];
+                if (next._handle != first._handle || next._len == 0 || next._len > first._len
+                    || total_len + next._len > MAX_UDP_GSO_TOTAL_LEN) {
+                    break;
+                }
+                total_len += next._len;
+                seg_num++;
+                if (next._len < first._len) {
+                    break;
+                }
+            }
+        }
+
+        struct mmsghdr& msg = msgs[msg_num];
+        memset(&msg, 0, sizeof(msg));
+        iovs[msg_num].iov_base = m_udp_send_buff + first._offset;
+        iovs[msg_num].iov_len  = total_len;
+        msg.msg_hdr.msg_iov    = &iovs[msg_num];
+        msg.msg_hdr.msg_iovlen = 1;
+        if (!is_connect) {
+            NetIO::ToSockAddr(first._handle, &peer_addrs[msg_num]);
+            msg.msg_hdr.msg_name    = &peer_addrs[msg_num];
+            msg.msg_hdr.msg_namelen = sizeof(peer_addrs[msg_num]);
+        }
+        if (seg_num > 1) {
+            msg.msg_hdr.msg_control    = controls[msg_num];
+            msg.msg_hdr.msg_controllen = sizeof(controls[msg_num]);
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type  = UDP_SEGMENT;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = static_cast<uint16_t>(first._len);
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        }
+        first_idx[msg_num] = idx;
+        msg_num++;
+        idx += seg_num;
+    }
+
+    uint32_t sent = 0;
+    while (sent < msg_num) {
+        int32_t ret = m_netio->SendMMsg(send_handle, msgs + sent, msg_num - sent);
+        if (ret > 0) {
+            sent += ret;
+            continue;
+        }
+        if (ret == 0) {
+            // socket缓冲区满，NetIO已监听EPOLLOUT，剩余报文等可写时再发
+            return first_idx[sent];
+        }
+        if (msgs[sent].msg_hdr.msg_control != NULL) {
+            // 内核或网卡不支持GSO，关闭GSO后重新组包发送剩余报文
+            _LOG_LAST_ERROR("udp gso send failed(%s), disable gso", m_netio->GetLastError());
+            m_udp_gso = false;
+            return SendUdpBatch(send_handle, first_idx[sent], end);
+        }
+        _LOG_LAST_ERROR("send udp msg to %lu failed(%s)",
+            m_udp_pending[first_idx[sent]]._handle, m_netio->GetLastError());
+        sent++;
+    }
+    return end;
+}
+
+bool NetMessage::IsUdpGsoSupported() {
+    int32_t fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    int32_t gso_size = MAX_UDP_GSO_SEGMENT_LEN;
+    bool supported = (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size)) == 0);
+    close(fd);
+    return supported;
+}
+
 bool NetMessage::IsTcpTransport(uint64_t handle) {
     const SocketInfo* socket_info = m_netio->GetSocketInfo(handle);
     return socket_info->_state & TCP_PROTOCOL;
 }
 
+int32_t NetMessage::GetEventFd() const {
+    return m_epoll ? m_epoll->GetFd() : -1;
+}
+
+int32_t NetMessage::AddEventFd(int32_t fd, const cxx::function<void()>& on_event) {
+    if (m_epoll == NULL || fd < 0 || !on_event) {
+        _LOG_LAST_ERROR("add event fd %d failed, epoll = %p", fd, m_epoll);
+        return kMESSAGE_INVAILD_PARAM;
+    }
+    if (m_epoll->AddFd(fd, EPOLLIN | EPOLLERR, EVENT_FD_FLAG | static_cast<uint32_t>(fd)) != 0) {
+        _LOG_LAST_ERROR("add event fd %d failed(%s)", fd, strerror(errno));
+        return kMESSAGE_EPOLL_INIT_FAILED;
+    }
+    m_event_fds[fd] = on_event;
+    return 0;
+}
+
+void NetMessage::RemoveEventFd(int32_t fd) {
+    if (m_event_fds.erase(fd) > 0) {
+        m_epoll->DelFd(fd);
+    }
+}
+
 void NetMessage::SetMaxSendListSize(uint32_t max_send_list_size) {
     m_max_send_list_size = max_send_list_size;
 }
@@ -16,6 +16,7 @@
 #define _PEBBLE_COMMON_NET_MESSAGE_H_
 
 #include <list>
+#include "common/buffer_pool.h"
 #include "framework/message.h"
 
 
@@ -44,9 +45,30 @@ public:
     /// @brief 每个连接默认的收发缓冲区大小，默认为2M
     static const int32_t DEFAULT_MSG_BUFF_LEN = 1024 * 1024 * 2;
 
+    /// @brief 收发缓冲区最小分配单位，收到更大的消息时按2的幂升级，直至msg_buff_len
+    static const uint32_t MIN_BUFF_BLOCK_LEN = 16 * 1024;
+
+    /// @brief 收发缓冲区内存池每一级最多缓存的空闲内存
+    static const uint32_t MAX_CACHED_BUFF_LEN = 16 * 1024 * 1024;
+
+    /// @brief udp报文的最大长度
+    static const uint32_t MAX_UDP_MSG_LEN = 64 * 1024;
+
+    /// @brief udp批量收发时一次系统调用最多处理的报文数
+    static const uint32_t MAX_UDP_BATCH_NUM = 64;
+
+    /// @brief udp批量发送时合并缓冲区的大小
+    static const uint32_t UDP_SEND_BATCH_BUFF_LEN = 256 * 1024;
+
+    /// @brief 使用GSO合并发送时单个分段的最大长度，需小于路径MTU
+    static const uint32_t MAX_UDP_GSO_SEGMENT_LEN = 1400;
+
+    /// @brief 使用GSO合并发送时最多的分段数
+    static const uint32_t MAX_UDP_GSO_SEGMENT_NUM = 64;
+
     /// @param msg_head_len 由上层用户指定TCP发送时消息头的长度
     /// @param get_msg_data_len_func 当接收完消息头部分后，回调此函数得到消息数据部分的长度
-    /// @param msg_buff_len TCP接收缓冲区大小，默认为2M
+    /// @param msg_buff_len 单个消息(含消息头)的最大长度，也是接收缓冲区的最大大小，默认为2M
     int32_t Init(uint32_t msg_head_len, const GetMsgDataLen& get_msg_data_len_func,
         uint32_t msg_buff_len = DEFAULT_MSG_BUFF_LEN);
 
@@ -83,6 +105,8 @@ public:
     /// @return <0 失败
     int32_t Close(uint64_t handle);
 
+    /// @brief 一次epoll_wait会处理完本次返回的所有事件，收到完整消息的连接按顺序加入就绪链表，
+    ///     后续Poll直接返回链表头，链表为空时才再次调用epoll_wait
     /// @return 0 成功，有事件
     /// @return <0 失败，无事件或网络故障
     int32_t Poll(uint64_t* handle, int32_t* event, int32_t timeout_ms);
@@ -94,12 +118,54 @@ public:
         return m_last_error;
     }
 
-    /// @brief 设置发送缓冲区列表最大长度
+    /// @brief 设置每个连接发送缓存的最大块数，默认为1w
     void SetMaxSendListSize(uint32_t max_send_list_size);
 
+    /// @brief 返回内部epoll fd，fd可读表示有网络事件待Poll处理
+    int32_t GetEventFd() const;
+
+    /// @brief 设置udp批量收发的报文数，默认为1，即每个报文一次系统调用，发送时不合并
+    ///     >1时每个可读事件用一次recvmmsg最多收取num个报文，
+    ///     发送的报文先合并，在下一次Poll(或合并数量达到num)时按本地socket一次sendmmsg发出，
+    ///     内核支持时发往同一对端的等长小报文还会使用UDP GSO合并为一个报文
+    /// @note 批量模式下Send返回0只表示报文已合并，socket缓冲区满时未发出的报文留在合并缓冲区，
+    ///     socket可写时再发出，合并缓冲区也满时Send返回kMESSAGE_SEND_BUFF_NOT_ENOUGH
+    void SetUdpBatchNum(uint32_t num);
+
+    /// @brief 立即发送合并的udp报文，Poll时会自动调用
+    void FlushUdpSend();
+
+    /// @brief 把外部fd加入内部epoll，fd可读时在Poll中回调on_event，用于其它驱动合并事件等待
+    /// @note fd的数据由回调自己读取，回调中可以调用RemoveEventFd
+    /// @return 0 成功
+    /// @return <0 失败
+    int32_t AddEventFd(int32_t fd, const cxx::function<void()>& on_event);
+
+    /// @brief 从内部epoll移除外部fd，fd由调用者关闭
+    void RemoveEventFd(int32_t fd);
+
 private:
+    /// @brief 取就绪链表头的连接，连接在消息被消费(Pop/Recv)后才离开链表
+    /// @return 1 取到，0 链表为空
     int32_t PollConnectionBuffer(uint64_t* handle);
 
+    /// @brief 处理一个epoll事件，收到完整消息时把连接加入就绪链表
+    void ProcessEvent(uint32_t events, uint64_t netaddr);
+
+    /// @brief 有完整消息的连接加入就绪链表尾部，已在链表中则不处理
+    void LinkReadyConnection(NetConnection* connection);
+
+    /// @brief 连接离开就绪链表，不在链表中则不处理
+    void UnlinkReadyConnection(NetConnection* connection);
+
+    /// @brief 队头消息被消费后，解析缓冲区中预读的下一个消息并更新就绪链表
+    void OnMsgConsumed(uint64_t handle, NetConnection* connection);
+
+    /// @brief 队头消息头已收完时解析出消息总长度
+    /// @return 0 成功或消息头未收完
+    /// @return <0 消息头非法，应该关闭连接
+    int32_t ParseMsgLen(NetConnection* connection);
+
     NetConnection* CreateConnection(uint64_t netaddr);
 
     NetConnection* GetConnection(uint64_t netaddr);
@@ -112,12 +178,40 @@ private:
     /// @return <0 失败 连接被关闭
     int32_t SendData(uint64_t handle, const uint8_t* msg, uint32_t msg_len);
 
+    /// @brief 发送缓存数据，一次可写事件尽量发完所有缓存
+    /// @return >=0 发送的字节数
+    /// @return <0 失败 连接被关闭
     int32_t SendCacheData(uint64_t netaddr);
 
+    /// @brief 缓存分片消息中offset之后未发送的数据
+    int32_t CacheSendData(uint64_t handle, NetConnection* connection, uint32_t msg_frag_num,
+        const uint8_t* msg_frag[], uint32_t msg_frag_len[], uint32_t offset);
+
     int32_t RecvTcpData(uint64_t netaddr);
 
     int32_t RecvUdpData(uint64_t netaddr);
 
+    /// @brief recvmmsg一次收取多个udp报文，按顺序作为连接的队头消息
+    int32_t RecvUdpBatch(uint64_t netaddr, NetConnection* connection,
+        uint32_t batch_num, uint32_t slot_len);
+
+    /// @brief 发送udp报文，非批量模式iovec直接指向用户的分片，批量模式下拷贝到合并缓冲区
+    int32_t SendUdpV(uint64_t handle, uint32_t msg_frag_num,
+        const uint8_t* msg_frag[], uint32_t msg_frag_len[]);
+
+    /// @brief 把合并缓冲区中[begin, end)的报文(同一个本地socket)用sendmmsg发出
+    /// @return 第一个未发出的报文下标，socket缓冲区满时<end，全部处理完返回end
+    uint32_t SendUdpBatch(uint64_t send_handle, uint32_t begin, uint32_t end);
+
+    /// @brief 合并缓冲区中是否有发往handle或使用handle发送的报文
+    bool HasUdpPending(uint64_t handle) const;
+
+    /// @brief 丢弃合并缓冲区中发往handle或使用handle发送的报文
+    void RemoveUdpPending(uint64_t handle);
+
+    /// @brief 探测内核是否支持UDP GSO
+    static bool IsUdpGsoSupported();
+
     uint64_t GetSendHandle(uint64_t netaddr);
 
 private:
@@ -126,12 +220,14 @@ private:
         RECV_END,
     };
 
+    /// @brief 外部fd在epoll中的数据带此标记，NetIO的地址不会使用最高位
+    static const uint64_t EVENT_FD_FLAG = 1ULL << 63;
+
 private:
     char   m_last_error[256];
     Epoll* m_epoll;
     NetIO* m_netio;
 
-    uint8_t* m_send_buff; // 对使用udp发送多片消息时使用buff组装完整包
     uint32_t m_msg_buff_len;
 
     uint32_t m_max_send_list_size;
@@ -139,11 +235,36 @@ private:
     uint32_t m_msg_head_len;
     GetMsgDataLen m_get_msg_data_len_func;
 
+    // 所有连接共享的收发缓冲区内存池
+    BufferPool m_buff_pool;
+
     // 连接数据
     cxx::unordered_map<uint64_t, NetConnection*> m_connections;
 
     // udp <peer handle, local listen handle> map
     cxx::unordered_map<uint64_t, uint64_t> m_peer_handle_to_local;
+
+    // 外部fd及其事件回调
+    cxx::unordered_map<int32_t, cxx::function<void()> > m_event_fds;
+
+    // udp批量发送，报文数据按顺序存放在合并缓冲区中
+    struct UdpPendingMsg {
+        uint64_t _handle;       // 目的句柄，udp connect的句柄或对端地址
+        uint64_t _send_handle;  // 本地socket句柄
+        uint32_t _offset;       // 报文在合并缓冲区中的位置
+        uint32_t _len;
+    };
+    uint32_t m_udp_batch_num;
+    bool     m_udp_gso;
+    uint8_t* m_udp_send_buff;   // 合并缓冲区，大小为UDP_SEND_BATCH_BUFF_LEN
+    uint32_t m_udp_send_len;
+    uint32_t m_udp_pending_num;
+    UdpPendingMsg m_udp_pending[MAX_UDP_BATCH_NUM];
+
+    // 有完整消息待消费的连接组成的侵入式双向链表，按收到消息的顺序排列，
+    // Poll的开销只与活跃连接数相关，与总连接数无关
+    NetConnection* m_ready_head;
+    NetConnection* m_ready_tail;
 };
 
 
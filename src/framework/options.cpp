@@ -27,9 +27,16 @@ Options::Options() {
     _app_instance_id        = DEFAULT_APP_INSTANCE_ID;
     _app_unit_id            = DEFAULT_APP_UNIT_ID;
     _app_program_id         = DEFAULT_APP_PROGRAM_ID;
+    _app_reactor_num        = DEFAULT_APP_REACTOR_NUM;
+    _app_precise_clock      = DEFAULT_APP_PRECISE_CLOCK;
+
+    // net
+    _net_enable_uring       = DEFAULT_NET_ENABLE_URING;
+    _net_udp_batch_num      = DEFAULT_NET_UDP_BATCH_NUM;
 
     // coroutine
     _co_stack_size_bytes    = DEFAULT_CO_STACK_SIZE;
+    _co_share_stack_num     = DEFAULT_CO_SHARE_STACK_NUM;
 
     // log
     _log_device             = DEFAULT_LOG_DEVICE;
@@ -48,7 +55,9 @@ Options::Options() {
     // flow control
     _enable_flow_control    = DEFAULT_ENABLE_FLOW_CONTROL;
     _max_msg_num_per_loop   = DEFAULT_MAX_MSG_NUM_PER_LOOP;
+    _max_request_num_per_loop = DEFAULT_MAX_REQUEST_NUM_PER_LOOP;
     _task_threshold         = DEFAULT_TASK_THRESHOLD;
+    _adaptive_task_limit    = DEFAULT_ADAPTIVE_TASK_LIMIT;
     _message_expire_ms      = DEFAULT_MESSAGE_EXPIRE_MS;
     _idle_us                = DEFAULT_IDLE_US;
 
@@ -66,8 +75,14 @@ std::string Options::ToString() {
             << kAppUnitId           << " = " << _app_unit_id          << "\n"
             << kAppProgramId        << " = " << _app_program_id       << "\n"
             << kAppCtrlCmdAddr      << " = " << _app_ctrl_cmd_addr    << "\n"
+            << kAppReactorNum       << " = " << _app_reactor_num      << "\n"
+            << kAppPreciseClock     << " = " << _app_precise_clock    << "\n"
+        << "[" << kSectionNet << "]\n"
+            << kNetEnableUring      << " = " << _net_enable_uring     << "\n"
+            << kNetUdpBatchNum      << " = " << _net_udp_batch_num    << "\n"
         << "[" << kSectionCoroutine << "]\n"
             << kCoStackSize         << " = " << _co_stack_size_bytes  << "\n"
+            << kCoShareStackNum     << " = " << _co_share_stack_num   << "\n"
         << "[" << kSectionLog << "]\n"
             << kLogDevice           << " = " << _log_device           << "\n"
             << kLogPriority         << " = " << _log_priority         << "\n"
@@ -83,7 +98,9 @@ std::string Options::ToString() {
         << "[" << kSectionFlowControl << "]\n"
             << kEnableFlowControl   << " = " << _enable_flow_control  << "\n"
             << kMaxMsgNumPerLoop    << " = " << _max_msg_num_per_loop << "\n"
+            << kMaxRequestNumPerLoop << " = " << _max_request_num_per_loop << "\n"
             << kTaskThreshold       << " = " << _task_threshold       << "\n"
+            << kAdaptiveTaskLimit   << " = " << _adaptive_task_limit  << "\n"
             << kMessageExpireMs     << " = " << _message_expire_ms    << "\n"
             << kIdleUs              << " = " << _idle_us              << "\n"
         << "[" << kSectionBroadcast << "]\n"
@@ -97,6 +114,7 @@ std::string Options::ToString() {
 
 // section
 const char* kSectionApp         = "app";
+const char* kSectionNet         = "net";
 const char* kSectionCoroutine   = "coroutine";
 const char* kSectionLog         = "log";
 const char* kSectionStat        = "stat";
@@ -112,9 +130,16 @@ const char* kAppInstanceId      = "instance_id";
 const char* kAppUnitId          = "unit_id";
 const char* kAppProgramId       = "program_id";
 const char* kAppCtrlCmdAddr     = "ctrl_cmd_address";
+const char* kAppReactorNum      = "reactor_num";
+const char* kAppPreciseClock    = "precise_clock";
+
+// [net]
+const char* kNetEnableUring     = "enable_uring";
+const char* kNetUdpBatchNum     = "udp_batch_num";
 
 // [coroutine]
 const char* kCoStackSize        = "stack_size";
+const char* kCoShareStackNum    = "share_stack_num";
 
 // [log]
 const char* kLogDevice          = "device";
@@ -133,7 +158,9 @@ const char* kGdataLogPath       = "gdata_log_path";
 // [flow_control]
 const char* kEnableFlowControl  = "enable";
 const char* kMaxMsgNumPerLoop   = "msg_num_per_loop";
+const char* kMaxRequestNumPerLoop = "request_num_per_loop";
 const char* kTaskThreshold      = "task_threshold";
+const char* kAdaptiveTaskLimit  = "adaptive_task_limit";
 const char* kMessageExpireMs    = "message_expire_ms";
 const char* kIdleUs             = "idle_us";
 
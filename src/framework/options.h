@@ -33,9 +33,16 @@ struct Options {
     int32_t     _app_unit_id;       // 兼容OMS，UNIT ID，默认为0
     int32_t     _app_program_id;    // 兼容OMS, PROGRAM(SERVER) ID，默认为0
     std::string _app_ctrl_cmd_addr; // 控制命令监听地址
+    uint32_t    _app_reactor_num;   // 网络线程(reactor)数，每个线程独立监听(SO_REUSEPORT)和处理消息，默认为1，非reload生效
+    bool        _app_precise_clock; // 定时器、超时使用精确时钟(每次读取CLOCK_MONOTONIC)，默认为0，即每轮循环缓存一次粗粒度单调时钟
+
+    // net
+    bool        _net_enable_uring;  // 是否启用io_uring驱动处理"uring://"地址，默认为0，非reload生效
+    uint32_t    _net_udp_batch_num; // udp批量收发的报文数，>1时用recvmmsg/sendmmsg批量收发，默认为1，非reload生效
 
     // coroutine
     uint32_t _co_stack_size_bytes;  // 协程栈大小（单位字节），默认为256K，非reload生效
+    uint32_t _co_share_stack_num;   // 共享栈个数，0为每个协程独立栈，>0时协程共用这些栈(切换时拷贝栈内容)，默认为0，非reload生效
 
     // log
     std::string _log_device;        // 打印输出方式 { FILE、STDOUT }，默认为FILE
@@ -54,9 +61,11 @@ struct Options {
     // flow control
     bool     _enable_flow_control;  // 是否打开流控，0 - 关闭，1 - 打开，默认为1
     uint32_t _max_msg_num_per_loop; // 每个tick最大消息处理数量，默认为100
+    uint32_t _max_request_num_per_loop; // 服务优先级不同时每个tick最多处理的请求数，超出的按优先级排队，默认为100
     uint32_t _task_threshold;       // 系统并发任务门限，默认为1w
+    bool     _adaptive_task_limit;  // 是否按请求处理时延自适应调整并发任务门限，打开后task_threshold为门限上限，默认为0
     uint32_t _message_expire_ms;    // 消息过期时间（单位ms），默认为10*1000(10s)
-    uint32_t _idle_us;              // idle time by us
+    uint32_t _idle_us;              // 空闲时最长阻塞等待时间(us)，有消息、协程hook的fd事件到达或定时器、co_poll、naming超时到期时提前唤醒，默认为10ms(用户OnUpdate中的轮询和naming的推送依赖此上限)
 
     // broadcast
     std::string _bc_relay_address;  // 接收其他server转发的广播消息的监听地址，非reload生效
@@ -70,6 +79,7 @@ struct Options {
 /// @brief ini配置默认字段名定义
 // section
 extern const char* kSectionApp;         // [app]
+extern const char* kSectionNet;         // [net]
 extern const char* kSectionCoroutine;   // [coroutine]
 extern const char* kSectionLog;         // [log]
 extern const char* kSectionStat;        // [stat]
@@ -85,10 +95,16 @@ extern const char* kAppInstanceId;
 extern const char* kAppUnitId;
 extern const char* kAppProgramId;
 extern const char* kAppCtrlCmdAddr;
+extern const char* kAppReactorNum;
+extern const char* kAppPreciseClock;
 
+// [net]
+extern const char* kNetEnableUring;
+extern const char* kNetUdpBatchNum;
 
 // [coroutine]
 extern const char* kCoStackSize;
+extern const char* kCoShareStackNum;
 
 // [log]
 extern const char* kLogDevice;
@@ -107,7 +123,9 @@ extern const char* kGdataLogPath;
 // [flow_control]
 extern const char* kEnableFlowControl;
 extern const char* kMaxMsgNumPerLoop;
+extern const char* kMaxRequestNumPerLoop;
 extern const char* kTaskThreshold;
+extern const char* kAdaptiveTaskLimit;
 extern const char* kMessageExpireMs;
 extern const char* kIdleUs;
 
@@ -125,10 +143,17 @@ extern const char* kBcZkTimeoutMs;
 
 #define DEFAULT_APP_UNIT_ID     0
 #define DEFAULT_APP_PROGRAM_ID  0
+#define DEFAULT_APP_REACTOR_NUM 1
+#define DEFAULT_APP_PRECISE_CLOCK   false
+
+// [net]
+#define DEFAULT_NET_ENABLE_URING    false
+#define DEFAULT_NET_UDP_BATCH_NUM   1
 
 
 // [coroutine]
 #define DEFAULT_CO_STACK_SIZE   (256 * 1024)
+#define DEFAULT_CO_SHARE_STACK_NUM  0
 
 // [log]
 #define DEFAULT_LOG_DEVICE      "FILE"
@@ -147,9 +172,11 @@ extern const char* kBcZkTimeoutMs;
 // [flow_control]
 #define DEFAULT_ENABLE_FLOW_CONTROL true
 #define DEFAULT_MAX_MSG_NUM_PER_LOOP    100
+#define DEFAULT_MAX_REQUEST_NUM_PER_LOOP    100
 #define DEFAULT_TASK_THRESHOLD      (10000)
+#define DEFAULT_ADAPTIVE_TASK_LIMIT false
 #define DEFAULT_MESSAGE_EXPIRE_MS   (10 * 1000)
-#define DEFAULT_IDLE_US         (1000)
+#define DEFAULT_IDLE_US         (10 * 1000)
 
 // [broadcast]
 #define DEFAULT_BC_ZK_TIMEOUT_MS    20000
@@ -16,6 +16,7 @@
 #include "framework/rpc_util.inh"
 #include "framework/dr/common/dr_define.h"
 #include "framework/dr/protocol/binary_protocol.h"
+#include "framework/dr/protocol/compact_protocol.h"
 #include "framework/dr/protocol/json_protocol.h"
 #include "framework/dr/transport/buffer_transport.h"
 #include "src/framework/exception.h"
@@ -48,6 +49,7 @@ PebbleRpc::PebbleRpc(CodeType code_type, CoroutineSchedule* coroutine_schedule)
     switch (m_code_type) {
         case kCODE_BINARY:
         case kCODE_JSON:
+        case kCODE_COMPACT:
             m_rpc_plugin = new ThriftRpcPlugin(this);
             break;
         case kCODE_PB:
@@ -113,6 +115,10 @@ dr::protocol::TProtocol* PebbleRpc::GetCodec(MemoryPolicy mem_policy) {
             codec = new dr::protocol::TBinaryProtocol(trans);
             break;
 
+        case kCODE_COMPACT:
+            codec = new dr::protocol::TCompactProtocol(trans);
+            break;
+
         default:
             _LOG_LAST_ERROR("unsupport code type : %d", m_code_type);
             return NULL;
@@ -131,13 +137,13 @@ uint8_t* PebbleRpc::GetBuffer(int32_t size) {
         return NULL;
     }
     // 2 * size or max_buff_size
-    int32_t need_realloc = std::min(size + size - m_buff_size, max_buff_size - m_buff_size);
-    uint8_t* new_buff = (uint8_t*)realloc(m_buff, need_realloc);
+    int32_t new_size = std::min(size + size, max_buff_size);
+    uint8_t* new_buff = (uint8_t*)realloc(m_buff, new_size);
     if (new_buff == NULL) {
         return NULL;
     }
     m_buff = new_buff;
-    m_buff_size += need_realloc;
+    m_buff_size = new_size;
     return m_buff;
 }
 
@@ -244,7 +250,7 @@ int32_t PebbleRpc::ProcessRequest(int64_t handle, const RpcHead& rpc_head,
     return m_rpc_util->ProcessRequest(handle, rpc_head, buff, buff_len);
 }
 
-int32_t PebbleRpc::AddService(cxx::shared_ptr<IPebbleRpcService> service) {
+int32_t PebbleRpc::AddService(cxx::shared_ptr<IPebbleRpcService> service, int32_t priority) {
     std::string service_name(service->Name());
     if (service_name.empty()) {
         _LOG_LAST_ERROR("service name is empty");
@@ -267,6 +273,14 @@ int32_t PebbleRpc::AddService(cxx::shared_ptr<IPebbleRpcService> service) {
         return kPEBBLE_RPC_SERVICE_ADD_FAILED;
     }
 
+    if (priority != kRPC_PRIORITY_BUTT) {
+        result = SetFunctionPriority(service_name, priority);
+        if (result != kRPC_SUCCESS) {
+            _LOG_LAST_ERROR("service %s SetFunctionPriority failed(%d)", service_name.c_str(), result);
+            return kPEBBLE_RPC_SERVICE_ADD_FAILED;
+        }
+    }
+
     return kRPC_SUCCESS;
 }
 
@@ -39,6 +39,7 @@ typedef enum {
     kCODE_BINARY  = 0,  // thrift binary protocol
     kCODE_JSON,         // thrift json protocol
     kCODE_PB,           // protobuff protocol
+    kCODE_COMPACT,      // thrift compact protocol
     kCODE_BUTT
 } CodeType;
 
@@ -67,6 +68,14 @@ public:
     template<typename Class>
     int32_t AddService(Class* service);
 
+    /// @brief 添加服务并设置服务所有方法的优先级，覆盖IDL中声明的优先级
+    /// @param service 实现了IDL生成服务接口的对象指针，对象内存由用户管理
+    /// @param priority @see RpcPriority
+    /// @return 0 成功
+    /// @return 非0 失败 @see PebbleRpcErrorCode
+    template<typename Class>
+    int32_t AddService(Class* service, int32_t priority);
+
 public:
     /// @brief 编解码内存策略
     /// @note 内部使用，用户无需关注
@@ -119,7 +128,9 @@ private:
     virtual int32_t ProcessRequest(int64_t handle, const RpcHead& rpc_head,
         const uint8_t* buff, uint32_t buff_len);
 
-    int32_t AddService(cxx::shared_ptr<IPebbleRpcService> service);
+    /// @param priority kRPC_PRIORITY_BUTT时保留IDL中声明的优先级
+    int32_t AddService(cxx::shared_ptr<IPebbleRpcService> service,
+        int32_t priority = kRPC_PRIORITY_BUTT);
 
 protected:
     CodeType m_code_type;
@@ -141,6 +152,14 @@ int32_t PebbleRpc::AddService(Class* service) {
     return AddService(GenServiceHandler<typename Class::__InterfaceType>()(this, service));
 }
 
+template<typename Class>
+int32_t PebbleRpc::AddService(Class* service, int32_t priority) {
+    if (NULL == service || priority < kRPC_PRIORITY_LOW || priority >= kRPC_PRIORITY_BUTT) {
+        return kRPC_INVALID_PARAM;
+    }
+    return AddService(GenServiceHandler<typename Class::__InterfaceType>()(this, service), priority);
+}
+
 
 /// @brief PebbleRpc IDL生成代码服务端骨架代码接口
 /// @note 内部使用，用户无需关注
@@ -54,6 +54,12 @@ public:
     virtual void OnRequestProcComplete(const std::string& name,
         int32_t result, int32_t time_cost_ms) = 0;
 
+    /// @brief 请求处理时延样本事件，只在需要应答的请求处理完成时回调，
+    ///   ONEWAY请求处理函数返回时处理未必完成，耗时不可信，不回调
+    /// @param result 处理结果
+    /// @param time_cost_ms 处理耗时，单位毫秒
+    virtual void OnRequestLatencySample(int32_t result, int32_t time_cost_ms) {}
+
     /// @brief 响应处理完成事件，在响应消息处理完成时被回调
     /// @param name 消息名称
     /// @param result 请求结果
@@ -98,10 +104,23 @@ public:
     // TODO: 每个Processor建议维护一个消息白名单或优先级列表，允许某些消息即使在过载情况下仍然要处理
     virtual int32_t OnMessage(int64_t handle, const uint8_t* buff, uint32_t buff_len, uint32_t is_overload) = 0;
 
+    /// @brief 设置下一条消息的到达时间，框架在OnMessage之前调用，Processor可据此计算消息的排队时间
+    /// @param arrived_ms 单调时钟毫秒 @see MsgExternInfo::_msg_arrived_ms
+    virtual void SetMessageArrivedTime(int64_t arrived_ms) {}
+
+    /// @brief 句柄关闭通知，框架关闭句柄时调用，Processor可据此释放和此句柄相关的状态
+    /// @param handle 被关闭的网络句柄
+    virtual void OnClose(int64_t handle) {}
+
     /// @brief 事件驱动
     /// @return 处理的事件数，0表示无事件
     virtual int32_t Update() = 0;
 
+    /// @brief 距离下一次需要调用Update的毫秒数，框架空闲时据此决定阻塞等待多久
+    /// @return >=0 毫秒数
+    /// @return <0 无定时事件，只在有消息时需要驱动
+    virtual int64_t GetNextTimeout() { return -1; }
+
     /// @brief 获取未结束的任务数，用于过载判断
     /// @return 实际未结束的任务数
     virtual uint32_t GetUnFinishedTaskNum() = 0;
@@ -221,6 +221,38 @@ const char* RawMessageDriver::GetLastError() {
     return "uninited.";
 }
 
+int32_t RawMessageDriver::GetEventFd() {
+    if (m_net_message) {
+        return m_net_message->GetEventFd();
+    }
+    return -1;
+}
+
+void RawMessageDriver::SetUdpBatchNum(uint32_t num) {
+    if (m_net_message) {
+        m_net_message->SetUdpBatchNum(num);
+    }
+}
+
+void RawMessageDriver::FlushUdpSend() {
+    if (m_net_message) {
+        m_net_message->FlushUdpSend();
+    }
+}
+
+int32_t RawMessageDriver::AddEventFd(int32_t fd, const cxx::function<void()>& on_event) {
+    if (m_net_message) {
+        return m_net_message->AddEventFd(fd, on_event);
+    }
+    return kMESSAGE_UNINSTALL_DRIVER;
+}
+
+void RawMessageDriver::RemoveEventFd(int32_t fd) {
+    if (m_net_message) {
+        m_net_message->RemoveEventFd(fd);
+    }
+}
+
 int32_t RawMessageDriver::ParseHead(const uint8_t* head, uint32_t head_len) {
     if (head == NULL || head_len < sizeof(TcpMsgHead)) {
         return -1;
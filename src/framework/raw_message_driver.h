@@ -80,6 +80,21 @@ public:
 
     virtual const char* GetLastError();
 
+    /// @brief 返回底层epoll fd，其它驱动可以监听此fd来合并事件等待
+    int32_t GetEventFd();
+
+    /// @brief 设置udp批量收发的报文数，见NetMessage::SetUdpBatchNum
+    void SetUdpBatchNum(uint32_t num);
+
+    /// @brief 立即发送合并的udp报文
+    void FlushUdpSend();
+
+    /// @brief 把外部fd加入底层epoll，见NetMessage::AddEventFd
+    int32_t AddEventFd(int32_t fd, const cxx::function<void()>& on_event);
+
+    /// @brief 从底层epoll移除外部fd
+    void RemoveEventFd(int32_t fd);
+
 private:
     int32_t ParseHead(const uint8_t* head, uint32_t head_len);
 
@@ -11,12 +11,13 @@
  *
  */
 
+#include <algorithm>
 #include <sstream>
 #include <string.h>
 
-#include "common/timer.h"
 #include "common/time_utility.h"
 #include "framework/message.h"
+#include "framework/options.h"
 #include "framework/rpc.h"
 
 namespace pebble {
@@ -46,51 +47,111 @@ public:
 static RpcErrorStringRegister s_rpc_error_string_register;
 
 
-/// @brief RPC会话数据结构定义
+/// @brief RPC会话数据结构定义，由Rpc的对象池管理，释放后复用
 struct RpcSession {
     RpcSession() {
         m_session_id  = 0;
         m_handle      = 0;
-        m_timerid     = -1;
         m_start_time  = 0;
+        m_expire_time = 0;
         m_server_side = false;
+        m_table_index = 0;
+        m_heap_index  = 0;
+        m_next        = NULL;
     }
 
     uint64_t m_session_id;
     int64_t  m_handle;
-    int64_t  m_timerid;
     int64_t  m_start_time;
+    int64_t  m_expire_time;
     RpcHead  m_rpc_head;
+    std::string m_request;  // 只带方法ID的请求数据，对端不认识此ID时按名字重发
     bool     m_server_side;
     OnRpcResponse m_rsp;
+    uint32_t m_table_index; // 在会话表中的下标
+    uint32_t m_heap_index;  // 在超时堆中的下标
+    RpcSession* m_next;     // 空闲链表
 };
 
 
 Rpc::Rpc() {
     m_session_id        = 0;
-    m_timer             = new SequenceTimer();
     m_last_error[0]     = 0;
     m_rpc_event_handler = NULL;
     m_task_num          = 0;
     m_latest_handle     = -1;
+    m_msg_arrived_ms    = 0;
+    m_function_mask     = 0;
+    m_session_mask      = 0;
+    m_session_num       = 0;
+    m_free_session      = NULL;
+    m_queued_num        = 0;
+    m_max_request_num_per_loop = DEFAULT_MAX_REQUEST_NUM_PER_LOOP;
+    m_request_budget    = DEFAULT_MAX_REQUEST_NUM_PER_LOOP;
+    m_lowest_priority   = kRPC_PRIORITY_NORMAL;
+    m_highest_priority  = kRPC_PRIORITY_NORMAL;
+    m_shed_priority     = kRPC_PRIORITY_NORMAL;
+    m_shed_adjust_ms    = 0;
+    m_last_overload_ms  = 0;
 }
 
 Rpc::~Rpc() {
-    if (m_timer) {
-        delete m_timer;
-        m_timer = NULL;
+    for (std::vector<RpcSession*>::iterator it = m_session_table.begin();
+        it != m_session_table.end(); ++it) {
+        delete *it;
+    }
+    while (m_free_session) {
+        RpcSession* session = m_free_session;
+        m_free_session = session->m_next;
+        delete session;
+    }
+    for (int32_t priority = 0; priority < kRPC_PRIORITY_BUTT; ++priority) {
+        std::deque<QueuedRequest*>& queue = m_request_queues[priority];
+        for (std::deque<QueuedRequest*>::iterator it = queue.begin(); it != queue.end(); ++it) {
+            delete *it;
+        }
+    }
+    for (std::vector<QueuedRequest*>::iterator it = m_free_requests.begin();
+        it != m_free_requests.end(); ++it) {
+        delete *it;
     }
 }
 
 int32_t Rpc::Update() {
     int32_t num = 0;
-    if (m_timer) {
-        num += m_timer->Update();
+    int64_t now = TimeUtility::GetMonotonicMS();
+    // 新启动的超时都晚于now，循环一定会结束
+    while (!m_timeout_heap.empty() && m_timeout_heap[0]->m_expire_time <= now) {
+        OnTimeout(m_timeout_heap[0]);
+        num++;
+    }
+
+    m_request_budget = m_max_request_num_per_loop;
+    if (m_queued_num > 0) {
+        num += DispatchQueuedRequests();
+    }
+
+    // 过载消失后逐级恢复拒绝的优先级
+    if (m_shed_priority > m_lowest_priority
+        && now - m_last_overload_ms >= SHED_ADJUST_MS && now - m_shed_adjust_ms >= SHED_ADJUST_MS) {
+        m_shed_priority--;
+        m_shed_adjust_ms = now;
     }
 
     return num;
 }
 
+int64_t Rpc::GetNextTimeout() {
+    if (m_queued_num > 0) {
+        return 0;
+    }
+    if (m_timeout_heap.empty()) {
+        return -1;
+    }
+    int64_t timeout = m_timeout_heap[0]->m_expire_time - TimeUtility::GetMonotonicMS();
+    return timeout > 0 ? timeout : 0;
+}
+
 int32_t Rpc::SetSendFunction(const SendFunction& send, const SendVFunction& sendv) {
     if (!send || !sendv) {
         _LOG_LAST_ERROR("param invalid: !send = %d, !sendv = %d", !send, !sendv);
@@ -132,15 +193,47 @@ int32_t Rpc::OnMessage(int64_t handle, const uint8_t* buff,
     const uint8_t* data = buff + head_len;
     uint32_t data_len   = buff_len - head_len;
 
+    int64_t arrived_ms = m_msg_arrived_ms;
+    m_msg_arrived_ms   = 0;
+
+    // 所有服务优先级相同时不用查找，请求也不排队
+    int32_t priority = m_highest_priority;
+    if (m_lowest_priority != m_highest_priority
+        && (kRPC_CALL == head.m_message_type || kRPC_ONEWAY == head.m_message_type)) {
+        RpcFunctionMap::value_type* function = FindFunction(head);
+        priority = function ? function->second.m_priority : kRPC_PRIORITY_NORMAL;
+    }
+
     int32_t ret = kRPC_UNKNOWN_TYPE;
     switch (head.m_message_type) {
         case kRPC_CALL:
+            if (head.m_timeout_ms > 0) {
+                // 调用方的时间预算已用完，调用方已按超时处理，不再解码和处理，也不回响应
+                int64_t now = TimeUtility::GetMonotonicMS();
+                int64_t remain_ms = (arrived_ms > 0 ? arrived_ms : now) + head.m_timeout_ms - now;
+                if (remain_ms <= 0) {
+                    ret = kRPC_MESSAGE_EXPIRED;
+                    OnRequestProcComplete(head.m_function_name, kRPC_MESSAGE_EXPIRED, 0);
+                    break;
+                }
+                head.m_timeout_ms = static_cast<int32_t>(remain_ms);
+            }
             if (is_overload != 0) {
-                ret = ResponseException(handle, kRPC_SYSTEM_OVERLOAD_BASE - is_overload, head);
-                OnRequestProcComplete(head.m_function_name, kRPC_SYSTEM_OVERLOAD_BASE - is_overload, 0);
-                break;
+                OnOverload();
+                if (priority <= m_shed_priority) {
+                    ret = ResponseException(handle, kRPC_SYSTEM_OVERLOAD_BASE - is_overload, head);
+                    OnRequestProcComplete(head.m_function_name, kRPC_SYSTEM_OVERLOAD_BASE - is_overload, 0);
+                    break;
+                }
             }
         case kRPC_ONEWAY:
+            if (m_lowest_priority != m_highest_priority) {
+                if (!CanDispatchRequest(priority)) {
+                    ret = EnqueueRequest(handle, head, priority, data, data_len);
+                    break;
+                }
+                m_request_budget--;
+            }
             m_latest_handle = handle;
             ret = ProcessRequest(handle, head, data, data_len);
             break;
@@ -164,18 +257,278 @@ int32_t Rpc::AddOnRequestFunction(const std::string& name, const OnRpcRequest& o
         return kRPC_INVALID_PARAM;
     }
 
-    std::pair<cxx::unordered_map<std::string, OnRpcRequest>::iterator, bool> ret =
-        m_service_map.insert(std::pair<std::string, OnRpcRequest>(name, on_request));
+    RpcFunction function;
+    function.m_id          = 0;
+    function.m_priority    = kRPC_PRIORITY_NORMAL;
+    function.m_pin_request = false;
+    function.m_on_request  = on_request;
+    std::pair<RpcFunctionMap::iterator, bool> ret =
+        m_service_map.insert(RpcFunctionMap::value_type(name, function));
     if (false == ret.second) {
         _LOG_LAST_ERROR("the %s is existed", name.c_str());
         return kRPC_FUNCTION_NAME_EXISTED;
     }
 
+    RebuildFunctionTable();
+    UpdatePriorityRange();
     return kRPC_SUCCESS;
 }
 
 int32_t Rpc::RemoveOnRequestFunction(const std::string& name) {
-    return m_service_map.erase(name) == 1 ? kRPC_SUCCESS : kRPC_FUNCTION_NAME_UNEXISTED;
+    if (m_service_map.erase(name) != 1) {
+        return kRPC_FUNCTION_NAME_UNEXISTED;
+    }
+
+    RebuildFunctionTable();
+    UpdatePriorityRange();
+    return kRPC_SUCCESS;
+}
+
+int32_t Rpc::SetFunctionPriority(const std::string& name, int32_t priority) {
+    if (name.empty() || priority < kRPC_PRIORITY_LOW || priority >= kRPC_PRIORITY_BUTT) {
+        _LOG_LAST_ERROR("param invalid: name = %s, priority = %d", name.c_str(), priority);
+        return kRPC_INVALID_PARAM;
+    }
+
+    uint32_t num = 0;
+    if (name.find(':') != std::string::npos) {
+        RpcFunctionMap::iterator it = m_service_map.find(name);
+        if (it != m_service_map.end()) {
+            it->second.m_priority = priority;
+            num++;
+        }
+    } else {
+        std::string prefix(name + ":");
+        for (RpcFunctionMap::iterator it = m_service_map.begin(); it != m_service_map.end(); ++it) {
+            if (it->first.compare(0, prefix.size(), prefix) == 0) {
+                it->second.m_priority = priority;
+                num++;
+            }
+        }
+    }
+
+    if (0 == num) {
+        _LOG_LAST_ERROR("the %s is not existed", name.c_str());
+        return kRPC_FUNCTION_NAME_UNEXISTED;
+    }
+
+    UpdatePriorityRange();
+    return kRPC_SUCCESS;
+}
+
+void Rpc::SetMaxRequestNumPerLoop(uint32_t max_request_num) {
+    // 为0时排队的请求永远不会被处理
+    m_max_request_num_per_loop = max_request_num > 0 ? max_request_num : 1;
+    m_request_budget = m_max_request_num_per_loop;
+}
+
+int32_t Rpc::SetFunctionPinRequest(const std::string& name, bool pin) {
+    RpcFunctionMap::iterator it = m_service_map.find(name);
+    if (m_service_map.end() == it) {
+        _LOG_LAST_ERROR("the %s is not existed", name.c_str());
+        return kRPC_FUNCTION_NAME_UNEXISTED;
+    }
+
+    it->second.m_pin_request = pin;
+    return kRPC_SUCCESS;
+}
+
+void Rpc::UpdatePriorityRange() {
+    m_lowest_priority  = kRPC_PRIORITY_NORMAL;
+    m_highest_priority = kRPC_PRIORITY_NORMAL;
+    RpcFunctionMap::iterator it = m_service_map.begin();
+    if (it != m_service_map.end()) {
+        m_lowest_priority  = it->second.m_priority;
+        m_highest_priority = it->second.m_priority;
+    }
+    for (; it != m_service_map.end(); ++it) {
+        m_lowest_priority  = std::min(m_lowest_priority, it->second.m_priority);
+        m_highest_priority = std::max(m_highest_priority, it->second.m_priority);
+    }
+    m_shed_priority = m_lowest_priority;
+}
+
+void Rpc::OnOverload() {
+    int64_t now = TimeUtility::GetMonotonicMS();
+    if (now - m_last_overload_ms > SHED_ADJUST_MS) {
+        // 新一轮过载，先只拒绝当前级别
+        m_shed_adjust_ms = now;
+    } else if (m_shed_priority < m_highest_priority && now - m_shed_adjust_ms >= SHED_ADJUST_MS) {
+        // 拒绝低优先级后仍持续过载，再拒绝高一级
+        m_shed_priority++;
+        m_shed_adjust_ms = now;
+    }
+    m_last_overload_ms = now;
+}
+
+int32_t Rpc::EnqueueRequest(int64_t handle, const RpcHead& rpc_head, int32_t priority,
+    const uint8_t* buff, uint32_t buff_len) {
+    if (m_queued_num >= MAX_QUEUED_REQUEST_NUM) {
+        // 队列满时丢弃最低优先级中最早的请求，都比新请求优先级高时拒绝新请求
+        int32_t lowest = 0;
+        while (m_request_queues[lowest].empty()) {
+            lowest++;
+        }
+        if (lowest > priority) {
+            RejectRequest(handle, rpc_head, kRPC_TASK_OVERLOAD);
+            return kRPC_TASK_OVERLOAD;
+        }
+        QueuedRequest* request = m_request_queues[lowest].front();
+        m_request_queues[lowest].pop_front();
+        m_queued_num--;
+        RejectRequest(request->m_handle, request->m_rpc_head, kRPC_TASK_OVERLOAD);
+        FreeQueuedRequest(request);
+    }
+
+    QueuedRequest* request = NULL;
+    if (m_free_requests.empty()) {
+        request = new QueuedRequest;
+    } else {
+        request = m_free_requests.back();
+        m_free_requests.pop_back();
+    }
+
+    request->m_handle      = handle;
+    request->m_deadline_ms = 0;
+    if (rpc_head.m_timeout_ms > 0) {
+        request->m_deadline_ms = TimeUtility::GetMonotonicMS() + rpc_head.m_timeout_ms;
+    }
+    request->m_rpc_head    = rpc_head;
+    request->m_data.assign(reinterpret_cast<const char*>(buff), buff_len);
+
+    m_request_queues[priority].push_back(request);
+    m_queued_num++;
+    return kRPC_SUCCESS;
+}
+
+int32_t Rpc::DispatchQueuedRequests() {
+    int32_t num = 0;
+    for (int32_t priority = kRPC_PRIORITY_BUTT - 1; priority >= 0; --priority) {
+        std::deque<QueuedRequest*>& queue = m_request_queues[priority];
+        while (!queue.empty() && m_request_budget > 0) {
+            QueuedRequest* request = queue.front();
+            queue.pop_front();
+            m_queued_num--;
+
+            if (request->m_deadline_ms > 0) {
+                int64_t remain_ms = request->m_deadline_ms - TimeUtility::GetMonotonicMS();
+                if (remain_ms <= 0) {
+                    OnRequestProcComplete(request->m_rpc_head.m_function_name, kRPC_MESSAGE_EXPIRED, 0);
+                    FreeQueuedRequest(request);
+                    continue;
+                }
+                request->m_rpc_head.m_timeout_ms = static_cast<int32_t>(remain_ms);
+            }
+
+            // 服务处理函数在返回前完成解码，之后即可复用请求对象
+            m_request_budget--;
+            m_latest_handle = request->m_handle;
+            ProcessRequest(request->m_handle, request->m_rpc_head,
+                reinterpret_cast<const uint8_t*>(request->m_data.data()),
+                static_cast<uint32_t>(request->m_data.size()));
+            FreeQueuedRequest(request);
+            num++;
+        }
+    }
+    return num;
+}
+
+bool Rpc::CanDispatchRequest(int32_t priority) const {
+    if (0 == m_request_budget) {
+        return false;
+    }
+    if (0 == m_queued_num) {
+        return true;
+    }
+    for (int32_t i = priority; i < kRPC_PRIORITY_BUTT; ++i) {
+        if (!m_request_queues[i].empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Rpc::FreeQueuedRequest(QueuedRequest* request) {
+    if (request->m_data.capacity() > MAX_KEEP_REQUEST_LEN) {
+        std::string().swap(request->m_data);
+    }
+    m_free_requests.push_back(request);
+}
+
+void Rpc::RejectRequest(int64_t handle, const RpcHead& rpc_head, int32_t ret) {
+    if (kRPC_CALL == rpc_head.m_message_type) {
+        ResponseException(handle, ret, rpc_head);
+    }
+    OnRequestProcComplete(rpc_head.m_function_name, ret, 0);
+}
+
+uint32_t Rpc::GetFunctionId(const std::string& name) {
+    uint32_t id = 2166136261u;
+    for (std::string::const_iterator it = name.begin(); it != name.end(); ++it) {
+        id ^= static_cast<uint8_t>(*it);
+        id *= 16777619u;
+    }
+    // 0保留表示未设置
+    return id != 0 ? id : 1;
+}
+
+void Rpc::RebuildFunctionTable() {
+    // 装载率不超过1/2，线性探测很短
+    uint32_t size = 16;
+    while (size < m_service_map.size() * 2) {
+        size <<= 1;
+    }
+
+    RpcFunctionSlot empty_slot = { 0, NULL };
+    m_function_table.assign(size, empty_slot);
+    m_function_mask = size - 1;
+
+    for (RpcFunctionMap::iterator it = m_service_map.begin(); it != m_service_map.end(); ++it) {
+        uint32_t id = GetFunctionId(it->first);
+        uint32_t index = id & m_function_mask;
+        while (m_function_table[index].m_id != 0 && m_function_table[index].m_id != id) {
+            index = (index + 1) & m_function_mask;
+        }
+
+        RpcFunctionSlot& slot = m_function_table[index];
+        if (slot.m_id == id) {
+            // ID冲突，冲突的方法都只能按名字调用
+            if (slot.m_entry) {
+                slot.m_entry->second.m_id = 0;
+                slot.m_entry = NULL;
+            }
+            it->second.m_id = 0;
+            continue;
+        }
+
+        slot.m_id    = id;
+        slot.m_entry = &(*it);
+        it->second.m_id = id;
+    }
+}
+
+Rpc::RpcFunctionMap::value_type* Rpc::FindFunction(const RpcHead& rpc_head) {
+    if (rpc_head.m_function_id != 0 && !m_function_table.empty()) {
+        uint32_t index = rpc_head.m_function_id & m_function_mask;
+        while (m_function_table[index].m_id != 0) {
+            if (m_function_table[index].m_id == rpc_head.m_function_id) {
+                RpcFunctionMap::value_type* entry = m_function_table[index].m_entry;
+                // 对端的方法可能和本端其它方法的ID相同，带了名字时以名字为准
+                if (entry && (rpc_head.m_function_name.empty() || rpc_head.m_function_name == entry->first)) {
+                    return entry;
+                }
+                break;
+            }
+            index = (index + 1) & m_function_mask;
+        }
+    }
+
+    // 老版本对端只带方法名，或ID冲突
+    if (rpc_head.m_function_name.empty()) {
+        return NULL;
+    }
+    RpcFunctionMap::iterator it = m_service_map.find(rpc_head.m_function_name);
+    return m_service_map.end() == it ? NULL : &(*it);
 }
 
 void Rpc::GetResourceUsed(cxx::unordered_map<std::string, int64_t>* resource_info) {
@@ -184,11 +537,11 @@ void Rpc::GetResourceUsed(cxx::unordered_map<std::string, int64_t>* resource_inf
     }
     std::ostringstream timer;
     timer << "Rpc(" << this << "):timer";
-    (*resource_info)[timer.str()]   = m_timer->GetTimerNum();
+    (*resource_info)[timer.str()]   = m_timeout_heap.size();
 
     std::ostringstream session;
     session << "Rpc(" << this << "):session";
-    (*resource_info)[session.str()] = m_session_map.size();
+    (*resource_info)[session.str()] = m_session_num;
     return;
 }
 
@@ -204,10 +557,37 @@ int32_t Rpc::SendRequest(int64_t handle,
         return kRPC_INVALID_PARAM;
     }
 
+    // 对端已在应答中确认此方法ID时请求头只带ID，否则名字和ID都带上，由对端的应答确认
+    bool id_only = false;
+    if (rpc_head.m_function_id != 0) {
+        cxx::unordered_map<int64_t, FunctionIdMap>::iterator peer = m_function_id_peers.find(handle);
+        if (peer != m_function_id_peers.end()) {
+            // 本端不同方法的ID也可能相同，以确认时的方法名为准
+            FunctionIdMap::iterator it = peer->second.find(rpc_head.m_function_id);
+            id_only = (it != peer->second.end() && it->second == rpc_head.m_function_name);
+        }
+    }
+
+    if (on_rsp && FindSession(rpc_head.m_session_id) != NULL) {
+        _LOG_LAST_ERROR("session %lu is existed", rpc_head.m_session_id);
+        return kRPC_INVALID_PARAM;
+    }
+
+    if (timeout_ms <= 0) {
+        timeout_ms = 10 * 1000;
+    }
+
+    m_send_head = rpc_head;
+    m_send_head.m_id_only = id_only;
+    // 超时时间作为时间预算带给对端，对端在预算用完后不再处理此请求
+    m_send_head.m_timeout_ms = on_rsp ? timeout_ms : 0;
+
     // 发送请求
-    int32_t ret = Send(handle, rpc_head, buff, buff_len);
+    int32_t ret = Send(handle, m_send_head, buff, buff_len);
     if (ret != kRPC_SUCCESS) {
         _LOG_LAST_ERROR("send failed(%d)", ret);
+        // 连接可能已被对端关闭，重连后的对端需要重新确认方法ID
+        m_function_id_peers.erase(handle);
         OnResponseProcComplete(rpc_head.m_function_name, kRPC_SEND_FAILED, 0);
         return ret;
     }
@@ -219,21 +599,13 @@ int32_t Rpc::SendRequest(int64_t handle,
     }
 
     // 保持会话
-    cxx::shared_ptr<RpcSession> session(new RpcSession());
-    session->m_session_id  = rpc_head.m_session_id;
-    session->m_handle      = handle;
+    RpcSession* session    = AllocSession(rpc_head.m_session_id, handle, timeout_ms);
     session->m_rsp         = on_rsp;
-    session->m_rpc_head    = rpc_head;
+    session->m_rpc_head    = m_send_head;
     session->m_server_side = false;
-    TimeoutCallback cb     = cxx::bind(&Rpc::OnTimeout, this, session->m_session_id);
-
-    if (timeout_ms <= 0) {
-        timeout_ms = 10 * 1000;
+    if (id_only) {
+        session->m_request.assign(reinterpret_cast<const char*>(buff), buff_len);
     }
-    session->m_timerid     = m_timer->StartTimer(timeout_ms, cb);
-    session->m_start_time  = TimeUtility::GetCurrentMS();
-
-    m_session_map[session->m_session_id] = session;
 
     return kRPC_SUCCESS;
 }
@@ -266,27 +638,24 @@ int32_t Rpc::BroadcastRequest(const std::string& name,
 int32_t Rpc::SendResponse(uint64_t session_id, int32_t ret,
     const uint8_t* buff, uint32_t buff_len) {
 
-    cxx::unordered_map< uint64_t, cxx::shared_ptr<RpcSession> >::iterator it =
-        m_session_map.find(session_id);
-    if (m_session_map.end() == it) {
+    RpcSession* session = FindSession(session_id);
+    if (NULL == session) {
         _LOG_LAST_ERROR("session %lu not found", session_id);
         return kRPC_SESSION_NOT_FOUND;
     }
 
-    m_timer->StopTimer(it->second->m_timerid);
-
     int32_t result = kRPC_SUCCESS;
     if (kRPC_SUCCESS == ret) {
-        it->second->m_rpc_head.m_message_type = kRPC_REPLY;
-        ret = Send(it->second->m_handle, it->second->m_rpc_head, buff, buff_len);
+        session->m_rpc_head.m_message_type = kRPC_REPLY;
+        ret = Send(session->m_handle, session->m_rpc_head, buff, buff_len);
     } else {
-        result = ResponseException(it->second->m_handle, ret, it->second->m_rpc_head, buff, buff_len);
+        result = ResponseException(session->m_handle, ret, session->m_rpc_head, buff, buff_len);
     }
 
-    OnRequestProcComplete(it->second->m_rpc_head.m_function_name,
-        ret, TimeUtility::GetCurrentMS() - it->second->m_start_time);
+    OnRequestProcComplete(session->m_rpc_head.m_function_name,
+        ret, TimeUtility::GetMonotonicMS() - session->m_start_time);
 
-    m_session_map.erase(it);
+    FreeSession(session);
     m_task_num--;
 
     if (result != kRPC_SUCCESS || ret != kRPC_SUCCESS) {
@@ -311,32 +680,183 @@ int32_t Rpc::Send(int64_t handle, const RpcHead& rpc_head,
     return m_sendv(handle, sizeof(msg_frag)/sizeof(*msg_frag), msg_frag, msg_frag_len, 0);
 }
 
-int32_t Rpc::OnTimeout(uint64_t session_id) {
-    cxx::unordered_map< uint64_t, cxx::shared_ptr<RpcSession> >::iterator it =
-        m_session_map.find(session_id);
-    if (m_session_map.end() == it) {
-        _LOG_LAST_ERROR("session %lu not found", session_id);
-        return kRPC_SESSION_NOT_FOUND;
-    }
-
+void Rpc::OnTimeout(RpcSession* session) {
     // request timeout
-    if ((it->second)->m_rsp) {
-        (it->second)->m_rsp(kRPC_REQUEST_TIMEOUT, NULL, 0);
-        Message::ReportHandleResult(it->second->m_handle, kRPC_REQUEST_TIMEOUT, 0);
+    if (session->m_rsp) {
+        session->m_rsp(kRPC_REQUEST_TIMEOUT, NULL, 0);
+        Message::ReportHandleResult(session->m_handle, kRPC_REQUEST_TIMEOUT, 0);
     }
 
-    if (it->second->m_server_side) {
+    if (session->m_server_side) {
         m_task_num--;
-        OnRequestProcComplete(it->second->m_rpc_head.m_function_name,
-            kRPC_PROCESS_TIMEOUT, TimeUtility::GetCurrentMS() - it->second->m_start_time);
+        OnRequestProcComplete(session->m_rpc_head.m_function_name,
+            kRPC_PROCESS_TIMEOUT, TimeUtility::GetMonotonicMS() - session->m_start_time);
     } else {
-        OnResponseProcComplete(it->second->m_rpc_head.m_function_name,
-            kRPC_REQUEST_TIMEOUT, TimeUtility::GetCurrentMS() - it->second->m_start_time);
+        OnResponseProcComplete(session->m_rpc_head.m_function_name,
+            kRPC_REQUEST_TIMEOUT, TimeUtility::GetMonotonicMS() - session->m_start_time);
     }
 
-    m_session_map.erase(it);
+    FreeSession(session);
+}
+
+RpcSession* Rpc::AllocSession(uint64_t session_id, int64_t handle, int32_t timeout_ms) {
+    if (FindSession(session_id) != NULL) {
+        return NULL;
+    }
 
-    return kTIMER_BE_REMOVED;
+    RpcSession* session = m_free_session;
+    if (session) {
+        m_free_session = session->m_next;
+        session->m_next = NULL;
+    } else {
+        session = new RpcSession();
+    }
+
+    session->m_session_id  = session_id;
+    session->m_handle      = handle;
+    session->m_start_time  = TimeUtility::GetMonotonicMS();
+    session->m_expire_time = session->m_start_time + timeout_ms;
+
+    InsertSession(session);
+
+    session->m_heap_index = m_timeout_heap.size();
+    m_timeout_heap.push_back(session);
+    TimeoutHeapUp(session->m_heap_index);
+
+    return session;
+}
+
+void Rpc::FreeSession(RpcSession* session) {
+    EraseSession(session);
+    TimeoutHeapErase(session);
+
+    // 释放回调持有的资源，RpcHead中的字符串保留容量供下次复用
+    session->m_rsp = OnRpcResponse();
+    if (session->m_request.capacity() > MAX_KEEP_REQUEST_LEN) {
+        std::string().swap(session->m_request);
+    } else {
+        session->m_request.clear();
+    }
+    session->m_next = m_free_session;
+    m_free_session = session;
+}
+
+RpcSession* Rpc::FindSession(uint64_t session_id) {
+    if (m_session_table.empty()) {
+        return NULL;
+    }
+
+    uint32_t index = static_cast<uint32_t>(session_id) & m_session_mask;
+    while (m_session_table[index] != NULL) {
+        if (m_session_table[index]->m_session_id == session_id) {
+            return m_session_table[index];
+        }
+        index = (index + 1) & m_session_mask;
+    }
+    return NULL;
+}
+
+void Rpc::InsertSession(RpcSession* session) {
+    if ((m_session_num + 1) * 2 > m_session_table.size()) {
+        GrowSessionTable();
+    }
+
+    uint32_t index = static_cast<uint32_t>(session->m_session_id) & m_session_mask;
+    while (m_session_table[index] != NULL) {
+        index = (index + 1) & m_session_mask;
+    }
+    m_session_table[index] = session;
+    session->m_table_index = index;
+    m_session_num++;
+}
+
+void Rpc::EraseSession(RpcSession* session) {
+    // 线性探测表的删除：把空位之后、起始位置不在空位之后的会话前移填补空位
+    uint32_t hole  = session->m_table_index;
+    uint32_t index = hole;
+    while (true) {
+        index = (index + 1) & m_session_mask;
+        RpcSession* next = m_session_table[index];
+        if (NULL == next) {
+            break;
+        }
+        uint32_t home = static_cast<uint32_t>(next->m_session_id) & m_session_mask;
+        if (((index - home) & m_session_mask) >= ((index - hole) & m_session_mask)) {
+            m_session_table[hole] = next;
+            next->m_table_index = hole;
+            hole = index;
+        }
+    }
+    m_session_table[hole] = NULL;
+    m_session_num--;
+}
+
+void Rpc::GrowSessionTable() {
+    std::vector<RpcSession*> old_table;
+    old_table.swap(m_session_table);
+
+    uint32_t size = old_table.empty() ? 1024 : old_table.size() * 2;
+    m_session_table.assign(size, NULL);
+    m_session_mask = size - 1;
+    m_session_num  = 0;
+
+    for (std::vector<RpcSession*>::iterator it = old_table.begin(); it != old_table.end(); ++it) {
+        if (*it) {
+            InsertSession(*it);
+        }
+    }
+}
+
+void Rpc::TimeoutHeapUp(uint32_t index) {
+    RpcSession* session = m_timeout_heap[index];
+    while (index > 0) {
+        uint32_t parent = (index - 1) / 2;
+        if (m_timeout_heap[parent]->m_expire_time <= session->m_expire_time) {
+            break;
+        }
+        m_timeout_heap[index] = m_timeout_heap[parent];
+        m_timeout_heap[index]->m_heap_index = index;
+        index = parent;
+    }
+    m_timeout_heap[index] = session;
+    session->m_heap_index = index;
+}
+
+void Rpc::TimeoutHeapDown(uint32_t index) {
+    RpcSession* session = m_timeout_heap[index];
+    uint32_t size = m_timeout_heap.size();
+    while (true) {
+        uint32_t child = index * 2 + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size
+            && m_timeout_heap[child + 1]->m_expire_time < m_timeout_heap[child]->m_expire_time) {
+            child++;
+        }
+        if (session->m_expire_time <= m_timeout_heap[child]->m_expire_time) {
+            break;
+        }
+        m_timeout_heap[index] = m_timeout_heap[child];
+        m_timeout_heap[index]->m_heap_index = index;
+        index = child;
+    }
+    m_timeout_heap[index] = session;
+    session->m_heap_index = index;
+}
+
+void Rpc::TimeoutHeapErase(RpcSession* session) {
+    uint32_t index = session->m_heap_index;
+    RpcSession* last = m_timeout_heap.back();
+    m_timeout_heap.pop_back();
+    if (last == session) {
+        return;
+    }
+
+    m_timeout_heap[index] = last;
+    last->m_heap_index = index;
+    TimeoutHeapDown(index);
+    TimeoutHeapUp(last->m_heap_index);
 }
 
 int32_t Rpc::ProcessRequest(int64_t handle, const RpcHead& rpc_head,
@@ -345,58 +865,70 @@ int32_t Rpc::ProcessRequest(int64_t handle, const RpcHead& rpc_head,
 }
 
 int32_t Rpc::ProcessRequestImp(int64_t handle, const RpcHead& rpc_head,
-    const uint8_t* buff, uint32_t buff_len) {
-
-    cxx::unordered_map<std::string, OnRpcRequest>::iterator it =
-        m_service_map.find(rpc_head.m_function_name);
-    if (m_service_map.end() == it) {
-        _LOG_LAST_ERROR("%s's request proc func not found", rpc_head.m_function_name.c_str());
-        ResponseException(handle, kRPC_UNSUPPORT_FUNCTION_NAME, rpc_head);
+    const uint8_t* buff, uint32_t buff_len, bool in_coroutine) {
+
+    RpcFunctionMap::value_type* function = FindFunction(rpc_head);
+    if (NULL == function) {
+        _LOG_LAST_ERROR("%s(%08x)'s request proc func not found",
+            rpc_head.m_function_name.c_str(), rpc_head.m_function_id);
+        // 异常应答不能只带ID，否则对端会误认为此ID已确认
+        RpcHead head(rpc_head);
+        head.m_id_only = false;
+        ResponseException(handle, kRPC_UNSUPPORT_FUNCTION_NAME, head);
         OnRequestProcComplete(rpc_head.m_function_name, kRPC_UNSUPPORT_FUNCTION_NAME, 0);
         return kRPC_UNSUPPORT_FUNCTION_NAME;
     }
 
+    // 处理函数的参数引用了请求数据，协程让出后请求数据所在的缓冲区会被复用，复制到协程栈上保持到处理函数返回
+    std::string pinned;
+    if (in_coroutine && function->second.m_pin_request) {
+        pinned.assign(reinterpret_cast<const char*>(buff), buff_len);
+        buff = reinterpret_cast<const uint8_t*>(pinned.data());
+    }
+
     if (kRPC_ONEWAY == rpc_head.m_message_type) {
         cxx::function<int32_t(int32_t, const uint8_t*, uint32_t)> rsp; // NOLINT
-        int32_t ret = (it->second)(buff, buff_len, rsp);
-        OnRequestProcComplete(rpc_head.m_function_name, ret, 0);
+        int32_t ret = function->second.m_on_request(buff, buff_len, rsp);
+        OnRequestProcComplete(function->first, ret, 0, false);
         return ret;
     }
 
-    // 请求处理也保持会话，方便扩展
-    cxx::shared_ptr<RpcSession> session(new RpcSession());
-    session->m_session_id  = GenSessionId();
-    session->m_handle      = handle;
+    // 请求处理也保持会话，方便扩展，调用方带了时间预算时预算用完即结束会话
+    int32_t timeout_ms = REQ_PROC_TIMEOUT_MS;
+    if (rpc_head.m_timeout_ms > 0 && rpc_head.m_timeout_ms < timeout_ms) {
+        timeout_ms = rpc_head.m_timeout_ms;
+    }
+    RpcSession* session    = AllocSession(GenSessionId(), handle, timeout_ms);
     session->m_rpc_head    = rpc_head;
+    session->m_rpc_head.m_timeout_ms = 0;
     session->m_server_side = true;
 
-    TimeoutCallback cb     = cxx::bind(&Rpc::OnTimeout, this, session->m_session_id);
-    session->m_timerid     = m_timer->StartTimer(REQ_PROC_TIMEOUT_MS, cb);
-    session->m_start_time  = TimeUtility::GetCurrentMS();
+    // 应答只带方法ID，同时告知对端本服务支持按ID调用
+    session->m_rpc_head.m_function_id = function->second.m_id;
+    session->m_rpc_head.m_id_only     = function->second.m_id != 0;
+    if (rpc_head.m_function_name.empty()) {
+        session->m_rpc_head.m_function_name = function->first;
+    }
 
-    m_session_map[session->m_session_id] = session;
     m_task_num++;
 
     cxx::function<int32_t(int32_t, const uint8_t*, uint32_t)> rsp = cxx::bind( // NOLINT
         &Rpc::SendResponse, this, session->m_session_id,
         cxx::placeholders::_1, cxx::placeholders::_2, cxx::placeholders::_3);
 
-    return (it->second)(buff, buff_len, rsp);
+    return function->second.m_on_request(buff, buff_len, rsp);
 }
 
 int32_t Rpc::ProcessResponse(const RpcHead& rpc_head,
     const uint8_t* buff, uint32_t buff_len) {
 
-    cxx::unordered_map< uint64_t, cxx::shared_ptr<RpcSession> >::iterator it =
-        m_session_map.find(rpc_head.m_session_id);
-    if (m_session_map.end() == it) {
+    RpcSession* session = FindSession(rpc_head.m_session_id);
+    if (NULL == session) {
         _LOG_LAST_ERROR("session(%lu) not found, function_name(%s)",
                         rpc_head.m_session_id, rpc_head.m_function_name.c_str());
         return kRPC_SESSION_NOT_FOUND;
     }
 
-    m_timer->StopTimer(it->second->m_timerid);
-
     int ret = kRPC_SUCCESS;
     const uint8_t* real_buff = buff;
     uint32_t real_buff_len = buff_len;
@@ -416,20 +948,58 @@ int32_t Rpc::ProcessResponse(const RpcHead& rpc_head,
         }
     }
 
-    if (it->second->m_rsp) {
-        ret = it->second->m_rsp(ret, real_buff, real_buff_len);
+    if (kRPC_UNSUPPORT_FUNCTION_NAME == ret) {
+        if (session->m_rpc_head.m_id_only && ResendByName(session) == kRPC_SUCCESS) {
+            return kRPC_SUCCESS;
+        }
+    } else if (rpc_head.m_id_only && rpc_head.m_function_id == session->m_rpc_head.m_function_id) {
+        // 对端按ID找到了同名方法，此后对此对端的此方法只带ID
+        m_function_id_peers[session->m_handle][rpc_head.m_function_id] = session->m_rpc_head.m_function_name;
+    }
+
+    if (session->m_rsp) {
+        ret = session->m_rsp(ret, real_buff, real_buff_len);
     }
 
-    int64_t time_cost = TimeUtility::GetCurrentMS() - it->second->m_start_time;
-    Message::ReportHandleResult(it->second->m_handle,
+    int64_t time_cost = TimeUtility::GetMonotonicMS() - session->m_start_time;
+    Message::ReportHandleResult(session->m_handle,
         (ret == kRPC_MESSAGE_EXPIRED ? 0 : ret), time_cost);
-    OnResponseProcComplete(it->second->m_rpc_head.m_function_name, ret, time_cost);
+    OnResponseProcComplete(session->m_rpc_head.m_function_name, ret, time_cost);
 
-    m_session_map.erase(it);
+    FreeSession(session);
 
     return ret;
 }
 
+int32_t Rpc::ResendByName(RpcSession* session) {
+    cxx::unordered_map<int64_t, FunctionIdMap>::iterator peer = m_function_id_peers.find(session->m_handle);
+    if (peer != m_function_id_peers.end()) {
+        peer->second.erase(session->m_rpc_head.m_function_id);
+    }
+
+    int64_t remain_ms = session->m_expire_time - TimeUtility::GetMonotonicMS();
+    if (remain_ms <= 0) {
+        return kRPC_REQUEST_TIMEOUT;
+    }
+
+    RpcHead& rpc_head     = session->m_rpc_head;
+    rpc_head.m_id_only    = false;
+    rpc_head.m_timeout_ms = static_cast<int32_t>(remain_ms);
+    int32_t ret = Send(session->m_handle, rpc_head,
+        reinterpret_cast<const uint8_t*>(session->m_request.data()), session->m_request.size());
+    if (ret != kRPC_SUCCESS) {
+        _LOG_LAST_ERROR("resend %s by name failed(%d)", rpc_head.m_function_name.c_str(), ret);
+        return ret;
+    }
+
+    session->m_request.clear();
+    return kRPC_SUCCESS;
+}
+
+void Rpc::OnClose(int64_t handle) {
+    m_function_id_peers.erase(handle);
+}
+
 int32_t Rpc::ResponseException(int64_t handle, int32_t ret, const RpcHead& rpc_head,
     const uint8_t* buff, uint32_t buff_len) {
 
@@ -451,9 +1021,12 @@ int32_t Rpc::ResponseException(int64_t handle, int32_t ret, const RpcHead& rpc_h
 }
 
 void Rpc::OnRequestProcComplete(const std::string& name,
-    int32_t result, int32_t time_cost_ms) {
+    int32_t result, int32_t time_cost_ms, bool sample) {
     if (m_rpc_event_handler) {
         m_rpc_event_handler->OnRequestProcComplete(name, result, time_cost_ms);
+        if (sample) {
+            m_rpc_event_handler->OnRequestLatencySample(result, time_cost_ms);
+        }
     }
 }
 
@@ -15,6 +15,9 @@
 #ifndef _PEBBLE_COMMON_RPC_H_
 #define _PEBBLE_COMMON_RPC_H_
 
+#include <deque>
+#include <vector>
+
 #include "common/error.h"
 #include "common/platform.h"
 #include "framework/processor.h"
@@ -57,8 +60,15 @@ typedef enum {
 } RpcMessageType;
 
 
+/// @brief RPC请求优先级，区分了优先级时积压的请求先处理高优先级的，过载时先拒绝低优先级的
+typedef enum {
+    kRPC_PRIORITY_LOW    = 0,
+    kRPC_PRIORITY_NORMAL = 1,   // 默认优先级
+    kRPC_PRIORITY_HIGH   = 2,
+    kRPC_PRIORITY_BUTT
+} RpcPriority;
+
 // 前置声明
-class SequenceTimer;
 struct RpcSession;
 
 /// @brief RPC协议版本号
@@ -72,12 +82,18 @@ struct RpcHead {
         m_version       = kVERSION_0;
         m_message_type  = kRPC_EXCEPTION;
         m_session_id    = 0;
+        m_function_id   = 0;
+        m_id_only       = false;
+        m_timeout_ms    = 0;
     }
 
     int32_t     m_version;
     int32_t     m_message_type;
     uint64_t    m_session_id;
     std::string m_function_name;
+    uint32_t    m_function_id;  // 方法ID，由"服务名:方法名"计算，0表示未设置 @see Rpc::GetFunctionId
+    bool        m_id_only;      // 编码时只带方法ID不带方法名，仅在对端已确认支持方法ID时使用
+    int32_t     m_timeout_ms;   // 请求剩余的时间预算，单位ms，0表示未设置，只在请求中传递
 };
 
 /// @brief RPC异常结构定义
@@ -115,6 +131,9 @@ public:
     /// @return 处理的事件数，0表示无事件
     virtual int32_t Update();
 
+    /// @brief 实现Processor接口，返回最近一个RPC超时的时间 @see IProcessor::GetNextTimeout
+    virtual int64_t GetNextTimeout();
+
     /// @brief 实现Processor接口，设置send函数
     /// @param send, sendv @see IProcessor::SetSendFunction
     /// @return 0 成功
@@ -140,6 +159,14 @@ public:
     virtual int32_t OnMessage(int64_t handle, const uint8_t* buff,
         uint32_t buff_len, uint32_t is_overload);
 
+    /// @brief 实现Processor接口，记录消息到达时间，请求的时间预算从到达时开始扣减
+    virtual void SetMessageArrivedTime(int64_t arrived_ms) {
+        m_msg_arrived_ms = arrived_ms;
+    }
+
+    /// @brief 实现Processor接口，句柄关闭时清除对端已确认的方法ID
+    virtual void OnClose(int64_t handle);
+
     /// @brief 实现Processor接口，返回并发的任务数
     virtual uint32_t GetUnFinishedTaskNum() {
         return m_task_num;
@@ -166,6 +193,29 @@ public:
     /// @return 非0 失败 @see RpcErrorCode
     int32_t RemoveOnRequestFunction(const std::string& name);
 
+    /// @brief 设置RPC服务的优先级，默认为kRPC_PRIORITY_NORMAL，IDL中可用(priority="high")注解指定\n
+    ///   所有服务优先级相同时请求按到达顺序直接处理；否则每个tick最多处理SetMaxRequestNumPerLoop个请求，
+    ///   没有同级或更高优先级的请求排队时直接处理，其余按优先级排队，每次Update从高到低处理，
+    ///   过载时先拒绝最低优先级的请求，过载持续SHED_ADJUST_MS后再拒绝高一级的，过载消失后逐级恢复
+    /// @param name "服务名:方法名"设置单个方法，"服务名"设置该服务的所有方法
+    /// @param priority @see RpcPriority
+    /// @return 0 成功
+    /// @return 非0 失败 @see RpcErrorCode
+    int32_t SetFunctionPriority(const std::string& name, int32_t priority);
+
+    /// @brief 设置服务优先级不同时每个tick最多处理的请求数，超出的请求按优先级排队到后续tick处理
+    /// @param max_request_num 每个tick最多处理的请求数，默认为DEFAULT_MAX_REQUEST_NUM_PER_LOOP
+    void SetMaxRequestNumPerLoop(uint32_t max_request_num);
+
+    /// @brief 设置请求数据是否要保持到RPC服务处理函数返回，参数中有cpp.view字段的服务由IDL生成代码设置\n
+    ///   不在协程中处理请求时请求数据本来就在处理函数返回前有效；在协程中处理时处理函数可能让出，
+    ///   让出后请求数据所在的缓冲区会被复用，这时先复制一份请求数据保存到处理函数返回
+    /// @param name "服务名:方法名"
+    /// @param pin 是否保持请求数据
+    /// @return 0 成功
+    /// @return 非0 失败 @see RpcErrorCode
+    int32_t SetFunctionPinRequest(const std::string& name, bool pin);
+
     /// @brief 发送RPC请求
     /// @param handle 网络句柄
     /// @param rpc_head RPC头部信息
@@ -200,13 +250,28 @@ public:
         return m_last_error;
     }
 
+    /// @brief 计算方法ID(FNV-1a 32)，IDL生成代码在编译期用同样的算法计算，结果稳定
+    /// @param name "服务名:方法名"
+    /// @return 非0的方法ID
+    static uint32_t GetFunctionId(const std::string& name);
+
 public:
     // TODO: 改成可配置
     static const int32_t REQ_PROC_TIMEOUT_MS = 60 * 1000; // 60s
 
+    /// @brief 按优先级排队的请求数上限，超过时丢弃最低优先级中最早的请求
+    static const uint32_t MAX_QUEUED_REQUEST_NUM = 10000;
+
+    /// @brief 过载持续或消失此时间后调整一级拒绝的优先级
+    static const int64_t SHED_ADJUST_MS = 100;
+
+    /// @brief 会话放回对象池时保留的请求数据容量上限，超过时释放
+    static const uint32_t MAX_KEEP_REQUEST_LEN = 4096;
+
     /// @note 内部使用，用户无需关注
+    /// @param in_coroutine 是否在协程中处理，处理函数可能让出
     int32_t ProcessRequestImp(int64_t handle, const RpcHead& rpc_head,
-        const uint8_t* buff, uint32_t buff_len);
+        const uint8_t* buff, uint32_t buff_len, bool in_coroutine = false);
 
     /// @note 内部使用，用户无需关注
     uint64_t GenSessionId() {
@@ -260,7 +325,26 @@ private:
     int32_t Send(int64_t handle, const RpcHead& rpc_head, const uint8_t* buff, uint32_t buff_len);
 
     // 超时处理，暂时支持请求的超时，可扩展支持服务处理超时
-    int32_t OnTimeout(uint64_t session_id);
+    void OnTimeout(RpcSession* session);
+
+    /// @brief 从对象池取一个会话，加入会话表并启动超时
+    /// @return NULL 会话ID已存在
+    RpcSession* AllocSession(uint64_t session_id, int64_t handle, int32_t timeout_ms);
+
+    /// @brief 从会话表和超时堆中移除会话，放回对象池
+    void FreeSession(RpcSession* session);
+
+    RpcSession* FindSession(uint64_t session_id);
+
+    /// @brief 会话表按会话ID低位直接寻址，线性探测，装载率超过1/2时扩容
+    void InsertSession(RpcSession* session);
+    void EraseSession(RpcSession* session);
+    void GrowSessionTable();
+
+    /// @brief 超时最小堆，堆下标保存在会话中
+    void TimeoutHeapUp(uint32_t index);
+    void TimeoutHeapDown(uint32_t index);
+    void TimeoutHeapErase(RpcSession* session);
 
 private:
     int32_t ProcessResponse(const RpcHead& rpc_head,
@@ -270,28 +354,107 @@ private:
     int32_t ResponseException(int64_t handle, int32_t ret, const RpcHead& rpc_head,
         const uint8_t* buff = NULL, uint32_t buff_len = 0);
 
+    /// @param sample 是否作为请求处理时延样本，ONEWAY请求处理函数返回时处理未必完成，不作为样本
     void OnRequestProcComplete(const std::string& name,
-        int32_t result, int32_t time_cost_ms);
+        int32_t result, int32_t time_cost_ms, bool sample = true);
 
     void OnResponseProcComplete(const std::string& name,
         int32_t result, int32_t time_cost_ms);
 
+    /// @brief 已注册的服务函数
+    struct RpcFunction {
+        uint32_t     m_id;      // 方法ID，和其它方法ID冲突时为0，只能按名字调用
+        int32_t      m_priority;
+        bool         m_pin_request; // 请求数据要保持到处理函数返回
+        OnRpcRequest m_on_request;
+    };
+    typedef cxx::unordered_map<std::string, RpcFunction> RpcFunctionMap;
+
+    /// @brief 方法ID分发表的槽，开放寻址，id为0表示空槽，entry为NULL表示ID冲突
+    struct RpcFunctionSlot {
+        uint32_t m_id;
+        RpcFunctionMap::value_type* m_entry;
+    };
+
+    /// @brief 注册的服务变化后重建方法ID分发表
+    void RebuildFunctionTable();
+
+    /// @brief 按方法ID(优先)或方法名查找服务函数，同时带了名字时校验ID找到的方法名一致
+    RpcFunctionMap::value_type* FindFunction(const RpcHead& rpc_head);
+
+    /// @brief 对端不认识只带ID的请求时(如对端降级或重连到老版本)，撤销确认并按名字重发一次
+    /// @return 0 已重发，会话继续等待应答
+    /// @return 非0 未重发
+    int32_t ResendByName(RpcSession* session);
+
+    /// @brief 排队等待处理的请求
+    struct QueuedRequest {
+        int64_t     m_handle;
+        int64_t     m_deadline_ms;  // 调用方时间预算的截止时间，0表示未设置
+        RpcHead     m_rpc_head;
+        std::string m_data;
+    };
+
+    /// @brief 服务注册或优先级变化后重新计算使用中的优先级范围
+    void UpdatePriorityRange();
+
+    /// @brief 过载时调整拒绝的优先级
+    void OnOverload();
+
+    /// @brief 本tick还有处理额度，且没有同级或更高优先级的请求排队时，请求不用排队
+    bool CanDispatchRequest(int32_t priority) const;
+
+    /// @brief 请求排队，请求数据在OnMessage返回后会被复用，排队时复制一份
+    int32_t EnqueueRequest(int64_t handle, const RpcHead& rpc_head, int32_t priority,
+        const uint8_t* buff, uint32_t buff_len);
+
+    /// @brief 按优先级从高到低处理排队的请求，用完本tick的处理额度为止，其余留在队列中
+    /// @return 处理的请求数
+    int32_t DispatchQueuedRequests();
+
+    /// @brief 排队的请求放回对象池
+    void FreeQueuedRequest(QueuedRequest* request);
+
+    /// @brief 过载拒绝请求，ONEWAY请求直接丢弃
+    void RejectRequest(int64_t handle, const RpcHead& rpc_head, int32_t ret);
+
 private:
     IEventHandler* m_rpc_event_handler;
     SendFunction   m_send;
     SendVFunction  m_sendv;
     BroadcastFunction  m_broadcast;
     BroadcastVFunction m_broadcastv;
-    cxx::unordered_map<std::string, OnRpcRequest> m_service_map;
+    RpcFunctionMap m_service_map;
+    std::vector<RpcFunctionSlot> m_function_table;  // 大小为2的幂，按方法ID直接寻址
+    uint32_t m_function_mask;
+    // 对端handle -> 对端已在应答中确认的方法ID及对应的方法名，只有确认过的方法请求头才只带ID
+    typedef cxx::unordered_map<uint32_t, std::string> FunctionIdMap;
+    cxx::unordered_map<int64_t, FunctionIdMap> m_function_id_peers;
 
     uint8_t m_rpc_head_buff[1024];
+    RpcHead m_send_head;    // 发送请求时按对端状态调整后的请求头，不修改调用方的请求头，复用避免每次分配
     uint8_t m_rpc_exception_buff[102400];
 
-    SequenceTimer* m_timer;
     uint64_t m_session_id;
-    cxx::unordered_map< uint64_t, cxx::shared_ptr<RpcSession> > m_session_map;
+    std::vector<RpcSession*> m_session_table;  // 大小为2的幂，会话ID是递增的，基本不冲突
+    uint32_t m_session_mask;
+    uint32_t m_session_num;
+    std::vector<RpcSession*> m_timeout_heap;   // 按超时时间排序的最小堆
+    RpcSession* m_free_session;                // 会话对象池，复用会话避免每个请求分配内存
+
+    std::deque<QueuedRequest*> m_request_queues[kRPC_PRIORITY_BUTT];
+    std::vector<QueuedRequest*> m_free_requests;
+    uint32_t m_queued_num;
+    uint32_t m_max_request_num_per_loop;
+    uint32_t m_request_budget;    // 本tick剩余的请求处理额度，每次Update重置
+    int32_t  m_lowest_priority;   // 已注册服务的最低优先级
+    int32_t  m_highest_priority;  // 已注册服务的最高优先级，和最低优先级不同时请求才排队
+    int32_t  m_shed_priority;     // 过载时拒绝此优先级及以下的请求
+    int64_t  m_shed_adjust_ms;
+    int64_t  m_last_overload_ms;
     int64_t  m_task_num; // 并发任务数，只包括服务处理
     int64_t  m_latest_handle;
+    int64_t  m_msg_arrived_ms; // 当前处理消息的到达时间，0表示未知
 
 protected:
     char m_last_error[256];
@@ -11,6 +11,9 @@
  *
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "framework/dr/common/dr_define.h"
 #include "framework/dr/protocol/protocol.h"
 #include "framework/dr/transport/buffer_transport.h"
@@ -42,7 +45,15 @@ int32_t ProtoBufRpcPlugin::HeadEncode(const RpcHead& rpc_head, uint8_t* buff, ui
         // pb_head.version         = rpc_head.m_version; // 暂时不需要版本号
         pb_head.msg_type        = rpc_head.m_message_type;
         pb_head.session_id      = rpc_head.m_session_id;
-        pb_head.function_name   = rpc_head.m_function_name;
+        if (!rpc_head.m_id_only) {
+            pb_head.__set_function_name(rpc_head.m_function_name);
+        }
+        if (rpc_head.m_function_id != 0) {
+            pb_head.__set_function_id(static_cast<int32_t>(rpc_head.m_function_id));
+        }
+        if (rpc_head.m_timeout_ms > 0 && kRPC_CALL == rpc_head.m_message_type) {
+            pb_head.__set_timeout_ms(rpc_head.m_timeout_ms);
+        }
 
         // 2. 序列化ProtoBufRpcHead，考虑到性能不使用write(buff, bufflen)接口
         len = pb_head.write(encoder);
@@ -79,7 +90,12 @@ int32_t ProtoBufRpcPlugin::HeadDecode(const uint8_t* buff, uint32_t buff_len, Rp
         }
         rpc_head->m_message_type  = pb_head.msg_type;
         rpc_head->m_session_id    = pb_head.session_id;
-        rpc_head->m_function_name = pb_head.function_name;
+        rpc_head->m_function_name.swap(pb_head.function_name);
+        rpc_head->m_function_id   = static_cast<uint32_t>(pb_head.function_id);
+        rpc_head->m_id_only       = !pb_head.__isset.function_name && pb_head.__isset.function_id;
+        if (pb_head.__isset.timeout_ms) {
+            rpc_head->m_timeout_ms = pb_head.timeout_ms;
+        }
     } catch (TException e) {
         return kPEBBLE_RPC_DECODE_HEAD_FAILED;
     }
@@ -107,9 +123,25 @@ int32_t ThriftRpcPlugin::HeadEncode(const RpcHead& rpc_head, uint8_t* buff, uint
 
     int32_t len = -1;
     try {
-        len = encoder->writeMessageBegin(rpc_head.m_function_name,
-            static_cast<pebble::dr::protocol::TMessageType>(rpc_head.m_message_type),
-            rpc_head.m_session_id);
+        if (rpc_head.m_id_only && rpc_head.m_function_id != 0) {
+            // thrift消息头只有一个名字字段，只带方法ID时写成"#"加8位16进制ID，
+            // 请求带时间预算时再追加"@"加10进制毫秒数，对端支持方法ID即支持此格式
+            char id_name[FUNCTION_ID_NAME_MAX_LEN + 1];
+            int32_t id_name_len = 0;
+            if (rpc_head.m_timeout_ms > 0 && kRPC_CALL == rpc_head.m_message_type) {
+                id_name_len = snprintf(id_name, sizeof(id_name), "#%08x@%d",
+                    rpc_head.m_function_id, rpc_head.m_timeout_ms);
+            } else {
+                id_name_len = snprintf(id_name, sizeof(id_name), "#%08x", rpc_head.m_function_id);
+            }
+            len = encoder->writeMessageBegin(std::string(id_name, id_name_len),
+                static_cast<pebble::dr::protocol::TMessageType>(rpc_head.m_message_type),
+                rpc_head.m_session_id);
+        } else {
+            len = encoder->writeMessageBegin(rpc_head.m_function_name,
+                static_cast<pebble::dr::protocol::TMessageType>(rpc_head.m_message_type),
+                rpc_head.m_session_id);
+        }
     } catch (TException e) {
         return kPEBBLE_RPC_ENCODE_HEAD_FAILED;
     }
@@ -138,6 +170,17 @@ int32_t ThriftRpcPlugin::HeadDecode(const uint8_t* buff, uint32_t buff_len, RpcH
         head_len = decoder->readMessageBegin(rpc_head->m_function_name, msg_type, seqid);
         rpc_head->m_message_type = static_cast<int32_t>(msg_type);
         rpc_head->m_session_id   = static_cast<uint64_t>(seqid);
+
+        const std::string& name = rpc_head->m_function_name;
+        if (name.size() >= FUNCTION_ID_NAME_LEN && '#' == name[0]
+            && (FUNCTION_ID_NAME_LEN == name.size() || '@' == name[FUNCTION_ID_NAME_LEN])) {
+            rpc_head->m_function_id = static_cast<uint32_t>(strtoul(name.c_str() + 1, NULL, 16));
+            rpc_head->m_id_only     = true;
+            if (name.size() > FUNCTION_ID_NAME_LEN) {
+                rpc_head->m_timeout_ms = atoi(name.c_str() + FUNCTION_ID_NAME_LEN + 1);
+            }
+            rpc_head->m_function_name.clear();
+        }
     } catch (TException e) {
         return kPEBBLE_RPC_DECODE_HEAD_FAILED;
     }
@@ -13,6 +13,7 @@
 
 #include "framework/rpc_util.inh"
 #include "common/coroutine.h"
+#include "common/time_utility.h"
 
 namespace pebble {
 
@@ -50,6 +51,10 @@ int32_t RpcUtil::SendRequestSync(int64_t handle,
         return kRPC_UTIL_NOT_IN_COROUTINE;
     }
 
+    if (!InheritTimeout(&timeout_ms)) {
+        return kRPC_REQUEST_TIMEOUT;
+    }
+
     int32_t ret = kRPC_SUCCESS;
 
     SendRequestInCoroutine(handle, rpc_head, buff, buff_len, on_rsp, timeout_ms, &ret);
@@ -105,6 +110,13 @@ void RpcUtil::SendRequestParallel(int64_t handle,
         return;
     }
 
+    if (!InheritTimeout(&timeout_ms)) {
+        *ret_code = kRPC_REQUEST_TIMEOUT;
+        --(*num_called);
+        --(*num_parallel);
+        return;
+    }
+
     SendRequestParallelInCoroutine(handle,
                                    rpc_head,
                                    buff,
@@ -189,12 +201,17 @@ int32_t RpcUtil::ProcessRequest(int64_t handle, const RpcHead& rpc_head,
     }
 
     if (m_coroutine_schedule->CurrentTaskId() != INVALID_CO_ID) {
-        return m_rpc->ProcessRequestImp(handle, rpc_head, buff, buff_len);
+        return m_rpc->ProcessRequestImp(handle, rpc_head, buff, buff_len, true);
+    }
+
+    int64_t deadline_ms = 0;
+    if (rpc_head.m_timeout_ms > 0) {
+        deadline_ms = TimeUtility::GetMonotonicMS() + rpc_head.m_timeout_ms;
     }
 
     CommonCoroutineTask* task = m_coroutine_schedule->NewTask<CommonCoroutineTask>();
     cxx::function<void(void)> run = cxx::bind(&RpcUtil::ProcessRequestInCoroutine, this,
-        handle, rpc_head, buff, buff_len);
+        handle, rpc_head, buff, buff_len, deadline_ms);
     task->Init(run);
     task->Start();
 
@@ -202,8 +219,37 @@ int32_t RpcUtil::ProcessRequest(int64_t handle, const RpcHead& rpc_head,
 }
 
 int32_t RpcUtil::ProcessRequestInCoroutine(int64_t handle, const RpcHead& rpc_head,
-    const uint8_t* buff, uint32_t buff_len) {
-    return m_rpc->ProcessRequestImp(handle, rpc_head, buff, buff_len);
+    const uint8_t* buff, uint32_t buff_len, int64_t deadline_ms) {
+    if (0 == deadline_ms) {
+        return m_rpc->ProcessRequestImp(handle, rpc_head, buff, buff_len, true);
+    }
+
+    int64_t co_id = m_coroutine_schedule->CurrentTaskId();
+    m_deadlines[co_id] = deadline_ms;
+    int32_t ret = m_rpc->ProcessRequestImp(handle, rpc_head, buff, buff_len, true);
+    m_deadlines.erase(co_id);
+    return ret;
+}
+
+bool RpcUtil::InheritTimeout(int32_t* timeout_ms) {
+    if (m_deadlines.empty()) {
+        return true;
+    }
+
+    cxx::unordered_map<int64_t, int64_t>::iterator it =
+        m_deadlines.find(m_coroutine_schedule->CurrentTaskId());
+    if (m_deadlines.end() == it) {
+        return true;
+    }
+
+    int64_t remain_ms = it->second - TimeUtility::GetMonotonicMS();
+    if (remain_ms <= 0) {
+        return false;
+    }
+    if (*timeout_ms <= 0 || *timeout_ms > remain_ms) {
+        *timeout_ms = static_cast<int32_t>(remain_ms);
+    }
+    return true;
 }
 
 
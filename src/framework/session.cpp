@@ -29,7 +29,7 @@ public:
 static SessionErrorStringRegister s_session_error_string_register;
 
 SessionMgr::SessionMgr() {
-    m_timer         = new SequenceTimer();
+    m_timer         = new TimingWheelTimer();
     m_last_error[0] = 0;
 }
 
@@ -95,6 +95,10 @@ int32_t SessionMgr::CheckTimeout() {
     return m_timer->Update();
 }
 
+int64_t SessionMgr::GetNextTimeout() {
+    return m_timer->GetNextTimeout();
+}
+
 int32_t SessionMgr::RestartTimer(int64_t session_id, uint32_t new_timeout_ms) {
     cxx::unordered_map<int64_t, SessionInfo>::iterator it = m_sessions.find(session_id);
     if (m_sessions.end() == it) {
@@ -22,7 +22,7 @@
 namespace pebble {
 
 // 前置声明
-class SequenceTimer;
+class TimingWheelTimer;
 
 /// @brief Session模块错误码定义
 typedef enum {
@@ -85,6 +85,9 @@ public:
     /// @return 超时的session数目
     int32_t CheckTimeout();
 
+    /// @brief 距离最近一个会话超时的毫秒数，<0表示没有会话 @see Timer::GetNextTimeout
+    int64_t GetNextTimeout();
+
     /// @brief 重启会话的计时，若new_timeout_ms>0，使用new_timeout_ms作为超时时间重新计时\n
     ///     否则使用原超时时间重新计时
     /// @param session_id 会话ID
@@ -119,7 +122,7 @@ private:
     };
 
 private:
-    SequenceTimer* m_timer;
+    TimingWheelTimer* m_timer;
     cxx::unordered_map<int64_t, SessionInfo> m_sessions;
     char m_last_error[256];
 };
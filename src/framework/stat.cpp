@@ -66,6 +66,56 @@ int32_t Stat::AddMessageItem(const std::string& name, int32_t result, int32_t ti
     return 0;
 }
 
+void Stat::Merge(Stat* other) {
+    if (NULL == other || this == other) {
+        return;
+    }
+
+    m_message_counts += other->m_message_counts;
+    m_failure_message_counts += other->m_failure_message_counts;
+
+    ResourceStatTemp::iterator rit = other->m_resource_stat_temp.begin();
+    for (; rit != other->m_resource_stat_temp.end(); ++rit) {
+        ResourceStatItem& item = m_resource_stat_result[rit->first];
+        ResourceStatTempData& temp = m_resource_stat_temp[rit->first];
+        const ResourceStatItem* other_item = rit->second._result;
+        temp._result = &item;
+        temp._count += rit->second._count;
+        temp._total_value += rit->second._total_value;
+        if (other_item != NULL) {
+            if (other_item->_max_value > item._max_value) {
+                item._max_value = other_item->_max_value;
+            }
+            if (other_item->_min_value < item._min_value) {
+                item._min_value = other_item->_min_value;
+            }
+        }
+    }
+
+    MessageStatTemp::iterator mit = other->m_message_stat_temp.begin();
+    for (; mit != other->m_message_stat_temp.end(); ++mit) {
+        MessageStatItem& item = m_message_stat_result[mit->first];
+        MessageStatTempData& temp = m_message_stat_temp[mit->first];
+        const MessageStatItem* other_item = mit->second._result;
+        temp._result = &item;
+        temp._total_count += mit->second._total_count;
+        temp._failure_count += mit->second._failure_count;
+        temp._total_cost_ms += mit->second._total_cost_ms;
+        if (other_item != NULL) {
+            if (other_item->_max_cost_ms > item._max_cost_ms) {
+                item._max_cost_ms = other_item->_max_cost_ms;
+            }
+            if (other_item->_min_cost_ms < item._min_cost_ms) {
+                item._min_cost_ms = other_item->_min_cost_ms;
+            }
+            cxx::unordered_map<int32_t, uint32_t>::const_iterator it = other_item->_result.begin();
+            for (; it != other_item->_result.end(); ++it) {
+                item._result[it->first] += it->second;
+            }
+        }
+    }
+}
+
 const ResourceStatItem* Stat::GetResourceResultByName(const std::string& name) {
     cxx::unordered_map<std::string, ResourceStatTempData>::iterator it;
     it = m_resource_stat_temp.find(name);
@@ -97,6 +97,10 @@ public:
     /// @brief 获取所有消息型统计结果
     const MessageStatResult* GetAllMessageResults();
 
+    /// @brief 合并另一个Stat已记录的数据，多reactor时各reactor的统计汇总到主reactor输出
+    /// @param other 被合并的数据，不会被修改
+    void Merge(Stat* other);
+
     /// @brief 获取所有消息数
     uint32_t GetAllMessageCounts() {
         return m_message_counts;
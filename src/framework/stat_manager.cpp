@@ -38,11 +38,16 @@ StatManager::StatManager() {
 }
 
 StatManager::~StatManager() {
-    WriteLog();
+    // 未Init的实例(如非主reactor)只做记录，不输出也不释放全局的gdata log
+    if (m_start_time_s != 0) {
+        WriteLog();
+    }
     delete m_report_timer;
-    delete m_gdata_monitor;
     delete m_stat;
-    oss::CLogDataAPI::FiniDataLog();
+    if (m_gdata_monitor != NULL) {
+        delete m_gdata_monitor;
+        oss::CLogDataAPI::FiniDataLog();
+    }
 }
 
 int32_t StatManager::SetReportCycle(uint32_t report_cycle_s) {
@@ -114,6 +119,10 @@ int32_t StatManager::Update() {
     return m_report_timer->Update();
 }
 
+int64_t StatManager::GetNextTimeout() {
+    return m_report_timer->GetNextTimeout();
+}
+
 int32_t StatManager::OnTimeout() {
     WriteLog();
     ReportGdataByCycle();
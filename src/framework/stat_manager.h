@@ -70,6 +70,9 @@ public:
     /// @return 处理事件数，未处理返回0
     int32_t Update();
 
+    /// @brief 距离下次输出统计的毫秒数 @see Timer::GetNextTimeout
+    int64_t GetNextTimeout();
+
     /// @brief 返回Stat实例
     /// @return 非空
     Stat* GetStat() {
@@ -0,0 +1,1319 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "common/string_utility.h"
+#include "common/time_utility.h"
+#include "framework/uring_message_driver.h"
+
+// 需要multishot recv(内核头文件6.0+)，更老的编译环境只编译降级路径
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define PEBBLE_IO_URING_SUPPORTED 1
+#endif
+
+
+namespace pebble {
+
+int32_t UrlToNetAddress(const std::string& url, std::string* ip, uint16_t* port);
+
+static const char* URING_SCHEME = "uring://";
+
+/// @brief 连接状态
+enum {
+    kURING_LISTEN     = 0,
+    kURING_ACCEPTED   = 1,
+    kURING_CONNECTED  = 2,
+};
+
+/// @brief 请求类型，保存在user_data的低3位，高位为连接对象指针
+enum {
+    kURING_OP_ACCEPT   = 1,
+    kURING_OP_RECV     = 2,
+    kURING_OP_SEND     = 3,
+    kURING_OP_CONNECT  = 4,
+    kURING_OP_RAW_POLL = 5,
+    kURING_OP_MASK     = 7,
+};
+
+struct UringConnection {
+    UringConnection() {
+        _handle         = -1;
+        _listen_handle  = -1;
+        _fd             = -1;
+        _type           = kURING_CONNECTED;
+        _closed         = false;
+        _connecting     = false;
+        _inflight       = 0;
+        memset(&_peer_addr, 0, sizeof(_peer_addr));
+
+        _recv_buff      = NULL;
+        _recv_buff_len  = 0;
+        _read_pos       = 0;
+        _recv_len       = 0;
+        _cur_msg_len    = 0;
+        _recv_ms        = 0;
+        _arrived_ms     = 0;
+
+        _send_buff      = NULL;
+        _send_buff_len  = 0;
+        _send_len       = 0;
+        _sending_buff   = NULL;
+        _sending_buff_len = 0;
+        _sending_len    = 0;
+        _sending_pos    = 0;
+        _sending        = false;
+
+        _in_ready_list  = false;
+        _ready_prev     = NULL;
+        _ready_next     = NULL;
+    }
+
+    ~UringConnection() {
+        free(_recv_buff);
+        free(_send_buff);
+        free(_sending_buff);
+    }
+
+    bool HasNewMsg() const {
+        return _cur_msg_len > 0 && _recv_len - _read_pos >= _cur_msg_len;
+    }
+
+    int64_t  _handle;
+    int64_t  _listen_handle;    // accept的连接记录监听句柄
+    int32_t  _fd;
+    int32_t  _type;
+    bool     _closed;
+    bool     _connecting;
+    uint32_t _inflight;         // 在途请求数，multishot请求在最后一个CQE前算1个
+    struct sockaddr_in _peer_addr;
+
+    // 接收缓冲区，[_read_pos, _recv_len)为未处理数据，_cur_msg_len为头部消息总长度(含消息头)
+    uint8_t* _recv_buff;
+    uint32_t _recv_buff_len;
+    uint32_t _read_pos;
+    uint32_t _recv_len;
+    uint32_t _cur_msg_len;
+    int64_t  _recv_ms;          // 最近一次收到数据的时间
+    int64_t  _arrived_ms;       // 头部消息的到达时间，解析消息头时记录
+
+    // 头部消息未被取走时不能移动接收缓冲区，这期间收到的provided buffer先暂存
+    struct ParkedBuff {
+        uint16_t _bid;
+        uint32_t _len;
+    };
+    std::list<ParkedBuff> _parked_buffs;
+
+    // 发送缓冲区，_send_buff累积新数据，_sending_buff为在途数据，在途send完成后交换
+    uint8_t* _send_buff;
+    uint32_t _send_buff_len;
+    uint32_t _send_len;
+    uint8_t* _sending_buff;
+    uint32_t _sending_buff_len;
+    uint32_t _sending_len;
+    uint32_t _sending_pos;
+    bool     _sending;
+
+    bool             _in_ready_list;
+    UringConnection* _ready_prev;
+    UringConnection* _ready_next;
+};
+
+static int32_t ReserveBuff(uint8_t** buff, uint32_t* buff_len, uint32_t need_len) {
+    if (*buff_len >= need_len) {
+        return 0;
+    }
+    uint32_t new_len = (*buff_len > 0) ? *buff_len : 4096;
+    while (new_len < need_len) {
+        new_len <<= 1;
+    }
+    uint8_t* new_buff = static_cast<uint8_t*>(realloc(*buff, new_len));
+    if (new_buff == NULL) {
+        return -1;
+    }
+    *buff     = new_buff;
+    *buff_len = new_len;
+    return 0;
+}
+
+static inline uint64_t MakeUserData(UringConnection* connection, uint32_t op) {
+    return reinterpret_cast<uint64_t>(connection) | op;
+}
+
+#ifdef PEBBLE_IO_URING_SUPPORTED
+
+/// @brief io_uring的最小封装，直接使用系统调用，不依赖liburing
+class IoUring {
+public:
+    IoUring();
+    ~IoUring();
+
+    /// @param entries SQ大小
+    /// @param buff_num provided buffer个数，需为2的幂
+    /// @param buff_len 每个provided buffer的大小
+    int32_t Init(uint32_t entries, uint32_t buff_num, uint32_t buff_len);
+
+    /// @brief 取一个空闲SQE，SQ满时先提交已有的SQE
+    struct io_uring_sqe* GetSqe();
+
+    /// @brief 提交SQE并等待完成事件，无SQE且不等待时不进入内核
+    /// @param wait_nr 最少等待的完成事件数
+    /// @param timeout_ms 等待超时，<0为一直等待
+    int32_t Submit(uint32_t wait_nr, int32_t timeout_ms);
+
+    /// @brief 取一个完成事件，取到后需调用SeenCqe
+    struct io_uring_cqe* PeekCqe();
+
+    void SeenCqe();
+
+    uint32_t GetBuffGroup() const {
+        return BUFF_GROUP_ID;
+    }
+
+    uint8_t* GetBuff(uint16_t bid) {
+        return m_buffs + static_cast<size_t>(bid) * m_buff_len;
+    }
+
+    /// @brief 把provided buffer归还给内核
+    void RecycleBuff(uint16_t bid);
+
+    const char* GetLastError() const {
+        return m_last_error;
+    }
+
+private:
+    static const uint16_t BUFF_GROUP_ID = 0;
+
+    int32_t  m_ring_fd;
+    void*    m_sq_ptr;
+    size_t   m_sq_ptr_len;
+    void*    m_cq_ptr;
+    size_t   m_cq_ptr_len;
+    struct io_uring_sqe* m_sqes;
+    size_t   m_sqes_len;
+
+    uint32_t* m_sq_head;
+    uint32_t* m_sq_tail;
+    uint32_t  m_sq_mask;
+    uint32_t  m_sq_entries;
+    uint32_t  m_sqe_head;       // 已提交到内核的位置
+    uint32_t  m_sqe_tail;       // 已分配的位置
+
+    uint32_t* m_cq_head;
+    uint32_t* m_cq_tail;
+    uint32_t  m_cq_mask;
+    struct io_uring_cqe* m_cqes;
+
+    struct io_uring_buf_ring* m_buf_ring;
+    size_t   m_buf_ring_len;
+    uint8_t* m_buffs;
+    uint32_t m_buff_num;
+    uint32_t m_buff_len;
+    uint16_t m_buf_tail;
+
+    char     m_last_error[256];
+};
+
+IoUring::IoUring() {
+    m_ring_fd    = -1;
+    m_sq_ptr     = MAP_FAILED;
+    m_sq_ptr_len = 0;
+    m_cq_ptr     = MAP_FAILED;
+    m_cq_ptr_len = 0;
+    m_sqes       = NULL;
+    m_sqes_len   = 0;
+    m_sq_head    = NULL;
+    m_sq_tail    = NULL;
+    m_sq_mask    = 0;
+    m_sq_entries = 0;
+    m_sqe_head   = 0;
+    m_sqe_tail   = 0;
+    m_cq_head    = NULL;
+    m_cq_tail    = NULL;
+    m_cq_mask    = 0;
+    m_cqes       = NULL;
+    m_buf_ring   = NULL;
+    m_buf_ring_len = 0;
+    m_buffs      = NULL;
+    m_buff_num   = 0;
+    m_buff_len   = 0;
+    m_buf_tail   = 0;
+    m_last_error[0] = 0;
+}
+
+IoUring::~IoUring() {
+    if (m_ring_fd >= 0) {
+        close(m_ring_fd);
+    }
+    if (m_buf_ring != NULL) {
+        munmap(m_buf_ring, m_buf_ring_len);
+    }
+    free(m_buffs);
+    if (m_sqes != NULL) {
+        munmap(m_sqes, m_sqes_len);
+    }
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr) {
+        munmap(m_cq_ptr, m_cq_ptr_len);
+    }
+    if (m_sq_ptr != MAP_FAILED) {
+        munmap(m_sq_ptr, m_sq_ptr_len);
+    }
+}
+
+int32_t IoUring::Init(uint32_t entries, uint32_t buff_num, uint32_t buff_len) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (m_ring_fd < 0) {
+        _LOG_LAST_ERROR("io_uring_setup failed(%s)", strerror(errno));
+        return -1;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)
+        || !(params.features & IORING_FEAT_FAST_POLL)) {
+        _LOG_LAST_ERROR("io_uring features 0x%x not enough", params.features);
+        return -1;
+    }
+
+    // 检查需要的操作码，SEND_ZC和multishot recv同在6.0版本加入，用来判断是否支持multishot recv
+    const uint32_t probe_len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = static_cast<struct io_uring_probe*>(calloc(1, probe_len));
+    if (probe == NULL) {
+        _LOG_LAST_ERROR("alloc probe failed");
+        return -1;
+    }
+    int32_t ret = syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_PROBE, probe, 256);
+    const uint8_t need_ops[] = { IORING_OP_ACCEPT, IORING_OP_CONNECT, IORING_OP_RECV,
+        IORING_OP_SEND, IORING_OP_POLL_ADD, IORING_OP_SEND_ZC };
+    for (uint32_t i = 0; ret == 0 && i < sizeof(need_ops); i++) {
+        if (need_ops[i] > probe->last_op || !(probe->ops[need_ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+            ret = -1;
+        }
+    }
+    free(probe);
+    if (ret != 0) {
+        _LOG_LAST_ERROR("io_uring opcode unsupported");
+        return -1;
+    }
+
+    m_sq_ptr_len = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_cq_ptr_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (m_cq_ptr_len > m_sq_ptr_len) {
+        m_sq_ptr_len = m_cq_ptr_len;
+    }
+    m_cq_ptr_len = m_sq_ptr_len;
+    m_sq_ptr = mmap(NULL, m_sq_ptr_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED) {
+        _LOG_LAST_ERROR("mmap sq ring failed(%s)", strerror(errno));
+        return -1;
+    }
+    m_cq_ptr = m_sq_ptr;
+
+    m_sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, m_sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        m_ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        _LOG_LAST_ERROR("mmap sqes failed(%s)", strerror(errno));
+        return -1;
+    }
+    m_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    uint8_t* sq = static_cast<uint8_t*>(m_sq_ptr);
+    m_sq_head    = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+    m_sq_tail    = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    m_sq_mask    = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sqe_head   = *m_sq_tail;
+    m_sqe_tail   = m_sqe_head;
+    // SQE按顺序使用，array固定为一一映射，提交时只需更新tail
+    uint32_t* sq_array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    for (uint32_t i = 0; i < m_sq_entries; i++) {
+        sq_array[i] = i;
+    }
+
+    uint8_t* cq = static_cast<uint8_t*>(m_cq_ptr);
+    m_cq_head = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    m_cqes    = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // 注册provided buffer ring，multishot recv时由内核选择buffer
+    m_buff_num = buff_num;
+    m_buff_len = buff_len;
+    m_buf_ring_len = buff_num * sizeof(struct io_uring_buf);
+    void* buf_ring = mmap(NULL, m_buf_ring_len, PROT_READ | PROT_WRITE,
+        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (buf_ring == MAP_FAILED) {
+        _LOG_LAST_ERROR("mmap buf ring failed(%s)", strerror(errno));
+        return -1;
+    }
+    m_buf_ring = static_cast<struct io_uring_buf_ring*>(buf_ring);
+    m_buffs = static_cast<uint8_t*>(malloc(static_cast<size_t>(buff_num) * buff_len));
+    if (m_buffs == NULL) {
+        _LOG_LAST_ERROR("alloc %u buffs failed", buff_num);
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = reinterpret_cast<uint64_t>(m_buf_ring);
+    reg.ring_entries = buff_num;
+    reg.bgid         = BUFF_GROUP_ID;
+    ret = syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+    if (ret != 0) {
+        _LOG_LAST_ERROR("register buf ring failed(%s)", strerror(errno));
+        return -1;
+    }
+    for (uint32_t i = 0; i < buff_num; i++) {
+        RecycleBuff(static_cast<uint16_t>(i));
+    }
+
+    return 0;
+}
+
+struct io_uring_sqe* IoUring::GetSqe() {
+    uint32_t head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head >= m_sq_entries) {
+        Submit(0, 0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head >= m_sq_entries) {
+            _LOG_LAST_ERROR("sq full");
+            return NULL;
+        }
+    }
+    struct io_uring_sqe* sqe = &m_sqes[m_sqe_tail & m_sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqe_tail++;
+    return sqe;
+}
+
+int32_t IoUring::Submit(uint32_t wait_nr, int32_t timeout_ms) {
+    uint32_t to_submit = m_sqe_tail - m_sqe_head;
+    if (to_submit > 0) {
+        __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+        m_sqe_head = m_sqe_tail;
+    }
+    if (to_submit == 0 && wait_nr == 0) {
+        return 0;
+    }
+
+    uint32_t flags = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (wait_nr > 0) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeout_ms >= 0) {
+            ts.tv_sec  = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000 * 1000;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    }
+
+    int32_t ret = 0;
+    do {
+        ret = syscall(__NR_io_uring_enter, m_ring_fd, to_submit, wait_nr, flags,
+            (wait_nr > 0) ? &arg : NULL, (wait_nr > 0) ? sizeof(arg) : 0);
+    } while (ret < 0 && errno == EINTR && to_submit > 0);
+
+    if (ret < 0 && errno != ETIME && errno != EINTR) {
+        _LOG_LAST_ERROR("io_uring_enter failed(%s)", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+struct io_uring_cqe* IoUring::PeekCqe() {
+    uint32_t head = *m_cq_head;
+    uint32_t tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return NULL;
+    }
+    return &m_cqes[head & m_cq_mask];
+}
+
+void IoUring::SeenCqe() {
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void IoUring::RecycleBuff(uint16_t bid) {
+    // bufs在C++下按__DECLARE_FLEX_ARRAY展开会带上空结构体的偏移，这里按内核布局直接从ring首地址取
+    struct io_uring_buf* bufs = reinterpret_cast<struct io_uring_buf*>(m_buf_ring);
+    struct io_uring_buf* buf  = &bufs[m_buf_tail & (m_buff_num - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(GetBuff(bid));
+    buf->len  = m_buff_len;
+    buf->bid  = bid;
+    m_buf_tail++;
+    __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+}
+
+#else
+
+/// @brief 编译环境不支持io_uring时的占位实现，Init总是失败，驱动全部降级
+class IoUring {
+public:
+    int32_t Init(uint32_t entries, uint32_t buff_num, uint32_t buff_len) {
+        return -1;
+    }
+    const char* GetLastError() const {
+        return "io_uring unsupported at compile time";
+    }
+};
+
+#endif // PEBBLE_IO_URING_SUPPORTED
+
+
+UringMessageDriver::UringMessageDriver() {
+    m_fallback       = NULL;
+    m_ring           = NULL;
+    m_ring_unavailable = false;
+    m_msg_buff_len   = RawMessageDriver::DEFAULT_MSG_BUFF_LEN;
+    m_handle_seq     = 1;
+    m_connection_num = 0;
+    m_raw_poll_armed = false;
+    m_raw_pending    = true;
+    m_buff_recycled  = false;
+    m_now_ms         = 0;
+    m_ready_head     = NULL;
+    m_ready_tail     = NULL;
+    m_last_error[0]  = 0;
+}
+
+UringMessageDriver::~UringMessageDriver() {
+    // 进程退出时直接释放，关闭ring后内核会取消所有在途请求
+    for (cxx::unordered_map<int64_t, UringConnection*>::iterator it = m_connections.begin();
+        it != m_connections.end(); ++it) {
+        close(it->second->_fd);
+    }
+    delete m_ring;
+}
+
+/// @brief provided buffer个数及大小，共4M
+static const uint32_t URING_BUFF_NUM     = 256;
+static const uint32_t URING_BUFF_LEN     = 16 * 1024;
+static const uint32_t URING_SQ_ENTRIES   = 1024;
+/// @brief 单连接待发送数据上限
+static const uint32_t URING_MAX_SEND_LEN = 64 * 1024 * 1024;
+
+int32_t UringMessageDriver::Init(RawMessageDriver* fallback, uint32_t msg_buff_len) {
+    if (fallback == NULL) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+    m_fallback     = fallback;
+    m_msg_buff_len = msg_buff_len;
+    return 0;
+}
+
+bool UringMessageDriver::InitRing() {
+    if (m_ring != NULL) {
+        return true;
+    }
+    if (m_ring_unavailable) {
+        return false;
+    }
+
+    // 第一次使用uring://时才创建ring，不使用的进程没有额外开销
+    IoUring* ring = new IoUring();
+    if (ring->Init(URING_SQ_ENTRIES, URING_BUFF_NUM, URING_BUFF_LEN) != 0) {
+        // 降级不算失败，uring://会由fallback按tcp://处理
+        _LOG_LAST_ERROR("io_uring unavailable, fallback to epoll(%s)", ring->GetLastError());
+        delete ring;
+        m_ring_unavailable = true;
+        return false;
+    }
+    m_ring = ring;
+    return true;
+}
+
+int64_t UringMessageDriver::Bind(const std::string& url) {
+    if (m_fallback == NULL) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    if (!StringUtility::StartsWith(url, URING_SCHEME)) {
+        return m_fallback->Bind(url);
+    }
+    if (!InitRing()) {
+        return m_fallback->Bind("tcp://" + url.substr(strlen(URING_SCHEME)));
+    }
+
+#ifdef PEBBLE_IO_URING_SUPPORTED
+    std::string ip;
+    uint16_t port = 0;
+    if (UrlToNetAddress(url.substr(strlen(URING_SCHEME)), &ip, &port) != 0) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+        _LOG_LAST_ERROR("invalid ip %s", ip.c_str());
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    int32_t fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        _LOG_LAST_ERROR("socket failed(%s)", strerror(errno));
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+    int32_t reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0
+        || listen(fd, 10240) != 0) {
+        _LOG_LAST_ERROR("listen %s:%u failed(%s)", ip.c_str(), port, strerror(errno));
+        close(fd);
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+
+    UringConnection* connection = CreateConnection(fd, -1);
+    connection->_type = kURING_LISTEN;
+    if (ArmAccept(connection) != 0) {
+        CloseConnection(connection);
+        return kMESSAGE_BIND_ADDR_FAILED;
+    }
+    return connection->_handle;
+#else
+    return kMESSAGE_UNSUPPORT;
+#endif
+}
+
+int64_t UringMessageDriver::Connect(const std::string& url) {
+    if (m_fallback == NULL) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    if (!StringUtility::StartsWith(url, URING_SCHEME)) {
+        return m_fallback->Connect(url);
+    }
+    if (!InitRing()) {
+        return m_fallback->Connect("tcp://" + url.substr(strlen(URING_SCHEME)));
+    }
+
+    std::string ip;
+    uint16_t port = 0;
+    if (UrlToNetAddress(url.substr(strlen(URING_SCHEME)), &ip, &port) != 0) {
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+        _LOG_LAST_ERROR("invalid ip %s", ip.c_str());
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    int32_t fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        _LOG_LAST_ERROR("socket failed(%s)", strerror(errno));
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+    int32_t nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    // 异步连接，连接建立前Send的数据先缓存
+    UringConnection* connection = CreateConnection(fd, -1);
+    connection->_peer_addr  = addr;
+    connection->_connecting = true;
+    if (ArmConnect(connection) != 0) {
+        CloseConnection(connection);
+        return kMESSAGE_CONNECT_ADDR_FAILED;
+    }
+    return connection->_handle;
+}
+
+int32_t UringMessageDriver::Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag) {
+    if (!IsUringHandle(handle)) {
+        return m_fallback ? m_fallback->Send(handle, msg, msg_len, flag) : kMESSAGE_UNINSTALL_DRIVER;
+    }
+    const uint8_t* frags[1] = { msg     };
+    uint32_t fragslen[1]    = { msg_len };
+    return SendV(handle, 1, frags, fragslen, flag);
+}
+
+int32_t UringMessageDriver::SendV(int64_t handle, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag) {
+    if (!IsUringHandle(handle)) {
+        return m_fallback ? m_fallback->SendV(handle, msg_frag_num, msg_frag, msg_frag_len, flag)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    UringConnection* connection = GetConnection(handle);
+    if (connection == NULL) {
+        _LOG_LAST_ERROR("get connection %ld failed", handle);
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    if (connection->_type == kURING_LISTEN) {
+        _LOG_LAST_ERROR("can't send to listen handle %ld", handle);
+        return kMESSAGE_INVAILD_PARAM;
+    }
+
+    int32_t ret = AppendSendData(connection, msg_frag_num, msg_frag, msg_frag_len);
+    if (ret != 0) {
+        return ret;
+    }
+
+    // 只在没有在途send时发起，否则等在途send完成后一起发送
+    if (!connection->_sending && !connection->_connecting) {
+        ret = ArmSend(connection);
+        if (ret != 0) {
+            CloseConnection(connection);
+            return kMESSAGE_SEND_FAILED;
+        }
+    }
+    return 0;
+}
+
+int32_t UringMessageDriver::Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
+    MsgExternInfo* msg_info) {
+    if (!IsUringHandle(handle)) {
+        return m_fallback ? m_fallback->Recv(handle, msg_buff, buff_len, msg_info)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    const uint8_t* msg = NULL;
+    uint32_t msg_len = 0;
+    int32_t ret = Peek(handle, &msg, &msg_len, msg_info);
+    if (ret != 0) {
+        return ret;
+    }
+    if (*buff_len < msg_len) {
+        return kMESSAGE_RECV_BUFF_NOT_ENOUGH;
+    }
+    memcpy(msg_buff, msg, msg_len);
+    *buff_len = msg_len;
+
+    return Pop(handle);
+}
+
+int32_t UringMessageDriver::Peek(int64_t handle, const uint8_t** msg, uint32_t* msg_len,
+    MsgExternInfo* msg_info) {
+    if (!IsUringHandle(handle)) {
+        return m_fallback ? m_fallback->Peek(handle, msg, msg_len, msg_info)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    UringConnection* connection = GetConnection(handle);
+    if (connection == NULL) {
+        _LOG_LAST_ERROR("get connection %ld failed", handle);
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    if (!connection->HasNewMsg()) {
+        _LOG_LAST_ERROR("uncompelte msg");
+        return kMESSAGE_RECV_FAILED;
+    }
+
+    *msg     = connection->_recv_buff + connection->_read_pos + sizeof(TcpMsgHead);
+    *msg_len = connection->_cur_msg_len - sizeof(TcpMsgHead);
+    return FillMsgInfo(connection, msg_info);
+}
+
+int32_t UringMessageDriver::Pop(int64_t handle) {
+    if (!IsUringHandle(handle)) {
+        return m_fallback ? m_fallback->Pop(handle) : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+#ifdef PEBBLE_IO_URING_SUPPORTED
+    UringConnection* connection = GetConnection(handle);
+    if (connection == NULL) {
+        _LOG_LAST_ERROR("get connection %ld failed", handle);
+        return kMESSAGE_UNKNOWN_CONNECTION;
+    }
+    if (!connection->HasNewMsg()) {
+        _LOG_LAST_ERROR("uncompelte msg");
+        return kMESSAGE_RECV_FAILED;
+    }
+
+    connection->_read_pos   += connection->_cur_msg_len;
+    connection->_cur_msg_len = 0;
+    if (connection->_read_pos == connection->_recv_len) {
+        connection->_read_pos = 0;
+        connection->_recv_len = 0;
+    }
+
+    // 头部消息已取走，暂存的数据可以放入接收缓冲区了
+    while (!connection->_parked_buffs.empty()) {
+        UringConnection::ParkedBuff& parked = connection->_parked_buffs.front();
+        if (AppendRecvData(connection, m_ring->GetBuff(parked._bid), parked._len) != 0) {
+            break;
+        }
+        RecycleBuff(parked._bid);
+        connection->_parked_buffs.pop_front();
+    }
+
+    if (ParseMsg(connection) != 0) {
+        CloseConnection(connection);
+    }
+#endif
+    return 0;
+}
+
+int32_t UringMessageDriver::Close(int64_t handle) {
+    if (!IsUringHandle(handle)) {
+        return m_fallback ? m_fallback->Close(handle) : kMESSAGE_UNINSTALL_DRIVER;
+    }
+
+    UringConnection* connection = GetConnection(handle);
+    if (connection != NULL) {
+        CloseConnection(connection);
+    }
+    return 0;
+}
+
+int32_t UringMessageDriver::Poll(int64_t* handle, int32_t* event, int32_t timeout_ms) {
+    if (m_fallback == NULL) {
+        return kMESSAGE_UNINSTALL_DRIVER;
+    }
+    // 没有uring连接时直接使用fallback，不引入额外开销
+    if (m_ring == NULL || m_connection_num == 0) {
+        m_raw_pending = true;
+        return m_fallback->Poll(handle, event, timeout_ms);
+    }
+
+#ifdef PEBBLE_IO_URING_SUPPORTED
+    // fallback只在有事件时才会被Poll，合并的udp报文在这里发出
+    m_fallback->FlushUdpSend();
+    if (m_ready_head != NULL) {
+        *handle = m_ready_head->_handle;
+        return 0;
+    }
+    if (m_raw_pending) {
+        if (m_fallback->Poll(handle, event, 0) == 0) {
+            return 0;
+        }
+        m_raw_pending = false;
+    }
+
+    // fallback的epoll fd也挂在ring上，任一方有事件都能唤醒
+    RearmStarvedRecv();
+    ArmRawPoll();
+    m_ring->Submit(0, 0);
+    ProcessCompletions();
+    if (m_ready_head == NULL && !m_raw_pending && timeout_ms != 0) {
+        m_ring->Submit(1, timeout_ms);
+        ProcessCompletions();
+    }
+
+    if (m_ready_head != NULL) {
+        *handle = m_ready_head->_handle;
+        return 0;
+    }
+    if (m_raw_pending) {
+        if (m_fallback->Poll(handle, event, 0) == 0) {
+            return 0;
+        }
+        m_raw_pending = false;
+    }
+#endif
+    return -1;
+}
+
+int32_t UringMessageDriver::ReportHandleResult(int64_t handle, int32_t result, int64_t time_cost) {
+    if (!IsUringHandle(handle)) {
+        return m_fallback ? m_fallback->ReportHandleResult(handle, result, time_cost)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+    return kMESSAGE_UNSUPPORT;
+}
+
+int32_t UringMessageDriver::GetUsedSize(int64_t handle, uint32_t* remain_size, uint32_t* max_size) {
+    if (!IsUringHandle(handle)) {
+        return m_fallback ? m_fallback->GetUsedSize(handle, remain_size, max_size)
+            : kMESSAGE_UNINSTALL_DRIVER;
+    }
+    return kMESSAGE_UNSUPPORT;
+}
+
+const char* UringMessageDriver::GetLastError() {
+    if ((m_ring == NULL || m_last_error[0] == 0) && m_fallback != NULL) {
+        return m_fallback->GetLastError();
+    }
+    return m_last_error;
+}
+
+UringConnection* UringMessageDriver::GetConnection(int64_t handle) {
+    cxx::unordered_map<int64_t, UringConnection*>::iterator it = m_connections.find(handle);
+    if (it == m_connections.end()) {
+        return NULL;
+    }
+    return it->second;
+}
+
+UringConnection* UringMessageDriver::CreateConnection(int32_t fd, int64_t listen_handle) {
+    UringConnection* connection = new UringConnection();
+    connection->_fd            = fd;
+    connection->_listen_handle = listen_handle;
+    connection->_type          = (listen_handle >= 0) ? kURING_ACCEPTED : kURING_CONNECTED;
+    connection->_handle        = ((m_handle_seq++ & 0x7FFFFFFFLL) << 32) | URING_HANDLE_FLAG;
+    m_connections[connection->_handle] = connection;
+    m_connection_num++;
+    return connection;
+}
+
+void UringMessageDriver::CloseConnection(UringConnection* connection) {
+    if (connection->_closed) {
+        return;
+    }
+    connection->_closed = true;
+    UnlinkReadyConnection(connection);
+    m_connections.erase(connection->_handle);
+
+#ifdef PEBBLE_IO_URING_SUPPORTED
+    while (!connection->_parked_buffs.empty()) {
+        RecycleBuff(connection->_parked_buffs.front()._bid);
+        connection->_parked_buffs.pop_front();
+    }
+
+    // 先提交所有SQE，避免fd号被复用后未提交的请求作用到新的socket上
+    // shutdown让在途的accept/recv/send尽快结束，内核持有文件引用，可以直接close
+    m_ring->Submit(0, 0);
+#endif
+    shutdown(connection->_fd, SHUT_RDWR);
+    close(connection->_fd);
+    connection->_fd = -1;
+
+    TryFreeConnection(connection);
+}
+
+void UringMessageDriver::TryFreeConnection(UringConnection* connection) {
+    if (connection->_closed && connection->_inflight == 0) {
+        delete connection;
+        m_connection_num--;
+    }
+}
+
+int32_t UringMessageDriver::AppendSendData(UringConnection* connection, uint32_t msg_frag_num,
+    const uint8_t* msg_frag[], const uint32_t msg_frag_len[]) {
+    uint32_t msg_len = 0;
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        msg_len += msg_frag_len[i];
+    }
+    uint32_t need_len = connection->_send_len + sizeof(TcpMsgHead) + msg_len;
+    if (need_len > URING_MAX_SEND_LEN) {
+        _LOG_LAST_ERROR("send buff full, %u bytes pending", connection->_send_len);
+        return kMESSAGE_SEND_BUFF_NOT_ENOUGH;
+    }
+    if (ReserveBuff(&connection->_send_buff, &connection->_send_buff_len, need_len) != 0) {
+        _LOG_LAST_ERROR("alloc send buff %u failed", need_len);
+        return kMESSAGE_CACHE_FAILED;
+    }
+
+    TcpMsgHead head;
+    head._magic    = htonl(head._magic);
+    head._version  = htonl(head._version);
+    head._data_len = htonl(msg_len);
+    uint8_t* pos = connection->_send_buff + connection->_send_len;
+    memcpy(pos, &head, sizeof(head));
+    pos += sizeof(head);
+    for (uint32_t i = 0; i < msg_frag_num; i++) {
+        memcpy(pos, msg_frag[i], msg_frag_len[i]);
+        pos += msg_frag_len[i];
+    }
+    connection->_send_len = need_len;
+    return 0;
+}
+
+#ifdef PEBBLE_IO_URING_SUPPORTED
+
+int32_t UringMessageDriver::ArmAccept(UringConnection* connection) {
+    struct io_uring_sqe* sqe = m_ring->GetSqe();
+    if (sqe == NULL) {
+        _LOG_LAST_ERROR("get sqe failed(%s)", m_ring->GetLastError());
+        return -1;
+    }
+    sqe->opcode       = IORING_OP_ACCEPT;
+    sqe->fd           = connection->_fd;
+    sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data    = MakeUserData(connection, kURING_OP_ACCEPT);
+    connection->_inflight++;
+    return 0;
+}
+
+int32_t UringMessageDriver::ArmRecv(UringConnection* connection) {
+    struct io_uring_sqe* sqe = m_ring->GetSqe();
+    if (sqe == NULL) {
+        _LOG_LAST_ERROR("get sqe failed(%s)", m_ring->GetLastError());
+        return -1;
+    }
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = connection->_fd;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = m_ring->GetBuffGroup();
+    sqe->user_data = MakeUserData(connection, kURING_OP_RECV);
+    connection->_inflight++;
+    return 0;
+}
+
+int32_t UringMessageDriver::ArmSend(UringConnection* connection) {
+    if (!connection->_sending) {
+        if (connection->_send_len == 0) {
+            return 0;
+        }
+        // 交换收集缓冲区和在途缓冲区，在途期间新的数据继续追加到收集缓冲区
+        uint8_t* buff = connection->_sending_buff;
+        uint32_t buff_len = connection->_sending_buff_len;
+        connection->_sending_buff     = connection->_send_buff;
+        connection->_sending_buff_len = connection->_send_buff_len;
+        connection->_sending_len      = connection->_send_len;
+        connection->_sending_pos      = 0;
+        connection->_send_buff        = buff;
+        connection->_send_buff_len    = buff_len;
+        connection->_send_len         = 0;
+        connection->_sending          = true;
+    }
+
+    struct io_uring_sqe* sqe = m_ring->GetSqe();
+    if (sqe == NULL) {
+        _LOG_LAST_ERROR("get sqe failed(%s)", m_ring->GetLastError());
+        return -1;
+    }
+    sqe->opcode    = IORING_OP_SEND;
+    sqe->fd        = connection->_fd;
+    sqe->addr      = reinterpret_cast<uint64_t>(connection->_sending_buff + connection->_sending_pos);
+    sqe->len       = connection->_sending_len - connection->_sending_pos;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = MakeUserData(connection, kURING_OP_SEND);
+    connection->_inflight++;
+    return 0;
+}
+
+int32_t UringMessageDriver::ArmConnect(UringConnection* connection) {
+    struct io_uring_sqe* sqe = m_ring->GetSqe();
+    if (sqe == NULL) {
+        _LOG_LAST_ERROR("get sqe failed(%s)", m_ring->GetLastError());
+        return -1;
+    }
+    sqe->opcode    = IORING_OP_CONNECT;
+    sqe->fd        = connection->_fd;
+    sqe->addr      = reinterpret_cast<uint64_t>(&connection->_peer_addr);
+    sqe->off       = sizeof(connection->_peer_addr);
+    sqe->user_data = MakeUserData(connection, kURING_OP_CONNECT);
+    connection->_inflight++;
+    return 0;
+}
+
+void UringMessageDriver::ArmRawPoll() {
+    if (m_raw_poll_armed) {
+        return;
+    }
+    int32_t fd = m_fallback->GetEventFd();
+    if (fd < 0) {
+        return;
+    }
+    struct io_uring_sqe* sqe = m_ring->GetSqe();
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode       = IORING_OP_POLL_ADD;
+    sqe->fd           = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data    = MakeUserData(NULL, kURING_OP_RAW_POLL);
+    m_raw_poll_armed  = true;
+}
+
+void UringMessageDriver::RecycleBuff(uint16_t bid) {
+    m_ring->RecycleBuff(bid);
+    m_buff_recycled = true;
+}
+
+void UringMessageDriver::RearmStarvedRecv() {
+    if (!m_buff_recycled || m_recv_starved.empty()) {
+        return;
+    }
+    m_buff_recycled = false;
+
+    std::vector<int64_t> starved;
+    starved.swap(m_recv_starved);
+    for (std::vector<int64_t>::iterator it = starved.begin(); it != starved.end(); ++it) {
+        // 等待期间已关闭的连接不在m_connections中
+        UringConnection* connection = GetConnection(*it);
+        if (connection != NULL && ArmRecv(connection) != 0) {
+            CloseConnection(connection);
+        }
+    }
+}
+
+void UringMessageDriver::ProcessCompletions() {
+    m_now_ms = TimeUtility::GetMonotonicMS();
+
+    struct io_uring_cqe* cqe = NULL;
+    while ((cqe = m_ring->PeekCqe()) != NULL) {
+        uint64_t user_data = cqe->user_data;
+        int32_t  res       = cqe->res;
+        uint32_t flags     = cqe->flags;
+        m_ring->SeenCqe();
+
+        uint32_t op = static_cast<uint32_t>(user_data & kURING_OP_MASK);
+        UringConnection* connection = reinterpret_cast<UringConnection*>(user_data & ~static_cast<uint64_t>(kURING_OP_MASK));
+        switch (op) {
+            case kURING_OP_RAW_POLL:
+                m_raw_poll_armed = false;
+                m_raw_pending    = true;
+                continue;
+            case kURING_OP_ACCEPT:
+                OnAccept(connection, res, flags);
+                break;
+            case kURING_OP_RECV:
+                OnRecv(connection, res, flags);
+                break;
+            case kURING_OP_SEND:
+                OnSend(connection, res);
+                break;
+            case kURING_OP_CONNECT:
+                OnConnect(connection, res);
+                break;
+            default:
+                continue;
+        }
+
+        // multishot请求在没有IORING_CQE_F_MORE时才结束
+        if (!(flags & IORING_CQE_F_MORE)) {
+            connection->_inflight--;
+            TryFreeConnection(connection);
+        }
+    }
+
+    RearmStarvedRecv();
+}
+
+void UringMessageDriver::OnAccept(UringConnection* connection, int32_t res, uint32_t flags) {
+    if (res >= 0) {
+        if (connection->_closed) {
+            close(res);
+        } else {
+            int32_t nodelay = 1;
+            setsockopt(res, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+            UringConnection* accepted = CreateConnection(res, connection->_handle);
+            if (ArmRecv(accepted) != 0) {
+                CloseConnection(accepted);
+            }
+        }
+    } else {
+        _LOG_LAST_ERROR("accept failed(%s)", strerror(-res));
+    }
+
+    if (!(flags & IORING_CQE_F_MORE) && !connection->_closed) {
+        ArmAccept(connection);
+    }
+}
+
+void UringMessageDriver::OnRecv(UringConnection* connection, int32_t res, uint32_t flags) {
+    if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+        uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (connection->_closed) {
+            RecycleBuff(bid);
+            return;
+        }
+
+        connection->_recv_ms = m_now_ms;
+        if (!connection->_parked_buffs.empty()
+            || AppendRecvData(connection, m_ring->GetBuff(bid), res) != 0) {
+            UringConnection::ParkedBuff parked;
+            parked._bid = bid;
+            parked._len = res;
+            connection->_parked_buffs.push_back(parked);
+        } else {
+            RecycleBuff(bid);
+        }
+
+        if (ParseMsg(connection) != 0) {
+            CloseConnection(connection);
+            return;
+        }
+    } else if (res == -ENOBUFS) {
+        // provided buffer暂时用完，multishot recv已结束，等有buffer归还后再重新发起，
+        // 立即重新发起只会马上再次失败，在buffer被应用持有期间空转
+        if (!(flags & IORING_CQE_F_MORE) && !connection->_closed) {
+            m_recv_starved.push_back(connection->_handle);
+        }
+        return;
+    } else if (!connection->_closed) {
+        // res == 0 对端关闭
+        CloseConnection(connection);
+        return;
+    }
+
+    if (!(flags & IORING_CQE_F_MORE) && !connection->_closed) {
+        if (ArmRecv(connection) != 0) {
+            CloseConnection(connection);
+        }
+    }
+}
+
+void UringMessageDriver::OnSend(UringConnection* connection, int32_t res) {
+    if (connection->_closed) {
+        return;
+    }
+    if (res < 0) {
+        _LOG_LAST_ERROR("send to %ld failed(%s)", connection->_handle, strerror(-res));
+        CloseConnection(connection);
+        return;
+    }
+
+    connection->_sending_pos += res;
+    if (connection->_sending_pos >= connection->_sending_len) {
+        connection->_sending = false;
+    }
+    if ((connection->_sending || connection->_send_len > 0) && ArmSend(connection) != 0) {
+        CloseConnection(connection);
+    }
+}
+
+void UringMessageDriver::OnConnect(UringConnection* connection, int32_t res) {
+    if (connection->_closed) {
+        return;
+    }
+    if (res < 0) {
+        _LOG_LAST_ERROR("connect %ld failed(%s)", connection->_handle, strerror(-res));
+        CloseConnection(connection);
+        return;
+    }
+
+    connection->_connecting = false;
+    if (ArmRecv(connection) != 0 || ArmSend(connection) != 0) {
+        CloseConnection(connection);
+    }
+}
+
+#else
+
+int32_t UringMessageDriver::ArmAccept(UringConnection* connection) { return -1; }
+int32_t UringMessageDriver::ArmRecv(UringConnection* connection) { return -1; }
+void UringMessageDriver::RecycleBuff(uint16_t bid) {}
+void UringMessageDriver::RearmStarvedRecv() {}
+int32_t UringMessageDriver::ArmSend(UringConnection* connection) { return -1; }
+int32_t UringMessageDriver::ArmConnect(UringConnection* connection) { return -1; }
+void UringMessageDriver::ArmRawPoll() {}
+void UringMessageDriver::ProcessCompletions() {}
+void UringMessageDriver::OnAccept(UringConnection* connection, int32_t res, uint32_t flags) {}
+void UringMessageDriver::OnRecv(UringConnection* connection, int32_t res, uint32_t flags) {}
+void UringMessageDriver::OnSend(UringConnection* connection, int32_t res) {}
+void UringMessageDriver::OnConnect(UringConnection* connection, int32_t res) {}
+
+#endif // PEBBLE_IO_URING_SUPPORTED
+
+int32_t UringMessageDriver::AppendRecvData(UringConnection* connection,
+    const uint8_t* data, uint32_t data_len) {
+    uint32_t free_len = connection->_recv_buff_len - connection->_recv_len;
+    if (free_len < data_len) {
+        // 头部有完整消息时，上层可能持有Peek返回的指针，不能移动数据
+        if (connection->HasNewMsg()) {
+            return -1;
+        }
+        uint32_t data_in_buff = connection->_recv_len - connection->_read_pos;
+        if (connection->_read_pos > 0) {
+            memmove(connection->_recv_buff, connection->_recv_buff + connection->_read_pos, data_in_buff);
+            connection->_read_pos = 0;
+            connection->_recv_len = data_in_buff;
+        }
+        if (ReserveBuff(&connection->_recv_buff, &connection->_recv_buff_len,
+            data_in_buff + data_len) != 0) {
+            return -1;
+        }
+    }
+
+    memcpy(connection->_recv_buff + connection->_recv_len, data, data_len);
+    connection->_recv_len += data_len;
+    return 0;
+}
+
+int32_t UringMessageDriver::ParseMsg(UringConnection* connection) {
+    uint32_t data_in_buff = connection->_recv_len - connection->_read_pos;
+    if (connection->_cur_msg_len == 0 && data_in_buff >= sizeof(TcpMsgHead)) {
+        const TcpMsgHead* head =
+            reinterpret_cast<const TcpMsgHead*>(connection->_recv_buff + connection->_read_pos);
+        uint32_t data_len = ntohl(head->_data_len);
+        if (ntohl(head->_magic) != TCP_HEAD_MAGIC
+            || data_len > m_msg_buff_len - sizeof(TcpMsgHead)) {
+            _LOG_LAST_ERROR("invalid msg head from %ld, len = %u", connection->_handle, data_len);
+            return -1;
+        }
+        connection->_cur_msg_len = sizeof(TcpMsgHead) + data_len;
+        connection->_arrived_ms  = connection->_recv_ms;
+    }
+
+    if (connection->HasNewMsg()) {
+        LinkReadyConnection(connection);
+    } else {
+        UnlinkReadyConnection(connection);
+    }
+    return 0;
+}
+
+void UringMessageDriver::LinkReadyConnection(UringConnection* connection) {
+    if (connection->_in_ready_list) {
+        return;
+    }
+    connection->_in_ready_list = true;
+    connection->_ready_prev = m_ready_tail;
+    connection->_ready_next = NULL;
+    if (m_ready_tail != NULL) {
+        m_ready_tail->_ready_next = connection;
+    } else {
+        m_ready_head = connection;
+    }
+    m_ready_tail = connection;
+}
+
+void UringMessageDriver::UnlinkReadyConnection(UringConnection* connection) {
+    if (!connection->_in_ready_list) {
+        return;
+    }
+    if (connection->_ready_prev != NULL) {
+        connection->_ready_prev->_ready_next = connection->_ready_next;
+    } else {
+        m_ready_head = connection->_ready_next;
+    }
+    if (connection->_ready_next != NULL) {
+        connection->_ready_next->_ready_prev = connection->_ready_prev;
+    } else {
+        m_ready_tail = connection->_ready_prev;
+    }
+    connection->_in_ready_list = false;
+    connection->_ready_prev = NULL;
+    connection->_ready_next = NULL;
+}
+
+int32_t UringMessageDriver::FillMsgInfo(UringConnection* connection, MsgExternInfo* msg_info) {
+    if (msg_info == NULL) {
+        return 0;
+    }
+    msg_info->_msg_arrived_ms = connection->_arrived_ms;
+    msg_info->_remote_handle  = connection->_handle;
+    msg_info->_self_handle    = (connection->_type == kURING_ACCEPTED)
+        ? connection->_listen_handle : connection->_handle;
+    return 0;
+}
+
+} // namespace pebble
@@ -0,0 +1,162 @@
+/*
+ * Tencent is pleased to support the open source community by making Pebble available.
+ * Copyright (C) 2016 THL A29 Limited, a Tencent company. All rights reserved.
+ * Licensed under the MIT License (the "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ * http://opensource.org/licenses/MIT
+ * Unless required by applicable law or agreed to in writing, software distributed under the License
+ * is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+ * or implied. See the License for the specific language governing permissions and limitations under
+ * the License.
+ *
+ */
+
+#ifndef _PEBBLE_COMMON_URING_MESSAGE_DRIVER_H_
+#define _PEBBLE_COMMON_URING_MESSAGE_DRIVER_H_
+
+#include <list>
+#include <vector>
+#include "framework/raw_message_driver.h"
+
+
+namespace pebble {
+
+class IoUring;
+struct UringConnection;
+
+/// @brief 基于io_uring的TCP网络驱动，默认不启用，通过Message::EnableUringDriver(或[net]enable_uring配置)启用\n
+///   "uring://ip:port"形式的url使用io_uring收发，消息格式与RAW TCP相同(TcpMsgHead)，可与tcp://互通\n
+///   - 监听端口使用multishot accept，连接使用multishot recv + 注册的provided buffer ring接收\n
+///   - Send只把数据追加到连接的发送缓存，每个连接同时只有一个send在途，完成后再发送期间累积的数据\n
+///   - 所有SQE在Poll中一次io_uring_enter提交并收割完成事件，高负载时每个请求的系统调用远小于1次\n
+///   其它url(tcp://、udp://)及非本驱动创建的句柄都转给RawMessageDriver处理，\n
+///   内核不支持io_uring(或缺少multishot recv等能力)时，uring://自动降级为tcp://由RawMessageDriver处理
+class UringMessageDriver : public MessageDriver {
+protected:
+    UringMessageDriver();
+    UringMessageDriver(const UringMessageDriver& rhs) {}
+public:
+    virtual ~UringMessageDriver();
+
+    static UringMessageDriver* Instance() {
+        static UringMessageDriver s_uring_message;
+        return &s_uring_message;
+    }
+
+    /// @brief 初始化
+    /// @param fallback 非uring://的url及降级时使用的驱动，需已初始化
+    /// @param msg_buff_len 单个消息(含消息头)的最大长度
+    /// @return 0 成功
+    /// @return <0 失败
+    /// @note io_uring在第一次使用uring://时才创建，不可用时uring://降级为tcp://，不返回失败
+    int32_t Init(RawMessageDriver* fallback,
+        uint32_t msg_buff_len = RawMessageDriver::DEFAULT_MSG_BUFF_LEN);
+
+    /// @brief io_uring是否已创建并可用
+    bool IsUringEnabled() const {
+        return m_ring != NULL;
+    }
+
+    virtual int64_t Bind(const std::string& url);
+
+    virtual int64_t Connect(const std::string& url);
+
+    virtual int32_t Send(int64_t handle, const uint8_t* msg, uint32_t msg_len, int32_t flag);
+
+    virtual int32_t SendV(int64_t handle, uint32_t msg_frag_num,
+                          const uint8_t* msg_frag[], uint32_t msg_frag_len[], int32_t flag);
+
+    virtual int32_t Recv(int64_t handle, uint8_t* msg_buff, uint32_t* buff_len,
+                         MsgExternInfo* msg_info);
+
+    virtual int32_t Peek(int64_t handle, const uint8_t** msg, uint32_t* msg_len,
+                         MsgExternInfo* msg_info);
+
+    virtual int32_t Pop(int64_t handle);
+
+    virtual int32_t Close(int64_t handle);
+
+    virtual int32_t Poll(int64_t* handle, int32_t* event, int32_t timeout_ms);
+
+    virtual int32_t ReportHandleResult(int64_t handle, int32_t result, int64_t time_cost);
+
+    virtual int32_t GetUsedSize(int64_t handle, uint32_t* remain_size, uint32_t* max_size);
+
+    virtual const char* GetLastError();
+
+private:
+    /// @brief uring句柄的低32位带此标记，RAW驱动的句柄低32位为socket下标或udp端口，不会冲突
+    static const int64_t URING_HANDLE_FLAG = 0x80000000LL;
+
+    bool IsUringHandle(int64_t handle) const {
+        return m_ring != NULL && (handle & URING_HANDLE_FLAG) != 0;
+    }
+
+    /// @brief 创建io_uring，失败后不再重试
+    bool InitRing();
+
+    UringConnection* GetConnection(int64_t handle);
+
+    UringConnection* CreateConnection(int32_t fd, int64_t listen_handle);
+
+    /// @brief 关闭连接，连接对象在所有在途请求完成后才释放
+    void CloseConnection(UringConnection* connection);
+
+    void TryFreeConnection(UringConnection* connection);
+
+    int32_t AppendSendData(UringConnection* connection, uint32_t msg_frag_num,
+        const uint8_t* msg_frag[], const uint32_t msg_frag_len[]);
+
+    int32_t ArmAccept(UringConnection* connection);
+    int32_t ArmRecv(UringConnection* connection);
+    int32_t ArmSend(UringConnection* connection);
+    int32_t ArmConnect(UringConnection* connection);
+    void ArmRawPoll();
+
+    /// @brief 归还provided buffer，并记录有buffer可用
+    void RecycleBuff(uint16_t bid);
+
+    /// @brief 有buffer归还后，重新发起因provided buffer用完(ENOBUFS)而结束的recv
+    void RearmStarvedRecv();
+
+    /// @brief 收割所有完成事件
+    void ProcessCompletions();
+
+    void OnAccept(UringConnection* connection, int32_t res, uint32_t flags);
+    void OnRecv(UringConnection* connection, int32_t res, uint32_t flags);
+    void OnSend(UringConnection* connection, int32_t res);
+    void OnConnect(UringConnection* connection, int32_t res);
+
+    /// @brief 追加收到的数据，头部有完整消息且需要移动缓冲区时返回-1，调用者需暂存数据
+    int32_t AppendRecvData(UringConnection* connection, const uint8_t* data, uint32_t data_len);
+
+    /// @brief 解析下一个消息头，并维护就绪链表
+    /// @return 0 成功，<0 消息非法
+    int32_t ParseMsg(UringConnection* connection);
+
+    void LinkReadyConnection(UringConnection* connection);
+    void UnlinkReadyConnection(UringConnection* connection);
+
+    int32_t FillMsgInfo(UringConnection* connection, MsgExternInfo* msg_info);
+
+private:
+    RawMessageDriver* m_fallback;
+    IoUring*          m_ring;
+    bool              m_ring_unavailable;
+    uint32_t          m_msg_buff_len;
+    int64_t           m_handle_seq;
+    uint32_t          m_connection_num;    // 含已关闭但还有在途请求的连接
+    bool              m_raw_poll_armed;    // 是否在ring上监听fallback的epoll fd
+    bool              m_raw_pending;       // fallback可能有事件待处理
+    int64_t           m_now_ms;
+    bool              m_buff_recycled;     // 上次RearmStarvedRecv后是否有provided buffer归还
+    std::vector<int64_t> m_recv_starved;   // 等待provided buffer归还后重新发起recv的连接
+    cxx::unordered_map<int64_t, UringConnection*> m_connections;
+    UringConnection*  m_ready_head;
+    UringConnection*  m_ready_tail;
+    char              m_last_error[256];
+};
+
+} // namespace pebble
+
+#endif // _PEBBLE_COMMON_URING_MESSAGE_DRIVER_H_
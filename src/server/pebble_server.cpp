@@ -23,6 +23,7 @@
 #include "common/ini_reader.h"
 #include "common/log.h"
 #include "common/memory.h"
+#include "common/net_util.h"
 #include "common/string_utility.h"
 #include "common/time_utility.h"
 #include "common/timer.h"
@@ -32,6 +33,7 @@
 #include "framework/message.h"
 #include "framework/monitor.h"
 #include "framework/pebble_rpc.h"
+#include "framework/raw_message_driver.h"
 #include "framework/session.h"
 #include "framework/stat.h"
 #include "framework/stat_manager.h"
@@ -247,6 +249,14 @@ void PebbleControlHandler::OnControlHistory(const std::vector<std::string>& opti
 }
 
 
+// 多reactor模式下每个reactor线程独立使用的RAW驱动
+class ReactorMessageDriver : public RawMessageDriver {
+public:
+    ReactorMessageDriver() {}
+    virtual ~ReactorMessageDriver() {}
+};
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 PebbleServer::PebbleServer() {
@@ -255,10 +265,10 @@ PebbleServer::PebbleServer() {
     m_monitor_centor     = NULL;
     m_task_monitor       = NULL;
     m_message_expire_monitor = NULL;
+    m_concurrency_limit_monitor = NULL;
     m_stat_manager       = NULL;
     m_timer              = NULL;
     m_stat_timer_ms      = 1000;
-    m_rpc_event_handler  = NULL;
     m_last_pid_cpu_use   = 0;
     m_last_total_cpu_use = 0;
     m_event_handler      = NULL;
@@ -269,6 +279,13 @@ PebbleServer::PebbleServer() {
     m_is_overload             = kNO_OVERLOAD;
     m_broadcast_event_handler = NULL;
     m_control_handler         = NULL;
+    m_reactor_index           = 0;
+    m_reactor                 = NULL;
+    m_has_ready_handle        = false;
+    m_ready_handle            = -1;
+    m_raw_driver              = RawMessageDriver::Instance();
+    m_co_epoll_fd             = -1;
+    m_co_has_event            = false;
 
     for (int32_t i = 0; i < kNAMING_BUTT; ++i) {
         m_naming_array[i] = NULL;
@@ -276,10 +293,13 @@ PebbleServer::PebbleServer() {
 
     for (int32_t i = 0; i < kPROCESSOR_TYPE_BUTT; ++i) {
         m_processor_array[i] = NULL;
+        m_rpc_event_handlers[i] = NULL;
     }
 }
 
 PebbleServer::~PebbleServer() {
+    StopReactors();
+
     // delete的原则: 如果出现重复delete说明逻辑实现有问题，通过crash暴露出来，赋NULL可能掩盖问题
     for (cxx::unordered_map<std::string, Router*>::iterator it = m_router_map.begin();
         it != m_router_map.end(); ++it) {
@@ -292,14 +312,18 @@ PebbleServer::~PebbleServer() {
 
     for (int32_t i = 0; i < kPROCESSOR_TYPE_BUTT; ++i) {
         delete m_processor_array[i];
+        delete m_rpc_event_handlers[i];
     }
 
-    delete m_rpc_event_handler;
     delete m_monitor_centor;
     delete m_task_monitor;
     delete m_message_expire_monitor;
+    delete m_concurrency_limit_monitor;
     delete m_stat_manager;
     delete m_ini_reader;
+    if (m_co_epoll_fd >= 0) {
+        m_raw_driver->RemoveEventFd(m_co_epoll_fd);
+    }
     delete m_coroutine_schedule;
     delete m_timer;
     delete m_session_mgr;
@@ -319,9 +343,30 @@ int32_t PebbleServer::Init(AppEventHandler* event_handler) {
 
     m_event_handler = event_handler;
 
-    InitLog();
+    // 日志、资源统计和控制命令服务只在主reactor初始化，其它reactor共用
+    if (0 == m_reactor_index) {
+        InitLog();
 
-    PLOG_INFO("%s", m_options.ToString().c_str());
+        PLOG_INFO("%s", m_options.ToString().c_str());
+
+        TimeUtility::SetPreciseMonotonic(m_options._app_precise_clock);
+
+        // 多reactor时各reactor监听同一地址，需在OnInit中Bind之前打开端口复用
+        if (m_options._app_reactor_num > 1) {
+            NetIO::PORT_REUSE = true;
+        }
+
+        RawMessageDriver::Instance()->SetUdpBatchNum(m_options._net_udp_batch_num);
+
+        // io_uring驱动需在OnInit中Bind uring://地址之前启用
+        if (m_options._net_enable_uring) {
+            int32_t ret = Message::EnableUringDriver();
+            if (ret != 0) {
+                PLOG_ERROR("enable uring driver failed(%d:%s)", ret, Message::GetLastError());
+                return -1;
+            }
+        }
+    }
 
     int32_t ret = InitTimer();
     CHECK_RETURN(ret);
@@ -342,11 +387,18 @@ int32_t PebbleServer::Init(AppEventHandler* event_handler) {
         CHECK_RETURN(ret);
     }
 
+    if (m_reactor_index > 0) {
+        return 0;
+    }
+
     ret = InitControlService();
     CHECK_RETURN(ret);
 
     signal(SIGPIPE, SIG_IGN);
 
+    ret = StartReactors();
+    CHECK_RETURN(ret);
+
     return 0;
 }
 
@@ -363,6 +415,13 @@ int64_t PebbleServer::Connect(const std::string &url) {
 }
 
 int32_t PebbleServer::Close(int64_t handle) {
+    // 通知各Processor释放和此句柄相关的状态
+    for (int32_t i = 0; i < kPROCESSOR_TYPE_BUTT; ++i) {
+        if (m_processor_array[i] != NULL) {
+            m_processor_array[i]->OnClose(handle);
+        }
+    }
+
     int32_t ret = Message::Close(handle);
     PLOG_IF_ERROR(ret != 0, "close %ld failed(%s)", handle, Message::GetLastError());
     return ret;
@@ -390,6 +449,122 @@ void PebbleServer::Serve() {
             Idle();
         }
     } while (true);
+
+    StopReactors();
+}
+
+int32_t PebbleServer::StartReactors() {
+    for (uint32_t i = 1; i < m_options._app_reactor_num; ++i) {
+        Reactor* reactor = new Reactor();
+        reactor->_index         = i;
+        reactor->_options       = m_options;
+        reactor->_event_handler = m_event_handler;
+        reactor->_state         = 0;
+        reactor->_stop          = false;
+        reactor->_stat          = new Stat();
+
+        int32_t ret = pthread_create(&reactor->_thread, NULL, ReactorRoutine, reactor);
+        if (ret != 0) {
+            PLOG_ERROR("create reactor %u thread failed(%d)", i, ret);
+            delete reactor->_stat;
+            delete reactor;
+            return -1;
+        }
+        m_reactors.push_back(reactor);
+
+        // 逐个等待初始化完成，用户的OnInit不会被并发调用
+        int32_t state = 0;
+        reactor->_mutex.Lock();
+        while (0 == reactor->_state) {
+            reactor->_state_cond.Wait(&reactor->_mutex);
+        }
+        state = reactor->_state;
+        reactor->_mutex.UnLock();
+        if (state < 0) {
+            PLOG_ERROR("reactor %u init failed", i);
+            return -1;
+        }
+    }
+
+    if (!m_reactors.empty()) {
+        PLOG_INFO("%u reactors started", m_options._app_reactor_num);
+    }
+
+    return 0;
+}
+
+void PebbleServer::StopReactors() {
+    std::vector<Reactor*>::iterator it = m_reactors.begin();
+    for (; it != m_reactors.end(); ++it) {
+        (*it)->_stop = true;
+    }
+
+    for (it = m_reactors.begin(); it != m_reactors.end(); ++it) {
+        pthread_join((*it)->_thread, NULL);
+    }
+
+    // reactor退出前转交的最后一批统计
+    if (m_stat_manager) {
+        CollectReactorStat(m_stat_manager->GetStat());
+    }
+
+    for (it = m_reactors.begin(); it != m_reactors.end(); ++it) {
+        delete (*it)->_stat;
+        delete *it;
+    }
+    m_reactors.clear();
+}
+
+void PebbleServer::CollectReactorStat(Stat* stat) {
+    std::vector<Reactor*>::iterator it = m_reactors.begin();
+    for (; it != m_reactors.end(); ++it) {
+        AutoLocker locker(&(*it)->_mutex);
+        stat->Merge((*it)->_stat);
+        (*it)->_stat->Clear();
+    }
+}
+
+void* PebbleServer::ReactorRoutine(void* arg) {
+    Reactor* reactor = static_cast<Reactor*>(arg);
+
+    // 每个reactor使用独立的NetIO和Epoll，本线程的Message接口都走此驱动，应答自然回到所属reactor
+    ReactorMessageDriver driver;
+    int32_t ret = driver.Init();
+    if (ret != 0) {
+        PLOG_ERROR("reactor %u message driver init failed(%d)", reactor->_index, ret);
+        AutoLocker locker(&reactor->_mutex);
+        reactor->_state = -1;
+        reactor->_state_cond.Signal();
+        return NULL;
+    }
+    driver.SetUdpBatchNum(reactor->_options._net_udp_batch_num);
+    Message::SetThreadMessageDriver(&driver);
+
+    // 协程调度器按线程管理上下文，PebbleServer需在本线程内创建和释放
+    PebbleServer* server   = new PebbleServer();
+    server->m_options       = reactor->_options;
+    server->m_reactor_index = reactor->_index;
+    server->m_reactor       = reactor;
+    server->m_raw_driver    = &driver;
+    ret = server->Init(reactor->_event_handler);
+    reactor->_mutex.Lock();
+    reactor->_state = (0 == ret ? 1 : -1);
+    reactor->_state_cond.Signal();
+    reactor->_mutex.UnLock();
+
+    while (0 == ret && !reactor->_stop) {
+        if (server->Update() <= 0) {
+            server->Idle();
+        }
+    }
+
+    if (server->m_stat_manager) {
+        server->OnStatTimeout();
+    }
+
+    delete server;
+    Message::SetThreadMessageDriver(NULL);
+    return NULL;
 }
 
 int32_t PebbleServer::Attach(int64_t handle, IProcessor* processor) {
@@ -415,7 +590,7 @@ int32_t PebbleServer::Attach(Router* router, IProcessor* processor) {
 
 
 IProcessor* PebbleServer::GetProcessor(ProcessorType processor_type) {
-    if (processor_type < kPEBBLE_RPC_BINARY || processor_type > kPEBBLE_RPC_PROTOBUF) {
+    if (processor_type < kPEBBLE_RPC_BINARY || processor_type >= kPROCESSOR_TYPE_BUTT) {
         return GetPebbleRpc(processor_type);
     }
     // 目前只有RPC相关的Processor，若有扩展，需要这里处理
@@ -423,7 +598,7 @@ IProcessor* PebbleServer::GetProcessor(ProcessorType processor_type) {
 }
 
 PebbleRpc* PebbleServer::GetPebbleRpc(ProcessorType processor_type) {
-    if (processor_type < kPEBBLE_RPC_BINARY || processor_type > kPEBBLE_RPC_PROTOBUF) {
+    if (processor_type < kPEBBLE_RPC_BINARY || processor_type >= kPROCESSOR_TYPE_BUTT) {
         PLOG_ERROR("param processor_type invalid(%d)", processor_type);
         return NULL;
     }
@@ -432,11 +607,6 @@ PebbleRpc* PebbleServer::GetPebbleRpc(ProcessorType processor_type) {
         return dynamic_cast<PebbleRpc*>(m_processor_array[processor_type]);
     }
 
-    if (!m_rpc_event_handler) {
-        m_rpc_event_handler = new RpcEventHandler();
-        static_cast<RpcEventHandler*>(m_rpc_event_handler)->Init(m_stat_manager);
-    }
-
     CodeType rpc_code_type = kCODE_BUTT;
     switch (processor_type) {
         case kPEBBLE_RPC_BINARY:
@@ -451,14 +621,28 @@ PebbleRpc* PebbleServer::GetPebbleRpc(ProcessorType processor_type) {
             rpc_code_type = kCODE_PB;
             break;
 
+        case kPEBBLE_RPC_COMPACT:
+            rpc_code_type = kCODE_COMPACT;
+            break;
+
         default:
             PLOG_FATAL("unsupport processor type %d", processor_type);
             return NULL;
     }
 
     PebbleRpc* rpc_instance = new PebbleRpc(rpc_code_type, m_coroutine_schedule);
+
+    // 不同Processor的服务时延不同，请求时延只作为本Processor并发限制的样本
+    RpcEventHandler* event_handler = new RpcEventHandler();
+    event_handler->Init(m_stat_manager);
+    if (m_concurrency_limit_monitor) {
+        event_handler->SetConcurrencyLimiter(m_concurrency_limit_monitor->GetLimiter(rpc_instance));
+    }
+    m_rpc_event_handlers[processor_type] = event_handler;
+
     rpc_instance->SetSendFunction(Message::Send, Message::SendV);
-    rpc_instance->SetEventHandler(m_rpc_event_handler);
+    rpc_instance->SetEventHandler(event_handler);
+    rpc_instance->SetMaxRequestNumPerLoop(m_options._max_request_num_per_loop);
     m_processor_array[processor_type] = rpc_instance;
 
     return rpc_instance;
@@ -520,7 +704,8 @@ int32_t PebbleServer::Stop() {
 int32_t PebbleServer::Update() {
     int32_t num = 0;
 
-    int64_t old = TimeUtility::GetCurrentMS();
+    // 每轮只读一次时钟，本轮内的定时器、超时及耗时计算都使用此缓存时间
+    int64_t old = TimeUtility::UpdateMonotonicTime();
 
     for (uint32_t i = 0; i < m_options._max_msg_num_per_loop; ++i) {
         if (ProcessMessage() <= 0) {
@@ -535,6 +720,12 @@ int32_t PebbleServer::Update() {
         }
     }
 
+    // 协程hook的fd事件由网络事件的epoll通知，co_poll的超时按时间检查
+    if (m_co_has_event || m_co_epoll_fd < 0 || 0 == co_get_next_timeout(co_get_epoll_ct(), 0)) {
+        m_co_has_event = false;
+        num += co_update(0);
+    }
+
     cxx::unordered_map<int64_t, IProcessor*>::iterator it = m_processor_map.begin();
     for (; it != m_processor_map.end(); ++it) {
         num += it->second->Update();
@@ -558,7 +749,7 @@ int32_t PebbleServer::Update() {
 
     if (m_stat_manager) {
         num += m_stat_manager->Update();
-        m_stat_manager->GetStat()->AddResourceItem("_loop", TimeUtility::GetCurrentMS() - old);
+        m_stat_manager->GetStat()->AddResourceItem("_loop", TimeUtility::UpdateMonotonicTime() - old);
     }
 
     return num;
@@ -584,6 +775,8 @@ int32_t PebbleServer::Reload() {
     // log
     InitLog();
 
+    TimeUtility::SetPreciseMonotonic(m_options._app_precise_clock);
+
     // stat
     m_stat_manager->SetReportCycle(m_options._stat_report_cycle_s);
     m_stat_manager->SetGdataParameter(m_options._stat_report_to_gdata,
@@ -592,6 +785,15 @@ int32_t PebbleServer::Reload() {
     // flow control
     m_task_monitor->SetTaskThreshold(m_options._task_threshold);
     m_message_expire_monitor->SetExpireThreshold(m_options._message_expire_ms);
+    m_concurrency_limit_monitor->SetLimitRange(
+        ConcurrencyLimiter::DEFAULT_MIN_LIMIT, m_options._task_threshold);
+    m_concurrency_limit_monitor->SetEnable(m_options._adaptive_task_limit);
+    for (int32_t i = 0; i < kPROCESSOR_TYPE_BUTT; ++i) {
+        if (m_rpc_event_handlers[i]) {
+            static_cast<PebbleRpc*>(m_processor_array[i])->SetMaxRequestNumPerLoop(
+                m_options._max_request_num_per_loop);
+        }
+    }
 
     return 0;
 }
@@ -605,9 +807,71 @@ void PebbleServer::Idle() {
         return;
     }
 
-    Log::Flush();
+    if (0 == m_reactor_index) {
+        Log::Flush();
+    }
+
+    // 在网络事件(含协程hook的fd)上阻塞等待，最长等到最近的定时器到期，消息到达时立即唤醒，不再固定sleep
+    int64_t wait_us = m_options._idle_us;
+    int64_t next_ms = GetNextTimeout();
+    if (next_ms >= 0 && next_ms * 1000 < wait_us) {
+        wait_us = next_ms * 1000;
+    }
+    if (wait_us <= 0) {
+        return;
+    }
+    if (wait_us < 1000) {
+        // epoll的超时精度为ms，更短的等待仍使用usleep
+        usleep(wait_us);
+        return;
+    }
+
+    int64_t handle = -1;
+    int32_t event  = 0;
+    if (Message::Poll(&handle, &event, static_cast<int32_t>(wait_us / 1000)) == 0) {
+        m_has_ready_handle = true;
+        m_ready_handle     = handle;
+    }
+}
+
+int64_t PebbleServer::GetNextTimeout() {
+    int64_t next = m_timer ? m_timer->GetNextTimeout() : -1;
+    int64_t timeout = m_session_mgr ? m_session_mgr->GetNextTimeout() : -1;
+    if (timeout >= 0 && (next < 0 || timeout < next)) {
+        next = timeout;
+    }
+
+    timeout = m_stat_manager ? m_stat_manager->GetNextTimeout() : -1;
+    if (timeout >= 0 && (next < 0 || timeout < next)) {
+        next = timeout;
+    }
+
+    // co_poll的超时只需检查到等待上限以内
+    timeout = co_get_next_timeout(co_get_epoll_ct(), m_options._idle_us / 1000);
+    if (timeout >= 0 && (next < 0 || timeout < next)) {
+        next = timeout;
+    }
+
+    for (int32_t i = 0; i < kNAMING_BUTT; ++i) {
+        timeout = m_naming_array[i] ? m_naming_array[i]->GetNextTimeout() : -1;
+        if (timeout >= 0 && (next < 0 || timeout < next)) {
+            next = timeout;
+        }
+    }
+
+    cxx::unordered_map<int64_t, IProcessor*>::iterator it = m_processor_map.begin();
+    for (; it != m_processor_map.end(); ++it) {
+        timeout = it->second->GetNextTimeout();
+        if (timeout >= 0 && (next < 0 || timeout < next)) {
+            next = timeout;
+        }
+    }
+
+    return next;
+}
 
-    usleep(m_options._idle_us);
+void PebbleServer::OnCoroutineEvent() {
+    m_co_has_event = true;
 }
 
 const char* PebbleServer::GetVersion() {
@@ -622,7 +886,13 @@ const char* PebbleServer::GetVersion() {
 int32_t PebbleServer::ProcessMessage() {
     int64_t handle = -1;
     int32_t event  = 0;
-    int32_t ret = Message::Poll(&handle, &event, 0);
+    int32_t ret    = 0;
+    if (m_has_ready_handle) {
+        m_has_ready_handle = false;
+        handle = m_ready_handle;
+    } else {
+        ret = Message::Poll(&handle, &event, 0);
+    }
     if (ret != 0) {
         return 0;
     }
@@ -651,8 +921,10 @@ int32_t PebbleServer::ProcessMessage() {
         if (m_options._enable_flow_control) {
             m_message_expire_monitor->OnMessage(msg_info._msg_arrived_ms);
             m_task_monitor->SetTaskNum(m_coroutine_schedule->Size()); // 内部实现暂使用协程数
+            m_concurrency_limit_monitor->SetInflight(it->second, it->second->GetUnFinishedTaskNum());
             m_is_overload = m_monitor_centor->IsOverLoad();
         }
+        it->second->SetMessageArrivedTime(msg_info._msg_arrived_ms);
         it->second->OnMessage(msg_info._remote_handle, msg, msg_len, m_is_overload);
         Message::Pop(handle);
     } while (0);
@@ -676,7 +948,8 @@ int32_t PebbleServer::InitCoSchedule() {
     }
 
     m_coroutine_schedule = new CoroutineSchedule();
-    int32_t ret = m_coroutine_schedule->Init(GetTimer(), m_options._co_stack_size_bytes);
+    int32_t ret = m_coroutine_schedule->Init(GetTimer(), m_options._co_stack_size_bytes,
+        m_options._co_share_stack_num);
     if (ret != 0) {
         delete m_coroutine_schedule;
         m_coroutine_schedule = NULL;
@@ -684,6 +957,16 @@ int32_t PebbleServer::InitCoSchedule() {
         return -1;
     }
 
+    // 协程hook的epoll fd加入网络事件的epoll，Idle阻塞等待时hook的fd就绪也能唤醒
+    int32_t fd = co_get_epoll_fd(co_get_epoll_ct());
+    ret = m_raw_driver->AddEventFd(fd, cxx::bind(&PebbleServer::OnCoroutineEvent, this));
+    if (ret != 0) {
+        // 不影响使用，每轮Update都检查一次hook的事件
+        PLOG_ERROR("add coroutine epoll fd %d failed(%d:%s)", fd, ret, m_raw_driver->GetLastError());
+    } else {
+        m_co_epoll_fd = fd;
+    }
+
     return 0;
 }
 
@@ -692,6 +975,12 @@ int32_t PebbleServer::InitStat() {
         m_stat_manager = new StatManager();
     }
 
+    // 非主reactor只在本线程记录，由OnStatTimeout定时转交主reactor汇总输出
+    if (m_reactor_index > 0) {
+        m_stat_manager->SetGdataParameter(kNO_REPORT, 0, 0);
+        return 0;
+    }
+
     m_stat_manager->SetReportCycle(m_options._stat_report_cycle_s);
     m_stat_manager->SetGdataParameter(m_options._stat_report_to_gdata,
         m_options._gdata_id, m_options._gdata_log_id);
@@ -707,21 +996,36 @@ void PebbleServer::InitMonitor() {
     if (!m_message_expire_monitor) {
         m_message_expire_monitor = new MessageExpireMonitor();
     }
+    if (!m_concurrency_limit_monitor) {
+        m_concurrency_limit_monitor = new ConcurrencyLimitMonitor();
+    }
     if (!m_monitor_centor) {
         m_monitor_centor = new MonitorCenter();
     }
 
     m_task_monitor->SetTaskThreshold(m_options._task_threshold);
     m_message_expire_monitor->SetExpireThreshold(m_options._message_expire_ms);
+    // 自适应限制以task_threshold为上限，关闭时只采样不拒绝，reload打开时已有合适的限制
+    m_concurrency_limit_monitor->SetLimitRange(
+        ConcurrencyLimiter::DEFAULT_MIN_LIMIT, m_options._task_threshold);
+    m_concurrency_limit_monitor->SetEnable(m_options._adaptive_task_limit);
 
     m_monitor_centor->Clear();
     m_monitor_centor->AddMonitor(m_task_monitor);
     m_monitor_centor->AddMonitor(m_message_expire_monitor);
+    m_monitor_centor->AddMonitor(m_concurrency_limit_monitor);
+
+    for (int32_t i = 0; i < kPROCESSOR_TYPE_BUTT; ++i) {
+        if (m_rpc_event_handlers[i]) {
+            static_cast<RpcEventHandler*>(m_rpc_event_handlers[i])->SetConcurrencyLimiter(
+                m_concurrency_limit_monitor->GetLimiter(m_processor_array[i]));
+        }
+    }
 }
 
 int32_t PebbleServer::InitTimer() {
     if (!m_timer) {
-        m_timer = new SequenceTimer();
+        m_timer = new TimingWheelTimer();
     }
 
     TimeoutCallback on_stat_timeout = cxx::bind(&PebbleServer::OnStatTimeout, this);
@@ -761,9 +1065,16 @@ int32_t PebbleServer::LoadOptionsFromIni(const std::string& file_name) {
     m_options._app_unit_id = ini_reader->GetInt32(kSectionApp, kAppUnitId, m_options._app_unit_id);
     m_options._app_program_id = ini_reader->GetInt32(kSectionApp, kAppProgramId, m_options._app_program_id);
     m_options._app_ctrl_cmd_addr = ini_reader->Get(kSectionApp, kAppCtrlCmdAddr, m_options._app_ctrl_cmd_addr);
+    m_options._app_reactor_num = ini_reader->GetUInt32(kSectionApp, kAppReactorNum, m_options._app_reactor_num);
+    m_options._app_precise_clock = ini_reader->GetBoolean(kSectionApp, kAppPreciseClock, m_options._app_precise_clock);
+
+    // net
+    m_options._net_enable_uring = ini_reader->GetBoolean(kSectionNet, kNetEnableUring, m_options._net_enable_uring);
+    m_options._net_udp_batch_num = ini_reader->GetUInt32(kSectionNet, kNetUdpBatchNum, m_options._net_udp_batch_num);
 
     // coroutine
     m_options._co_stack_size_bytes = ini_reader->GetUInt32(kSectionCoroutine, kCoStackSize, m_options._co_stack_size_bytes);
+    m_options._co_share_stack_num = ini_reader->GetUInt32(kSectionCoroutine, kCoShareStackNum, m_options._co_share_stack_num);
 
     // log
     m_options._log_device = ini_reader->Get(kSectionLog, kLogDevice, m_options._log_device);
@@ -782,7 +1093,9 @@ int32_t PebbleServer::LoadOptionsFromIni(const std::string& file_name) {
     // flow control
     m_options._enable_flow_control = ini_reader->GetBoolean(kSectionFlowControl, kEnableFlowControl, m_options._enable_flow_control);
     m_options._max_msg_num_per_loop = ini_reader->GetUInt32(kSectionFlowControl, kMaxMsgNumPerLoop, m_options._max_msg_num_per_loop);
+    m_options._max_request_num_per_loop = ini_reader->GetUInt32(kSectionFlowControl, kMaxRequestNumPerLoop, m_options._max_request_num_per_loop);
     m_options._task_threshold = ini_reader->GetUInt32(kSectionFlowControl, kTaskThreshold, m_options._task_threshold);
+    m_options._adaptive_task_limit = ini_reader->GetBoolean(kSectionFlowControl, kAdaptiveTaskLimit, m_options._adaptive_task_limit);
     m_options._message_expire_ms = ini_reader->GetUInt32(kSectionFlowControl, kMessageExpireMs, m_options._message_expire_ms);
     m_options._idle_us = ini_reader->GetUInt32(kSectionFlowControl, kIdleUs, m_options._idle_us);
 
@@ -796,6 +1109,16 @@ int32_t PebbleServer::LoadOptionsFromIni(const std::string& file_name) {
 
 int32_t PebbleServer::OnStatTimeout() {
     Stat* stat = m_stat_manager->GetStat();
+
+    // 非主reactor把本周期的统计转交主reactor，资源统计只在主reactor进行
+    if (m_reactor != NULL) {
+        AutoLocker locker(&m_reactor->_mutex);
+        m_reactor->_stat->Merge(stat);
+        stat->Clear();
+        return m_stat_timer_ms;
+    }
+
+    CollectReactorStat(stat);
     StatCpu(stat);
     StatMemory(stat);
     StatCoroutine(stat);
@@ -15,8 +15,11 @@
 #ifndef  _PEBBLE_EXTENSION_PEBBLE_SERVER_H_
 #define  _PEBBLE_EXTENSION_PEBBLE_SERVER_H_
 
+#include <pthread.h>
 #include <vector>
 
+#include "common/condition_variable.h"
+#include "common/mutex.h"
 #include "common/platform.h"
 #include "framework/options.h"
 #include "framework/pebble_rpc.h"
@@ -41,11 +44,13 @@ class Naming;
 class NamingFactory;
 class PebbleControlHandler;
 class PebbleServer;
+class RawMessageDriver;
 class RouterFactory;
 class SessionMgr;
 class Stat;
 class StatManager;
 class TaskMonitor;
+class ConcurrencyLimitMonitor;
 class Timer;
 
 
@@ -78,8 +83,8 @@ public:
     virtual int32_t OnReload() { return 0; }
 
     /// @brief Idle事件回调处理
-    /// @return <=0 Pebble sleep 10ms
-    /// @return >0 不sleep
+    /// @return <=0 Pebble阻塞等待，直到有消息到达、最近的定时器到期或等待idle_us
+    /// @return >0 不等待
     virtual int32_t OnIdle() { return 0; }
 };
 
@@ -103,6 +108,7 @@ typedef enum {
     kPEBBLE_RPC_BINARY = 0, // thrift binary编码的pebble rpc实例
     kPEBBLE_RPC_JSON,       // thrift json编码的pebble rpc实例
     kPEBBLE_RPC_PROTOBUF,   // protobuf编码的pebble rpc实例
+    kPEBBLE_RPC_COMPACT,    // thrift compact编码的pebble rpc实例，整数和字段头变长编码，适合带宽受限的场景
     kPROCESSOR_TYPE_BUTT
 } ProcessorType;
 
@@ -164,8 +170,18 @@ public:
     int64_t Connect(const std::string &url);
 
     /// @brief 启动服务，此调用会阻塞当前线程(循环处理事件，若无事件处理会Idle)
+    /// @note 配置了多个reactor时，其它reactor线程在Init时启动，Serve退出时一起停止
     void Serve();
 
+    /// @brief 返回当前PebbleServer所属reactor的序号，主线程为0
+    /// @note reactor_num大于1时，每个reactor线程都有独立的PebbleServer实例，并各自回调一次OnInit，
+    ///     OnInit中的Bind使用SO_REUSEPORT监听同一地址，由内核把连接分到各reactor，连接上的请求和
+    ///     应答都在所属reactor内处理；AppEventHandler的OnInit/OnUpdate/OnIdle会在多个线程中调用，
+    ///     OnStop/OnReload只在主reactor调用；uring://、inproc://、shm://只在主reactor可用
+    uint32_t GetReactorIndex() const {
+        return m_reactor_index;
+    }
+
     /// @brief 返回Pebble预定义的Processor
     /// @param processor_type @see ProcesserType
     /// @return 非NULL 成功
@@ -314,6 +330,12 @@ public:
 private:
     int32_t ProcessMessage();
 
+    /// @brief 距离最近一个定时器(含RPC、会话、co_poll和naming超时)到期的毫秒数，<0表示没有定时器
+    int64_t GetNextTimeout();
+
+    /// @brief 协程hook的epoll有事件，下一轮Update时co_update
+    void OnCoroutineEvent();
+
     void InitLog();
 
     int32_t InitCoSchedule();
@@ -344,16 +366,41 @@ private:
 
     void OnControlLog(const std::vector<std::string>& options, int32_t* ret_code, std::string* data);
 
+    /// @brief 启动主reactor以外的reactor线程，逐个等待初始化完成
+    int32_t StartReactors();
+
+    /// @brief 通知所有reactor线程退出并等待结束
+    void StopReactors();
+
+    /// @brief 取走各reactor转交的统计数据，汇总到主reactor的统计中输出
+    void CollectReactorStat(Stat* stat);
+
+    static void* ReactorRoutine(void* arg);
+
 private:
+    /// @brief 非主reactor线程的上下文，PebbleServer实例在reactor线程内创建和释放
+    struct Reactor {
+        pthread_t         _thread;
+        uint32_t          _index;
+        Options           _options;
+        AppEventHandler*  _event_handler;
+        volatile int32_t  _state;    // 0 初始化中，1 运行中，<0 初始化失败
+        volatile bool     _stop;
+        Mutex             _mutex;    // 保护_state和_stat
+        ConditionVariable _state_cond;
+        Stat*             _stat;     // 本reactor待汇总的统计数据，由主reactor定时取走
+    };
+
     Options            m_options;
     CoroutineSchedule* m_coroutine_schedule;
     INIReader*         m_ini_reader;
     MonitorCenter*     m_monitor_centor;
     TaskMonitor*       m_task_monitor;
     MessageExpireMonitor* m_message_expire_monitor;
+    ConcurrencyLimitMonitor* m_concurrency_limit_monitor;
     Naming*            m_naming_array[kNAMING_BUTT];
     IProcessor*        m_processor_array[kPROCESSOR_TYPE_BUTT];
-    IEventHandler*     m_rpc_event_handler;
+    IEventHandler*     m_rpc_event_handlers[kPROCESSOR_TYPE_BUTT]; // 每个RPC Processor独立，时延样本按Processor区分
     IEventHandler*     m_broadcast_event_handler;
     StatManager*       m_stat_manager;
     Timer*             m_timer;
@@ -370,6 +417,14 @@ private:
     cxx::unordered_map<std::string, Router*> m_router_map;
     std::string m_ini_file_name;
     uint32_t    m_is_overload;
+    uint32_t    m_reactor_index;
+    std::vector<Reactor*> m_reactors;
+    Reactor*    m_reactor;  // 非主reactor所属的上下文，主reactor为NULL
+    bool        m_has_ready_handle;  // Idle阻塞等待时收到了消息，下一轮直接处理
+    int64_t     m_ready_handle;
+    RawMessageDriver* m_raw_driver;  // 本reactor的RAW驱动，Idle最终阻塞在它的epoll上
+    int32_t     m_co_epoll_fd;       // 加入m_raw_driver的协程hook epoll fd，<0表示未加入，每轮都co_update
+    bool        m_co_has_event;
     static std::string m_version;
 };
 
@@ -32,6 +32,7 @@
  */
 
 #include <cassert>
+#include <cstdio>
 
 #include <fstream>
 #include <iostream>
@@ -52,6 +53,20 @@ using std::vector;
 
 static const string endl = "\n";  // avoid ostream << std::endl flushes
 
+/**
+ * RPC method id, must be the same as pebble::Rpc::GetFunctionId (FNV-1a 32)
+ */
+static string function_id(const string& name) {
+  uint32_t id = 2166136261u;
+  for (string::const_iterator it = name.begin(); it != name.end(); ++it) {
+    id ^= static_cast<uint8_t>(*it);
+    id *= 16777619u;
+  }
+  char buff[16];
+  snprintf(buff, sizeof(buff), "0x%08xu", id != 0 ? id : 1);
+  return buff;
+}
+
 /**
  * C++ code generator. This is legitimacy incarnate.
  *
@@ -121,6 +136,11 @@ class t_cpp_generator : public t_oop_generator {
   void generate_struct_reader        (std::ofstream& out, t_struct* tstruct, bool pointers=false);
   void generate_struct_writer        (std::ofstream& out, t_struct* tstruct, bool pointers=false);
   void generate_struct_result_writer (std::ofstream& out, t_struct* tstruct, bool pointers=false);
+  void generate_struct_reader_body   (std::ofstream& out, t_struct* tstruct, bool pointers, bool direct);
+  void generate_struct_writer_body   (std::ofstream& out, t_struct* tstruct, bool pointers, std::string direct_type);
+  void generate_struct_result_writer_body(std::ofstream& out, t_struct* tstruct, bool pointers, std::string direct_type);
+  void generate_struct_writer_signature(std::ofstream& out, t_struct* tstruct, std::string direct_type);
+  void generate_struct_serialized_size(std::ofstream& out, t_struct* tstruct);
   void generate_struct_swap          (std::ofstream& out, t_struct* tstruct);
   void generate_struct_ostream_operator(std::ofstream& out, t_struct* tstruct);
   void generate_struct_reflection_info(std::ofstream& out, t_struct* tstruct);
@@ -261,6 +281,15 @@ class t_cpp_generator : public t_oop_generator {
       (ttype->is_base_type() && (((t_base_type*)ttype)->get_base() == t_base_type::TYPE_STRING));
   }
 
+  bool is_string_view(t_type* ttype) {
+    ttype = get_true_type(ttype);
+    return ttype->is_base_type() &&
+      ((t_base_type*)ttype)->get_base() == t_base_type::TYPE_STRING &&
+      ttype->annotations_.find("cpp.view") != ttype->annotations_.end();
+  }
+
+  bool has_string_view(t_type* ttype, std::set<t_type*>& visited);
+
   void set_use_include_prefix(bool use_include_prefix) {
     use_include_prefix_ = use_include_prefix;
   }
@@ -389,6 +418,7 @@ void t_cpp_generator::init_generator() {
   f_types_h_ <<
       "#include \"framework/dr/common/common.h\"" << endl <<
       "#include \"framework/dr/common/field_pack.h\"" << endl <<
+      "#include \"framework/dr/protocol/serialized_size.h\"" << endl <<
       "#include \"framework/dr/common/fp_util.h\"" << endl <<
       "#include \"framework/dr/common/reflection.h\"" <<
       endl;
@@ -1062,6 +1092,27 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
         indent() << "uint32_t write(" <<
         "::pebble::dr::protocol::TProtocol* oprot) const;" << endl;
   }
+  if (!gen_templates_ && (read || write)) {
+    out <<
+        indent() << "// binary协议直接编解码，不经过虚函数，TProtocol为binary且传输层为TMemoryBuffer时自动使用" << endl;
+  }
+  if (!gen_templates_ && read) {
+      out <<
+        indent() << "uint32_t read(" <<
+        "::pebble::dr::protocol::TBinaryReader* iprot);" << endl;
+  }
+  if (!gen_templates_ && write) {
+      out <<
+        indent() << "uint32_t write(" <<
+        "::pebble::dr::protocol::TBinarySizer* oprot) const;" << endl <<
+        indent() << "uint32_t write(" <<
+        "::pebble::dr::protocol::TBinaryWriter* oprot) const;" << endl <<
+        indent() << "uint32_t write(" <<
+        "::pebble::dr::protocol::TCompactSizer* oprot) const;" << endl << endl <<
+        indent() << "// 按oprot的协议编码后的准确长度，用于编码前一次分配好缓冲区，协议不支持预先计算时返回0" << endl <<
+        indent() << "uint32_t SerializedSize(" <<
+        "::pebble::dr::protocol::TProtocol* oprot) const;" << endl;
+  }
   out << endl;
 
   if (read) {
@@ -1360,7 +1411,7 @@ void t_cpp_generator::generate_struct_reader(ofstream& out,
   indent_up();
 
   indent(out) << "return pebble::dr::UnPack<"<< tstruct->get_name() <<
-    ", pebble::dr::protocol::TBinaryProtocol>(this, reinterpret_cast<uint8_t*>(buff), static_cast<uint32_t>(buff_len));" <<
+    ", pebble::dr::protocol::TBinaryProtocol>(this, reinterpret_cast<uint8_t*>(buff), static_cast<uint32_t>(buff_len), NULL);" <<
     endl;
 
   indent_down();
@@ -1380,11 +1431,35 @@ void t_cpp_generator::generate_struct_reader(ofstream& out,
   indent(out) <<
     "}" << endl << endl;
 
+  generate_struct_reader_body(out, tstruct, pointers, false);
+  if (!gen_templates_) {
+    generate_struct_reader_body(out, tstruct, pointers, true);
+  }
+}
+
+/**
+ * Generates the read(protocol) function. The generic version takes a
+ * TProtocol and hands binary/TMemoryBuffer input over to the direct version,
+ * which has the same body but reads through the non-virtual TBinaryReader.
+ * Nested structs resolve to the matching overload by argument type.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ * @param direct Generate the TBinaryReader overload
+ */
+void t_cpp_generator::generate_struct_reader_body(ofstream& out,
+                                                  t_struct* tstruct,
+                                                  bool pointers,
+                                                  bool direct) {
   if (gen_templates_) {
     out <<
       indent() << "template <class Protocol_>" << endl <<
       indent() << "uint32_t " << tstruct->get_name() <<
       "::read(Protocol_* iprot) {" << endl;
+  } else if (direct) {
+    indent(out) <<
+      "uint32_t " << tstruct->get_name() <<
+      "::read(::pebble::dr::protocol::TBinaryReader* iprot) {" << endl;
   } else {
     indent(out) <<
       "uint32_t " << tstruct->get_name() <<
@@ -1392,6 +1467,15 @@ void t_cpp_generator::generate_struct_reader(ofstream& out,
   }
   indent_up();
 
+  if (!gen_templates_ && !direct) {
+    out <<
+      indent() << "::pebble::dr::transport::TMemoryBuffer* direct_buff =" << endl <<
+      indent(2) << "::pebble::dr::protocol::TBinaryDirect::GetBuffer(iprot);" << endl <<
+      indent() << "if (direct_buff != NULL) {" << endl <<
+      indent(1) << "return ::pebble::dr::protocol::TBinaryDirect::Read(*this, iprot, direct_buff);" << endl <<
+      indent() << "}" << endl;
+  }
+
   const vector<t_field*>& fields = tstruct->get_members();
   vector<t_field*>::const_iterator f_iter;
 
@@ -1539,17 +1623,13 @@ void t_cpp_generator::generate_struct_reader(ofstream& out,
 void t_cpp_generator::generate_struct_writer(ofstream& out,
                                              t_struct* tstruct,
                                              bool pointers) {
-  string name = tstruct->get_name();
-  const vector<t_field*>& fields = tstruct->get_sorted_members();
-  vector<t_field*>::const_iterator f_iter;
-
   indent(out) <<
     "int " << tstruct->get_name() <<
     "::write(char *buff, size_t buff_len) const {" << endl;
   indent_up();
 
   indent(out) << "return pebble::dr::Pack<"<< tstruct->get_name() <<
-    ", pebble::dr::protocol::TBinaryProtocol>(this, reinterpret_cast<uint8_t*>(buff), static_cast<uint32_t>(buff_len));" <<
+    ", pebble::dr::protocol::TBinaryProtocol>(this, reinterpret_cast<uint8_t*>(buff), static_cast<uint32_t>(buff_len), NULL);" <<
     endl;
 
   indent_down();
@@ -1586,16 +1666,35 @@ void t_cpp_generator::generate_struct_writer(ofstream& out,
     "}" << endl << endl;
 
 
-  if (gen_templates_) {
-    out <<
-      indent() << "template <class Protocol_>" << endl <<
-      indent() << "uint32_t " << tstruct->get_name() <<
-      "::write(Protocol_* oprot) const {" << endl;
-  } else {
-    indent(out) <<
-      "uint32_t " << tstruct->get_name() <<
-      "::write(::pebble::dr::protocol::TProtocol* oprot) const {" << endl;
+  generate_struct_writer_body(out, tstruct, pointers, "");
+  if (!gen_templates_) {
+    generate_struct_writer_body(out, tstruct, pointers, "TBinarySizer");
+    generate_struct_writer_body(out, tstruct, pointers, "TBinaryWriter");
+    generate_struct_writer_body(out, tstruct, pointers, "TCompactSizer");
+    generate_struct_serialized_size(out, tstruct);
   }
+}
+
+/**
+ * Generates the write(protocol) function. With an empty direct_type the
+ * generic TProtocol version is generated, which hands binary/TMemoryBuffer
+ * output over to TBinaryDirect. Otherwise the same body is generated for the
+ * non-virtual TBinarySizer or TBinaryWriter; nested structs resolve to the
+ * matching overload by argument type.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ * @param direct_type "", "TBinarySizer" or "TBinaryWriter"
+ */
+void t_cpp_generator::generate_struct_writer_body(ofstream& out,
+                                                  t_struct* tstruct,
+                                                  bool pointers,
+                                                  string direct_type) {
+  string name = tstruct->get_name();
+  const vector<t_field*>& fields = tstruct->get_sorted_members();
+  vector<t_field*>::const_iterator f_iter;
+
+  generate_struct_writer_signature(out, tstruct, direct_type);
   indent_up();
 
   out <<
@@ -1651,6 +1750,55 @@ void t_cpp_generator::generate_struct_writer(ofstream& out,
     endl;
 }
 
+/**
+ * Opens a write(protocol) function, see generate_struct_writer_body(). The
+ * generic version starts by trying the direct binary path.
+ */
+void t_cpp_generator::generate_struct_writer_signature(ofstream& out,
+                                                       t_struct* tstruct,
+                                                       string direct_type) {
+  if (gen_templates_) {
+    out <<
+      indent() << "template <class Protocol_>" << endl <<
+      indent() << "uint32_t " << tstruct->get_name() <<
+      "::write(Protocol_* oprot) const {" << endl;
+    return;
+  }
+
+  if (!direct_type.empty()) {
+    indent(out) <<
+      "uint32_t " << tstruct->get_name() <<
+      "::write(::pebble::dr::protocol::" << direct_type << "* oprot) const {" << endl;
+    return;
+  }
+
+  indent(out) <<
+    "uint32_t " << tstruct->get_name() <<
+    "::write(::pebble::dr::protocol::TProtocol* oprot) const {" << endl;
+  out <<
+    indent(1) << "::pebble::dr::transport::TMemoryBuffer* direct_buff =" << endl <<
+    indent(3) << "::pebble::dr::protocol::TBinaryDirect::GetBuffer(oprot);" << endl <<
+    indent(1) << "if (direct_buff != NULL) {" << endl <<
+    indent(2) << "return ::pebble::dr::protocol::TBinaryDirect::Write(*this, direct_buff);" << endl <<
+    indent(1) << "}" << endl;
+}
+
+/**
+ * Generates SerializedSize(protocol), which runs the write body through the
+ * sizer of the protocol so callers can size their buffer before encoding.
+ */
+void t_cpp_generator::generate_struct_serialized_size(ofstream& out,
+                                                      t_struct* tstruct) {
+  indent(out) <<
+    "uint32_t " << tstruct->get_name() <<
+    "::SerializedSize(::pebble::dr::protocol::TProtocol* oprot) const {" << endl;
+  indent_up();
+  indent(out) <<
+    "return ::pebble::dr::protocol::TSerializedSize::Get(*this, typeid(*oprot));" << endl;
+  indent_down();
+  indent(out) << "}" << endl << endl;
+}
+
 /**
  * Struct writer for result of a function, which can have only one of its
  * fields set and does a conditional if else look up into the __isset field
@@ -1662,20 +1810,24 @@ void t_cpp_generator::generate_struct_writer(ofstream& out,
 void t_cpp_generator::generate_struct_result_writer(ofstream& out,
                                                     t_struct* tstruct,
                                                     bool pointers) {
+  generate_struct_result_writer_body(out, tstruct, pointers, "");
+  if (!gen_templates_) {
+    generate_struct_result_writer_body(out, tstruct, pointers, "TBinarySizer");
+    generate_struct_result_writer_body(out, tstruct, pointers, "TBinaryWriter");
+    generate_struct_result_writer_body(out, tstruct, pointers, "TCompactSizer");
+    generate_struct_serialized_size(out, tstruct);
+  }
+}
+
+void t_cpp_generator::generate_struct_result_writer_body(ofstream& out,
+                                                         t_struct* tstruct,
+                                                         bool pointers,
+                                                         string direct_type) {
   string name = tstruct->get_name();
   const vector<t_field*>& fields = tstruct->get_sorted_members();
   vector<t_field*>::const_iterator f_iter;
 
-  if (gen_templates_) {
-    out <<
-      indent() << "template <class Protocol_>" << endl <<
-      indent() << "uint32_t " << tstruct->get_name() <<
-      "::write(Protocol_* oprot) const {" << endl;
-  } else {
-    indent(out) <<
-      "uint32_t " << tstruct->get_name() <<
-      "::write(::pebble::dr::protocol::TProtocol* oprot) const {" << endl;
-  }
+  generate_struct_writer_signature(out, tstruct, direct_type);
   indent_up();
 
   out <<
@@ -2824,7 +2976,8 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
 
     out << indent() <<
         "::pebble::RpcHead head;" << endl << indent() <<
-        "head.m_function_name.assign(\"" << service_name_ << ":" << funname << "\");" << endl << indent();
+        "head.m_function_name.assign(\"" << service_name_ << ":" << funname << "\");" << endl << indent() <<
+        "head.m_function_id = " << function_id(service_name_ + ":" + funname) << ";" << endl << indent();
     if (!(*f_iter)->is_oneway()) {
         out << "head.m_message_type = pebble::dr::protocol::T_CALL;" << endl << indent();
     } else {
@@ -2919,7 +3072,8 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
 
       out << indent() <<
           "::pebble::RpcHead head;" << endl << indent() <<
-          "head.m_function_name.assign(\"" << service_name_ << ":" << funname << "\");" << endl << indent();
+          "head.m_function_name.assign(\"" << service_name_ << ":" << funname << "\");" << endl << indent() <<
+          "head.m_function_id = " << function_id(service_name_ + ":" + funname) << ";" << endl << indent();
       if (!(*f_iter)->is_oneway()) {
           out << "head.m_message_type = pebble::dr::protocol::T_CALL;" << endl << indent();
       } else {
@@ -3031,7 +3185,8 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
 
       out << indent() <<
           "::pebble::RpcHead head;" << endl << indent() <<
-          "head.m_function_name.assign(\"" << service_name_ << ":" << funname << "\");" << endl << indent();
+          "head.m_function_name.assign(\"" << service_name_ << ":" << funname << "\");" << endl << indent() <<
+          "head.m_function_id = " << function_id(service_name_ + ":" + funname) << ";" << endl << indent();
       if (!(*f_iter)->is_oneway()) {
           out << "head.m_message_type = pebble::dr::protocol::T_CALL;" << endl << indent();
       } else {
@@ -3516,6 +3671,28 @@ void ProcessorGenerator::generate_register_service_function() {
       indent(1) << "return ret;" << endl <<
       indent() << "}" << endl <<
       endl;
+
+    std::set<t_type*> visited;
+    if (generator_->has_string_view((*f_iter)->get_arglist(), visited)) {
+      f_out_ <<
+        indent() << "ret = m_server->SetFunctionPinRequest(\"" << service_name_ <<
+        ":" << (*f_iter)->get_name() << "\", true);" << endl <<
+        indent() << "if (ret != pebble::kRPC_SUCCESS) {" << endl <<
+        indent(1) << "return ret;" << endl <<
+        indent() << "}" << endl <<
+        endl;
+    }
+
+    std::string priority((*f_iter)->get_priority());
+    if (!priority.empty()) {
+      f_out_ <<
+        indent() << "ret = m_server->SetFunctionPriority(\"" << service_name_ <<
+        ":" << (*f_iter)->get_name() << "\", " << priority << ");" << endl <<
+        indent() << "if (ret != pebble::kRPC_SUCCESS) {" << endl <<
+        indent(1) << "return ret;" << endl <<
+        indent() << "}" << endl <<
+        endl;
+    }
   }
 
   if (!extends_.empty()) {
@@ -3705,9 +3882,20 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
     "resetBuffer(const_cast<uint8_t*>(buff), buff_len, ::pebble::dr::transport::TMemoryBuffer::OBSERVE);" << endl <<
     endl;
 
+  std::set<t_type*> visited;
+  std::string ref_scope;
+  if (has_string_view(arg_struct, visited)) {
+    // cpp.view字段直接引用请求数据，注册服务时已要求框架在处理函数返回前保持请求数据有效
+    ref_scope = "::pebble::dr::StringViewRefScope ref_scope;";
+  }
+
   out <<
     indent() << tservice->get_name() + "_" + tfunction->get_name() << "_args args;" << endl << indent() <<
-      "try {" << endl << indent(1) <<
+      "try {" << endl;
+  if (!ref_scope.empty()) {
+    out << indent(1) << ref_scope << endl;
+  }
+  out << indent(1) <<
       "args.read(decoder);" << endl << indent(1) <<
       "decoder->readMessageEnd();" << endl << indent(1) <<
       "decoder->getTransport()->readEnd();" << endl << indent() <<
@@ -4445,6 +4633,36 @@ string t_cpp_generator::namespace_close(string ns) {
   return result;
 }
 
+/**
+ * Whether a value of this type can hold a cpp.view string, which references
+ * the buffer it was decoded from.
+ */
+bool t_cpp_generator::has_string_view(t_type* ttype, std::set<t_type*>& visited) {
+  ttype = get_true_type(ttype);
+  if (is_string_view(ttype)) {
+    return true;
+  }
+  if (!visited.insert(ttype).second) {
+    return false;
+  }
+  if (ttype->is_struct() || ttype->is_xception()) {
+    const vector<t_field*>& fields = ((t_struct*)ttype)->get_members();
+    for (vector<t_field*>::const_iterator f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
+      if (has_string_view((*f_iter)->get_type(), visited)) {
+        return true;
+      }
+    }
+  } else if (ttype->is_map()) {
+    return has_string_view(((t_map*)ttype)->get_key_type(), visited) ||
+      has_string_view(((t_map*)ttype)->get_val_type(), visited);
+  } else if (ttype->is_list()) {
+    return has_string_view(((t_list*)ttype)->get_elem_type(), visited);
+  } else if (ttype->is_set()) {
+    return has_string_view(((t_set*)ttype)->get_elem_type(), visited);
+  }
+  return false;
+}
+
 /**
  * Returns a C++ type name
  *
@@ -4454,6 +4672,9 @@ string t_cpp_generator::namespace_close(string ns) {
 string t_cpp_generator::type_name(t_type* ttype, bool in_typedef, bool arg) {
   if (ttype->is_base_type()) {
     string bname = base_type_name(((t_base_type*)ttype)->get_base());
+    if (is_string_view(ttype)) {
+      bname = "pebble::dr::StringView";
+    }
     std::map<string, string>::iterator it = ttype->annotations_.find("cpp.type");
     if (it != ttype->annotations_.end()) {
       bname = it->second;
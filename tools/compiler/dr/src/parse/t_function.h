@@ -127,6 +127,25 @@ class t_function : public t_doc {
     return timeoutms;
   }
 
+  // 注解priority = "low" | "normal" | "high"，未设置或无效时返回空串
+  std::string get_priority() {
+    std::map<std::string, std::string>::iterator it = annotations_.find("priority");
+    if (annotations_.end() == it) {
+        return "";
+    }
+    std::string& value = it->second;
+    if (value == "low") {
+        return "pebble::kRPC_PRIORITY_LOW";
+    }
+    if (value == "normal") {
+        return "pebble::kRPC_PRIORITY_NORMAL";
+    }
+    if (value == "high") {
+        return "pebble::kRPC_PRIORITY_HIGH";
+    }
+    return "";
+  }
+
   std::map<std::string, std::string> annotations_;
 
  private:
@@ -1,5 +1,7 @@
 
 #include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <map>
 #include <sstream>
 
@@ -37,6 +39,18 @@ std::string FileNameIdentifier(const std::string& filename) {
     return result;
 }
 
+// 生成方法ID，与RpcHead::GetFunctionId一致(FNV-1a)
+std::string FunctionId(const std::string& name) {
+    uint32_t id = 2166136261u;
+    for (unsigned i = 0; i < name.size(); i++) {
+        id ^= static_cast<uint8_t>(name[i]);
+        id *= 16777619u;
+    }
+    char buff[16];
+    snprintf(buff, sizeof(buff), "0x%08xu", id != 0 ? id : 1);
+    return buff;
+}
+
 // 生成include信息
 void PrintIncludes(Printer* printer, const std::vector<std::string>& headers,
                    const Parameters& params) {
@@ -636,6 +650,7 @@ void PrintSourceClientMethod(Printer* printer, const Method* method,
     (*vars)["Method"] = method->name();
     (*vars)["Request"] = method->input_type_name();
     (*vars)["Response"] = method->output_type_name();
+    (*vars)["FunctionId"] = FunctionId((*vars)["Service"] + ":" + method->name());
 
     if (is_public) {
         // 同步调用
@@ -645,6 +660,7 @@ void PrintSourceClientMethod(Printer* printer, const Method* method,
 
         printer->Print("::pebble::RpcHead __head;\n");
         printer->Print(*vars, "__head.m_function_name.assign(\"$Service$:$Method$\");\n");
+        printer->Print(*vars, "__head.m_function_id = $FunctionId$;\n");
         printer->Print("__head.m_message_type = ::pebble::kRPC_CALL;\n");
         printer->Print("__head.m_session_id = m_imp->m_client->GenSessionId();\n\n");
 
@@ -686,6 +702,7 @@ void PrintSourceClientMethod(Printer* printer, const Method* method,
 
         printer->Print("::pebble::RpcHead __head;\n");
         printer->Print(*vars, "__head.m_function_name.assign(\"$Service$:$Method$\");\n");
+        printer->Print(*vars, "__head.m_function_id = $FunctionId$;\n");
         printer->Print("__head.m_message_type = ::pebble::kRPC_CALL;\n");
         printer->Print("__head.m_session_id = m_imp->m_client->GenSessionId();\n\n");
 
@@ -729,6 +746,7 @@ void PrintSourceClientMethod(Printer* printer, const Method* method,
 
         printer->Print("::pebble::RpcHead __head;\n");
         printer->Print(*vars, "__head.m_function_name.assign(\"$Service$:$Method$\");\n");
+        printer->Print(*vars, "__head.m_function_id = $FunctionId$;\n");
         printer->Print("__head.m_message_type = ::pebble::kRPC_CALL;\n");
         printer->Print("__head.m_session_id = m_imp->m_client->GenSessionId();\n\n");
 